@@ -0,0 +1,276 @@
+#ifndef SAMPLE_MINE_BATCH_SCHEDULER_H
+#define SAMPLE_MINE_BATCH_SCHEDULER_H
+
+//
+// Dynamic batching: single-image requests are queued and coalesced into one
+// backend call once either maxBatchSize requests are waiting or the oldest one
+// has waited maxQueueDelay, whichever comes first. Results are handed back to
+// each request through its own future, or a callback. A request the backend
+// can answer at once (InferenceBackend::answerNow(), e.g. a cache hit) is
+// answered on the submitting thread and never queued. Batches go to the
+// backend through inferAsync(), so a pipelined backend can work on several of
+// them at once. A backend that throws fails the requests of that batch; the
+// dispatcher goes on with the next one.
+//
+
+#include "inferenceBackend.h"
+#include "traceEvents.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace mine
+{
+
+//!
+//! \brief Outcome of one request.
+//!
+struct InferResult
+{
+    bool ok{false};
+    bool rejected{false}; //!< Failed on its own, e.g. its image did not decode, rather than with its batch
+    Prediction prediction;
+};
+
+class BatchScheduler
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Stats
+    {
+        uint64_t requests{0};
+        uint64_t batches{0};
+        uint64_t fullBatches{0};           //!< Dispatched because maxBatchSize requests were waiting
+        uint64_t answeredNow{0};           //!< Answered at submission, not in requests
+        std::vector<uint64_t> batchSizes;  //!< Batches per size, indexed by size
+
+        double meanBatchSize() const
+        {
+            return batches ? static_cast<double>(requests) / batches : 0.0;
+        }
+    };
+
+    //!
+    //! \param maxBatchSize  Largest batch handed to the backend, capped at backend.maxBatchSize().
+    //! \param maxQueueDelay Longest a request waits for others to join its batch.
+    //!
+    BatchScheduler(InferenceBackend& backend, int maxBatchSize, std::chrono::microseconds maxQueueDelay)
+        : mBackend(backend)
+        , mMaxBatchSize(std::max(1, std::min(maxBatchSize, backend.maxBatchSize())))
+        , mMaxQueueDelay(maxQueueDelay)
+    {
+        mStats.batchSizes.assign(mMaxBatchSize + 1, 0);
+        mDispatcher = std::thread([this]() { dispatchLoop(); });
+    }
+
+    //!
+    //! \brief Hands everything still queued to the backend, then stops the dispatcher. Batches the
+    //!        backend runs asynchronously complete on its own threads, possibly after this returns.
+    //!
+    ~BatchScheduler()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStop = true;
+        }
+        mCondition.notify_all();
+        mDispatcher.join();
+    }
+
+    BatchScheduler(const BatchScheduler&) = delete;
+    BatchScheduler& operator=(const BatchScheduler&) = delete;
+
+    int maxBatchSize() const
+    {
+        return mMaxBatchSize;
+    }
+
+    //!
+    //! \brief Queues one image; the future is ready once the batch it joined has run, or right
+    //!        away if the backend answered it on the spot.
+    //!
+    std::future<InferResult> submit(ImageRequest request)
+    {
+        Pending pending;
+        pending.request = std::move(request);
+        std::future<InferResult> result = pending.promise.get_future();
+        enqueue(std::move(pending));
+        return result;
+    }
+
+    //!
+    //! \brief Queues one image; done is called with its result on the thread that finishes the
+    //!        batch, so it must not block. For callers that cannot wait on a future, such as an
+    //!        event loop.
+    //!
+    void submit(ImageRequest request, std::function<void(InferResult&)> done)
+    {
+        Pending pending;
+        pending.request = std::move(request);
+        pending.done = std::move(done);
+        enqueue(std::move(pending));
+    }
+
+    Stats stats() const
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mStats;
+    }
+
+private:
+    struct Pending
+    {
+        ImageRequest request;
+        std::promise<InferResult> promise;       //!< Unused when done is set
+        std::function<void(InferResult&)> done;
+        Clock::time_point enqueued;
+        bool completed{false};
+    };
+
+    //!
+    //! \brief Hands every request of batch its result, each only once, so the requests a backend
+    //!        left unanswered when it threw can be failed afterwards.
+    //!
+    static void complete(std::vector<Pending>& batch, bool ok, std::vector<Prediction>& predictions)
+    {
+        ok = ok && predictions.size() == batch.size();
+        for (size_t i = 0; i < batch.size(); ++i)
+        {
+            Pending& pending = batch[i];
+            if (pending.completed)
+            {
+                continue;
+            }
+            pending.completed = true;
+            InferResult result;
+            result.ok = ok && predictions[i].ok;
+            result.rejected = ok && !predictions[i].ok;
+            if (result.ok)
+            {
+                result.prediction = std::move(predictions[i]);
+            }
+            if (!pending.done)
+            {
+                pending.promise.set_value(std::move(result));
+                continue;
+            }
+            // A callback that throws has had its result; the rest of the batch still gets theirs
+            try
+            {
+                pending.done(result);
+            }
+            catch (...)
+            {
+            }
+        }
+    }
+
+    void enqueue(Pending pending)
+    {
+        // Outside the lock: answering may hash the image, or read its file
+        std::vector<Prediction> answer(1);
+        bool answered = false;
+        try
+        {
+            answered = mBackend.answerNow(pending.request, answer[0]);
+        }
+        catch (...)
+        {
+            // Left to the batch, which fails the request if its image is the problem
+        }
+        if (answered)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+                ++mStats.answeredNow;
+            }
+            std::vector<Pending> single;
+            single.push_back(std::move(pending));
+            complete(single, true, answer);
+            return;
+        }
+        pending.enqueued = Clock::now();
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mQueue.push_back(std::move(pending));
+        }
+        mCondition.notify_one();
+    }
+
+    void dispatchLoop()
+    {
+        traceThreadName("batch scheduler");
+        for (;;)
+        {
+            // Shared with the completion callback, which may run on another thread after the
+            // backend accepted the batch; the requests have to live until then.
+            std::shared_ptr<std::vector<Pending>> batch = std::make_shared<std::vector<Pending>>();
+            {
+                std::unique_lock<std::mutex> lock(mMutex);
+                mCondition.wait(lock, [this]() { return mStop || !mQueue.empty(); });
+                if (mQueue.empty())
+                {
+                    return;
+                }
+                const Clock::time_point deadline = mQueue.front().enqueued + mMaxQueueDelay;
+                mCondition.wait_until(lock, deadline,
+                    [this]() { return mStop || static_cast<int>(mQueue.size()) >= mMaxBatchSize; });
+
+                const int n = std::min(static_cast<int>(mQueue.size()), mMaxBatchSize);
+                for (int i = 0; i < n; ++i)
+                {
+                    batch->push_back(std::move(mQueue.front()));
+                    mQueue.pop_front();
+                }
+                mStats.requests += n;
+                mStats.batches += 1;
+                mStats.fullBatches += n == mMaxBatchSize ? 1 : 0;
+                mStats.batchSizes[n] += 1;
+            }
+
+            // Blocks while a pipelined backend is full, which shows in a trace as a long dispatch
+            const TraceScope trace("dispatch batch");
+            try
+            {
+                std::vector<const ImageRequest*> requests;
+                for (const auto& pending : *batch)
+                {
+                    requests.push_back(&pending.request);
+                }
+                mBackend.inferAsync(requests, [batch](bool ok, std::vector<Prediction>& predictions) {
+                    complete(*batch, ok, predictions);
+                });
+            }
+            catch (...)
+            {
+                // Requests answered before the backend threw keep their results; the rest fail
+                std::vector<Prediction> none;
+                complete(*batch, false, none);
+            }
+        }
+    }
+
+    InferenceBackend& mBackend;
+    const int mMaxBatchSize;
+    const std::chrono::microseconds mMaxQueueDelay;
+
+    mutable std::mutex mMutex;
+    std::condition_variable mCondition;
+    std::deque<Pending> mQueue;
+    bool mStop{false};
+    Stats mStats;
+    std::thread mDispatcher; //!< Last member: started once everything above is initialized
+};
+
+} // namespace mine
+
+#endif // SAMPLE_MINE_BATCH_SCHEDULER_H
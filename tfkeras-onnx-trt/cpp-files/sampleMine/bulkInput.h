@@ -0,0 +1,256 @@
+#ifndef SAMPLE_MINE_BULK_INPUT_H
+#define SAMPLE_MINE_BULK_INPUT_H
+
+//
+// Input side of bulk inference: a stream of images from a directory or a
+// manifest file, read one entry at a time so millions of images never have to
+// be listed in memory, and a checkpoint recording how far the results got.
+//
+// An entry's offset is its index in the stream (0-based, counting only image
+// entries). Resuming skips the first checkpointed offset entries, so the
+// directory or manifest must not change in between; manifests are the safer
+// choice for resumable runs since readdir order is only stable for an
+// unchanged directory.
+//
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+namespace mine
+{
+
+struct ImageEntry
+{
+    std::string name; //!< Written to the results: file name, or the manifest line
+    std::string path; //!< Where to read the image from
+};
+
+class ImageSource
+{
+public:
+    virtual ~ImageSource() = default;
+
+    //!
+    //! \brief Next image, false at the end of the stream.
+    //!
+    virtual bool next(ImageEntry& entry) = 0;
+
+    //!
+    //! \brief Offset of the entry next() returns next, i.e. entries consumed so far.
+    //!
+    uint64_t offset() const
+    {
+        return mOffset;
+    }
+
+    //!
+    //! \brief Skips count entries; false if the stream ends first.
+    //!
+    bool skip(uint64_t count)
+    {
+        ImageEntry entry;
+        for (uint64_t i = 0; i < count; ++i)
+        {
+            if (!next(entry))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+protected:
+    uint64_t mOffset{0};
+};
+
+inline bool hasImageExtension(const std::string& name)
+{
+    const size_t dot = name.rfind('.');
+    if (dot == std::string::npos)
+    {
+        return false;
+    }
+    std::string ext = name.substr(dot + 1);
+    for (char& c : ext)
+    {
+        c = static_cast<char>(c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c);
+    }
+    return ext == "jpg" || ext == "jpeg" || ext == "png" || ext == "bmp";
+}
+
+//!
+//! \brief The .jpg/.jpeg/.png/.bmp files of one directory (not recursive), in readdir order.
+//!
+class DirectorySource : public ImageSource
+{
+public:
+    ~DirectorySource()
+    {
+        if (mDir)
+        {
+            closedir(mDir);
+        }
+    }
+
+    bool open(const std::string& dir)
+    {
+        mDirPath = dir.empty() || dir.back() == '/' ? dir : dir + "/";
+        mDir = opendir(dir.c_str());
+        return mDir != nullptr;
+    }
+
+    bool next(ImageEntry& entry) override
+    {
+        while (struct dirent* e = readdir(mDir))
+        {
+            const std::string name(e->d_name);
+            if (name[0] == '.' || !hasImageExtension(name))
+            {
+                continue;
+            }
+            entry.name = name;
+            entry.path = mDirPath + name;
+            ++mOffset;
+            return true;
+        }
+        return false;
+    }
+
+private:
+    std::string mDirPath;
+    DIR* mDir{nullptr};
+};
+
+//!
+//! \brief One image path per line; blank lines and lines starting with '#' are skipped.
+//!        Relative paths are resolved against the manifest's directory.
+//!
+class ManifestSource : public ImageSource
+{
+public:
+    bool open(const std::string& manifest)
+    {
+        const size_t slash = manifest.rfind('/');
+        mBaseDir = slash == std::string::npos ? "" : manifest.substr(0, slash + 1);
+        mFile.open(manifest);
+        return static_cast<bool>(mFile);
+    }
+
+    bool next(ImageEntry& entry) override
+    {
+        std::string line;
+        while (std::getline(mFile, line))
+        {
+            if (!line.empty() && line.back() == '\r')
+            {
+                line.pop_back();
+            }
+            if (line.empty() || line[0] == '#')
+            {
+                continue;
+            }
+            entry.name = line;
+            entry.path = line[0] == '/' ? line : mBaseDir + line;
+            ++mOffset;
+            return true;
+        }
+        return false;
+    }
+
+private:
+    std::string mBaseDir;
+    std::ifstream mFile;
+};
+
+//!
+//! \brief A fixed list of entries, e.g. the bundled sample images.
+//!
+class VectorSource : public ImageSource
+{
+public:
+    explicit VectorSource(std::vector<ImageEntry> entries)
+        : mEntries(std::move(entries))
+    {
+    }
+
+    bool next(ImageEntry& entry) override
+    {
+        if (mOffset >= mEntries.size())
+        {
+            return false;
+        }
+        entry = mEntries[mOffset++];
+        return true;
+    }
+
+private:
+    std::vector<ImageEntry> mEntries;
+};
+
+//!
+//! \brief A DirectorySource if path is a directory, a ManifestSource otherwise; nullptr if
+//!        it cannot be opened.
+//!
+inline std::unique_ptr<ImageSource> openImageSource(const std::string& path)
+{
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0)
+    {
+        return nullptr;
+    }
+    if (S_ISDIR(st.st_mode))
+    {
+        std::unique_ptr<DirectorySource> dir(new DirectorySource);
+        return dir->open(path) ? std::unique_ptr<ImageSource>(std::move(dir)) : nullptr;
+    }
+    std::unique_ptr<ManifestSource> manifest(new ManifestSource);
+    return manifest->open(path) ? std::unique_ptr<ImageSource>(std::move(manifest)) : nullptr;
+}
+
+//!
+//! \brief How far a bulk run got: the first offset entries have their rows in the first
+//!        outputBytes bytes of the results file.
+//!
+//! Rows past outputBytes may have been written after the last checkpoint; resuming truncates
+//! them so no image is reported twice.
+//!
+struct BulkCheckpoint
+{
+    uint64_t offset{0};
+    uint64_t outputBytes{0};
+};
+
+inline bool readCheckpoint(const std::string& path, BulkCheckpoint& checkpoint)
+{
+    std::ifstream file(path);
+    return static_cast<bool>(file >> checkpoint.offset >> checkpoint.outputBytes);
+}
+
+//!
+//! \brief Writes to a temporary file and renames it over path, so a crash leaves either the
+//!        old or the new checkpoint, never a torn one.
+//!
+inline bool writeCheckpoint(const std::string& path, const BulkCheckpoint& checkpoint)
+{
+    const std::string tmp = path + ".tmp";
+    {
+        std::ofstream file(tmp, std::ios::trunc);
+        file << checkpoint.offset << " " << checkpoint.outputBytes << "\n";
+        if (!file.flush())
+        {
+            return false;
+        }
+    }
+    return std::rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+} // namespace mine
+
+#endif // SAMPLE_MINE_BULK_INPUT_H
@@ -0,0 +1,134 @@
+#ifndef SAMPLE_MINE_CALIBRATION_CACHE_H
+#define SAMPLE_MINE_CALIBRATION_CACHE_H
+
+//
+// INT8 calibration cache on disk. The cache file itself is exactly what
+// TensorRT writes, so trtexec --calib=<file> can use it too; a <file>.key
+// sidecar records how the calibration batches were produced (images,
+// preprocessing, batch count), and a cache whose key differs is not reused,
+// since its scales would describe other inputs.
+//
+// No TensorRT or CUDA here: the calibrator hands this the bytes.
+//
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace mine
+{
+
+class CalibrationCache
+{
+public:
+    CalibrationCache(const std::string& path, const std::string& key)
+        : mPath(path)
+        , mKey(key)
+    {
+    }
+
+    //!
+    //! \brief Reads the cache into data; false, with error() saying why, if there is no cache, it is
+    //!        empty, or it was calibrated under another key.
+    //!
+    bool read(std::vector<char>& data)
+    {
+        data.clear();
+        std::ifstream keyFile(keyPath());
+        std::string key;
+        if (!std::getline(keyFile, key))
+        {
+            mError = "no calibration cache " + mPath;
+            return false;
+        }
+        if (key != mKey)
+        {
+            mError = mPath + " was calibrated on other inputs (" + key + ")";
+            return false;
+        }
+        std::ifstream file(mPath, std::ios::binary);
+        data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        if (data.empty())
+        {
+            mError = "empty calibration cache " + mPath;
+            return false;
+        }
+        return true;
+    }
+
+    //!
+    //! \brief Replaces the cache and its key. The old key goes first, so a crash in between leaves a
+    //!        cache that is not reused rather than one under the wrong key.
+    //!
+    bool write(const void* data, size_t size)
+    {
+        std::remove(keyPath().c_str());
+        if (!writeFile(mPath, data, size) || !writeFile(keyPath(), (mKey + "\n").data(), mKey.size() + 1))
+        {
+            mError = "cannot write calibration cache " + mPath;
+            return false;
+        }
+        return true;
+    }
+
+    const std::string& path() const
+    {
+        return mPath;
+    }
+
+    const std::string& key() const
+    {
+        return mKey;
+    }
+
+    const std::string& error() const
+    {
+        return mError;
+    }
+
+private:
+    std::string keyPath() const
+    {
+        return mPath + ".key";
+    }
+
+    //!
+    //! \brief Through path.tmp and a rename, so readers never see a partial file.
+    //!
+    static bool writeFile(const std::string& path, const void* data, size_t size)
+    {
+        const std::string tmp = path + ".tmp";
+        {
+            std::ofstream file(tmp, std::ios::binary | std::ios::trunc);
+            file.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+            if (!file.flush())
+            {
+                return false;
+            }
+        }
+        return std::rename(tmp.c_str(), path.c_str()) == 0;
+    }
+
+    std::string mPath;
+    std::string mKey;
+    std::string mError;
+};
+
+//!
+//! \brief 64-bit FNV-1a, to fold an image list into a calibration key.
+//!
+inline uint64_t fnv1a(const std::string& text, uint64_t hash = 14695981039346656037ull)
+{
+    for (unsigned char c : text)
+    {
+        hash = (hash ^ c) * 1099511628211ull;
+    }
+    return hash;
+}
+
+} // namespace mine
+
+#endif // SAMPLE_MINE_CALIBRATION_CACHE_H
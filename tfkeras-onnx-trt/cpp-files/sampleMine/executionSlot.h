@@ -0,0 +1,160 @@
+#ifndef SAMPLE_MINE_EXECUTION_SLOT_H
+#define SAMPLE_MINE_EXECUTION_SLOT_H
+
+#include "traceEvents.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+namespace mine
+{
+
+//!
+//! \brief Host buffers for one batch plus whatever runs them on the device.
+//!
+//! Several slots let consecutive batches be preprocessed, executed and post-processed at
+//! the same time, each in its own slot.
+//!
+class ExecutionSlot
+{
+public:
+    //!
+    //! \brief Duration of each device step of one run(), in microseconds.
+    //!
+    struct StepTimes
+    {
+        double h2dUs;
+        double executeUs;
+        double d2hUs;
+    };
+
+    virtual ~ExecutionSlot() = default;
+
+    //! Host input buffer, a whole batch of input tensors of the slot's InputType.
+    virtual void* hostInput() = 0;
+
+    //! Host output buffer, a whole batch of class scores.
+    virtual float* hostOutput() = 0;
+
+    virtual bool copyInputToDevice() = 0;
+
+    virtual bool execute() = 0;
+
+    virtual bool copyOutputToHost() = 0;
+
+    //!
+    //! \brief The three device steps in order.
+    //!
+    bool run()
+    {
+        typedef std::chrono::steady_clock Clock;
+        const Clock::time_point start = Clock::now();
+        if (!copyInputToDevice())
+        {
+            return false;
+        }
+        const Clock::time_point copied = Clock::now();
+        if (!execute())
+        {
+            return false;
+        }
+        const Clock::time_point executed = Clock::now();
+        if (!copyOutputToHost())
+        {
+            return false;
+        }
+        const Clock::time_point done = Clock::now();
+        // As the host sees them: a TensorRT slot only queues the first two, and waits for all
+        // three in copyOutputToHost
+        traceEvent("copyInputToDevice", start, copied);
+        traceEvent("execute", copied, executed);
+        traceEvent("copyOutputToHost", executed, done);
+        mLastSteps.h2dUs = std::chrono::duration<double, std::micro>(copied - start).count();
+        mLastSteps.executeUs = std::chrono::duration<double, std::micro>(executed - copied).count();
+        mLastSteps.d2hUs = std::chrono::duration<double, std::micro>(done - executed).count();
+        return true;
+    }
+
+    //!
+    //! \brief Step times of the last successful run(), as seen from the host. Slots whose steps
+    //!        only queue work override this with the times measured on the device.
+    //!
+    virtual StepTimes lastStepTimes() const
+    {
+        return mLastSteps;
+    }
+
+    //!
+    //! \brief Bytes copyInputToDevice() has moved host to device so far.
+    //!
+    uint64_t bytesToDevice() const
+    {
+        return mBytesToDevice.load(std::memory_order_relaxed);
+    }
+
+protected:
+    void countBytesToDevice(size_t bytes)
+    {
+        mBytesToDevice.fetch_add(bytes, std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<uint64_t> mBytesToDevice{0}; //!< Read by stats while another thread uses the slot
+    StepTimes mLastSteps{0.0, 0.0, 0.0};
+};
+
+//!
+//! \brief Stand-in for an engine execution context: execute() only sleeps, and the output
+//!        scores are all zero (a uniform softmax). No GPU needed.
+//!
+class FakeExecutionSlot : public ExecutionSlot
+{
+public:
+    FakeExecutionSlot(size_t inputBytes, size_t outputCount, std::chrono::microseconds latency)
+        : mInput(inputBytes)
+        , mOutput(outputCount)
+        , mLatency(latency)
+    {
+    }
+
+    void* hostInput() override
+    {
+        return mInput.data();
+    }
+
+    float* hostOutput() override
+    {
+        return mOutput.data();
+    }
+
+    bool copyInputToDevice() override
+    {
+        countBytesToDevice(mInput.size());
+        return true;
+    }
+
+    bool execute() override
+    {
+        std::this_thread::sleep_for(mLatency);
+        return true;
+    }
+
+    bool copyOutputToHost() override
+    {
+        std::memset(mOutput.data(), 0, mOutput.size() * sizeof(float));
+        return true;
+    }
+
+private:
+    std::vector<uint8_t> mInput;
+    std::vector<float> mOutput;
+    std::chrono::microseconds mLatency;
+};
+
+} // namespace mine
+
+#endif // SAMPLE_MINE_EXECUTION_SLOT_H
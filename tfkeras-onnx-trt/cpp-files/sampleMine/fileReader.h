@@ -0,0 +1,616 @@
+#ifndef SAMPLE_MINE_FILE_READER_H
+#define SAMPLE_MINE_FILE_READER_H
+
+//
+// Asynchronous whole-file reads, so image files are already in memory when
+// preprocessing wants to decode them instead of each blocking read stalling a
+// preprocessing worker on a cold page cache or a network filesystem.
+//
+// IoUringReader drives the kernel's io_uring interface directly (no liburing
+// needed): reads are queued in the submission ring and reaped from the
+// completion ring, so one thread keeps many reads in flight. Where io_uring is
+// unavailable (kernel < 5.1, headers too old, or blocked by a container's
+// seccomp profile) PreadReader does the same with blocking pread() calls on a
+// small thread pool. createFileReader() picks whichever works.
+//
+// Files are opened synchronously in submit(); only the data transfer is
+// asynchronous.
+//
+
+#include "bulkInput.h"
+#include "threadPool.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define SAMPLE_MINE_IO_URING 1
+#endif
+#endif
+#endif
+
+namespace mine
+{
+
+//!
+//! \brief A finished read: bytes holds the whole file if ok.
+//!
+struct FileRead
+{
+    uint64_t tag{0};
+    bool ok{false};
+    std::vector<uint8_t> bytes;
+};
+
+class AsyncFileReader
+{
+public:
+    virtual ~AsyncFileReader() = default;
+
+    virtual const char* name() const = 0;
+
+    //!
+    //! \brief Reads that may be outstanding at once; submit() beyond that is not allowed.
+    //!
+    virtual int depth() const = 0;
+
+    //!
+    //! \brief Starts reading the whole of path; wait() reports it under tag.
+    //!
+    virtual void submit(uint64_t tag, const std::string& path) = 0;
+
+    //!
+    //! \brief Blocks until some outstanding read finished. False if none is outstanding.
+    //!
+    virtual bool wait(FileRead& read) = 0;
+};
+
+//!
+//! \brief Opens path and sizes its buffer; -1 if it cannot be opened or is not a regular file.
+//!        Throws std::bad_alloc, with nothing left open, if the buffer cannot grow that large.
+//!
+inline int openForRead(const std::string& path, std::vector<uint8_t>& bytes)
+{
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        close(fd);
+        return -1;
+    }
+    try
+    {
+        bytes.resize(static_cast<size_t>(st.st_size));
+    }
+    catch (...)
+    {
+        close(fd);
+        throw;
+    }
+    return fd;
+}
+
+//!
+//! \brief Blocking whole-file read with pread(), retrying short reads.
+//!
+inline bool preadFile(const std::string& path, std::vector<uint8_t>& bytes)
+{
+    const int fd = openForRead(path, bytes);
+    if (fd < 0)
+    {
+        return false;
+    }
+    size_t done = 0;
+    while (done < bytes.size())
+    {
+        const ssize_t n = pread(fd, bytes.data() + done, bytes.size() - done, static_cast<off_t>(done));
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            break;
+        }
+        done += static_cast<size_t>(n);
+    }
+    close(fd);
+    bytes.resize(done);
+    return !bytes.empty();
+}
+
+//!
+//! \brief Fallback reader: every read is a pread() task on a thread pool of `threads` workers.
+//!
+class PreadReader : public AsyncFileReader
+{
+public:
+    PreadReader(int depth, int threads)
+        : mDepth(depth)
+        , mPool(threads)
+    {
+    }
+
+    const char* name() const override
+    {
+        return "pread";
+    }
+
+    int depth() const override
+    {
+        return mDepth;
+    }
+
+    void submit(uint64_t tag, const std::string& path) override
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            ++mOutstanding;
+        }
+        mPool.enqueue([this, tag, path]() {
+            FileRead read;
+            read.tag = tag;
+            // The completion has to be posted whatever happens, or wait() never returns
+            try
+            {
+                read.ok = preadFile(path, read.bytes);
+            }
+            catch (const std::bad_alloc&)
+            {
+                read.ok = false;
+                read.bytes.clear();
+            }
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+                mDone.push_back(std::move(read));
+            }
+            mCompleted.notify_one();
+        });
+    }
+
+    bool wait(FileRead& read) override
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        if (mOutstanding == 0)
+        {
+            return false;
+        }
+        mCompleted.wait(lock, [this]() { return !mDone.empty(); });
+        read = std::move(mDone.front());
+        mDone.pop_front();
+        --mOutstanding;
+        return true;
+    }
+
+private:
+    const int mDepth;
+    std::mutex mMutex;
+    std::condition_variable mCompleted;
+    std::deque<FileRead> mDone;
+    int mOutstanding{0};
+    ThreadPool mPool; //!< Last member: its destructor finishes queued reads while the rest is alive
+};
+
+#ifdef SAMPLE_MINE_IO_URING
+
+//!
+//! \brief Reader on a private io_uring instance; check valid() after construction.
+//!
+class IoUringReader : public AsyncFileReader
+{
+public:
+    explicit IoUringReader(int depth)
+        : mDepth(depth)
+        , mRequests(depth)
+    {
+        struct io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        mRingFd = static_cast<int>(syscall(__NR_io_uring_setup, static_cast<unsigned>(depth), &params));
+        if (mRingFd < 0)
+        {
+            return;
+        }
+
+        mSqRingBytes = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+        mCqRingBytes = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+        mSqesBytes = params.sq_entries * sizeof(struct io_uring_sqe);
+        mSqRing = mapRing(mSqRingBytes, IORING_OFF_SQ_RING);
+        mCqRing = mapRing(mCqRingBytes, IORING_OFF_CQ_RING);
+        mSqes = static_cast<struct io_uring_sqe*>(mapRing(mSqesBytes, IORING_OFF_SQES));
+        if (!mSqRing || !mCqRing || !mSqes)
+        {
+            release();
+            return;
+        }
+
+        uint8_t* sq = static_cast<uint8_t*>(mSqRing);
+        mSqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        mSqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        mSqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        uint8_t* cq = static_cast<uint8_t*>(mCqRing);
+        mCqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        mCqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        mCqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        mCqes = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+
+        for (int i = depth - 1; i >= 0; --i)
+        {
+            mFreeRequests.push_back(i);
+        }
+    }
+
+    ~IoUringReader()
+    {
+        // Reap what is still in flight so the kernel is done with the buffers
+        FileRead read;
+        while (valid() && wait(read))
+        {
+        }
+        release();
+    }
+
+    IoUringReader(const IoUringReader&) = delete;
+    IoUringReader& operator=(const IoUringReader&) = delete;
+
+    bool valid() const
+    {
+        return mRingFd >= 0;
+    }
+
+    const char* name() const override
+    {
+        return "io_uring";
+    }
+
+    int depth() const override
+    {
+        return mDepth;
+    }
+
+    void submit(uint64_t tag, const std::string& path) override
+    {
+        const int index = mFreeRequests.back();
+        mFreeRequests.pop_back();
+        Request& request = mRequests[index];
+        request.tag = tag;
+        request.done = 0;
+        request.fd = openForRead(path, request.bytes);
+        if (request.fd < 0 || request.bytes.empty() || !queueRead(index))
+        {
+            finish(index, false);
+        }
+    }
+
+    bool wait(FileRead& read) override
+    {
+        while (mReady.empty())
+        {
+            if (mInFlight == 0)
+            {
+                return false;
+            }
+            reap();
+        }
+        read = std::move(mReady.front());
+        mReady.pop_front();
+        return true;
+    }
+
+private:
+    struct Request
+    {
+        uint64_t tag{0};
+        int fd{-1};
+        std::vector<uint8_t> bytes;
+        size_t done{0};
+        struct iovec iov;
+    };
+
+    void* mapRing(size_t bytes, off_t offset)
+    {
+        void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mRingFd, offset);
+        return p == MAP_FAILED ? nullptr : p;
+    }
+
+    void release()
+    {
+        if (mSqes)
+        {
+            munmap(mSqes, mSqesBytes);
+        }
+        if (mCqRing)
+        {
+            munmap(mCqRing, mCqRingBytes);
+        }
+        if (mSqRing)
+        {
+            munmap(mSqRing, mSqRingBytes);
+        }
+        if (mRingFd >= 0)
+        {
+            close(mRingFd);
+        }
+        mSqes = nullptr;
+        mCqRing = nullptr;
+        mSqRing = nullptr;
+        mRingFd = -1;
+    }
+
+    //!
+    //! \brief Queues a READV for the rest of request index and submits it.
+    //!
+    bool queueRead(int index)
+    {
+        Request& request = mRequests[index];
+        request.iov.iov_base = request.bytes.data() + request.done;
+        request.iov.iov_len = request.bytes.size() - request.done;
+
+        const unsigned tail = *mSqTail;
+        const unsigned slot = tail & mSqMask;
+        struct io_uring_sqe* sqe = &mSqes[slot];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_READV;
+        sqe->fd = request.fd;
+        sqe->addr = reinterpret_cast<uint64_t>(&request.iov);
+        sqe->len = 1;
+        sqe->off = request.done;
+        sqe->user_data = static_cast<uint64_t>(index);
+        mSqArray[slot] = slot;
+        __atomic_store_n(mSqTail, tail + 1, __ATOMIC_RELEASE);
+
+        int submitted;
+        do
+        {
+            submitted = static_cast<int>(syscall(__NR_io_uring_enter, mRingFd, 1, 0, 0, nullptr, 0));
+        } while (submitted < 0 && (errno == EINTR || errno == EAGAIN || errno == EBUSY));
+        if (submitted != 1)
+        {
+            // Not consumed by the kernel: take the entry back
+            __atomic_store_n(mSqTail, tail, __ATOMIC_RELEASE);
+            return false;
+        }
+        ++mInFlight;
+        return true;
+    }
+
+    //!
+    //! \brief Waits for at least one completion and handles every one available.
+    //!
+    void reap()
+    {
+        unsigned head = *mCqHead;
+        if (head == __atomic_load_n(mCqTail, __ATOMIC_ACQUIRE))
+        {
+            syscall(__NR_io_uring_enter, mRingFd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+        }
+        for (; head != __atomic_load_n(mCqTail, __ATOMIC_ACQUIRE); ++head)
+        {
+            const struct io_uring_cqe& cqe = mCqes[head & mCqMask];
+            const int index = static_cast<int>(cqe.user_data);
+            const int result = cqe.res;
+            __atomic_store_n(mCqHead, head + 1, __ATOMIC_RELEASE);
+            --mInFlight;
+
+            Request& request = mRequests[index];
+            if (result > 0)
+            {
+                request.done += static_cast<size_t>(result);
+            }
+            if (result > 0 && request.done < request.bytes.size())
+            {
+                // Short read: queue the remainder
+                if (!queueRead(index))
+                {
+                    finish(index, false);
+                }
+            }
+            else
+            {
+                request.bytes.resize(request.done);
+                finish(index, result >= 0 && request.done > 0);
+            }
+        }
+    }
+
+    void finish(int index, bool ok)
+    {
+        Request& request = mRequests[index];
+        if (request.fd >= 0)
+        {
+            close(request.fd);
+            request.fd = -1;
+        }
+        FileRead read;
+        read.tag = request.tag;
+        read.ok = ok;
+        read.bytes.swap(request.bytes);
+        mReady.push_back(std::move(read));
+        mFreeRequests.push_back(index);
+    }
+
+    const int mDepth;
+    int mRingFd{-1};
+    void* mSqRing{nullptr};
+    void* mCqRing{nullptr};
+    struct io_uring_sqe* mSqes{nullptr};
+    size_t mSqRingBytes{0};
+    size_t mCqRingBytes{0};
+    size_t mSqesBytes{0};
+    unsigned* mSqTail{nullptr};
+    unsigned* mSqArray{nullptr};
+    unsigned mSqMask{0};
+    unsigned* mCqHead{nullptr};
+    unsigned* mCqTail{nullptr};
+    unsigned mCqMask{0};
+    struct io_uring_cqe* mCqes{nullptr};
+
+    std::vector<Request> mRequests;
+    std::vector<int> mFreeRequests;
+    std::deque<FileRead> mReady; //!< Finished, not yet returned by wait()
+    int mInFlight{0};            //!< Reads the kernel has not completed yet
+};
+
+#endif // SAMPLE_MINE_IO_URING
+
+enum class FileReaderKind : int
+{
+    kAUTO = 0,     //!< io_uring if it works here, pread otherwise
+    kIO_URING = 1,
+    kPREAD = 2
+};
+
+inline bool parseFileReaderKind(const std::string& name, FileReaderKind& kind)
+{
+    if (name == "auto")
+    {
+        kind = FileReaderKind::kAUTO;
+    }
+    else if (name == "uring" || name == "io_uring")
+    {
+        kind = FileReaderKind::kIO_URING;
+    }
+    else if (name == "pread")
+    {
+        kind = FileReaderKind::kPREAD;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+//!
+//! \brief A reader of the requested kind keeping up to depth reads in flight; nullptr if
+//!        io_uring was explicitly requested but is not available.
+//!
+inline std::unique_ptr<AsyncFileReader> createFileReader(FileReaderKind kind, int depth)
+{
+    depth = std::max(1, depth);
+#ifdef SAMPLE_MINE_IO_URING
+    if (kind != FileReaderKind::kPREAD)
+    {
+        std::unique_ptr<IoUringReader> uring(new IoUringReader(depth));
+        if (uring->valid())
+        {
+            return std::unique_ptr<AsyncFileReader>(std::move(uring));
+        }
+    }
+#endif
+    if (kind == FileReaderKind::kIO_URING)
+    {
+        return nullptr;
+    }
+    // Blocking reads need a thread each to overlap; cap it, past that the device is the limit
+    return std::unique_ptr<AsyncFileReader>(new PreadReader(depth, std::min(depth, 16)));
+}
+
+//!
+//! \brief Reads ahead of an ImageSource: keeps the next depth() files in flight and hands
+//!        entries back in source order, each with its file contents.
+//!
+class Prefetcher
+{
+public:
+    Prefetcher(ImageSource& source, AsyncFileReader& reader)
+        : mSource(source)
+        , mReader(reader)
+    {
+    }
+
+    ~Prefetcher()
+    {
+        FileRead read;
+        while (mReader.wait(read))
+        {
+        }
+    }
+
+    Prefetcher(const Prefetcher&) = delete;
+    Prefetcher& operator=(const Prefetcher&) = delete;
+
+    //!
+    //! \brief Next entry in source order. ok is false if its file could not be read, in which
+    //!        case bytes is empty. Returns false at the end of the source.
+    //!
+    bool next(ImageEntry& entry, std::vector<uint8_t>& bytes, bool& ok)
+    {
+        fill();
+        if (mEntries.empty())
+        {
+            return false;
+        }
+        auto done = mDone.find(mNextOut);
+        while (done == mDone.end())
+        {
+            FileRead read;
+            if (!mReader.wait(read))
+            {
+                return false;
+            }
+            const uint64_t tag = read.tag;
+            mDone.insert(std::make_pair(tag, std::move(read)));
+            done = mDone.find(mNextOut);
+        }
+        entry = std::move(mEntries.front());
+        mEntries.pop_front();
+        ok = done->second.ok;
+        bytes.swap(done->second.bytes);
+        mDone.erase(done);
+        ++mNextOut;
+        fill();
+        return true;
+    }
+
+private:
+    void fill()
+    {
+        ImageEntry entry;
+        while (static_cast<int>(mEntries.size()) < mReader.depth() && !mSourceDone)
+        {
+            if (!mSource.next(entry))
+            {
+                mSourceDone = true;
+                break;
+            }
+            mReader.submit(mNextIn++, entry.path);
+            mEntries.push_back(entry);
+        }
+    }
+
+    ImageSource& mSource;
+    AsyncFileReader& mReader;
+    std::deque<ImageEntry> mEntries;    //!< Submitted, not yet returned, in source order
+    std::map<uint64_t, FileRead> mDone; //!< Finished out of order, keyed by sequence number
+    uint64_t mNextIn{0};
+    uint64_t mNextOut{0};
+    bool mSourceDone{false};
+};
+
+} // namespace mine
+
+#endif // SAMPLE_MINE_FILE_READER_H
@@ -0,0 +1,83 @@
+#ifndef SAMPLE_MINE_HALF_FLOAT_H
+#define SAMPLE_MINE_HALF_FLOAT_H
+
+//
+// IEEE 754 binary16 <-> binary32 conversion in plain C++, for writing and
+// reading fp16 tensors on any CPU.
+//
+
+#include <cstdint>
+#include <cstring>
+
+namespace mine
+{
+
+//!
+//! \brief Rounds f to the nearest half (ties to even). Overflow gives +-inf, NaN stays NaN.
+//!
+inline uint16_t floatToHalf(float f)
+{
+    uint32_t x;
+    std::memcpy(&x, &f, sizeof(x));
+    const uint16_t sign = static_cast<uint16_t>((x >> 16) & 0x8000u);
+    x &= 0x7fffffffu;
+
+    if (x >= 0x7f800000u)
+    {
+        return static_cast<uint16_t>(sign | 0x7c00u | (x > 0x7f800000u ? 0x0200u : 0u));
+    }
+    if (x >= 0x477ff000u) // >= 65520 rounds past the largest half, 65504
+    {
+        return static_cast<uint16_t>(sign | 0x7c00u);
+    }
+    if (x < 0x38800000u) // below 2^-14: a half subnormal, or zero
+    {
+        if (x < 0x33000000u) // at most 2^-25, which rounds to zero
+        {
+            return sign;
+        }
+        const uint32_t shift = 126u - (x >> 23);
+        const uint32_t mantissa = (x & 0x007fffffu) | 0x00800000u;
+        uint32_t h = mantissa >> shift;
+        const uint32_t rest = mantissa & ((1u << shift) - 1u);
+        const uint32_t half = 1u << (shift - 1u);
+        h += (rest > half || (rest == half && (h & 1u))) ? 1u : 0u;
+        return static_cast<uint16_t>(sign | h);
+    }
+    // Rebias the exponent from 127 to 15; a mantissa carry correctly bumps the exponent
+    uint32_t h = (x - 0x38000000u) >> 13;
+    const uint32_t rest = x & 0x1fffu;
+    h += (rest > 0x1000u || (rest == 0x1000u && (h & 1u))) ? 1u : 0u;
+    return static_cast<uint16_t>(sign | h);
+}
+
+//!
+//! \brief Exact: every half is representable as a float.
+//!
+inline float halfToFloat(uint16_t h)
+{
+    const uint32_t sign = static_cast<uint32_t>(h & 0x8000u) << 16;
+    const uint32_t exponent = (h >> 10) & 0x1fu;
+    const uint32_t mantissa = h & 0x03ffu;
+    uint32_t x;
+    if (exponent == 0)
+    {
+        const float f = static_cast<float>(mantissa) * 5.9604644775390625e-8f; // 2^-24
+        return sign ? -f : f;
+    }
+    if (exponent == 31)
+    {
+        x = sign | 0x7f800000u | (mantissa << 13);
+    }
+    else
+    {
+        x = sign | ((exponent + 112u) << 23) | (mantissa << 13);
+    }
+    float f;
+    std::memcpy(&f, &x, sizeof(f));
+    return f;
+}
+
+} // namespace mine
+
+#endif // SAMPLE_MINE_HALF_FLOAT_H
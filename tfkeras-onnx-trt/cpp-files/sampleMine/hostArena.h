@@ -0,0 +1,424 @@
+#ifndef SAMPLE_MINE_HOST_ARENA_H
+#define SAMPLE_MINE_HOST_ARENA_H
+
+//
+// Per-thread bump arenas for the scratch memory of one image: the file it is read
+// from, its decoded pixels (through ArenaMatAllocator) and the resampler's taps and
+// row buffers.
+//
+// An arena hands out memory from slabs mapped once, on huge pages where the system
+// has them (MAP_HUGETLB, else transparent huge pages through MADV_HUGEPAGE), and
+// prefaulted, so neither malloc nor a page fault sits on the path of an image. An
+// ArenaScope gives back everything allocated since it was opened, so slabs are
+// recycled image after image; once the largest image has been seen, nothing is
+// mapped any more. The counters of arenaStats() show it.
+//
+// An arena keeps at most 64 MiB mapped between images: the slabs an oversize image
+// needed beyond that are unmapped once everything is freed, rather than held for
+// the life of the thread. A slab that cannot be mapped throws std::bad_alloc, which
+// fails that image only.
+//
+
+#include "opencv2/core.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace mine
+{
+
+//!
+//! \brief What all arenas of the process did so far.
+//!
+struct ArenaStats
+{
+    uint64_t slabs{0};         //!< Slabs mapped; flat once the arenas are warm
+    uint64_t bytesMapped{0};
+    uint64_t hugeTlbBytes{0};  //!< Part of bytesMapped on explicit huge pages
+    uint64_t allocations{0};   //!< Allocations served from slabs
+    uint64_t slabsUnmapped{0}; //!< Slabs given back after oversize images
+    uint64_t bytesUnmapped{0};
+};
+
+namespace detail
+{
+
+struct ArenaCounters
+{
+    std::atomic<uint64_t> slabs{0};
+    std::atomic<uint64_t> bytesMapped{0};
+    std::atomic<uint64_t> hugeTlbBytes{0};
+    std::atomic<uint64_t> allocations{0};
+    std::atomic<uint64_t> slabsUnmapped{0};
+    std::atomic<uint64_t> bytesUnmapped{0};
+};
+
+inline ArenaCounters& arenaCounters()
+{
+    static ArenaCounters counters;
+    return counters;
+}
+
+} // namespace detail
+
+inline ArenaStats arenaStats()
+{
+    const detail::ArenaCounters& counters = detail::arenaCounters();
+    ArenaStats stats;
+    stats.slabs = counters.slabs.load();
+    stats.bytesMapped = counters.bytesMapped.load();
+    stats.hugeTlbBytes = counters.hugeTlbBytes.load();
+    stats.allocations = counters.allocations.load();
+    stats.slabsUnmapped = counters.slabsUnmapped.load();
+    stats.bytesUnmapped = counters.bytesUnmapped.load();
+    return stats;
+}
+
+//!
+//! \brief Bump allocator over huge-page slabs, used by one thread at a time.
+//!
+class Arena
+{
+public:
+    static const size_t kHugePageBytes = 2 << 20;
+    static const size_t kDefaultSlabBytes = 8 << 20;
+    static const size_t kDefaultRetainBytes = 64 << 20;
+
+    //!
+    //! \brief Where the arena stands; rewinding to it frees everything allocated since.
+    //!
+    struct Mark
+    {
+        size_t slab;
+        size_t offset;
+    };
+
+    //!
+    //! \param slabBytes   Size of each slab, rounded up to whole huge pages. Nothing is mapped
+    //!        until the first allocation.
+    //! \param retainBytes Most bytes kept mapped once everything is freed.
+    //!
+    explicit Arena(size_t slabBytes = kDefaultSlabBytes, size_t retainBytes = kDefaultRetainBytes)
+        : mSlabBytes(roundUp(std::max<size_t>(slabBytes, 1), kHugePageBytes))
+        , mRetainBytes(retainBytes)
+    {
+    }
+
+    ~Arena()
+    {
+        for (const Slab& slab : mSlabs)
+        {
+            munmap(slab.data, slab.size);
+        }
+    }
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    //!
+    //! \brief bytes aligned to align (a power of two), valid until the arena is rewound past
+    //!        this call. Throws std::bad_alloc if no slab can be mapped, like operator new.
+    //!
+    void* allocate(size_t bytes, size_t align = 64)
+    {
+        for (;; ++mSlab, mOffset = 0)
+        {
+            if (mSlab == mSlabs.size())
+            {
+                mapSlab(bytes + align);
+            }
+            const Slab& slab = mSlabs[mSlab];
+            const size_t offset = roundUp(mOffset, align);
+            if (offset + bytes <= slab.size)
+            {
+                mOffset = offset + bytes;
+                mPeak = std::max(mPeak, used());
+                detail::arenaCounters().allocations.fetch_add(1, std::memory_order_relaxed);
+                return slab.data + offset;
+            }
+        }
+    }
+
+    template <typename T>
+    T* allocate(size_t count)
+    {
+        return static_cast<T*>(allocate(count * sizeof(T), std::max<size_t>(alignof(T), 64)));
+    }
+
+    Mark mark() const
+    {
+        return Mark{mSlab, mOffset};
+    }
+
+    //!
+    //! \brief Frees everything allocated since mark; rewound to empty, also unmaps the slabs beyond
+    //!        retainBytes.
+    //!
+    void rewind(const Mark& mark)
+    {
+        mSlab = mark.slab;
+        mOffset = mark.offset;
+        if (mSlab == 0 && mOffset == 0)
+        {
+            trim();
+        }
+    }
+
+    //!
+    //! \brief Bytes of the slabs mapped now.
+    //!
+    size_t mapped() const
+    {
+        return mMappedBytes;
+    }
+
+    //!
+    //! \brief Bytes allocated and not rewound, including alignment and skipped slab tails.
+    //!
+    size_t used() const
+    {
+        size_t bytes = mOffset;
+        for (size_t s = 0; s < mSlab && s < mSlabs.size(); ++s)
+        {
+            bytes += mSlabs[s].size;
+        }
+        return bytes;
+    }
+
+    size_t peak() const
+    {
+        return mPeak;
+    }
+
+private:
+    struct Slab
+    {
+        uint8_t* data;
+        size_t size;
+    };
+
+    static size_t roundUp(size_t value, size_t multiple)
+    {
+        return (value + multiple - 1) / multiple * multiple;
+    }
+
+    void mapSlab(size_t minBytes)
+    {
+        mSlabs.reserve(mSlabs.size() + 1); // So the push_back below cannot throw and leak the slab
+        const size_t size = std::max(mSlabBytes, roundUp(minBytes, kHugePageBytes));
+        bool hugeTlb = false;
+        void* data = MAP_FAILED;
+#ifdef MAP_HUGETLB
+        data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        hugeTlb = data != MAP_FAILED;
+#endif
+        if (data == MAP_FAILED)
+        {
+            data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (data == MAP_FAILED)
+            {
+                throw std::bad_alloc();
+            }
+#ifdef MADV_HUGEPAGE
+            madvise(data, size, MADV_HUGEPAGE);
+#endif
+        }
+        // Fault every page in now rather than under the first images that reach it
+        uint8_t* bytes = static_cast<uint8_t*>(data);
+        for (size_t offset = 0; offset < size; offset += 4096)
+        {
+            bytes[offset] = 0;
+        }
+        mSlabs.push_back(Slab{bytes, size});
+        mMappedBytes += size;
+        detail::ArenaCounters& counters = detail::arenaCounters();
+        ++counters.slabs;
+        counters.bytesMapped += size;
+        counters.hugeTlbBytes += hugeTlb ? size : 0;
+    }
+
+    //!
+    //! \brief Unmaps the last slabs until at most mRetainBytes stay mapped; only with nothing
+    //!        allocated, so no slab holds live memory.
+    //!
+    void trim()
+    {
+        detail::ArenaCounters& counters = detail::arenaCounters();
+        while (!mSlabs.empty() && mMappedBytes > mRetainBytes)
+        {
+            const Slab slab = mSlabs.back();
+            mSlabs.pop_back();
+            munmap(slab.data, slab.size);
+            mMappedBytes -= slab.size;
+            ++counters.slabsUnmapped;
+            counters.bytesUnmapped += slab.size;
+        }
+    }
+
+    size_t mSlabBytes;
+    size_t mRetainBytes;
+    std::vector<Slab> mSlabs; //!< Kept while they fit in mRetainBytes
+    size_t mMappedBytes{0};
+    size_t mSlab{0};          //!< Slab allocated from
+    size_t mOffset{0};        //!< First free byte of that slab
+    size_t mPeak{0};
+};
+
+//!
+//! \brief The arena of the calling thread, created with it and unmapped when it exits.
+//!
+inline Arena& threadArena()
+{
+    static thread_local Arena arena;
+    return arena;
+}
+
+//!
+//! \brief Frees everything allocated from arena while it is in scope.
+//!
+class ArenaScope
+{
+public:
+    explicit ArenaScope(Arena& arena = threadArena())
+        : mArena(arena)
+        , mMark(arena.mark())
+    {
+    }
+
+    ~ArenaScope()
+    {
+        mArena.rewind(mMark);
+    }
+
+    ArenaScope(const ArenaScope&) = delete;
+    ArenaScope& operator=(const ArenaScope&) = delete;
+
+    Arena& arena() const
+    {
+        return mArena;
+    }
+
+private:
+    Arena& mArena;
+    Arena::Mark mMark;
+};
+
+#if CV_VERSION_MAJOR >= 4
+typedef cv::AccessFlag MatAccessFlag;
+#else
+typedef int MatAccessFlag;
+#endif
+
+//!
+//! \brief Allocates cv::Mat pixels and headers from the calling thread's arena.
+//!
+//! Releasing such a Mat frees nothing; the memory goes back with the ArenaScope around it.
+//! So a Mat using this allocator must be created, used and released within one ArenaScope on
+//! one thread, and must not be shared beyond it.
+//!
+class ArenaMatAllocator : public cv::MatAllocator
+{
+public:
+    cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step, MatAccessFlag,
+        cv::UMatUsageFlags) const override
+    {
+        // The layout cv::Mat expects, as the standard allocator computes it
+        size_t total = CV_ELEM_SIZE(type);
+        for (int i = dims - 1; i >= 0; --i)
+        {
+            if (step)
+            {
+                if (data && step[i] != CV_AUTOSTEP)
+                {
+                    total = step[i];
+                }
+                else
+                {
+                    step[i] = total;
+                }
+            }
+            total *= sizes[i];
+        }
+        Arena& arena = threadArena();
+        void* header = arena.allocate(sizeof(cv::UMatData), alignof(cv::UMatData));
+        uint8_t* pixels = data ? static_cast<uint8_t*>(data) : static_cast<uint8_t*>(arena.allocate(total));
+        cv::UMatData* u = new (header) cv::UMatData(this);
+        u->data = u->origdata = pixels;
+        u->size = total;
+        if (data)
+        {
+            u->flags |= cv::UMatData::USER_ALLOCATED;
+        }
+        return u;
+    }
+
+    bool allocate(cv::UMatData* u, MatAccessFlag, cv::UMatUsageFlags) const override
+    {
+        return u != nullptr;
+    }
+
+    void deallocate(cv::UMatData* u) const override
+    {
+        if (u)
+        {
+            u->~UMatData();
+        }
+    }
+};
+
+inline ArenaMatAllocator* arenaMatAllocator()
+{
+    static ArenaMatAllocator allocator;
+    return &allocator;
+}
+
+//!
+//! \brief Reads the whole file at path into arena memory.
+//!
+inline bool readFileToArena(const std::string& path, Arena& arena, const uint8_t*& data, size_t& size)
+{
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0)
+    {
+        if (fd >= 0)
+        {
+            ::close(fd);
+        }
+        return false;
+    }
+    size = static_cast<size_t>(st.st_size);
+    uint8_t* bytes = static_cast<uint8_t*>(arena.allocate(std::max<size_t>(size, 1)));
+    size_t done = 0;
+    while (done < size)
+    {
+        const ssize_t n = ::read(fd, bytes + done, size - done);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            break;
+        }
+        done += static_cast<size_t>(n);
+    }
+    ::close(fd);
+    data = bytes;
+    return done == size;
+}
+
+} // namespace mine
+
+#endif // SAMPLE_MINE_HOST_ARENA_H
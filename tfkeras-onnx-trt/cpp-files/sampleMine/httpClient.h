@@ -0,0 +1,164 @@
+#ifndef SAMPLE_MINE_HTTP_CLIENT_H
+#define SAMPLE_MINE_HTTP_CLIENT_H
+
+//
+// The client side of HttpServer, just enough for the load generator and the
+// benchmark: a TCP connection, request heads, and an incremental reader of the
+// responses, which only ever come with a Content-Length.
+//
+
+#include <sys/socket.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+namespace mine
+{
+
+//!
+//! \brief Connects to host:port over TCP, with Nagle off; -1, with error set, on failure. A
+//!        non-blocking connect may still be in progress when this returns.
+//!
+inline int connectTcp(const std::string& host, int port, bool nonBlocking, std::string& error)
+{
+    addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* address = nullptr;
+    if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &address) != 0 || !address)
+    {
+        error = "cannot resolve " + host;
+        return -1;
+    }
+    const int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC | (nonBlocking ? SOCK_NONBLOCK : 0), 0);
+    const bool connected = fd >= 0
+        && (connect(fd, address->ai_addr, address->ai_addrlen) == 0 || (nonBlocking && errno == EINPROGRESS));
+    freeaddrinfo(address);
+    if (!connected)
+    {
+        error = "cannot connect to " + host + ":" + std::to_string(port) + ": " + std::strerror(errno);
+        if (fd >= 0)
+        {
+            ::close(fd);
+        }
+        return -1;
+    }
+    const int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+//!
+//! \brief Request line and headers of a request with a bodyBytes long body (none if 0).
+//!
+inline std::string httpRequestHead(const std::string& method, const std::string& target, const std::string& host,
+    const std::string& contentType, size_t bodyBytes, bool keepAlive = true)
+{
+    std::string head = method + " " + target + " HTTP/1.1\r\nHost: " + host + "\r\n";
+    if (bodyBytes > 0 || method == "POST")
+    {
+        head += "Content-Type: " + contentType + "\r\nContent-Length: " + std::to_string(bodyBytes) + "\r\n";
+    }
+    if (!keepAlive)
+    {
+        head += "Connection: close\r\n";
+    }
+    return head + "\r\n";
+}
+
+struct HttpReply
+{
+    int status{0};
+    bool close{false}; //!< The server closes the connection after this response
+    std::string body;
+};
+
+//!
+//! \brief Splits the bytes received on one connection into responses, skipping interim
+//!        (1xx) ones.
+//!
+class HttpReplyReader
+{
+public:
+    void append(const char* data, size_t size)
+    {
+        mIn.append(data, size);
+    }
+
+    //!
+    //! \brief 1 with the next response in reply, 0 while it is incomplete, -1 if the bytes are
+    //!        not a response.
+    //!
+    int next(HttpReply& reply)
+    {
+        for (;;)
+        {
+            const size_t headEnd = mIn.find("\r\n\r\n");
+            if (headEnd == std::string::npos)
+            {
+                return mIn.size() > 64 * 1024 ? -1 : 0;
+            }
+            if (mIn.compare(0, 9, "HTTP/1.1 ") != 0 && mIn.compare(0, 9, "HTTP/1.0 ") != 0)
+            {
+                return -1;
+            }
+            const int status = std::atoi(mIn.c_str() + 9);
+            size_t length = 0;
+            bool close = mIn.compare(0, 8, "HTTP/1.0") == 0;
+            for (size_t line = mIn.find("\r\n") + 2; line < headEnd; line = mIn.find("\r\n", line) + 2)
+            {
+                const size_t lineEnd = mIn.find("\r\n", line);
+                std::string header(mIn, line, lineEnd - line);
+                for (char& ch : header)
+                {
+                    ch = static_cast<char>(std::tolower(static_cast<unsigned char>(ch)));
+                }
+                if (header.compare(0, 15, "content-length:") == 0)
+                {
+                    length = static_cast<size_t>(std::strtoull(header.c_str() + 15, nullptr, 10));
+                }
+                else if (header.compare(0, 11, "connection:") == 0)
+                {
+                    close = header.find("close") != std::string::npos;
+                }
+            }
+            if (status >= 100 && status < 200)
+            {
+                mIn.erase(0, headEnd + 4);
+                continue;
+            }
+            if (mIn.size() < headEnd + 4 + length)
+            {
+                return 0;
+            }
+            reply.status = status;
+            reply.close = close;
+            reply.body.assign(mIn, headEnd + 4, length);
+            mIn.erase(0, headEnd + 4 + length);
+            return 1;
+        }
+    }
+
+    //!
+    //! \brief Bytes received but not yet returned as a response.
+    //!
+    size_t buffered() const
+    {
+        return mIn.size();
+    }
+
+private:
+    std::string mIn;
+};
+
+} // namespace mine
+
+#endif // SAMPLE_MINE_HTTP_CLIENT_H
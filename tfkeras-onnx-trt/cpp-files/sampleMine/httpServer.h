@@ -0,0 +1,873 @@
+#ifndef SAMPLE_MINE_HTTP_SERVER_H
+#define SAMPLE_MINE_HTTP_SERVER_H
+
+//
+// Minimal HTTP/1.1 server for sample_mine --http. One thread runs an epoll loop
+// over every connection, so thousands of keep-alive clients cost a few KiB of
+// buffers each rather than a thread. Complete requests are handed to a handler
+// on that thread, which must not block: it starts the work and answers later,
+// from any thread, through respond(). Responses go out in request order, also
+// when a client pipelines requests and they finish out of order.
+//
+// Only what an inference endpoint needs is implemented: Content-Length bodies
+// (no chunked uploads), keep-alive and Connection: close, Expect: 100-continue
+// (curl sends it for bodies over 1 KiB), and limits on header and body size,
+// requests awaiting a response per connection, connections and idle time.
+// Past its pipelining limit a connection is not read, so TCP flow control
+// holds back a client that sends faster than it is answered.
+//
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace mine
+{
+
+struct HttpRequest
+{
+    std::string method;
+    std::string target; //!< Path and query, as sent
+    std::string contentType;
+    std::vector<uint8_t> body;
+};
+
+struct HttpResponse
+{
+    int status{200};
+    std::string contentType{"application/json"};
+    std::string body;
+};
+
+inline const char* httpReason(int status)
+{
+    switch (status)
+    {
+    case 100: return "Continue";
+    case 200: return "OK";
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 413: return "Payload Too Large";
+    case 415: return "Unsupported Media Type";
+    case 417: return "Expectation Failed";
+    case 422: return "Unprocessable Entity";
+    case 431: return "Request Header Fields Too Large";
+    case 500: return "Internal Server Error";
+    case 501: return "Not Implemented";
+    case 503: return "Service Unavailable";
+    case 505: return "HTTP Version Not Supported";
+    default: return "Unknown";
+    }
+}
+
+//!
+//! \brief Raises the soft limit on open files to the hard limit, as thousands of connections
+//!        need; returns the limit now in effect.
+//!
+inline uint64_t raiseOpenFileLimit()
+{
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) != 0)
+    {
+        return 0;
+    }
+    if (limit.rlim_cur < limit.rlim_max)
+    {
+        rlimit raised = limit;
+        raised.rlim_cur = limit.rlim_max;
+        if (setrlimit(RLIMIT_NOFILE, &raised) == 0)
+        {
+            limit = raised;
+        }
+    }
+    return static_cast<uint64_t>(limit.rlim_cur);
+}
+
+struct HttpLimits
+{
+    size_t maxHeaderBytes{16 * 1024};
+    size_t maxBodyBytes{8 << 20};
+    int maxPipelined{16};      //!< Requests of one connection awaiting a response before it is not read
+    int maxConnections{16384}; //!< Connections past this are closed as soon as accepted
+    int idleTimeoutMs{60000};  //!< Connections with nothing outstanding are closed after this
+};
+
+class HttpServer
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    //!
+    //! \brief Which response a handler owes: its connection, and its place among that
+    //!        connection's requests.
+    //!
+    struct Ticket
+    {
+        uint64_t connection;
+        uint64_t sequence;
+    };
+
+    //! Called on the loop thread for every complete request; must eventually respond(ticket, ...)
+    typedef std::function<void(HttpRequest& request, Ticket ticket)> Handler;
+
+    struct Stats
+    {
+        uint64_t accepted{0};
+        uint64_t refused{0};   //!< Closed at once, over maxConnections or out of file descriptors
+        uint64_t requests{0};  //!< Handed to the handler
+        uint64_t responses{0}; //!< Queued for writing, the server's own error responses included
+        uint64_t rejected{0};  //!< Answered with an error by the server itself, without the handler
+        uint64_t dropped{0};   //!< Responses to connections already closed
+        uint64_t idleClosed{0};
+        size_t connections{0};
+        size_t peakConnections{0};
+    };
+
+    HttpServer() = default;
+
+    ~HttpServer()
+    {
+        for (auto& entry : mConnections)
+        {
+            ::close(entry.second->fd);
+        }
+        const int fds[] = {mListen, mEpoll, mWake};
+        for (int fd : fds)
+        {
+            if (fd >= 0)
+            {
+                ::close(fd);
+            }
+        }
+    }
+
+    HttpServer(const HttpServer&) = delete;
+    HttpServer& operator=(const HttpServer&) = delete;
+
+    //!
+    //! \brief Binds host:port (port 0 picks a free one, see port()); false, with error() set,
+    //!        if that is not possible.
+    //!
+    bool listen(const std::string& host, int port, const HttpLimits& limits = HttpLimits())
+    {
+        mLimits = limits;
+        addrinfo hints;
+        std::memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = AI_PASSIVE;
+        addrinfo* address = nullptr;
+        const std::string endpoint = host + ":" + std::to_string(port);
+        if (getaddrinfo(host.empty() ? nullptr : host.c_str(), std::to_string(port).c_str(), &hints, &address) != 0
+            || !address)
+        {
+            mError = "cannot resolve " + endpoint;
+            return false;
+        }
+        mListen = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        const int one = 1;
+        const bool bound = mListen >= 0 && setsockopt(mListen, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) == 0
+            && bind(mListen, address->ai_addr, address->ai_addrlen) == 0 && ::listen(mListen, SOMAXCONN) == 0;
+        freeaddrinfo(address);
+        if (!bound)
+        {
+            mError = "cannot listen on " + endpoint + ": " + std::strerror(errno);
+            return false;
+        }
+        sockaddr_in local;
+        socklen_t length = sizeof(local);
+        getsockname(mListen, reinterpret_cast<sockaddr*>(&local), &length);
+        mPort = ntohs(local.sin_port);
+
+        mEpoll = epoll_create1(EPOLL_CLOEXEC);
+        mWake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (mEpoll < 0 || mWake < 0 || !watch(mListen, kListenKey, EPOLLIN, EPOLL_CTL_ADD)
+            || !watch(mWake, kWakeKey, EPOLLIN, EPOLL_CTL_ADD))
+        {
+            mError = std::string("cannot set up epoll: ") + std::strerror(errno);
+            return false;
+        }
+        return true;
+    }
+
+    int port() const
+    {
+        return mPort;
+    }
+
+    const std::string& error() const
+    {
+        return mError;
+    }
+
+    //!
+    //! \brief Serves on the calling thread until stop(). Then it stops accepting and reading,
+    //!        writes the responses still owed (for up to drainTimeout) and closes every connection.
+    //!
+    bool run(const Handler& handler, std::chrono::milliseconds drainTimeout = std::chrono::milliseconds(10000))
+    {
+        mHandler = &handler;
+        epoll_event events[256];
+        Clock::time_point lastSweep = Clock::now();
+        Clock::time_point drainDeadline;
+        bool ok = true;
+        for (;;)
+        {
+            if (mStopping.load(std::memory_order_acquire) && !mDraining)
+            {
+                beginDrain();
+                drainDeadline = Clock::now() + drainTimeout;
+            }
+            if (mDraining && (mConnections.empty() || Clock::now() > drainDeadline))
+            {
+                break;
+            }
+            const int n = epoll_wait(mEpoll, events, 256, mDraining ? 100 : 1000);
+            if (n < 0 && errno != EINTR)
+            {
+                mError = std::string("epoll_wait failed: ") + std::strerror(errno);
+                ok = false;
+                break;
+            }
+            for (int i = 0; i < n; ++i)
+            {
+                const uint64_t key = events[i].data.u64;
+                if (key == kListenKey)
+                {
+                    acceptAll();
+                }
+                else if (key == kWakeKey)
+                {
+                    uint64_t count;
+                    while (::read(mWake, &count, sizeof(count)) > 0)
+                    {
+                    }
+                }
+                else
+                {
+                    serve(key, events[i].events);
+                }
+            }
+            deliverResponses();
+
+            const Clock::time_point now = Clock::now();
+            if (now - lastSweep >= std::chrono::seconds(1))
+            {
+                closeIdle(now);
+                lastSweep = now;
+            }
+        }
+        while (!mConnections.empty())
+        {
+            close(mConnections.begin()->first);
+        }
+        mHandler = nullptr;
+        return ok;
+    }
+
+    //!
+    //! \brief Answers the request of ticket; from any thread. A response to a connection that
+    //!        is gone meanwhile is dropped.
+    //!
+    void respond(Ticket ticket, HttpResponse response)
+    {
+        bool wake;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            wake = mCompleted.empty();
+            mCompleted.push_back(Completed{ticket, std::move(response)});
+        }
+        if (wake)
+        {
+            signalLoop();
+        }
+    }
+
+    //!
+    //! \brief Makes run() drain and return; from any thread, and async-signal-safe.
+    //!
+    void stop()
+    {
+        mStopping.store(true, std::memory_order_release);
+        signalLoop();
+    }
+
+    //!
+    //! \brief Only consistent on the loop thread (in the handler) or once run() returned.
+    //!
+    Stats stats() const
+    {
+        Stats stats = mStats;
+        stats.connections = mConnections.size();
+        return stats;
+    }
+
+private:
+    static const uint64_t kListenKey = 0;
+    static const uint64_t kWakeKey = 1;
+    static const uint64_t kNever = ~0ull;
+    static const size_t kReadBytes = 64 * 1024;
+
+    struct Connection
+    {
+        int fd{-1};
+        uint64_t id{0};
+        std::string in;
+        size_t parsed{0}; //!< Bytes of in consumed by requests already handed out
+        std::string out;
+        size_t written{0};
+        uint64_t nextSequence{0};                 //!< Of the next request parsed
+        uint64_t nextResponse{0};                 //!< Sequence whose response is written next
+        std::map<uint64_t, std::string> finished; //!< Responses waiting for earlier ones
+        uint64_t closeAfter{kNever};              //!< Last request answered before closing
+        bool continueSent{false};                 //!< 100 Continue went out for the request being read
+        bool peerClosed{false};
+        bool lingering{false}; //!< Our side is shut down; reading and discarding until the peer closes
+        bool touched{false};   //!< Has new responses; parse and update once deliverResponses() is done
+        uint32_t events{0};    //!< As registered with epoll
+        Clock::time_point lastActive;
+    };
+
+    struct Completed
+    {
+        Ticket ticket;
+        HttpResponse response;
+    };
+
+    //!
+    //! \brief The part of a request before its body.
+    //!
+    struct RequestHead
+    {
+        std::string method;
+        std::string target;
+        std::string contentType;
+        size_t contentLength{0};
+        bool keepAlive{true};
+        bool expectContinue{false};
+    };
+
+    bool watch(int fd, uint64_t key, uint32_t events, int op)
+    {
+        epoll_event event;
+        std::memset(&event, 0, sizeof(event));
+        event.events = events;
+        event.data.u64 = key;
+        return epoll_ctl(mEpoll, op, fd, &event) == 0;
+    }
+
+    void signalLoop()
+    {
+        const uint64_t one = 1;
+        const ssize_t written = ::write(mWake, &one, sizeof(one));
+        (void) written; // Only fails while the counter is already non-zero, i.e. the loop is woken anyway
+    }
+
+    void acceptAll()
+    {
+        for (;;)
+        {
+            const int fd = accept4(mListen, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0)
+            {
+                if (errno == EINTR || errno == ECONNABORTED)
+                {
+                    continue;
+                }
+                if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM)
+                {
+                    // The pending connection stays in the backlog; stop listening until one closes,
+                    // or the level-triggered listen socket would wake the loop forever
+                    watch(mListen, kListenKey, 0, EPOLL_CTL_MOD);
+                    mListenPaused = true;
+                    ++mStats.refused;
+                }
+                return;
+            }
+            if (static_cast<int>(mConnections.size()) >= mLimits.maxConnections)
+            {
+                ::close(fd);
+                ++mStats.refused;
+                continue;
+            }
+            const int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)); // Responses are single small writes
+            std::unique_ptr<Connection> connection(new Connection);
+            connection->fd = fd;
+            connection->id = mNextId++;
+            connection->lastActive = Clock::now();
+            connection->events = EPOLLIN;
+            if (!watch(fd, connection->id, EPOLLIN, EPOLL_CTL_ADD))
+            {
+                ::close(fd);
+                ++mStats.refused;
+                continue;
+            }
+            mConnections[connection->id] = std::move(connection);
+            ++mStats.accepted;
+            mStats.peakConnections = std::max(mStats.peakConnections, mConnections.size());
+        }
+    }
+
+    void serve(uint64_t id, uint32_t events)
+    {
+        const auto it = mConnections.find(id);
+        if (it == mConnections.end())
+        {
+            return;
+        }
+        Connection& c = *it->second;
+        if ((events & EPOLLERR) || ((events & EPOLLHUP) && !(events & EPOLLIN)))
+        {
+            close(id);
+            return;
+        }
+        if (events & EPOLLIN)
+        {
+            if (mReadBuffer.size() < kReadBytes)
+            {
+                mReadBuffer.resize(kReadBytes);
+            }
+            const ssize_t received = ::recv(c.fd, &mReadBuffer[0], kReadBytes, 0);
+            if (received > 0)
+            {
+                c.lastActive = Clock::now();
+                if (!c.lingering)
+                {
+                    c.in.append(&mReadBuffer[0], static_cast<size_t>(received));
+                    parse(c);
+                }
+            }
+            else if (received == 0)
+            {
+                c.peerClosed = true;
+            }
+            else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            {
+                close(id);
+                return;
+            }
+        }
+        update(c);
+    }
+
+    //!
+    //! \brief Hands every complete request buffered on c to the handler, as far as the
+    //!        pipelining limit allows.
+    //!
+    void parse(Connection& c)
+    {
+        while (!mDraining && !c.lingering && c.closeAfter == kNever
+            && c.nextSequence - c.nextResponse < static_cast<uint64_t>(mLimits.maxPipelined))
+        {
+            const size_t headEnd = c.in.find("\r\n\r\n", c.parsed);
+            if (headEnd == std::string::npos || headEnd - c.parsed > mLimits.maxHeaderBytes)
+            {
+                if (c.in.size() - c.parsed > mLimits.maxHeaderBytes)
+                {
+                    reject(c, 431);
+                }
+                break;
+            }
+            RequestHead head;
+            const int status = parseHead(c.in, c.parsed, headEnd + 2, head);
+            if (status != 0)
+            {
+                reject(c, status);
+                break;
+            }
+            if (head.contentLength > mLimits.maxBodyBytes)
+            {
+                reject(c, 413);
+                break;
+            }
+            const size_t bodyStart = headEnd + 4;
+            if (c.in.size() - bodyStart < head.contentLength)
+            {
+                // Only once every earlier response is out, or the interim response would overtake them
+                if (head.expectContinue && !c.continueSent && c.nextResponse == c.nextSequence)
+                {
+                    c.out += "HTTP/1.1 100 Continue\r\n\r\n";
+                    c.continueSent = true;
+                }
+                break;
+            }
+
+            HttpRequest request;
+            request.method = std::move(head.method);
+            request.target = std::move(head.target);
+            request.contentType = std::move(head.contentType);
+            request.body.assign(c.in.begin() + bodyStart, c.in.begin() + bodyStart + head.contentLength);
+            c.parsed = bodyStart + head.contentLength;
+            c.continueSent = false;
+            const uint64_t sequence = c.nextSequence++;
+            if (!head.keepAlive)
+            {
+                c.closeAfter = sequence;
+            }
+            ++mStats.requests;
+            (*mHandler)(request, Ticket{c.id, sequence});
+        }
+        if (c.parsed == c.in.size() || c.parsed >= kReadBytes)
+        {
+            c.in.erase(0, c.parsed);
+            c.parsed = 0;
+        }
+    }
+
+    //!
+    //! \brief Parses the request line and headers in [begin, end), end just past the last CRLF.
+    //!        Returns 0, or the status to reject the request with.
+    //!
+    static int parseHead(const std::string& in, size_t begin, size_t end, RequestHead& head)
+    {
+        size_t lineEnd = in.find("\r\n", begin);
+        const size_t methodEnd = in.find(' ', begin);
+        const size_t targetEnd = methodEnd < lineEnd ? in.find(' ', methodEnd + 1) : std::string::npos;
+        if (methodEnd == begin || methodEnd >= lineEnd || targetEnd >= lineEnd || targetEnd == methodEnd + 1)
+        {
+            return 400;
+        }
+        head.method.assign(in, begin, methodEnd - begin);
+        head.target.assign(in, methodEnd + 1, targetEnd - methodEnd - 1);
+        const std::string version(in, targetEnd + 1, lineEnd - targetEnd - 1);
+        if (version == "HTTP/1.0")
+        {
+            head.keepAlive = false;
+        }
+        else if (version != "HTTP/1.1")
+        {
+            return version.compare(0, 5, "HTTP/") == 0 ? 505 : 400;
+        }
+
+        bool lengthSeen = false;
+        for (size_t line = lineEnd + 2; line < end; line = lineEnd + 2)
+        {
+            lineEnd = in.find("\r\n", line);
+            const size_t colon = in.find(':', line);
+            if (colon >= lineEnd || colon == line || in[line] == ' ' || in[line] == '\t')
+            {
+                return 400; // Also obsolete line folding
+            }
+            std::string name(in, line, colon - line);
+            for (char& ch : name)
+            {
+                ch = static_cast<char>(std::tolower(static_cast<unsigned char>(ch)));
+            }
+            size_t valueBegin = colon + 1;
+            size_t valueEnd = lineEnd;
+            while (valueBegin < valueEnd && (in[valueBegin] == ' ' || in[valueBegin] == '\t'))
+            {
+                ++valueBegin;
+            }
+            while (valueEnd > valueBegin && (in[valueEnd - 1] == ' ' || in[valueEnd - 1] == '\t'))
+            {
+                --valueEnd;
+            }
+            std::string value(in, valueBegin, valueEnd - valueBegin);
+            if (name == "content-length")
+            {
+                if (value.empty() || value.size() > 18 || value.find_first_not_of("0123456789") != std::string::npos)
+                {
+                    return 400;
+                }
+                const size_t length = static_cast<size_t>(std::stoull(value));
+                if (lengthSeen && length != head.contentLength)
+                {
+                    return 400;
+                }
+                head.contentLength = length;
+                lengthSeen = true;
+                continue;
+            }
+            if (name == "content-type")
+            {
+                head.contentType = std::move(value);
+                continue;
+            }
+            for (char& ch : value)
+            {
+                ch = static_cast<char>(std::tolower(static_cast<unsigned char>(ch)));
+            }
+            if (name == "transfer-encoding")
+            {
+                return 501;
+            }
+            else if (name == "connection")
+            {
+                if (value.find("close") != std::string::npos)
+                {
+                    head.keepAlive = false;
+                }
+                else if (value.find("keep-alive") != std::string::npos)
+                {
+                    head.keepAlive = true;
+                }
+            }
+            else if (name == "expect")
+            {
+                if (value != "100-continue")
+                {
+                    return 417;
+                }
+                head.expectContinue = true;
+            }
+        }
+        return 0;
+    }
+
+    //!
+    //! \brief Answers the next request of c with status itself and closes c after it: once a
+    //!        request cannot be parsed, nothing after it can be trusted to be a request either.
+    //!
+    void reject(Connection& c, int status)
+    {
+        const uint64_t sequence = c.nextSequence++;
+        c.closeAfter = sequence;
+        c.in.clear();
+        c.parsed = 0;
+        ++mStats.rejected;
+        HttpResponse response;
+        response.status = status;
+        response.body = std::string("{\"error\": \"") + httpReason(status) + "\"}\n";
+        finish(c, sequence, std::move(response));
+    }
+
+    //!
+    //! \brief Queues the response to request sequence of c, behind the responses it still owes
+    //!        to earlier requests.
+    //!
+    void finish(Connection& c, uint64_t sequence, HttpResponse response)
+    {
+        const bool last = sequence == c.closeAfter;
+        std::string message = "HTTP/1.1 " + std::to_string(response.status) + " " + httpReason(response.status)
+            + "\r\nContent-Type: " + response.contentType + "\r\nContent-Length: "
+            + std::to_string(response.body.size()) + (last ? "\r\nConnection: close" : "\r\nConnection: keep-alive")
+            + "\r\n\r\n";
+        message += response.body;
+        ++mStats.responses;
+        if (sequence != c.nextResponse)
+        {
+            c.finished[sequence] = std::move(message);
+            return;
+        }
+        c.out += message;
+        ++c.nextResponse;
+        for (auto it = c.finished.begin(); it != c.finished.end() && it->first == c.nextResponse;
+             it = c.finished.erase(it))
+        {
+            c.out += it->second;
+            ++c.nextResponse;
+        }
+    }
+
+    void deliverResponses()
+    {
+        std::vector<Completed> completed;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            completed.swap(mCompleted);
+        }
+        std::vector<uint64_t> touched;
+        for (Completed& done : completed)
+        {
+            const auto it = mConnections.find(done.ticket.connection);
+            if (it == mConnections.end() || it->second->lingering)
+            {
+                ++mStats.dropped;
+                continue;
+            }
+            Connection& c = *it->second;
+            finish(c, done.ticket.sequence, std::move(done.response));
+            if (!c.touched)
+            {
+                c.touched = true;
+                touched.push_back(c.id);
+            }
+        }
+        for (uint64_t id : touched)
+        {
+            const auto it = mConnections.find(id);
+            if (it != mConnections.end())
+            {
+                Connection& c = *it->second;
+                c.touched = false;
+                parse(c); // Requests held back by the pipelining limit may proceed now
+                update(c);
+            }
+        }
+    }
+
+    //!
+    //! \brief Writes what c can take, then closes c or adjusts what epoll watches it for.
+    //!
+    void update(Connection& c)
+    {
+        while (c.written < c.out.size())
+        {
+            const ssize_t sent = ::send(c.fd, c.out.data() + c.written, c.out.size() - c.written, MSG_NOSIGNAL);
+            if (sent > 0)
+            {
+                c.written += static_cast<size_t>(sent);
+                c.lastActive = Clock::now();
+            }
+            else if (sent < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            else if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            {
+                break;
+            }
+            else
+            {
+                close(c.id);
+                return;
+            }
+        }
+        if (c.written == c.out.size())
+        {
+            c.out.clear();
+            c.written = 0;
+        }
+
+        const bool answered = c.out.empty() && c.nextResponse == c.nextSequence;
+        if (c.peerClosed || (answered && mDraining))
+        {
+            if (answered || c.lingering)
+            {
+                close(c.id);
+                return;
+            }
+        }
+        else if (answered && !c.lingering && c.closeAfter != kNever && c.nextResponse > c.closeAfter)
+        {
+            // Closing with unread input would reset the connection and could destroy the last
+            // response before the client read it; shut down our side and wait for the peer instead
+            shutdown(c.fd, SHUT_WR);
+            c.lingering = true;
+            c.lastActive = Clock::now();
+        }
+
+        uint32_t events = 0;
+        if (!c.peerClosed
+            && (c.lingering
+                || (!mDraining && c.closeAfter == kNever
+                    && c.nextSequence - c.nextResponse < static_cast<uint64_t>(mLimits.maxPipelined))))
+        {
+            events |= EPOLLIN;
+        }
+        if (!c.out.empty())
+        {
+            events |= EPOLLOUT;
+        }
+        if (events != c.events && watch(c.fd, c.id, events, EPOLL_CTL_MOD))
+        {
+            c.events = events;
+        }
+    }
+
+    void close(uint64_t id)
+    {
+        const auto it = mConnections.find(id);
+        ::close(it->second->fd);
+        mConnections.erase(it);
+        if (mListenPaused && !mDraining)
+        {
+            mListenPaused = !watch(mListen, kListenKey, EPOLLIN, EPOLL_CTL_MOD);
+        }
+    }
+
+    //!
+    //! \brief Closes connections with nothing outstanding that were quiet for too long, and
+    //!        lingering ones whose peer does not close within a second.
+    //!
+    void closeIdle(Clock::time_point now)
+    {
+        std::vector<uint64_t> idle;
+        for (const auto& entry : mConnections)
+        {
+            const Connection& c = *entry.second;
+            const bool quiet = c.out.empty() && c.nextResponse == c.nextSequence;
+            const auto timeout = c.lingering ? std::chrono::milliseconds(1000)
+                                             : std::chrono::milliseconds(mLimits.idleTimeoutMs);
+            if (quiet && now - c.lastActive > timeout)
+            {
+                idle.push_back(entry.first);
+            }
+        }
+        for (uint64_t id : idle)
+        {
+            mStats.idleClosed += mConnections[id]->lingering ? 0 : 1;
+            close(id);
+        }
+    }
+
+    //!
+    //! \brief Stops accepting and reading. Connections that are owed nothing close right away,
+    //!        the others once their responses are written.
+    //!
+    void beginDrain()
+    {
+        mDraining = true;
+        ::close(mListen);
+        mListen = -1;
+        std::vector<uint64_t> ids;
+        for (const auto& entry : mConnections)
+        {
+            ids.push_back(entry.first);
+        }
+        for (uint64_t id : ids)
+        {
+            Connection& c = *mConnections[id];
+            if (c.nextSequence > c.nextResponse)
+            {
+                c.closeAfter = std::min(c.closeAfter, c.nextSequence - 1);
+            }
+            update(c);
+        }
+    }
+
+    HttpLimits mLimits;
+    std::string mError;
+    int mListen{-1};
+    int mEpoll{-1};
+    int mWake{-1}; //!< eventfd that respond() and stop() wake the loop through
+    int mPort{0};
+    bool mListenPaused{false};
+    bool mDraining{false};
+    std::atomic<bool> mStopping{false};
+    const Handler* mHandler{nullptr};
+    uint64_t mNextId{2}; //!< Connection ids are epoll keys; 0 and 1 are the listen socket and mWake
+    std::unordered_map<uint64_t, std::unique_ptr<Connection>> mConnections;
+    std::vector<char> mReadBuffer;
+    Stats mStats;
+
+    std::mutex mMutex; //!< Guards mCompleted
+    std::vector<Completed> mCompleted;
+};
+
+} // namespace mine
+
+#endif // SAMPLE_MINE_HTTP_SERVER_H
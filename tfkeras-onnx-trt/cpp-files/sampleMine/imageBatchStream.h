@@ -0,0 +1,272 @@
+#ifndef SAMPLE_MINE_IMAGE_BATCH_STREAM_H
+#define SAMPLE_MINE_IMAGE_BATCH_STREAM_H
+
+//
+// INT8 calibration batches read from image files: each batch is decoded,
+// resized and packed in parallel exactly as sample_mine preprocesses images
+// for inference, so the calibrator sees the value ranges the engine will.
+//
+// Batches are only produced when TensorRT asks for them; with a reusable
+// calibration cache it never does, and no image is decoded.
+//
+
+#include "BatchStream.h"
+#include "bulkInput.h"
+#include "calibrationCache.h"
+#include "jpegDecode.h"
+#include "preprocessPipeline.h"
+#include "preprocessSpec.h"
+#include "tensorDesc.h"
+#include "threadPool.h"
+
+#include "NvInfer.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+
+namespace mine
+{
+
+class ImageBatchStream : public IBatchStream
+{
+public:
+    //!
+    //! \brief dims is the NCHW or NHWC network input; N is the calibration batch. At most maxBatches
+    //!        batches are produced, fewer if the images run out (a partial last batch is dropped).
+    //!        Images are preprocessed as spec says, always into float.
+    //!
+    ImageBatchStream(std::vector<ImageEntry> images, const nvinfer1::Dims& dims, int maxBatches,
+        const PreprocessSpec& spec, int threads = 0)
+        : mImages(std::move(images))
+        , mDims(dims)
+        , mDesc(describeTensor(dims, ElementType::kFLOAT, false))
+        , mMaxBatches(maxBatches)
+        , mSpec(spec)
+        , mPool(threads)
+    {
+        std::string error;
+        mSpec.type = InputType::kFLOAT;
+        mCompiled = mPreprocess.compile(mSpec, mDesc, error);
+        if (valid())
+        {
+            mBatch.resize(static_cast<size_t>(getBatchSize()) * imageVolume());
+        }
+    }
+
+    //!
+    //! \brief False unless dims is a batch of 3-channel images with every dimension positive.
+    //!
+    bool valid() const
+    {
+        return mDims.nbDims == 4 && mDesc.batch() > 0 && mCompiled;
+    }
+
+    void reset(int firstBatch) override
+    {
+        mCursor = 0;
+        mBatchesRead = 0;
+        mFailed = 0;
+        skip(firstBatch);
+    }
+
+    //!
+    //! \brief Fills the next batch. Images that cannot be read, decoded or preprocessed are counted
+    //!        in failed() and replaced by the ones after them.
+    //!
+    bool next() override
+    {
+        if (!valid() || mBatchesRead >= mMaxBatches)
+        {
+            return false;
+        }
+        const int batch = getBatchSize();
+        const size_t volume = imageVolume();
+        int filled = 0;
+        while (filled < batch && mCursor < mImages.size())
+        {
+            const int count = static_cast<int>(std::min<size_t>(batch - filled, mImages.size() - mCursor));
+            std::vector<char> ok(count); // Not vector<bool>, which workers cannot write concurrently
+            mPool.parallelFor(count, [&](int i) {
+                try
+                {
+                    ok[i] = preprocess(mImages[mCursor + i], &mBatch[(filled + i) * volume]);
+                }
+                catch (const std::exception&)
+                {
+                    ok[i] = false; // Counted as failed like an unreadable image
+                }
+            });
+            // Close the gaps the failed images left, keeping the rest in order
+            const int first = filled;
+            for (int i = 0; i < count; ++i)
+            {
+                if (!ok[i])
+                {
+                    ++mFailed;
+                    continue;
+                }
+                if (first + i != filled)
+                {
+                    std::memmove(&mBatch[filled * volume], &mBatch[(first + i) * volume], volume * sizeof(float));
+                }
+                ++filled;
+            }
+            mCursor += count;
+        }
+        if (filled < batch)
+        {
+            return false;
+        }
+        ++mBatchesRead;
+        return true;
+    }
+
+    //!
+    //! \brief Skips skipCount batches' worth of images without decoding them.
+    //!
+    void skip(int skipCount) override
+    {
+        mCursor = std::min(mImages.size(), mCursor + static_cast<size_t>(skipCount) * getBatchSize());
+        mBatchesRead += skipCount;
+    }
+
+    float* getBatch() override
+    {
+        return mBatch.data();
+    }
+
+    //!
+    //! \brief Calibration needs no labels.
+    //!
+    float* getLabels() override
+    {
+        return nullptr;
+    }
+
+    int getBatchesRead() const override
+    {
+        return mBatchesRead;
+    }
+
+    int getBatchSize() const override
+    {
+        return mDims.d[0];
+    }
+
+    nvinfer1::Dims getDims() const override
+    {
+        return mDims;
+    }
+
+    //!
+    //! \brief Images skipped so far because they could not be read or decoded.
+    //!
+    uint64_t failed() const
+    {
+        return mFailed;
+    }
+
+    //!
+    //! \brief Everything the calibration depends on, for a CalibrationCache key: the model, given as
+    //!        a hash of its file, the images with the size and mtime of each file, the batch shape
+    //!        and count, and the preprocessing.
+    //!
+    std::string key(uint64_t model) const
+    {
+        // A path alone does not tell an image rewritten in place; its size and mtime do
+        uint64_t hash = fnv1a("");
+        for (const ImageEntry& image : mImages)
+        {
+            struct stat st;
+            std::ostringstream file;
+            file << image.path;
+            if (stat(image.path.c_str(), &st) == 0)
+            {
+                file << " " << st.st_size << " " << st.st_mtim.tv_sec << "." << st.st_mtim.tv_nsec;
+            }
+            hash = fnv1a(file.str() + "\n", hash);
+        }
+        std::ostringstream key;
+        key << "model " << std::hex << model << ", " << std::dec << mImages.size() << " images " << std::hex << hash
+            << std::dec << ", " << mMaxBatches
+            << " batches of " << mDims.d[0] << "x" << mDims.d[1] << "x" << mDims.d[2] << "x" << mDims.d[3]
+            << ", resize " << resizeModeName(mSpec.resize) << ", scale";
+        const PackParams params = preprocessPackParams(mSpec);
+        for (float s : params.scale)
+        {
+            key << " " << s;
+        }
+        key << ", bias";
+        for (float b : params.bias)
+        {
+            key << " " << b;
+        }
+        // Only what differs from the defaults, so keys stay short for default preprocessing
+        const PreprocessSpec defaults;
+        if (mSpec.decode != defaults.decode)
+        {
+            key << ", decode " << decodeModeName(mSpec.decode);
+        }
+        if (mSpec.filter != defaults.filter)
+        {
+            key << ", filter " << resizeFilterName(mSpec.filter);
+        }
+        if (mSpec.order != defaults.order)
+        {
+            key << ", order " << colorOrderName(mSpec.order);
+        }
+        if (mSpec.resize == ResizeMode::kLETTERBOX)
+        {
+            key << ", pad " << int(mSpec.padRGB[0]) << " " << int(mSpec.padRGB[1]) << " " << int(mSpec.padRGB[2]);
+        }
+        return key.str();
+    }
+
+private:
+    size_t imageVolume() const
+    {
+        return mDesc.sampleElements();
+    }
+
+    //!
+    //! \brief The processInput() pipeline for one image: the spec compiled the same way, decode,
+    //!        then the fused pass into the layout of the input.
+    //!
+    bool preprocess(const ImageEntry& image, float* dst) const
+    {
+        std::vector<uint8_t> bytes;
+        cv::Mat bgr;
+        int denom = 1;
+        if (!readFileBytes(image.path, bytes) || !mPreprocess.decode(bytes.data(), bytes.size(), bgr, denom))
+        {
+            return false;
+        }
+        mPreprocess.pack(bgr.ptr<uint8_t>(), bgr.step, bgr.cols, bgr.rows, dst);
+        return true;
+    }
+
+    std::vector<ImageEntry> mImages;
+    nvinfer1::Dims mDims;
+    TensorDesc mDesc;
+    int mMaxBatches;
+    PreprocessSpec mSpec;
+    PreprocessPipeline mPreprocess;
+    bool mCompiled{false}; //!< False unless the input is a 3-channel image
+    ThreadPool mPool;
+
+    std::vector<float> mBatch;
+    size_t mCursor{0}; //!< Next image to decode
+    int mBatchesRead{0};
+    uint64_t mFailed{0};
+};
+
+} // namespace mine
+
+#endif // SAMPLE_MINE_IMAGE_BATCH_STREAM_H
@@ -0,0 +1,437 @@
+#ifndef SAMPLE_MINE_IMAGE_PACKING_H
+#define SAMPLE_MINE_IMAGE_PACKING_H
+
+//
+// Packing of interleaved 8-bit BGR rows (cv::Mat CV_8UC3 layout) into planar,
+// normalized float RGB (the CHW layout the inception_v3 engine expects), or
+// into normalized IEEE half or unnormalized 8-bit planes for narrower inputs.
+//
+// Every row is converted in a single pass: BGR -> RGB swap, HWC -> CHW split and
+// the per-channel normalization are fused. The row kernel is picked once at
+// runtime from the best instruction set the CPU supports.
+//
+
+#include "halfFloat.h"
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SAMPLE_MINE_X86 1
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+namespace mine
+{
+
+//!
+//! \brief Per-channel affine normalization applied while packing: out = in * scale + bias.
+//!        Channels are indexed in output (RGB) order.
+//!
+struct PackParams
+{
+    float scale[3];
+    float bias[3];
+};
+
+//!
+//! \brief The normalization used by the dogs-vs-cats model: RGB in [0, 1].
+//!
+inline PackParams defaultPackParams()
+{
+    const float s = 1.0f / 255.0f;
+    return PackParams{{s, s, s}, {0.0f, 0.0f, 0.0f}};
+}
+
+//!
+//! \brief Packs one row of `width` interleaved BGR pixels into the three output planes.
+//!
+typedef void (*PackRowFn)(const uint8_t* bgr, int width, float* r, float* g, float* b, const PackParams& params);
+
+//!
+//! \brief As PackRowFn, but only splits and reorders the channels: the planes stay 8-bit and
+//!        unnormalized.
+//!
+typedef void (*PackRowU8Fn)(const uint8_t* bgr, int width, uint8_t* r, uint8_t* g, uint8_t* b);
+
+//!
+//! \brief As PackRowFn, but the normalized values are stored as IEEE half (round to nearest even).
+//!
+typedef void (*PackRowHalfFn)(
+    const uint8_t* bgr, int width, uint16_t* r, uint16_t* g, uint16_t* b, const PackParams& params);
+
+enum class SimdLevel : int
+{
+    kSCALAR = 0,
+    kSSE41 = 1,
+    kAVX2 = 2,
+    kAVX512 = 3
+};
+
+inline const char* simdLevelName(SimdLevel level)
+{
+    switch (level)
+    {
+    case SimdLevel::kSSE41: return "sse4.1";
+    case SimdLevel::kAVX2: return "avx2";
+    case SimdLevel::kAVX512: return "avx512";
+    default: return "scalar";
+    }
+}
+
+//!
+//! \brief Scalar reference kernel, also used for the tail of every SIMD row.
+//!
+inline void packRowScalar(const uint8_t* bgr, int width, float* r, float* g, float* b, const PackParams& params)
+{
+    for (int x = 0; x < width; ++x, bgr += 3)
+    {
+        r[x] = float(bgr[2]) * params.scale[0] + params.bias[0];
+        g[x] = float(bgr[1]) * params.scale[1] + params.bias[1];
+        b[x] = float(bgr[0]) * params.scale[2] + params.bias[2];
+    }
+}
+
+inline void packRowU8Scalar(const uint8_t* bgr, int width, uint8_t* r, uint8_t* g, uint8_t* b)
+{
+    for (int x = 0; x < width; ++x, bgr += 3)
+    {
+        r[x] = bgr[2];
+        g[x] = bgr[1];
+        b[x] = bgr[0];
+    }
+}
+
+inline void packRowHalfScalar(
+    const uint8_t* bgr, int width, uint16_t* r, uint16_t* g, uint16_t* b, const PackParams& params)
+{
+    for (int x = 0; x < width; ++x, bgr += 3)
+    {
+        r[x] = floatToHalf(float(bgr[2]) * params.scale[0] + params.bias[0]);
+        g[x] = floatToHalf(float(bgr[1]) * params.scale[1] + params.bias[1]);
+        b[x] = floatToHalf(float(bgr[0]) * params.scale[2] + params.bias[2]);
+    }
+}
+
+#ifdef SAMPLE_MINE_X86
+
+//!
+//! \brief Splits 16 interleaved BGR pixels (48 bytes) into one register per channel.
+//!
+__attribute__((target("sse4.1"))) inline void deinterleaveBGR16(
+    const uint8_t* src, __m128i& b, __m128i& g, __m128i& r)
+{
+    const __m128i a0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+    const __m128i a1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 16));
+    const __m128i a2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 32));
+
+    b = _mm_or_si128(_mm_or_si128(
+        _mm_shuffle_epi8(a0, _mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+        _mm_shuffle_epi8(a1, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1))),
+        _mm_shuffle_epi8(a2, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13)));
+    g = _mm_or_si128(_mm_or_si128(
+        _mm_shuffle_epi8(a0, _mm_setr_epi8(1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+        _mm_shuffle_epi8(a1, _mm_setr_epi8(-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1))),
+        _mm_shuffle_epi8(a2, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14)));
+    r = _mm_or_si128(_mm_or_si128(
+        _mm_shuffle_epi8(a0, _mm_setr_epi8(2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+        _mm_shuffle_epi8(a1, _mm_setr_epi8(-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1))),
+        _mm_shuffle_epi8(a2, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15)));
+}
+
+__attribute__((target("sse4.1"))) inline void storeChannelSSE41(
+    __m128i v, float* dst, __m128 scale, __m128 bias)
+{
+    for (int i = 0; i < 4; ++i, v = _mm_srli_si128(v, 4))
+    {
+        const __m128 f = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(v));
+        _mm_storeu_ps(dst + 4 * i, _mm_add_ps(_mm_mul_ps(f, scale), bias));
+    }
+}
+
+__attribute__((target("sse4.1"))) inline void packRowSSE41(
+    const uint8_t* bgr, int width, float* r, float* g, float* b, const PackParams& params)
+{
+    const __m128 sr = _mm_set1_ps(params.scale[0]), br = _mm_set1_ps(params.bias[0]);
+    const __m128 sg = _mm_set1_ps(params.scale[1]), bg = _mm_set1_ps(params.bias[1]);
+    const __m128 sb = _mm_set1_ps(params.scale[2]), bb = _mm_set1_ps(params.bias[2]);
+    int x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        __m128i vb, vg, vr;
+        deinterleaveBGR16(bgr + 3 * x, vb, vg, vr);
+        storeChannelSSE41(vr, r + x, sr, br);
+        storeChannelSSE41(vg, g + x, sg, bg);
+        storeChannelSSE41(vb, b + x, sb, bb);
+    }
+    packRowScalar(bgr + 3 * x, width - x, r + x, g + x, b + x, params);
+}
+
+__attribute__((target("sse4.1"))) inline void packRowU8SSE41(
+    const uint8_t* bgr, int width, uint8_t* r, uint8_t* g, uint8_t* b)
+{
+    int x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        __m128i vb, vg, vr;
+        deinterleaveBGR16(bgr + 3 * x, vb, vg, vr);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(r + x), vr);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(g + x), vg);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(b + x), vb);
+    }
+    packRowU8Scalar(bgr + 3 * x, width - x, r + x, g + x, b + x);
+}
+
+__attribute__((target("avx2"))) inline void storeChannelAVX2(
+    __m128i v, float* dst, __m256 scale, __m256 bias)
+{
+    const __m256 lo = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(v));
+    const __m256 hi = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(v, 8)));
+    _mm256_storeu_ps(dst, _mm256_add_ps(_mm256_mul_ps(lo, scale), bias));
+    _mm256_storeu_ps(dst + 8, _mm256_add_ps(_mm256_mul_ps(hi, scale), bias));
+}
+
+__attribute__((target("avx2"))) inline void packRowAVX2(
+    const uint8_t* bgr, int width, float* r, float* g, float* b, const PackParams& params)
+{
+    const __m256 sr = _mm256_set1_ps(params.scale[0]), br = _mm256_set1_ps(params.bias[0]);
+    const __m256 sg = _mm256_set1_ps(params.scale[1]), bg = _mm256_set1_ps(params.bias[1]);
+    const __m256 sb = _mm256_set1_ps(params.scale[2]), bb = _mm256_set1_ps(params.bias[2]);
+    int x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        __m128i vb, vg, vr;
+        deinterleaveBGR16(bgr + 3 * x, vb, vg, vr);
+        storeChannelAVX2(vr, r + x, sr, br);
+        storeChannelAVX2(vg, g + x, sg, bg);
+        storeChannelAVX2(vb, b + x, sb, bb);
+    }
+    packRowScalar(bgr + 3 * x, width - x, r + x, g + x, b + x, params);
+}
+
+__attribute__((target("avx2,f16c"))) inline void storeChannelHalfF16C(
+    __m128i v, uint16_t* dst, __m256 scale, __m256 bias)
+{
+    const __m256 lo = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(v));
+    const __m256 hi = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(v, 8)));
+    const int rounding = _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC;
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst),
+        _mm256_cvtps_ph(_mm256_add_ps(_mm256_mul_ps(lo, scale), bias), rounding));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 8),
+        _mm256_cvtps_ph(_mm256_add_ps(_mm256_mul_ps(hi, scale), bias), rounding));
+}
+
+__attribute__((target("avx2,f16c"))) inline void packRowHalfF16C(
+    const uint8_t* bgr, int width, uint16_t* r, uint16_t* g, uint16_t* b, const PackParams& params)
+{
+    const __m256 sr = _mm256_set1_ps(params.scale[0]), br = _mm256_set1_ps(params.bias[0]);
+    const __m256 sg = _mm256_set1_ps(params.scale[1]), bg = _mm256_set1_ps(params.bias[1]);
+    const __m256 sb = _mm256_set1_ps(params.scale[2]), bb = _mm256_set1_ps(params.bias[2]);
+    int x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        __m128i vb, vg, vr;
+        deinterleaveBGR16(bgr + 3 * x, vb, vg, vr);
+        storeChannelHalfF16C(vr, r + x, sr, br);
+        storeChannelHalfF16C(vg, g + x, sg, bg);
+        storeChannelHalfF16C(vb, b + x, sb, bb);
+    }
+    packRowHalfScalar(bgr + 3 * x, width - x, r + x, g + x, b + x, params);
+}
+
+__attribute__((target("avx512f"))) inline void storeChannelAVX512(
+    __m128i v, float* dst, __m512 scale, __m512 bias)
+{
+    // maskz forms: identical result, but avoid GCC's -Wmaybe-uninitialized on _mm512_undefined_*
+    const __mmask16 all = 0xFFFF;
+    const __m512 f = _mm512_maskz_cvtepi32_ps(all, _mm512_maskz_cvtepu8_epi32(all, v));
+    _mm512_storeu_ps(dst, _mm512_add_ps(_mm512_mul_ps(f, scale), bias));
+}
+
+__attribute__((target("avx512f"))) inline void packRowAVX512(
+    const uint8_t* bgr, int width, float* r, float* g, float* b, const PackParams& params)
+{
+    const __m512 sr = _mm512_set1_ps(params.scale[0]), br = _mm512_set1_ps(params.bias[0]);
+    const __m512 sg = _mm512_set1_ps(params.scale[1]), bg = _mm512_set1_ps(params.bias[1]);
+    const __m512 sb = _mm512_set1_ps(params.scale[2]), bb = _mm512_set1_ps(params.bias[2]);
+    int x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        __m128i vb, vg, vr;
+        deinterleaveBGR16(bgr + 3 * x, vb, vg, vr);
+        storeChannelAVX512(vr, r + x, sr, br);
+        storeChannelAVX512(vg, g + x, sg, bg);
+        storeChannelAVX512(vb, b + x, sb, bb);
+    }
+    packRowScalar(bgr + 3 * x, width - x, r + x, g + x, b + x, params);
+}
+
+__attribute__((target("avx512f"))) inline void storeChannelHalfAVX512(
+    __m128i v, uint16_t* dst, __m512 scale, __m512 bias)
+{
+    const __mmask16 all = 0xFFFF;
+    const __m512 f = _mm512_maskz_cvtepi32_ps(all, _mm512_maskz_cvtepu8_epi32(all, v));
+    const __m256i h = _mm512_maskz_cvtps_ph(all, _mm512_add_ps(_mm512_mul_ps(f, scale), bias),
+        _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), h);
+}
+
+__attribute__((target("avx512f"))) inline void packRowHalfAVX512(
+    const uint8_t* bgr, int width, uint16_t* r, uint16_t* g, uint16_t* b, const PackParams& params)
+{
+    const __m512 sr = _mm512_set1_ps(params.scale[0]), br = _mm512_set1_ps(params.bias[0]);
+    const __m512 sg = _mm512_set1_ps(params.scale[1]), bg = _mm512_set1_ps(params.bias[1]);
+    const __m512 sb = _mm512_set1_ps(params.scale[2]), bb = _mm512_set1_ps(params.bias[2]);
+    int x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        __m128i vb, vg, vr;
+        deinterleaveBGR16(bgr + 3 * x, vb, vg, vr);
+        storeChannelHalfAVX512(vr, r + x, sr, br);
+        storeChannelHalfAVX512(vg, g + x, sg, bg);
+        storeChannelHalfAVX512(vb, b + x, sb, bb);
+    }
+    packRowHalfScalar(bgr + 3 * x, width - x, r + x, g + x, b + x, params);
+}
+
+//!
+//! \brief F16C is its own CPUID bit (leaf 1, ECX); every AVX2 CPU so far has it, but check.
+//!
+inline bool cpuHasF16C()
+{
+    unsigned a = 0, b = 0, c = 0, d = 0;
+    return __get_cpuid(1, &a, &b, &c, &d) && (c & bit_F16C);
+}
+
+#endif // SAMPLE_MINE_X86
+
+//!
+//! \brief Returns true if this CPU can run kernels of the given level.
+//!
+inline bool simdLevelSupported(SimdLevel level)
+{
+#ifdef SAMPLE_MINE_X86
+    switch (level)
+    {
+    case SimdLevel::kAVX512: return __builtin_cpu_supports("avx512f");
+    case SimdLevel::kAVX2: return __builtin_cpu_supports("avx2");
+    case SimdLevel::kSSE41: return __builtin_cpu_supports("sse4.1");
+    default: return true;
+    }
+#else
+    return level == SimdLevel::kSCALAR;
+#endif
+}
+
+//!
+//! \brief Best level supported by this CPU.
+//!
+inline SimdLevel detectSimdLevel()
+{
+    const SimdLevel order[] = {SimdLevel::kAVX512, SimdLevel::kAVX2, SimdLevel::kSSE41};
+    for (SimdLevel level : order)
+    {
+        if (simdLevelSupported(level))
+        {
+            return level;
+        }
+    }
+    return SimdLevel::kSCALAR;
+}
+
+//!
+//! \brief Row kernel for an explicit level; the level must be supported by this CPU.
+//!
+inline PackRowFn getPackRow(SimdLevel level)
+{
+#ifdef SAMPLE_MINE_X86
+    switch (level)
+    {
+    case SimdLevel::kAVX512: return packRowAVX512;
+    case SimdLevel::kAVX2: return packRowAVX2;
+    case SimdLevel::kSSE41: return packRowSSE41;
+    default: break;
+    }
+#endif
+    (void) level;
+    return packRowScalar;
+}
+
+//!
+//! \brief Row kernel for this CPU, resolved on first use.
+//!
+inline PackRowFn packRow()
+{
+    static const PackRowFn fn = getPackRow(detectSimdLevel());
+    return fn;
+}
+
+//!
+//! \brief 8-bit row kernel for an explicit level. Shuffling bytes gains nothing from wider
+//!        registers here, so every SIMD level uses the SSE4.1 kernel.
+//!
+inline PackRowU8Fn getPackRowU8(SimdLevel level)
+{
+#ifdef SAMPLE_MINE_X86
+    if (level != SimdLevel::kSCALAR)
+    {
+        return packRowU8SSE41;
+    }
+#endif
+    (void) level;
+    return packRowU8Scalar;
+}
+
+inline PackRowU8Fn packRowU8()
+{
+    static const PackRowU8Fn fn = getPackRowU8(detectSimdLevel());
+    return fn;
+}
+
+//!
+//! \brief Half row kernel for an explicit level: AVX-512F and F16C convert in hardware, below AVX2
+//!        it is the scalar conversion. The conversions round identically; the float values before
+//!        them can differ in the last bit where the compiler fuses the multiply-add.
+//!
+inline PackRowHalfFn getPackRowHalf(SimdLevel level)
+{
+#ifdef SAMPLE_MINE_X86
+    if (level == SimdLevel::kAVX512)
+    {
+        return packRowHalfAVX512;
+    }
+    if (level == SimdLevel::kAVX2 && cpuHasF16C())
+    {
+        return packRowHalfF16C;
+    }
+#endif
+    (void) level;
+    return packRowHalfScalar;
+}
+
+inline PackRowHalfFn packRowHalf()
+{
+    static const PackRowHalfFn fn = getPackRowHalf(detectSimdLevel());
+    return fn;
+}
+
+//!
+//! \brief Packs a width x height BGR image into three contiguous planes starting at dst (R, G, B).
+//!
+//! \param srcStep Bytes between the starts of consecutive source rows (cv::Mat::step).
+//!
+inline void packBGRToPlanarRGB(const uint8_t* src, size_t srcStep, int width, int height, float* dst,
+    const PackParams& params, PackRowFn fn = packRow())
+{
+    const size_t plane = static_cast<size_t>(width) * height;
+    for (int y = 0; y < height; ++y)
+    {
+        const size_t offset = static_cast<size_t>(y) * width;
+        fn(src + y * srcStep, width, dst + offset, dst + plane + offset, dst + 2 * plane + offset, params);
+    }
+}
+
+} // namespace mine
+
+#endif // SAMPLE_MINE_IMAGE_PACKING_H
@@ -0,0 +1,367 @@
+#ifndef SAMPLE_MINE_IMAGE_RESIZE_H
+#define SAMPLE_MINE_IMAGE_RESIZE_H
+
+//
+// Resize fused with packing: a decoded BGR image is resampled row by row
+// straight into the planar float (or half, or 8-bit) RGB tensor, so no resized
+// intermediate image is ever materialized. Only two horizontally-interpolated source rows and one
+// output row are kept in scratch memory, which comes from the calling thread's arena.
+//
+
+#include "hostArena.h"
+#include "imagePacking.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <string>
+
+namespace mine
+{
+
+//!
+//! \brief How the source aspect ratio is mapped onto the model input.
+//!
+enum class ResizeMode : int
+{
+    kSTRETCH = 0,     //!< Whole image scaled to the input size, aspect ratio not kept (cv::resize behaviour)
+    kCENTER_CROP = 1, //!< Scaled to cover the input, centered overflow cropped
+    kLETTERBOX = 2    //!< Scaled to fit inside the input, borders filled with the pad color
+};
+
+inline const char* resizeModeName(ResizeMode mode)
+{
+    switch (mode)
+    {
+    case ResizeMode::kCENTER_CROP: return "crop";
+    case ResizeMode::kLETTERBOX: return "letterbox";
+    default: return "stretch";
+    }
+}
+
+inline bool parseResizeMode(const std::string& name, ResizeMode& mode)
+{
+    const ResizeMode modes[] = {ResizeMode::kSTRETCH, ResizeMode::kCENTER_CROP, ResizeMode::kLETTERBOX};
+    for (ResizeMode m : modes)
+    {
+        if (name == resizeModeName(m))
+        {
+            mode = m;
+            return true;
+        }
+    }
+    return false;
+}
+
+//!
+//! \brief An axis-aligned pixel rectangle.
+//!
+struct PixelRect
+{
+    int x, y, width, height;
+};
+
+//!
+//! \brief Source region that is sampled and destination region that receives it.
+//!
+struct ResizeGeometry
+{
+    PixelRect src;
+    PixelRect dst;
+};
+
+inline ResizeGeometry computeResizeGeometry(int srcW, int srcH, int dstW, int dstH, ResizeMode mode)
+{
+    ResizeGeometry g{{0, 0, srcW, srcH}, {0, 0, dstW, dstH}};
+    // Compare aspect ratios srcW/srcH and dstW/dstH without division.
+    const long long srcWide = static_cast<long long>(srcW) * dstH;
+    const long long dstWide = static_cast<long long>(dstW) * srcH;
+    if (mode == ResizeMode::kCENTER_CROP)
+    {
+        if (srcWide > dstWide)
+        {
+            g.src.width = std::max(1, static_cast<int>(dstWide / dstH));
+            g.src.x = (srcW - g.src.width) / 2;
+        }
+        else if (srcWide < dstWide)
+        {
+            g.src.height = std::max(1, static_cast<int>(srcWide / dstW));
+            g.src.y = (srcH - g.src.height) / 2;
+        }
+    }
+    else if (mode == ResizeMode::kLETTERBOX)
+    {
+        if (srcWide > dstWide)
+        {
+            g.dst.height = std::max(1, static_cast<int>((static_cast<long long>(srcH) * dstW + srcW / 2) / srcW));
+            g.dst.y = (dstH - g.dst.height) / 2;
+        }
+        else if (srcWide < dstWide)
+        {
+            g.dst.width = std::max(1, static_cast<int>((static_cast<long long>(srcW) * dstH + srcH / 2) / srcH));
+            g.dst.x = (dstW - g.dst.width) / 2;
+        }
+    }
+    return g;
+}
+
+//!
+//! \brief Template argument for an image extent that is only known at run time.
+//!
+const int kAnyExtent = 0;
+
+//!
+//! \brief An extent fixed at compile time, or for kAnyExtent the value it is constructed with.
+//!
+template <int N>
+struct Extent
+{
+    explicit Extent(int) {}
+    int get() const
+    {
+        return N;
+    }
+};
+
+template <>
+struct Extent<kAnyExtent>
+{
+    explicit Extent(int n)
+        : mN(n)
+    {
+    }
+    int get() const
+    {
+        return mN;
+    }
+    int mN;
+};
+
+namespace detail
+{
+
+const int kResizeCoefBits = 11;
+const int kResizeCoefScale = 1 << kResizeCoefBits;
+
+//!
+//! \brief Bilinear tap for one output coordinate: two source indices and fixed-point weights.
+//!
+struct LinearTap
+{
+    int i0, i1;
+    int w0, w1;
+};
+
+//!
+//! \brief Pixel-center aligned taps, as cv::resize INTER_LINEAR computes them.
+//!
+inline void computeLinearTaps(int srcSize, int dstSize, LinearTap* taps)
+{
+    const double scale = static_cast<double>(srcSize) / dstSize;
+    for (int d = 0; d < dstSize; ++d)
+    {
+        const double f = (d + 0.5) * scale - 0.5;
+        int i = static_cast<int>(std::floor(f));
+        double a = f - i;
+        if (i < 0)
+        {
+            i = 0;
+            a = 0.0;
+        }
+        if (i >= srcSize - 1)
+        {
+            i = srcSize - 1;
+            a = 0.0;
+        }
+        LinearTap& t = taps[d];
+        t.i0 = i;
+        t.i1 = std::min(i + 1, srcSize - 1);
+        t.w1 = static_cast<int>(a * kResizeCoefScale + 0.5);
+        t.w0 = kResizeCoefScale - t.w1;
+    }
+}
+
+//!
+//! \brief Horizontal pass over one source row into width interleaved fixed-point pixels. Width is the
+//!        template argument when it is not kAnyExtent, so the loop has a constant trip count.
+//!
+template <int Width>
+inline void interpolateRow(const uint8_t* src, const LinearTap* xTaps, int width, int* out)
+{
+    for (int x = 0, n = Extent<Width>(width).get(); x < n; ++x, out += 3)
+    {
+        const uint8_t* p0 = src + 3 * xTaps[x].i0;
+        const uint8_t* p1 = src + 3 * xTaps[x].i1;
+        const int w0 = xTaps[x].w0;
+        const int w1 = xTaps[x].w1;
+        out[0] = p0[0] * w0 + p1[0] * w1;
+        out[1] = p0[1] * w0 + p1[1] * w1;
+        out[2] = p0[2] * w0 + p1[2] * w1;
+    }
+}
+
+//!
+//! \brief Vertical pass: blends two horizontally interpolated rows of n values into 8 bits.
+//!
+template <int N>
+inline void blendRows(const int* h0, const int* h1, const LinearTap& tap, int n, uint8_t* out)
+{
+    const int shift = 2 * kResizeCoefBits;
+    const int round = 1 << (shift - 1);
+    for (int i = 0, count = Extent<N>(n).get(); i < count; ++i)
+    {
+        out[i] = static_cast<uint8_t>((h0[i] * tap.w0 + h1[i] * tap.w1 + round) >> shift);
+    }
+}
+
+//!
+//! \brief Bilinearly resamples a BGR image row by row, calling emit(rowBGR, y) with each of the
+//!        dstH interleaved BGR output rows. The row buffer is reused for the next row.
+//!
+//! DstW and DstH fix the output size at compile time (see packKernels.h); with kAnyExtent the
+//! dstW and dstH arguments are used. A source already of the output size is passed through.
+//!
+template <int DstW, int DstH, typename EmitRow>
+void resampleBGRRows(const uint8_t* src, size_t step, int srcW, int srcH, int dstWidth, int dstHeight,
+    ResizeMode mode, const uint8_t padBGR[3], EmitRow emit)
+{
+    const int dstW = Extent<DstW>(dstWidth).get();
+    const int dstH = Extent<DstH>(dstHeight).get();
+    if (srcW == dstW && srcH == dstH)
+    {
+        // Every mode maps the image onto the whole output and every tap weight is 0 or 1
+        for (int y = 0; y < dstH; ++y)
+        {
+            emit(src + y * step, y);
+        }
+        return;
+    }
+
+    const ResizeGeometry g = computeResizeGeometry(srcW, srcH, dstW, dstH, mode);
+    ArenaScope scratch;
+    Arena& arena = scratch.arena();
+
+    LinearTap* const xTaps = arena.allocate<LinearTap>(g.dst.width);
+    LinearTap* const yTaps = arena.allocate<LinearTap>(g.dst.height);
+    computeLinearTaps(g.src.width, g.dst.width, xTaps);
+    computeLinearTaps(g.src.height, g.dst.height, yTaps);
+
+    // One output row of BGR: pad color in the letterbox columns, resampled pixels in between.
+    const size_t rowBytes = 3 * static_cast<size_t>(dstW);
+    uint8_t* const row = arena.allocate<uint8_t>(rowBytes);
+    for (int x = 0; x < dstW; ++x)
+    {
+        row[3 * x + 0] = padBGR ? padBGR[0] : 0;
+        row[3 * x + 1] = padBGR ? padBGR[1] : 0;
+        row[3 * x + 2] = padBGR ? padBGR[2] : 0;
+    }
+    uint8_t* const padRow = arena.allocate<uint8_t>(rowBytes);
+    std::memcpy(padRow, row, rowBytes);
+
+    // Horizontally interpolated source rows, cached across output rows that share them.
+    int* hBuf[2];
+    int hRow[2] = {-1, -1};
+    hBuf[0] = arena.allocate<int>(3 * static_cast<size_t>(g.dst.width));
+    hBuf[1] = arena.allocate<int>(3 * static_cast<size_t>(g.dst.width));
+    const uint8_t* srcOrigin = src + g.src.y * step + 3 * static_cast<size_t>(g.src.x);
+    auto horizontal = [&](int sy) -> const int* {
+        for (int k = 0; k < 2; ++k)
+        {
+            if (hRow[k] == sy)
+            {
+                return hBuf[k];
+            }
+        }
+        // Evict the row the next output row no longer needs (always the smaller index).
+        const int k = hRow[0] < hRow[1] ? 0 : 1;
+        if (g.dst.width == dstW)
+        {
+            interpolateRow<DstW>(srcOrigin + sy * step, xTaps, dstW, hBuf[k]);
+        }
+        else
+        {
+            interpolateRow<kAnyExtent>(srcOrigin + sy * step, xTaps, g.dst.width, hBuf[k]);
+        }
+        hRow[k] = sy;
+        return hBuf[k];
+    };
+
+    for (int y = 0; y < dstH; ++y)
+    {
+        const int ty = y - g.dst.y;
+        if (ty < 0 || ty >= g.dst.height)
+        {
+            emit(padRow, y);
+            continue;
+        }
+        const LinearTap& tap = yTaps[ty];
+        const int* h0 = horizontal(tap.i0);
+        const int* h1 = horizontal(tap.i1);
+        uint8_t* out = row + 3 * static_cast<size_t>(g.dst.x);
+        if (g.dst.width == dstW)
+        {
+            blendRows<3 * DstW>(h0, h1, tap, 3 * dstW, out);
+        }
+        else
+        {
+            blendRows<kAnyExtent>(h0, h1, tap, 3 * g.dst.width, out);
+        }
+        emit(row, y);
+    }
+}
+
+} // namespace detail
+
+//!
+//! \brief Bilinearly resamples a BGR image into three planes of dstW x dstH floats (R, G, B) at dst.
+//!
+//! \param src    First pixel of the decoded interleaved BGR image.
+//! \param step   Bytes between the starts of consecutive source rows.
+//! \param padBGR Color written outside the image in ResizeMode::kLETTERBOX, before normalization.
+//!
+inline void resizeBGRToPlanarRGB(const uint8_t* src, size_t step, int srcW, int srcH, int dstW, int dstH,
+    float* dst, const PackParams& params, ResizeMode mode = ResizeMode::kSTRETCH,
+    const uint8_t padBGR[3] = nullptr, PackRowFn fn = packRow())
+{
+    const size_t plane = static_cast<size_t>(dstW) * dstH;
+    detail::resampleBGRRows<kAnyExtent, kAnyExtent>(
+        src, step, srcW, srcH, dstW, dstH, mode, padBGR, [&](const uint8_t* row, int y) {
+            const size_t offset = static_cast<size_t>(y) * dstW;
+            fn(row, dstW, dst + offset, dst + plane + offset, dst + 2 * plane + offset, params);
+        });
+}
+
+//!
+//! \brief As resizeBGRToPlanarRGB, but the normalized values are stored as IEEE half.
+//!
+inline void resizeBGRToPlanarRGBHalf(const uint8_t* src, size_t step, int srcW, int srcH, int dstW, int dstH,
+    uint16_t* dst, const PackParams& params, ResizeMode mode = ResizeMode::kSTRETCH,
+    const uint8_t padBGR[3] = nullptr, PackRowHalfFn fn = packRowHalf())
+{
+    const size_t plane = static_cast<size_t>(dstW) * dstH;
+    detail::resampleBGRRows<kAnyExtent, kAnyExtent>(
+        src, step, srcW, srcH, dstW, dstH, mode, padBGR, [&](const uint8_t* row, int y) {
+            const size_t offset = static_cast<size_t>(y) * dstW;
+            fn(row, dstW, dst + offset, dst + plane + offset, dst + 2 * plane + offset, params);
+        });
+}
+
+//!
+//! \brief As resizeBGRToPlanarRGB, but the planes keep the resampled 8-bit values and
+//!        normalization is left to whoever consumes them (e.g. the device).
+//!
+inline void resizeBGRToPlanarRGB8(const uint8_t* src, size_t step, int srcW, int srcH, int dstW, int dstH,
+    uint8_t* dst, ResizeMode mode = ResizeMode::kSTRETCH, const uint8_t padBGR[3] = nullptr,
+    PackRowU8Fn fn = packRowU8())
+{
+    const size_t plane = static_cast<size_t>(dstW) * dstH;
+    detail::resampleBGRRows<kAnyExtent, kAnyExtent>(
+        src, step, srcW, srcH, dstW, dstH, mode, padBGR, [&](const uint8_t* row, int y) {
+            const size_t offset = static_cast<size_t>(y) * dstW;
+            fn(row, dstW, dst + offset, dst + plane + offset, dst + 2 * plane + offset);
+        });
+}
+
+} // namespace mine
+
+#endif // SAMPLE_MINE_IMAGE_RESIZE_H
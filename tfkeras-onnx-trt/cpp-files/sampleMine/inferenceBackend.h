@@ -0,0 +1,164 @@
+#ifndef SAMPLE_MINE_INFERENCE_BACKEND_H
+#define SAMPLE_MINE_INFERENCE_BACKEND_H
+
+#include "softmax.h"
+#include "tensorShard.h"
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace mine
+{
+
+//!
+//! \brief An image in memory owned by someone else, e.g. a shared memory ring slot.
+//!
+struct ImageView
+{
+    const uint8_t* data{nullptr};
+    size_t size{0};
+    int width{0}; //!< 0: data is an encoded image; otherwise BGR pixels, width x height, rows packed
+    int height{0};
+};
+
+//!
+//! \brief Content key a result cache took of a request when it was submitted, so the batch the
+//!        request joins need not hash it again. size is 0 while no key was taken.
+//!
+struct CacheTag
+{
+    uint64_t hash{0};
+    uint64_t size{0};
+};
+
+//!
+//! \brief One image to classify: a preprocessed tensor, an image in memory, or a file to read
+//!        it from.
+//!
+struct ImageRequest
+{
+    std::string name;           //!< Reported back with the result
+    std::string path;           //!< Read when bytes and view are empty
+    std::vector<uint8_t> bytes; //!< Encoded image (JPEG, PNG, ...)
+    ShardTensor tensor;         //!< Already preprocessed; when set, bytes and path are not decoded
+    ImageView view;             //!< Borrowed instead of bytes; must stay valid until the result is in
+    CacheTag cacheTag;          //!< Set by CachingBackend::answerNow()
+};
+
+//!
+//! \brief Class probabilities for one image.
+//!
+struct Prediction
+{
+    std::vector<float> probabilities;
+    TopK top;     //!< Most likely classes, filled by backends that run the full post-processing
+    bool ok{true}; //!< Unset when this image alone failed, e.g. it could not be decoded
+};
+
+//!
+//! \brief Something that classifies a batch of up to maxBatchSize() images at once.
+//!
+class InferenceBackend
+{
+public:
+    //! Receives the outcome of one batch; predictions[i] belongs to request i.
+    typedef std::function<void(bool ok, std::vector<Prediction>& predictions)> BatchCallback;
+
+    virtual ~InferenceBackend() = default;
+
+    virtual int maxBatchSize() const = 0;
+
+    //!
+    //! \brief Classifies requests; predictions[i] receives the result for requests[i].
+    //!        Returning false fails every request of the batch; a request that fails on its own
+    //!        gets a prediction with ok unset instead.
+    //!
+    virtual bool infer(const std::vector<const ImageRequest*>& requests, std::vector<Prediction>& predictions) = 0;
+
+    //!
+    //! \brief Answers request on the spot if that needs no batch, as a cache hit does. Called by
+    //!        BatchScheduler on the submitting thread before request is queued; may also prepare
+    //!        request for the batch it joins otherwise. The default answers nothing.
+    //!
+    virtual bool answerNow(ImageRequest& /*request*/, Prediction& /*prediction*/)
+    {
+        return false;
+    }
+
+    //!
+    //! \brief Starts a batch and calls done once it finished; requests must stay valid until then.
+    //!
+    //! The default runs infer() on the calling thread. Pipelined backends return as soon as the
+    //! batch is queued, so the caller can assemble the next one meanwhile.
+    //!
+    virtual void inferAsync(const std::vector<const ImageRequest*>& requests, BatchCallback done)
+    {
+        std::vector<Prediction> predictions;
+        const bool ok = infer(requests, predictions);
+        done(ok, predictions);
+    }
+};
+
+//!
+//! \brief Stand-in for the TensorRT engine so batching can be exercised without a GPU.
+//!
+//! A batch of n images takes batchLatency + n * imageLatency and every image gets the same
+//! uniform prediction. Images are not decoded.
+//!
+class FakeBackend : public InferenceBackend
+{
+public:
+    FakeBackend(int maxBatchSize, int numClasses, std::chrono::microseconds batchLatency,
+        std::chrono::microseconds imageLatency = std::chrono::microseconds(0))
+        : mMaxBatchSize(maxBatchSize)
+        , mNumClasses(numClasses)
+        , mBatchLatency(batchLatency)
+        , mImageLatency(imageLatency)
+        , mBatchSizeHistogram(maxBatchSize + 1, 0)
+    {
+    }
+
+    int maxBatchSize() const override
+    {
+        return mMaxBatchSize;
+    }
+
+    bool infer(const std::vector<const ImageRequest*>& requests, std::vector<Prediction>& predictions) override
+    {
+        const int n = static_cast<int>(requests.size());
+        if (n > mMaxBatchSize)
+        {
+            return false;
+        }
+        std::this_thread::sleep_for(mBatchLatency + n * mImageLatency);
+        Prediction uniform;
+        uniform.probabilities.assign(mNumClasses, 1.0f / mNumClasses);
+        uniform.top = topK(uniform.probabilities.data(), mNumClasses, 1);
+        predictions.assign(n, uniform);
+        ++mBatchSizeHistogram[n];
+        return true;
+    }
+
+    //!
+    //! \brief Number of batches run per batch size, indexed by size.
+    //!
+    const std::vector<uint64_t>& batchSizeHistogram() const
+    {
+        return mBatchSizeHistogram;
+    }
+
+private:
+    int mMaxBatchSize;
+    int mNumClasses;
+    std::chrono::microseconds mBatchLatency;
+    std::chrono::microseconds mImageLatency;
+    std::vector<uint64_t> mBatchSizeHistogram;
+};
+
+} // namespace mine
+
+#endif // SAMPLE_MINE_INFERENCE_BACKEND_H
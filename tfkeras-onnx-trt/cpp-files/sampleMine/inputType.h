@@ -0,0 +1,57 @@
+#ifndef SAMPLE_MINE_INPUT_TYPE_H
+#define SAMPLE_MINE_INPUT_TYPE_H
+
+//
+// Element type of the host input buffer, i.e. what preprocessing writes and
+// what is copied to the device per input value. Narrower host types are widened
+// (and for uint8 normalized) on the device, unless the engine input binding is
+// itself half, in which case half is copied straight into it.
+//
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace mine
+{
+
+enum class InputType : int
+{
+    kFLOAT = 0, //!< Normalized float, what the engine takes
+    kUINT8 = 1, //!< Resized 8-bit pixels, normalized on the device
+    kHALF = 2   //!< Normalized IEEE half, packed on the host
+};
+
+inline const char* inputTypeName(InputType type)
+{
+    return type == InputType::kUINT8 ? "uint8" : type == InputType::kHALF ? "half" : "float";
+}
+
+inline bool parseInputType(const std::string& name, InputType& type)
+{
+    if (name == "float")
+    {
+        type = InputType::kFLOAT;
+        return true;
+    }
+    if (name == "uint8")
+    {
+        type = InputType::kUINT8;
+        return true;
+    }
+    if (name == "half" || name == "fp16")
+    {
+        type = InputType::kHALF;
+        return true;
+    }
+    return false;
+}
+
+inline size_t inputElementSize(InputType type)
+{
+    return type == InputType::kUINT8 ? sizeof(uint8_t) : type == InputType::kHALF ? sizeof(uint16_t) : sizeof(float);
+}
+
+} // namespace mine
+
+#endif // SAMPLE_MINE_INPUT_TYPE_H
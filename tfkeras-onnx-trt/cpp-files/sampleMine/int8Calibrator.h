@@ -0,0 +1,123 @@
+#ifndef SAMPLE_MINE_INT8_CALIBRATOR_H
+#define SAMPLE_MINE_INT8_CALIBRATOR_H
+
+//
+// Entropy calibrator for building INT8 engines of an explicit-batch network:
+// batches come from any IBatchStream (an ImageBatchStream for sample_mine) and
+// the result is kept in a CalibrationCache, so a rebuild with the same images
+// and preprocessing skips calibration entirely.
+//
+
+#include "BatchStream.h"
+#include "calibrationCache.h"
+#include "common.h"
+
+#include "NvInfer.h"
+#include <cuda_runtime_api.h>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace mine
+{
+
+class Int8ImageCalibrator : public nvinfer1::IInt8EntropyCalibrator2
+{
+public:
+    //!
+    //! \brief stream and cache must outlive the calibrator. stream.getDims() is the whole network
+    //!        input, batch included.
+    //!
+    Int8ImageCalibrator(IBatchStream& stream, CalibrationCache& cache, const std::string& inputName)
+        : mStream(stream)
+        , mCache(cache)
+        , mInputName(inputName)
+        , mInputCount(samplesCommon::volume(stream.getDims()))
+    {
+        if (cudaMalloc(&mDeviceInput, mInputCount * sizeof(float)) != cudaSuccess)
+        {
+            mDeviceInput = nullptr;
+        }
+        mStream.reset(0);
+    }
+
+    ~Int8ImageCalibrator()
+    {
+        if (mDeviceInput)
+        {
+            cudaFree(mDeviceInput);
+        }
+    }
+
+    Int8ImageCalibrator(const Int8ImageCalibrator&) = delete;
+    Int8ImageCalibrator& operator=(const Int8ImageCalibrator&) = delete;
+
+    bool valid() const
+    {
+        return mDeviceInput != nullptr;
+    }
+
+    //!
+    //! \brief True once TensorRT took the scales from the cache instead of calibrating.
+    //!
+    bool cacheUsed() const
+    {
+        return mCacheUsed;
+    }
+
+    //!
+    //! \brief Always 1: with an explicit batch dimension the batch is part of the input dims.
+    //!
+    int getBatchSize() const override
+    {
+        return 1;
+    }
+
+    bool getBatch(void* bindings[], const char* names[], int nbBindings) override
+    {
+        if (!mDeviceInput || nbBindings != 1 || mInputName != names[0] || !mStream.next())
+        {
+            return false;
+        }
+        if (cudaMemcpy(mDeviceInput, mStream.getBatch(), mInputCount * sizeof(float), cudaMemcpyHostToDevice)
+            != cudaSuccess)
+        {
+            return false;
+        }
+        bindings[0] = mDeviceInput;
+        return true;
+    }
+
+    const void* readCalibrationCache(size_t& length) override
+    {
+        mCacheUsed = mCache.read(mCacheData);
+        if (!mCacheUsed)
+        {
+            gLogInfo << mCache.error() << ", calibrating" << std::endl;
+        }
+        length = mCacheData.size();
+        return length ? mCacheData.data() : nullptr;
+    }
+
+    void writeCalibrationCache(const void* cache, size_t length) override
+    {
+        if (!mCache.write(cache, length))
+        {
+            gLogError << mCache.error() << std::endl;
+        }
+    }
+
+private:
+    IBatchStream& mStream;
+    CalibrationCache& mCache;
+    std::string mInputName;
+    size_t mInputCount;
+    void* mDeviceInput{nullptr};
+    std::vector<char> mCacheData;
+    bool mCacheUsed{false};
+};
+
+} // namespace mine
+
+#endif // SAMPLE_MINE_INT8_CALIBRATOR_H
@@ -0,0 +1,500 @@
+#ifndef SAMPLE_MINE_JPEG_DECODE_H
+#define SAMPLE_MINE_JPEG_DECODE_H
+
+//
+// Reduced-scale JPEG decoding with libjpeg-turbo.
+//
+// A JPEG can be decoded at 1/2, 1/4 or 1/8 of its size directly in the DCT
+// domain, which skips most of the IDCT and color conversion work. The smallest
+// scale that still covers the model input is chosen, so a 12 MP photo headed
+// for a 299x299 tensor is decoded at roughly 500x375 instead of 4000x3000.
+// Anything libjpeg cannot handle falls back to cv::imdecode.
+//
+// A JPEG whose header declares more than kMaxJpegPixels is refused before any
+// pixel memory is allocated, so a small crafted file cannot make a worker map
+// gigabytes. Other formats are held to OpenCV's own limit.
+//
+// Each thread keeps one decompressor, whose memory comes from an arena of its
+// own: past the first images, decoding a JPEG makes no heap allocation.
+//
+
+#include "hostArena.h"
+#include "imageResize.h"
+
+#include "opencv2/highgui.hpp"
+
+#include <csetjmp>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <jpeglib.h>
+#include <jerror.h>
+
+namespace mine
+{
+
+//!
+//! \brief Most pixels a JPEG may declare, 64 Mpx: room for any camera, and at most 192 MiB of BGR
+//!        even at full size.
+//!
+const uint64_t kMaxJpegPixels = 1ull << 26;
+
+//!
+//! \brief Reads a whole file into memory.
+//!
+inline bool readFileBytes(const std::string& path, std::vector<uint8_t>& bytes)
+{
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file)
+    {
+        return false;
+    }
+    const std::streamoff size = file.tellg();
+    bytes.resize(static_cast<size_t>(size));
+    file.seekg(0, std::ios::beg);
+    return size == 0 || static_cast<bool>(file.read(reinterpret_cast<char*>(bytes.data()), size));
+}
+
+inline bool isJpeg(const uint8_t* data, size_t size)
+{
+    return size > 3 && data[0] == 0xFF && data[1] == 0xD8 && data[2] == 0xFF;
+}
+
+//!
+//! \brief Largest DCT scale denominator (8, 4, 2 or 1, at most maxDenom) for which a srcW x srcH
+//!        image still covers the part of the dstW x dstH input it is resampled into.
+//!
+inline int chooseJpegScaleDenom(int srcW, int srcH, int dstW, int dstH, ResizeMode mode, int maxDenom = 8)
+{
+    const int denoms[] = {8, 4, 2};
+    for (int denom : denoms)
+    {
+        if (denom > maxDenom)
+        {
+            continue;
+        }
+        // libjpeg rounds scaled dimensions up
+        const int w = (srcW + denom - 1) / denom;
+        const int h = (srcH + denom - 1) / denom;
+        const ResizeGeometry g = computeResizeGeometry(w, h, dstW, dstH, mode);
+        if (g.src.width >= g.dst.width && g.src.height >= g.dst.height)
+        {
+            return denom;
+        }
+    }
+    return 1;
+}
+
+namespace detail
+{
+
+struct JpegErrorManager
+{
+    jpeg_error_mgr pub;
+    jmp_buf jump;
+    char message[JMSG_LENGTH_MAX];
+};
+
+inline void jpegErrorExit(j_common_ptr cinfo)
+{
+    JpegErrorManager* err = reinterpret_cast<JpegErrorManager*>(cinfo->err);
+    (*cinfo->err->format_message)(cinfo, err->message);
+    longjmp(err->jump, 1);
+}
+
+inline void jpegSilentMessage(j_common_ptr, int) {}
+
+//!
+//! \brief A virtual array, which libjpeg uses for the coefficients of progressive JPEGs; held
+//!        whole in memory, as libjpeg's own jmemnobs manager holds them.
+//!
+struct JpegVirtualArray
+{
+    JDIMENSION width; //!< Samples or blocks per row
+    JDIMENSION rows;
+    bool blocks;
+    bool preZero;
+    JSAMPARRAY sampleRows;
+    JBLOCKARRAY blockRows;
+    JpegVirtualArray* next;
+};
+
+//!
+//! \brief libjpeg memory manager over an Arena. JPOOL_IMAGE memory is bump allocated and rewound
+//!        when libjpeg frees that pool after every image, so a warm decompressor allocates
+//!        nothing. The few JPOOL_PERMANENT objects (source manager, Huffman and quantization
+//!        tables) come from the heap once and live as long as the decompressor.
+//!
+struct JpegArenaMemory
+{
+    jpeg_memory_mgr pub;                         //!< First, so cinfo->mem converts back
+    jpeg_memory_mgr* original{nullptr};          //!< libjpeg's, owning what jpeg_create_decompress allocated
+    Arena image{Arena::kHugePageBytes, Arena::kDefaultSlabBytes};
+    void* permanent{nullptr};                    //!< Heap blocks, each starting with the next one's address
+    JpegVirtualArray* virtualArrays{nullptr};    //!< Requested in the current image
+
+    static JpegArenaMemory& of(j_common_ptr cinfo)
+    {
+        return *reinterpret_cast<JpegArenaMemory*>(cinfo->mem);
+    }
+
+    //!
+    //! \brief Takes over cinfo's allocations from libjpeg's manager, right after jpeg_create_*.
+    //!
+    void install(j_common_ptr cinfo)
+    {
+        original = cinfo->mem;
+        pub = *original;
+        pub.alloc_small = allocate;
+        pub.alloc_large = allocate;
+        pub.alloc_sarray = allocSamples;
+        pub.alloc_barray = allocBlocks;
+        pub.request_virt_sarray = requestSamples;
+        pub.request_virt_barray = requestBlocks;
+        pub.realize_virt_arrays = realize;
+        pub.access_virt_sarray = accessSamples;
+        pub.access_virt_barray = accessBlocks;
+        pub.free_pool = freePool;
+        pub.self_destruct = selfDestruct;
+        cinfo->mem = &pub;
+    }
+
+    //!
+    //! \brief Raises JERR_OUT_OF_MEMORY through the error manager rather than throwing across
+    //!        libjpeg's C frames.
+    //!
+    static void* allocate(j_common_ptr cinfo, int pool, size_t bytes)
+    {
+        JpegArenaMemory& memory = of(cinfo);
+        void* block = nullptr;
+        if (pool == JPOOL_IMAGE)
+        {
+            try
+            {
+                block = memory.image.allocate(bytes);
+            }
+            catch (const std::bad_alloc&)
+            {
+            }
+        }
+        else
+        {
+            void* heap = nullptr;
+            if (posix_memalign(&heap, 64, bytes + 64) == 0)
+            {
+                *static_cast<void**>(heap) = memory.permanent;
+                memory.permanent = heap;
+                block = static_cast<uint8_t*>(heap) + 64;
+            }
+        }
+        if (!block)
+        {
+            ERREXIT1(cinfo, JERR_OUT_OF_MEMORY, 0);
+        }
+        return block;
+    }
+
+    //!
+    //! \brief Rows padded to 64 bytes and 64-byte aligned, as libjpeg-turbo's SIMD code expects.
+    //!
+    static JSAMPARRAY allocSamples(j_common_ptr cinfo, int pool, JDIMENSION width, JDIMENSION rows)
+    {
+        const size_t rowBytes = sampleBytes(width, 1);
+        JSAMPARRAY array = static_cast<JSAMPARRAY>(allocate(cinfo, pool, rows * sizeof(JSAMPROW)));
+        uint8_t* data = static_cast<uint8_t*>(allocate(cinfo, pool, sampleBytes(width, rows)));
+        for (JDIMENSION r = 0; r < rows; ++r)
+        {
+            array[r] = reinterpret_cast<JSAMPROW>(data + r * rowBytes);
+        }
+        return array;
+    }
+
+    static size_t sampleBytes(JDIMENSION width, JDIMENSION rows)
+    {
+        return rows * ((width * sizeof(JSAMPLE) + 63) / 64 * 64);
+    }
+
+    static size_t blockBytes(JDIMENSION width, JDIMENSION rows)
+    {
+        return static_cast<size_t>(rows) * width * sizeof(JBLOCK);
+    }
+
+    static JBLOCKARRAY allocBlocks(j_common_ptr cinfo, int pool, JDIMENSION width, JDIMENSION rows)
+    {
+        JBLOCKARRAY array = static_cast<JBLOCKARRAY>(allocate(cinfo, pool, rows * sizeof(JBLOCKROW)));
+        JBLOCKROW data = static_cast<JBLOCKROW>(allocate(cinfo, pool, blockBytes(width, rows)));
+        for (JDIMENSION r = 0; r < rows; ++r)
+        {
+            array[r] = data + static_cast<size_t>(r) * width;
+        }
+        return array;
+    }
+
+    static JpegVirtualArray* request(j_common_ptr cinfo, int pool, bool blocks, boolean preZero, JDIMENSION width,
+        JDIMENSION rows)
+    {
+        if (pool != JPOOL_IMAGE)
+        {
+            ERREXIT1(cinfo, JERR_BAD_POOL_ID, pool);
+        }
+        JpegArenaMemory& memory = of(cinfo);
+        JpegVirtualArray* array = static_cast<JpegVirtualArray*>(allocate(cinfo, pool, sizeof(JpegVirtualArray)));
+        *array = JpegVirtualArray{width, rows, blocks, preZero != FALSE, nullptr, nullptr, memory.virtualArrays};
+        memory.virtualArrays = array;
+        return array;
+    }
+
+    static jvirt_sarray_ptr requestSamples(j_common_ptr cinfo, int pool, boolean preZero, JDIMENSION width,
+        JDIMENSION rows, JDIMENSION)
+    {
+        return reinterpret_cast<jvirt_sarray_ptr>(request(cinfo, pool, false, preZero, width, rows));
+    }
+
+    static jvirt_barray_ptr requestBlocks(j_common_ptr cinfo, int pool, boolean preZero, JDIMENSION width,
+        JDIMENSION rows, JDIMENSION)
+    {
+        return reinterpret_cast<jvirt_barray_ptr>(request(cinfo, pool, true, preZero, width, rows));
+    }
+
+    static void realize(j_common_ptr cinfo)
+    {
+        for (JpegVirtualArray* array = of(cinfo).virtualArrays; array; array = array->next)
+        {
+            if (array->sampleRows || array->blockRows)
+            {
+                continue;
+            }
+            if (array->blocks)
+            {
+                array->blockRows = allocBlocks(cinfo, JPOOL_IMAGE, array->width, array->rows);
+            }
+            else
+            {
+                array->sampleRows = allocSamples(cinfo, JPOOL_IMAGE, array->width, array->rows);
+            }
+            if (array->preZero && array->rows > 0)
+            {
+                // Each kind is one contiguous block after its row pointers
+                if (array->blocks)
+                {
+                    std::memset(array->blockRows[0], 0, blockBytes(array->width, array->rows));
+                }
+                else
+                {
+                    std::memset(array->sampleRows[0], 0, sampleBytes(array->width, array->rows));
+                }
+            }
+        }
+    }
+
+    static JpegVirtualArray* access(j_common_ptr cinfo, void* handle, JDIMENSION start, JDIMENSION rows)
+    {
+        JpegVirtualArray* array = static_cast<JpegVirtualArray*>(handle);
+        if (start + rows > array->rows || (!array->sampleRows && !array->blockRows))
+        {
+            ERREXIT(cinfo, JERR_BAD_VIRTUAL_ACCESS);
+        }
+        return array;
+    }
+
+    static JSAMPARRAY accessSamples(j_common_ptr cinfo, jvirt_sarray_ptr handle, JDIMENSION start,
+        JDIMENSION rows, boolean)
+    {
+        return access(cinfo, handle, start, rows)->sampleRows + start;
+    }
+
+    static JBLOCKARRAY accessBlocks(j_common_ptr cinfo, jvirt_barray_ptr handle, JDIMENSION start,
+        JDIMENSION rows, boolean)
+    {
+        return access(cinfo, handle, start, rows)->blockRows + start;
+    }
+
+    static void freePool(j_common_ptr cinfo, int pool)
+    {
+        JpegArenaMemory& memory = of(cinfo);
+        if (pool == JPOOL_IMAGE)
+        {
+            memory.virtualArrays = nullptr;
+            memory.image.rewind(Arena::Mark{0, 0});
+            return;
+        }
+        while (memory.permanent)
+        {
+            void* next = *static_cast<void**>(memory.permanent);
+            std::free(memory.permanent);
+            memory.permanent = next;
+        }
+    }
+
+    //!
+    //! \brief jpeg_destroy_*: frees ours, then hands back to libjpeg's manager to free its own.
+    //!
+    static void selfDestruct(j_common_ptr cinfo)
+    {
+        JpegArenaMemory& memory = of(cinfo);
+        freePool(cinfo, JPOOL_IMAGE);
+        freePool(cinfo, JPOOL_PERMANENT);
+        cinfo->mem = memory.original;
+        (*cinfo->mem->self_destruct)(cinfo);
+    }
+};
+
+//!
+//! \brief The decompressor of the calling thread, created at its first JPEG and reused for every
+//!        later one: jpeg_abort_decompress() after an image keeps its source manager, tables and
+//!        memory, so a warm thread decodes without touching the heap.
+//!
+class JpegDecoder
+{
+public:
+    JpegDecoder()
+    {
+        cinfo.err = jpeg_std_error(&err.pub);
+        err.pub.error_exit = jpegErrorExit;
+        err.pub.emit_message = jpegSilentMessage;
+        if (setjmp(err.jump))
+        {
+            jpeg_destroy_decompress(&cinfo);
+            return;
+        }
+        jpeg_create_decompress(&cinfo);
+        memory.install(reinterpret_cast<j_common_ptr>(&cinfo));
+        mReady = true;
+    }
+
+    ~JpegDecoder()
+    {
+        if (mReady)
+        {
+            jpeg_destroy_decompress(&cinfo);
+        }
+    }
+
+    JpegDecoder(const JpegDecoder&) = delete;
+    JpegDecoder& operator=(const JpegDecoder&) = delete;
+
+    //!
+    //! \brief False if the decompressor could not be created.
+    //!
+    bool ready() const
+    {
+        return mReady;
+    }
+
+    jpeg_decompress_struct cinfo;
+    JpegErrorManager err;
+    JpegArenaMemory memory;
+
+private:
+    bool mReady{false};
+};
+
+inline JpegDecoder& threadJpegDecoder()
+{
+    static thread_local JpegDecoder decoder;
+    return decoder;
+}
+
+//!
+//! \brief The libjpeg part of decodeJpegScaled, on the thread's decompressor. Keeps only trivially
+//!        destructible locals because errors longjmp back into it. Sets tooLarge, and fails, for an
+//!        image of more than maxPixels.
+//!
+inline bool decodeJpegRaw(const uint8_t* data, size_t size, int dstW, int dstH, ResizeMode mode, int maxDenom,
+    uint64_t maxPixels, cv::Mat& bgr, int& denom, bool& tooLarge, std::string& error)
+{
+    JpegDecoder& decoder = threadJpegDecoder();
+    if (!decoder.ready())
+    {
+        error = "cannot create a JPEG decompressor";
+        return false;
+    }
+    jpeg_decompress_struct& cinfo = decoder.cinfo;
+    decoder.err.message[0] = '\0';
+    if (setjmp(decoder.err.jump))
+    {
+        // Back to where jpeg_create_decompress left it, ready for the next image
+        jpeg_abort_decompress(&cinfo);
+        error = decoder.err.message;
+        return false;
+    }
+
+    jpeg_mem_src(&cinfo, const_cast<unsigned char*>(data), static_cast<unsigned long>(size));
+    jpeg_read_header(&cinfo, TRUE);
+    tooLarge = static_cast<uint64_t>(cinfo.image_width) * cinfo.image_height > maxPixels;
+    if (tooLarge)
+    {
+        error = "image of " + std::to_string(cinfo.image_width) + "x" + std::to_string(cinfo.image_height)
+            + " exceeds " + std::to_string(maxPixels) + " pixels";
+        jpeg_abort_decompress(&cinfo);
+        return false;
+    }
+
+    denom = chooseJpegScaleDenom(cinfo.image_width, cinfo.image_height, dstW, dstH, mode, maxDenom);
+    cinfo.scale_num = 1;
+    cinfo.scale_denom = denom;
+    cinfo.out_color_space = JCS_EXT_BGR; // straight into cv::Mat channel order
+    jpeg_start_decompress(&cinfo);
+
+    try
+    {
+        bgr.create(cinfo.output_height, cinfo.output_width, CV_8UC3);
+    }
+    catch (const std::exception&)
+    {
+        // Out of memory: fail this image, and leave the decompressor ready for the next
+        error = "cannot allocate the decoded image";
+        jpeg_abort_decompress(&cinfo);
+        return false;
+    }
+    while (cinfo.output_scanline < cinfo.output_height)
+    {
+        JSAMPROW row = bgr.ptr<uint8_t>(cinfo.output_scanline);
+        jpeg_read_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_decompress(&cinfo); // Frees the image pool, like jpeg_abort_decompress()
+    return true;
+}
+
+} // namespace detail
+
+//!
+//! \brief Decodes an in-memory image to 8-bit BGR, as small as a dstW x dstH input allows.
+//!
+//! JPEGs are decoded at a reduced DCT scale when possible; other formats and JPEGs libjpeg
+//! rejects go through cv::imdecode at full size. A JPEG of more than maxPixels fails outright.
+//!
+//! \param denom    Receives the scale denominator used (1 for full size).
+//! \param maxDenom Largest scale denominator allowed; 1 always decodes at full size.
+//!
+inline bool decodeImageScaled(const uint8_t* data, size_t size, int dstW, int dstH, ResizeMode mode, cv::Mat& bgr,
+    int& denom, int maxDenom = 8, uint64_t maxPixels = kMaxJpegPixels)
+{
+    denom = 1;
+    bool tooLarge = false;
+    std::string error;
+    if (isJpeg(data, size)
+        && detail::decodeJpegRaw(data, size, dstW, dstH, mode, maxDenom, maxPixels, bgr, denom, tooLarge, error))
+    {
+        return true;
+    }
+    if (tooLarge)
+    {
+        return false; // cv::imdecode would decode it at full size
+    }
+    denom = 1;
+    const cv::Mat encoded(1, static_cast<int>(size), CV_8UC1, const_cast<uint8_t*>(data));
+    bgr = cv::imdecode(encoded, cv::IMREAD_COLOR);
+    return !bgr.empty();
+}
+
+} // namespace mine
+
+#endif // SAMPLE_MINE_JPEG_DECODE_H
@@ -0,0 +1,265 @@
+#ifndef SAMPLE_MINE_LAYOUT_CONVERT_H
+#define SAMPLE_MINE_LAYOUT_CONVERT_H
+
+//
+// NCHW <-> NHWC conversion of one image, and writes of an image into its batch
+// slot of a tensor in either layout. Only the order of the values changes, so the
+// kernels move elements of 1, 2 or 4 bytes (uint8, half, float) without looking at
+// them. Three channels go through SSE4.1 byte shuffles, 48 bytes at a time. Other
+// channel counts use a plain loop.
+//
+
+#include "imagePacking.h"
+#include "tensorDesc.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace mine
+{
+
+namespace detail
+{
+
+template <typename T>
+inline void planarToInterleavedScalar(const T* src, int channels, size_t plane, size_t begin, T* dst)
+{
+    for (size_t i = begin; i < plane; ++i)
+    {
+        for (int c = 0; c < channels; ++c)
+        {
+            dst[i * channels + c] = src[c * plane + i];
+        }
+    }
+}
+
+template <typename T>
+inline void interleavedToPlanarScalar(const T* src, int channels, size_t plane, size_t begin, T* dst)
+{
+    for (size_t i = begin; i < plane; ++i)
+    {
+        for (int c = 0; c < channels; ++c)
+        {
+            dst[c * plane + i] = src[i * channels + c];
+        }
+    }
+}
+
+#ifdef SAMPLE_MINE_X86
+
+//!
+//! \brief pshufb masks between three registers of interleaved 3-channel elements (48 bytes, 16
+//!        bytes per element size's worth of pixels) and one register per channel.
+//!
+struct ShuffleMasks3
+{
+    alignas(16) int8_t split[3][3][16]; //!< [channel][interleaved register]
+    alignas(16) int8_t merge[3][3][16]; //!< [interleaved register][channel]
+
+    explicit ShuffleMasks3(int elementBytes)
+    {
+        for (int r = 0; r < 3; ++r)
+        {
+            for (int c = 0; c < 3; ++c)
+            {
+                for (int j = 0; j < 16; ++j)
+                {
+                    // Byte j of channel c's register comes from interleaved byte s
+                    const int s = (3 * (j / elementBytes) + c) * elementBytes + j % elementBytes;
+                    split[c][r][j] = static_cast<int8_t>(s / 16 == r ? s % 16 : -1);
+                    // Interleaved byte 16r + j comes from byte p of the register of its channel
+                    const int t = 16 * r + j;
+                    const int p = t / (3 * elementBytes) * elementBytes + t % elementBytes;
+                    merge[r][c][j] = static_cast<int8_t>(t / elementBytes % 3 == c ? p : -1);
+                }
+            }
+        }
+    }
+};
+
+template <int ElementBytes>
+inline const ShuffleMasks3& shuffleMasks3()
+{
+    static const ShuffleMasks3 masks(ElementBytes);
+    return masks;
+}
+
+template <typename T>
+__attribute__((target("sse4.1"))) inline void interleavedToPlanar3SSE41(const T* src, size_t plane, T* dst)
+{
+    const ShuffleMasks3& masks = shuffleMasks3<sizeof(T)>();
+    __m128i split[3][3];
+    for (int c = 0; c < 3; ++c)
+    {
+        for (int r = 0; r < 3; ++r)
+        {
+            split[c][r] = _mm_load_si128(reinterpret_cast<const __m128i*>(masks.split[c][r]));
+        }
+    }
+    const size_t step = 16 / sizeof(T);
+    const uint8_t* in = reinterpret_cast<const uint8_t*>(src);
+    size_t i = 0;
+    for (; i + step <= plane; i += step, in += 48)
+    {
+        const __m128i a0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+        const __m128i a1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 16));
+        const __m128i a2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 32));
+        for (int c = 0; c < 3; ++c)
+        {
+            const __m128i v = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a0, split[c][0]),
+                _mm_shuffle_epi8(a1, split[c][1])), _mm_shuffle_epi8(a2, split[c][2]));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + c * plane + i), v);
+        }
+    }
+    interleavedToPlanarScalar(src, 3, plane, i, dst);
+}
+
+template <typename T>
+__attribute__((target("sse4.1"))) inline void planarToInterleaved3SSE41(const T* src, size_t plane, T* dst)
+{
+    const ShuffleMasks3& masks = shuffleMasks3<sizeof(T)>();
+    __m128i merge[3][3];
+    for (int r = 0; r < 3; ++r)
+    {
+        for (int c = 0; c < 3; ++c)
+        {
+            merge[r][c] = _mm_load_si128(reinterpret_cast<const __m128i*>(masks.merge[r][c]));
+        }
+    }
+    const size_t step = 16 / sizeof(T);
+    uint8_t* out = reinterpret_cast<uint8_t*>(dst);
+    size_t i = 0;
+    for (; i + step <= plane; i += step, out += 48)
+    {
+        const __m128i p0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        const __m128i p1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + plane + i));
+        const __m128i p2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2 * plane + i));
+        for (int r = 0; r < 3; ++r)
+        {
+            const __m128i v = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(p0, merge[r][0]),
+                _mm_shuffle_epi8(p1, merge[r][1])), _mm_shuffle_epi8(p2, merge[r][2]));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 16 * r), v);
+        }
+    }
+    planarToInterleavedScalar(src, 3, plane, i, dst);
+}
+
+#endif // SAMPLE_MINE_X86
+
+inline bool layoutConvertSIMD()
+{
+    static const bool supported = simdLevelSupported(SimdLevel::kSSE41);
+    return supported;
+}
+
+template <typename T>
+inline void planarToInterleaved(const T* src, int channels, size_t plane, T* dst, bool simd)
+{
+#ifdef SAMPLE_MINE_X86
+    if (channels == 3 && simd)
+    {
+        planarToInterleaved3SSE41(src, plane, dst);
+        return;
+    }
+#endif
+    (void) simd;
+    planarToInterleavedScalar(src, channels, plane, 0, dst);
+}
+
+template <typename T>
+inline void interleavedToPlanar(const T* src, int channels, size_t plane, T* dst, bool simd)
+{
+#ifdef SAMPLE_MINE_X86
+    if (channels == 3 && simd)
+    {
+        interleavedToPlanar3SSE41(src, plane, dst);
+        return;
+    }
+#endif
+    (void) simd;
+    interleavedToPlanarScalar(src, channels, plane, 0, dst);
+}
+
+} // namespace detail
+
+//!
+//! \brief NCHW -> NHWC for one image of channels planes of plane elements, each elementSize
+//!        (1, 2 or 4) bytes. src and dst must not overlap. simd = false forces the plain loop.
+//!
+inline void planarToInterleaved(const void* src, int channels, size_t plane, size_t elementSize, void* dst,
+    bool simd = detail::layoutConvertSIMD())
+{
+    switch (elementSize)
+    {
+    case 1:
+        detail::planarToInterleaved(
+            static_cast<const uint8_t*>(src), channels, plane, static_cast<uint8_t*>(dst), simd);
+        break;
+    case 2:
+        detail::planarToInterleaved(
+            static_cast<const uint16_t*>(src), channels, plane, static_cast<uint16_t*>(dst), simd);
+        break;
+    default:
+        detail::planarToInterleaved(static_cast<const float*>(src), channels, plane, static_cast<float*>(dst), simd);
+        break;
+    }
+}
+
+//!
+//! \brief NHWC -> NCHW, the inverse of planarToInterleaved.
+//!
+inline void interleavedToPlanar(const void* src, int channels, size_t plane, size_t elementSize, void* dst,
+    bool simd = detail::layoutConvertSIMD())
+{
+    switch (elementSize)
+    {
+    case 1:
+        detail::interleavedToPlanar(
+            static_cast<const uint8_t*>(src), channels, plane, static_cast<uint8_t*>(dst), simd);
+        break;
+    case 2:
+        detail::interleavedToPlanar(
+            static_cast<const uint16_t*>(src), channels, plane, static_cast<uint16_t*>(dst), simd);
+        break;
+    default:
+        detail::interleavedToPlanar(static_cast<const float*>(src), channels, plane, static_cast<float*>(dst), simd);
+        break;
+    }
+}
+
+//!
+//! \brief Start of batch item index in a tensor of desc's shape whose elements are elementSize
+//!        bytes (the host element size, which may be narrower than desc.type).
+//!
+inline void* batchItem(void* tensor, const TensorDesc& desc, size_t elementSize, int index)
+{
+    return static_cast<uint8_t*>(tensor) + static_cast<size_t>(index) * desc.batchStride() * elementSize;
+}
+
+//!
+//! \brief Writes one image, laid out as layout, into batch item index of an image tensor of
+//!        desc's shape, converting it to desc.layout on the way.
+//!
+inline void writeImage(
+    const void* image, TensorLayout layout, const TensorDesc& desc, size_t elementSize, int index, void* tensor)
+{
+    void* const out = batchItem(tensor, desc, elementSize, index);
+    const size_t plane = static_cast<size_t>(desc.height()) * desc.width();
+    if (layout == desc.layout)
+    {
+        std::memcpy(out, image, desc.channels() * plane * elementSize);
+    }
+    else if (desc.layout == TensorLayout::kNHWC)
+    {
+        planarToInterleaved(image, desc.channels(), plane, elementSize, out);
+    }
+    else
+    {
+        interleavedToPlanar(image, desc.channels(), plane, elementSize, out);
+    }
+}
+
+} // namespace mine
+
+#endif // SAMPLE_MINE_LAYOUT_CONVERT_H
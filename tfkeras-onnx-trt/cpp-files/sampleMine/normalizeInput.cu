@@ -0,0 +1,80 @@
+#include "normalizeInput.h"
+
+#include <cuda_fp16.h>
+
+namespace mine
+{
+
+namespace
+{
+
+struct Affine
+{
+    float scale[3];
+    float bias[3];
+};
+
+__global__ void normalizeU8PlanesKernel(
+    const uint8_t* __restrict__ src, float* __restrict__ dst, size_t total, size_t plane, int channels, Affine affine)
+{
+    const size_t stride = static_cast<size_t>(blockDim.x) * gridDim.x;
+    for (size_t i = static_cast<size_t>(blockIdx.x) * blockDim.x + threadIdx.x; i < total; i += stride)
+    {
+        const int c = static_cast<int>((i / plane) % channels) % 3;
+        dst[i] = src[i] * affine.scale[c] + affine.bias[c];
+    }
+}
+
+__global__ void widenHalfKernel(const __half* __restrict__ src, float* __restrict__ dst, size_t count)
+{
+    const size_t stride = static_cast<size_t>(blockDim.x) * gridDim.x;
+    for (size_t i = static_cast<size_t>(blockIdx.x) * blockDim.x + threadIdx.x; i < count; i += stride)
+    {
+        dst[i] = __half2float(src[i]);
+    }
+}
+
+//!
+//! \brief Memory bound: enough blocks to fill the device, each thread striding over the rest.
+//!
+int gridBlocks(size_t total, int threads)
+{
+    const size_t needed = (total + threads - 1) / threads;
+    return static_cast<int>(needed < 4096 ? needed : 4096);
+}
+
+} // namespace
+
+cudaError_t normalizeU8Planes(const uint8_t* src, float* dst, int images, int channels, size_t plane,
+    const float scale[3], const float bias[3], cudaStream_t stream)
+{
+    const size_t total = static_cast<size_t>(images) * channels * plane;
+    if (total == 0)
+    {
+        return cudaSuccess;
+    }
+    Affine affine;
+    for (int c = 0; c < 3; ++c)
+    {
+        affine.scale[c] = scale[c];
+        affine.bias[c] = bias[c];
+    }
+    const int threads = 256;
+    normalizeU8PlanesKernel<<<gridBlocks(total, threads), threads, 0, stream>>>(
+        src, dst, total, plane, channels, affine);
+    return cudaGetLastError();
+}
+
+cudaError_t widenHalf(const uint16_t* src, float* dst, size_t count, cudaStream_t stream)
+{
+    if (count == 0)
+    {
+        return cudaSuccess;
+    }
+    const int threads = 256;
+    widenHalfKernel<<<gridBlocks(count, threads), threads, 0, stream>>>(
+        reinterpret_cast<const __half*>(src), dst, count);
+    return cudaGetLastError();
+}
+
+} // namespace mine
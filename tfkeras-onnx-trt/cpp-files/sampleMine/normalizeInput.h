@@ -0,0 +1,35 @@
+#ifndef SAMPLE_MINE_NORMALIZE_INPUT_H
+#define SAMPLE_MINE_NORMALIZE_INPUT_H
+
+//
+// Device-side input normalization for InputType::kUINT8: the host copies
+// resized 8-bit CHW planes, a quarter of the float bytes, and this kernel
+// widens them into the engine's float input binding on the slot's stream.
+// InputType::kHALF planes are already normalized and only need widening.
+//
+// Kept free of host SIMD headers so nvcc only ever sees plain C++.
+//
+
+#include <cuda_runtime_api.h>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace mine
+{
+
+//!
+//! \brief Queues dst[i] = src[i] * scale[c] + bias[c] on stream, over images CHW tensors of
+//!        channels planes of plane values each; c is the channel modulo 3.
+//!
+cudaError_t normalizeU8Planes(const uint8_t* src, float* dst, int images, int channels, size_t plane,
+    const float scale[3], const float bias[3], cudaStream_t stream);
+
+//!
+//! \brief Queues dst[i] = float(src[i]) on stream for count IEEE half values.
+//!
+cudaError_t widenHalf(const uint16_t* src, float* dst, size_t count, cudaStream_t stream);
+
+} // namespace mine
+
+#endif // SAMPLE_MINE_NORMALIZE_INPUT_H
@@ -0,0 +1,556 @@
+#ifndef SAMPLE_MINE_PACK_KERNELS_H
+#define SAMPLE_MINE_PACK_KERNELS_H
+
+//
+// Resize-and-pack kernels compiled for the input shape of the model. The engine's C, H
+// and W are only known at run time, so the generic path leaves every row loop with a
+// variable trip count. PackKernel is a template on channels, height, width, layout and
+// element type. Instantiated for a fixed shape (3x299x299, 3x224x224), it gives the
+// resampler and the row packing kernels constant trip counts, and on AVX2 CPUs the whole
+// resampler is compiled for AVX2 as well, which only pays for the few shapes of the table.
+// The same template with kAnyExtent is the generic fallback, built for the baseline
+// instruction set. selectPackKernel picks one from the table, once per engine. Every
+// kernel comes in two forms: normalizing with PackParams arithmetic, or through the
+// lookup tables of packTables.h, which the compiled preprocessing uses.
+//
+
+#include "halfFloat.h"
+#include "imagePacking.h"
+#include "imageResize.h"
+#include "inputType.h"
+#include "packTables.h"
+#include "tensorDesc.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+namespace mine
+{
+
+//!
+//! \brief Shape and element type of one image in the input tensor.
+//!
+struct PackShape
+{
+    int channels, height, width;
+    TensorLayout layout;
+    InputType type;
+};
+
+//!
+//! \brief Resamples a BGR image of srcW x srcH into dst, laid out and typed as shape says.
+//!        padBGR is the letterbox border color, nullptr for black.
+//!
+typedef void (*ResizePackFn)(const uint8_t* src, size_t step, int srcW, int srcH, const PackShape& shape, void* dst,
+    const PackParams& params, ResizeMode mode, const uint8_t padBGR[3]);
+
+//!
+//! \brief As ResizePackFn, normalizing through tables, which also put R, G and B in their output
+//!        channels. uint8 values are only placed.
+//!
+typedef void (*ResizePackTableFn)(const uint8_t* src, size_t step, int srcW, int srcH, const PackShape& shape,
+    void* dst, const PackTables& tables, ResizeMode mode, const uint8_t padBGR[3]);
+
+namespace detail
+{
+
+//!
+//! \brief Element stored for each InputType, and how one 8-bit channel value becomes it.
+//!
+template <InputType Type>
+struct PackElement;
+
+template <>
+struct PackElement<InputType::kFLOAT>
+{
+    typedef float Value;
+    static float convert(uint8_t v, float scale, float bias)
+    {
+        return float(v) * scale + bias;
+    }
+    static float lookup(uint8_t v, const PackTables& tables, int c)
+    {
+        return tables.value[c][v];
+    }
+};
+
+template <>
+struct PackElement<InputType::kHALF>
+{
+    typedef uint16_t Value;
+    static uint16_t convert(uint8_t v, float scale, float bias)
+    {
+        return floatToHalf(float(v) * scale + bias);
+    }
+    static uint16_t lookup(uint8_t v, const PackTables& tables, int c)
+    {
+        return tables.half[c][v];
+    }
+};
+
+template <>
+struct PackElement<InputType::kUINT8>
+{
+    typedef uint8_t Value;
+    static uint8_t convert(uint8_t v, float, float)
+    {
+        return v;
+    }
+    static uint8_t lookup(uint8_t v, const PackTables&, int)
+    {
+        return v;
+    }
+};
+
+//!
+//! \brief The planar row kernels of imagePacking.h bound to rows of exactly Width pixels.
+//!
+//! Each wrapper carries the target of the kernel it calls, so the kernel is inlined with its
+//! width constant: the 16-pixel loop runs a fixed number of times and the scalar tail is
+//! unrolled, or gone when Width is a multiple of 16. For kAnyExtent the kernels of
+//! imagePacking.h are returned as they are.
+//!
+template <int Width>
+struct FixedWidthRows
+{
+    static void pack(const uint8_t* bgr, int, float* r, float* g, float* b, const PackParams& params)
+    {
+        packRowScalar(bgr, Width, r, g, b, params);
+    }
+
+    static void packU8(const uint8_t* bgr, int, uint8_t* r, uint8_t* g, uint8_t* b)
+    {
+        packRowU8Scalar(bgr, Width, r, g, b);
+    }
+
+    static void packHalf(const uint8_t* bgr, int, uint16_t* r, uint16_t* g, uint16_t* b, const PackParams& params)
+    {
+        packRowHalfScalar(bgr, Width, r, g, b, params);
+    }
+
+    static void packTable(const uint8_t* bgr, int, float* r, float* g, float* b, const PackTables& tables)
+    {
+        packRowTableScalar(bgr, Width, r, g, b, tables);
+    }
+
+    static void packHalfTable(
+        const uint8_t* bgr, int, uint16_t* r, uint16_t* g, uint16_t* b, const PackTables& tables)
+    {
+        packRowHalfTableScalar(bgr, Width, r, g, b, tables);
+    }
+
+#ifdef SAMPLE_MINE_X86
+    __attribute__((target("sse4.1"))) static void packSSE41(
+        const uint8_t* bgr, int, float* r, float* g, float* b, const PackParams& params)
+    {
+        packRowSSE41(bgr, Width, r, g, b, params);
+    }
+
+    __attribute__((target("avx2"))) static void packAVX2(
+        const uint8_t* bgr, int, float* r, float* g, float* b, const PackParams& params)
+    {
+        packRowAVX2(bgr, Width, r, g, b, params);
+    }
+
+    __attribute__((target("avx512f"))) static void packAVX512(
+        const uint8_t* bgr, int, float* r, float* g, float* b, const PackParams& params)
+    {
+        packRowAVX512(bgr, Width, r, g, b, params);
+    }
+
+    __attribute__((target("sse4.1"))) static void packU8SSE41(
+        const uint8_t* bgr, int, uint8_t* r, uint8_t* g, uint8_t* b)
+    {
+        packRowU8SSE41(bgr, Width, r, g, b);
+    }
+
+    __attribute__((target("avx2,f16c"))) static void packHalfF16C(
+        const uint8_t* bgr, int, uint16_t* r, uint16_t* g, uint16_t* b, const PackParams& params)
+    {
+        packRowHalfF16C(bgr, Width, r, g, b, params);
+    }
+
+    __attribute__((target("avx512f"))) static void packHalfAVX512(
+        const uint8_t* bgr, int, uint16_t* r, uint16_t* g, uint16_t* b, const PackParams& params)
+    {
+        packRowHalfAVX512(bgr, Width, r, g, b, params);
+    }
+
+    __attribute__((target("avx2"))) static void packTableAVX2(
+        const uint8_t* bgr, int, float* r, float* g, float* b, const PackTables& tables)
+    {
+        packRowTableAVX2(bgr, Width, r, g, b, tables);
+    }
+
+    __attribute__((target("avx2"))) static void packHalfTableAVX2(
+        const uint8_t* bgr, int, uint16_t* r, uint16_t* g, uint16_t* b, const PackTables& tables)
+    {
+        packRowHalfTableAVX2(bgr, Width, r, g, b, tables);
+    }
+#endif // SAMPLE_MINE_X86
+
+    //!
+    //! \brief Same choice per level as getPackRow, getPackRowU8 and getPackRowHalf; the pointer
+    //!        argument only selects the element type.
+    //!
+    static PackRowFn select(SimdLevel level, float*)
+    {
+        if (Width == kAnyExtent)
+        {
+            return getPackRow(level);
+        }
+#ifdef SAMPLE_MINE_X86
+        switch (level)
+        {
+        case SimdLevel::kAVX512: return packAVX512;
+        case SimdLevel::kAVX2: return packAVX2;
+        case SimdLevel::kSSE41: return packSSE41;
+        default: break;
+        }
+#endif
+        return pack;
+    }
+
+    static PackRowU8Fn select(SimdLevel level, uint8_t*)
+    {
+        if (Width == kAnyExtent)
+        {
+            return getPackRowU8(level);
+        }
+#ifdef SAMPLE_MINE_X86
+        if (level != SimdLevel::kSCALAR)
+        {
+            return packU8SSE41;
+        }
+#endif
+        return packU8;
+    }
+
+    static PackRowHalfFn select(SimdLevel level, uint16_t*)
+    {
+        if (Width == kAnyExtent)
+        {
+            return getPackRowHalf(level);
+        }
+#ifdef SAMPLE_MINE_X86
+        if (level == SimdLevel::kAVX512)
+        {
+            return packHalfAVX512;
+        }
+        if (level == SimdLevel::kAVX2 && cpuHasF16C())
+        {
+            return packHalfF16C;
+        }
+#endif
+        return packHalf;
+    }
+
+    //!
+    //! \brief Same choice per level as getPackRowTable and getPackRowHalfTable. uint8 values need
+    //!        no table and get the select kernel.
+    //!
+    static PackRowTableFn selectTable(SimdLevel level, float*)
+    {
+        if (Width == kAnyExtent)
+        {
+            return getPackRowTable(level);
+        }
+#ifdef SAMPLE_MINE_X86
+        if (level >= SimdLevel::kAVX2)
+        {
+            return packTableAVX2;
+        }
+#endif
+        return packTable;
+    }
+
+    static PackRowHalfTableFn selectTable(SimdLevel level, uint16_t*)
+    {
+        if (Width == kAnyExtent)
+        {
+            return getPackRowHalfTable(level);
+        }
+#ifdef SAMPLE_MINE_X86
+        if (level >= SimdLevel::kAVX2)
+        {
+            return packHalfTableAVX2;
+        }
+#endif
+        return packHalfTable;
+    }
+
+    static PackRowU8Fn selectTable(SimdLevel level, uint8_t*)
+    {
+        return select(level, static_cast<uint8_t*>(nullptr));
+    }
+};
+
+inline void callRow(PackRowFn fn, const uint8_t* row, int width, float* r, float* g, float* b,
+    const PackParams& params)
+{
+    fn(row, width, r, g, b, params);
+}
+
+inline void callRow(PackRowHalfFn fn, const uint8_t* row, int width, uint16_t* r, uint16_t* g, uint16_t* b,
+    const PackParams& params)
+{
+    fn(row, width, r, g, b, params);
+}
+
+inline void callRow(
+    PackRowU8Fn fn, const uint8_t* row, int width, uint8_t* r, uint8_t* g, uint8_t* b, const PackParams&)
+{
+    fn(row, width, r, g, b);
+}
+
+inline void callRow(PackRowTableFn fn, const uint8_t* row, int width, float* r, float* g, float* b,
+    const PackTables& tables)
+{
+    fn(row, width, r, g, b, tables);
+}
+
+inline void callRow(PackRowHalfTableFn fn, const uint8_t* row, int width, uint16_t* r, uint16_t* g, uint16_t* b,
+    const PackTables& tables)
+{
+    fn(row, width, r, g, b, tables);
+}
+
+inline void callRow(
+    PackRowU8Fn fn, const uint8_t* row, int width, uint8_t* r, uint8_t* g, uint8_t* b, const PackTables&)
+{
+    fn(row, width, r, g, b);
+}
+
+//!
+//! \brief One BGR row to interleaved RGB values, for NHWC tensors.
+//!
+template <InputType Type, int Width>
+inline void packRowInterleaved(
+    const uint8_t* bgr, int width, typename PackElement<Type>::Value* rgb, const PackParams& params)
+{
+    for (int x = 0, n = Extent<Width>(width).get(); x < n; ++x, bgr += 3, rgb += 3)
+    {
+        rgb[0] = PackElement<Type>::convert(bgr[2], params.scale[0], params.bias[0]);
+        rgb[1] = PackElement<Type>::convert(bgr[1], params.scale[1], params.bias[1]);
+        rgb[2] = PackElement<Type>::convert(bgr[0], params.scale[2], params.bias[2]);
+    }
+}
+
+//!
+//! \brief As packRowInterleaved, through tables and into the positions they give.
+//!
+template <InputType Type, int Width>
+inline void packRowInterleavedTable(
+    const uint8_t* bgr, int width, typename PackElement<Type>::Value* out, const PackTables& tables)
+{
+    const int r = tables.plane[0], g = tables.plane[1], b = tables.plane[2];
+    for (int x = 0, n = Extent<Width>(width).get(); x < n; ++x, bgr += 3, out += 3)
+    {
+        out[r] = PackElement<Type>::lookup(bgr[2], tables, 0);
+        out[g] = PackElement<Type>::lookup(bgr[1], tables, 1);
+        out[b] = PackElement<Type>::lookup(bgr[0], tables, 2);
+    }
+}
+
+} // namespace detail
+
+//!
+//! \brief Resample-and-pack for C x H x W images in the given layout and element type, each
+//!        extent either fixed here or kAnyExtent to be taken from the PackShape at run time.
+//!
+template <int C, int H, int W, TensorLayout Layout, InputType Type>
+struct PackKernel
+{
+    static_assert(C == 3 || C == kAnyExtent, "the kernels read 3-channel BGR images");
+
+    typedef typename detail::PackElement<Type>::Value Value;
+
+    //!
+    //! \brief A ResizePackFn with the row kernel of Level, resolved on the first call.
+    //!
+    template <SimdLevel Level>
+    static void resize(const uint8_t* src, size_t step, int srcW, int srcH, const PackShape& shape, void* dst,
+        const PackParams& params, ResizeMode mode, const uint8_t padBGR[3])
+    {
+        static const auto fn = detail::FixedWidthRows<W>::select(Level, static_cast<Value*>(nullptr));
+        const int width = Extent<W>(shape.width).get();
+        const int height = Extent<H>(shape.height).get();
+        Value* const out = static_cast<Value*>(dst);
+        const size_t plane = static_cast<size_t>(width) * height;
+        detail::resampleBGRRows<W, H>(
+            src, step, srcW, srcH, width, height, mode, padBGR, [&](const uint8_t* row, int y) {
+                const size_t offset = static_cast<size_t>(y) * width;
+                if (Layout == TensorLayout::kNHWC)
+                {
+                    detail::packRowInterleaved<Type, W>(row, width, out + 3 * offset, params);
+                }
+                else
+                {
+                    detail::callRow(fn, row, width, out + offset, out + plane + offset, out + 2 * plane + offset,
+                        params);
+                }
+            });
+    }
+
+#ifdef SAMPLE_MINE_X86
+    //!
+    //! \brief resize with the resampler inlined and compiled for AVX2. The fixed-size blend loop
+    //!        then runs on 256-bit registers; only the shapes of the table get this copy.
+    //!
+    template <SimdLevel Level>
+    __attribute__((target("avx2"), flatten)) static void resizeAVX2(const uint8_t* src, size_t step, int srcW,
+        int srcH, const PackShape& shape, void* dst, const PackParams& params, ResizeMode mode,
+        const uint8_t padBGR[3])
+    {
+        resize<Level>(src, step, srcW, srcH, shape, dst, params, mode, padBGR);
+    }
+#endif
+
+    //!
+    //! \brief A ResizePackTableFn: resize with every value looked up in tables.
+    //!
+    template <SimdLevel Level>
+    static void resizeTable(const uint8_t* src, size_t step, int srcW, int srcH, const PackShape& shape, void* dst,
+        const PackTables& tables, ResizeMode mode, const uint8_t padBGR[3])
+    {
+        static const auto fn = detail::FixedWidthRows<W>::selectTable(Level, static_cast<Value*>(nullptr));
+        const int width = Extent<W>(shape.width).get();
+        const int height = Extent<H>(shape.height).get();
+        Value* const out = static_cast<Value*>(dst);
+        const size_t plane = static_cast<size_t>(width) * height;
+        detail::resampleBGRRows<W, H>(
+            src, step, srcW, srcH, width, height, mode, padBGR, [&](const uint8_t* row, int y) {
+                const size_t offset = static_cast<size_t>(y) * width;
+                if (Layout == TensorLayout::kNHWC)
+                {
+                    detail::packRowInterleavedTable<Type, W>(row, width, out + 3 * offset, tables);
+                }
+                else
+                {
+                    detail::callRow(fn, row, width, out + tables.plane[0] * plane + offset,
+                        out + tables.plane[1] * plane + offset, out + tables.plane[2] * plane + offset, tables);
+                }
+            });
+    }
+
+#ifdef SAMPLE_MINE_X86
+    template <SimdLevel Level>
+    __attribute__((target("avx2"), flatten)) static void resizeTableAVX2(const uint8_t* src, size_t step, int srcW,
+        int srcH, const PackShape& shape, void* dst, const PackTables& tables, ResizeMode mode,
+        const uint8_t padBGR[3])
+    {
+        resizeTable<Level>(src, step, srcW, srcH, shape, dst, tables, mode, padBGR);
+    }
+#endif
+};
+
+//!
+//! \brief The kernel selectPackKernel chose, and whether it is compiled for the shape.
+//!
+struct PackKernelChoice
+{
+    ResizePackFn fn;           //!< nullptr when no kernel handles the shape
+    ResizePackTableFn tableFn; //!< The same kernel normalizing through tables, nullptr with fn
+    bool specialized;
+};
+
+namespace detail
+{
+
+//!
+//! \brief The kernels of Kernel with the row kernels of Level, the resampler compiled for the
+//!        baseline (std::false_type) or for AVX2 (std::true_type).
+//!
+template <typename Kernel, SimdLevel Level>
+PackKernelChoice packKernelAt(bool fixed, std::false_type)
+{
+    return PackKernelChoice{Kernel::template resize<Level>, Kernel::template resizeTable<Level>, fixed};
+}
+
+#ifdef SAMPLE_MINE_X86
+template <typename Kernel, SimdLevel Level>
+PackKernelChoice packKernelAt(bool, std::true_type)
+{
+    return PackKernelChoice{Kernel::template resizeAVX2<Level>, Kernel::template resizeTableAVX2<Level>, true};
+}
+#endif
+
+//!
+//! \brief The PackKernel instantiation for C x H x W in one layout and element type, with the row
+//!        kernels of level and, when the extents are fixed and level has AVX2, the resampler
+//!        compiled for AVX2. The generic kernel's resampler is only compiled for the baseline.
+//!
+template <int C, int H, int W, TensorLayout Layout, InputType Type>
+PackKernelChoice packKernelFor(SimdLevel level)
+{
+    typedef PackKernel<C, H, W, Layout, Type> Kernel;
+    const bool fixed = C != kAnyExtent && H != kAnyExtent && W != kAnyExtent;
+    typedef std::integral_constant<bool, fixed> FixedAVX2;
+    switch (level)
+    {
+#ifdef SAMPLE_MINE_X86
+    case SimdLevel::kAVX512: return packKernelAt<Kernel, SimdLevel::kAVX512>(fixed, FixedAVX2());
+    case SimdLevel::kAVX2: return packKernelAt<Kernel, SimdLevel::kAVX2>(fixed, FixedAVX2());
+    case SimdLevel::kSSE41: return packKernelAt<Kernel, SimdLevel::kSSE41>(fixed, std::false_type());
+#endif
+    default: return packKernelAt<Kernel, SimdLevel::kSCALAR>(fixed, std::false_type());
+    }
+}
+
+template <int C, int H, int W, TensorLayout Layout>
+PackKernelChoice packKernelFor(InputType type, SimdLevel level)
+{
+    return type == InputType::kUINT8 ? packKernelFor<C, H, W, Layout, InputType::kUINT8>(level)
+        : type == InputType::kHALF   ? packKernelFor<C, H, W, Layout, InputType::kHALF>(level)
+                                     : packKernelFor<C, H, W, Layout, InputType::kFLOAT>(level);
+}
+
+template <int C, int H, int W>
+PackKernelChoice packKernelFor(TensorLayout layout, InputType type, SimdLevel level)
+{
+    return layout == TensorLayout::kNHWC ? packKernelFor<C, H, W, TensorLayout::kNHWC>(type, level)
+                                         : packKernelFor<C, H, W, TensorLayout::kNCHW>(type, level);
+}
+
+//!
+//! \brief Model input shapes with kernels of their own. Adding a row here is all a new shape needs.
+//!
+struct FixedPackShape
+{
+    int channels, height, width;
+    PackKernelChoice (*kernel)(TensorLayout, InputType, SimdLevel);
+};
+
+const FixedPackShape kFixedPackShapes[] = {
+    {3, 299, 299, packKernelFor<3, 299, 299>}, // InceptionV3, Xception
+    {3, 224, 224, packKernelFor<3, 224, 224>}, // ResNet, MobileNet, VGG
+};
+
+} // namespace detail
+
+//!
+//! \brief The kernel for shape: compiled for it if it is in the table and specialized is set,
+//!        else the generic one. Only 3-channel shapes have a kernel. level must be supported.
+//!
+inline PackKernelChoice selectPackKernel(
+    const PackShape& shape, bool specialized = true, SimdLevel level = detectSimdLevel())
+{
+    if (shape.channels != 3 || shape.height <= 0 || shape.width <= 0)
+    {
+        return PackKernelChoice{nullptr, nullptr, false};
+    }
+    for (const detail::FixedPackShape& fixed : detail::kFixedPackShapes)
+    {
+        if (specialized && fixed.channels == shape.channels && fixed.height == shape.height
+            && fixed.width == shape.width)
+        {
+            return fixed.kernel(shape.layout, shape.type, level);
+        }
+    }
+    return detail::packKernelFor<kAnyExtent, kAnyExtent, kAnyExtent>(shape.layout, shape.type, level);
+}
+
+} // namespace mine
+
+#endif // SAMPLE_MINE_PACK_KERNELS_H
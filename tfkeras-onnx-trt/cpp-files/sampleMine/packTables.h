@@ -0,0 +1,173 @@
+#ifndef SAMPLE_MINE_PACK_TABLES_H
+#define SAMPLE_MINE_PACK_TABLES_H
+
+//
+// Normalization through per-channel lookup tables. An 8-bit channel value has only
+// 256 possible outputs, so (v - mean) / stddev is evaluated once per value when the
+// preprocessing is compiled, in double and rounded once, instead of as
+// v * scale + bias for every pixel. The tables hold the correctly rounded values
+// whatever the mean and stddev are, and packing one value is one load. They also say
+// which output plane each of R, G and B goes to, so BGR models cost nothing extra.
+//
+
+#include "halfFloat.h"
+#include "imagePacking.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace mine
+{
+
+//!
+//! \brief Normalized values of the 8-bit R, G and B values, and the output channel of each.
+//!
+struct PackTables
+{
+    int plane[3];              //!< Output channel (plane, or position in an NHWC pixel) of R, G and B
+    float value[3][256];       //!< value[c][v]: R, G or B value v normalized
+    uint16_t half[3][256 + 2]; //!< The same as IEEE half; spare entries let a gather read 4 bytes at 255
+};
+
+//!
+//! \brief Fills tables for out = (v - mean[o]) / stddev[o], where o is the output channel and mean
+//!        and stddev are in pixel units and output order. bgr puts B in output channel 0.
+//!
+inline void makePackTables(const float mean[3], const float stddev[3], bool bgr, PackTables& tables)
+{
+    for (int c = 0; c < 3; ++c)
+    {
+        const int o = bgr ? 2 - c : c;
+        tables.plane[c] = o;
+        for (int v = 0; v < 256; ++v)
+        {
+            const float value = static_cast<float>((v - static_cast<double>(mean[o])) / stddev[o]);
+            tables.value[c][v] = value;
+            tables.half[c][v] = floatToHalf(value);
+        }
+        tables.half[c][256] = tables.half[c][257] = 0;
+    }
+}
+
+//!
+//! \brief Packs one row of width interleaved BGR pixels, looking every value up in tables.
+//!        r, g and b receive the R, G and B values; the caller points them at tables.plane.
+//!
+typedef void (*PackRowTableFn)(
+    const uint8_t* bgr, int width, float* r, float* g, float* b, const PackTables& tables);
+
+//!
+//! \brief As PackRowTableFn, into IEEE half.
+//!
+typedef void (*PackRowHalfTableFn)(
+    const uint8_t* bgr, int width, uint16_t* r, uint16_t* g, uint16_t* b, const PackTables& tables);
+
+inline void packRowTableScalar(
+    const uint8_t* bgr, int width, float* r, float* g, float* b, const PackTables& tables)
+{
+    for (int x = 0; x < width; ++x, bgr += 3)
+    {
+        r[x] = tables.value[0][bgr[2]];
+        g[x] = tables.value[1][bgr[1]];
+        b[x] = tables.value[2][bgr[0]];
+    }
+}
+
+inline void packRowHalfTableScalar(
+    const uint8_t* bgr, int width, uint16_t* r, uint16_t* g, uint16_t* b, const PackTables& tables)
+{
+    for (int x = 0; x < width; ++x, bgr += 3)
+    {
+        r[x] = tables.half[0][bgr[2]];
+        g[x] = tables.half[1][bgr[1]];
+        b[x] = tables.half[2][bgr[0]];
+    }
+}
+
+#ifdef SAMPLE_MINE_X86
+
+__attribute__((target("avx2"))) inline void gatherChannelAVX2(__m128i v, const float* table, float* dst)
+{
+    const __m256i lo = _mm256_cvtepu8_epi32(v);
+    const __m256i hi = _mm256_cvtepu8_epi32(_mm_srli_si128(v, 8));
+    _mm256_storeu_ps(dst, _mm256_i32gather_ps(table, lo, 4));
+    _mm256_storeu_ps(dst + 8, _mm256_i32gather_ps(table, hi, 4));
+}
+
+__attribute__((target("avx2"))) inline void packRowTableAVX2(
+    const uint8_t* bgr, int width, float* r, float* g, float* b, const PackTables& tables)
+{
+    int x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        __m128i vb, vg, vr;
+        deinterleaveBGR16(bgr + 3 * x, vb, vg, vr);
+        gatherChannelAVX2(vr, tables.value[0], r + x);
+        gatherChannelAVX2(vg, tables.value[1], g + x);
+        gatherChannelAVX2(vb, tables.value[2], b + x);
+    }
+    packRowTableScalar(bgr + 3 * x, width - x, r + x, g + x, b + x, tables);
+}
+
+//!
+//! \brief 16 half values: 32-bit gathers at 2-byte strides, the upper halves dropped on packing.
+//!
+__attribute__((target("avx2"))) inline void gatherChannelHalfAVX2(__m128i v, const uint16_t* table, uint16_t* dst)
+{
+    const int* base = reinterpret_cast<const int*>(table);
+    const __m256i mask = _mm256_set1_epi32(0xFFFF);
+    const __m256i lo = _mm256_and_si256(_mm256_i32gather_epi32(base, _mm256_cvtepu8_epi32(v), 2), mask);
+    const __m256i hi
+        = _mm256_and_si256(_mm256_i32gather_epi32(base, _mm256_cvtepu8_epi32(_mm_srli_si128(v, 8)), 2), mask);
+    // packus works per 128-bit lane: lo0 hi0 lo1 hi1, put back in order
+    const __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(lo, hi), 0xD8);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), packed);
+}
+
+__attribute__((target("avx2"))) inline void packRowHalfTableAVX2(
+    const uint8_t* bgr, int width, uint16_t* r, uint16_t* g, uint16_t* b, const PackTables& tables)
+{
+    int x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        __m128i vb, vg, vr;
+        deinterleaveBGR16(bgr + 3 * x, vb, vg, vr);
+        gatherChannelHalfAVX2(vr, tables.half[0], r + x);
+        gatherChannelHalfAVX2(vg, tables.half[1], g + x);
+        gatherChannelHalfAVX2(vb, tables.half[2], b + x);
+    }
+    packRowHalfTableScalar(bgr + 3 * x, width - x, r + x, g + x, b + x, tables);
+}
+
+#endif // SAMPLE_MINE_X86
+
+//!
+//! \brief Table row kernel for an explicit level. Gathers need AVX2; AVX-512 CPUs use them too.
+//!
+inline PackRowTableFn getPackRowTable(SimdLevel level)
+{
+#ifdef SAMPLE_MINE_X86
+    if (level >= SimdLevel::kAVX2)
+    {
+        return packRowTableAVX2;
+    }
+#endif
+    (void) level;
+    return packRowTableScalar;
+}
+
+inline PackRowHalfTableFn getPackRowHalfTable(SimdLevel level)
+{
+#ifdef SAMPLE_MINE_X86
+    if (level >= SimdLevel::kAVX2)
+    {
+        return packRowHalfTableAVX2;
+    }
+#endif
+    (void) level;
+    return packRowHalfTableScalar;
+}
+
+} // namespace mine
+
+#endif // SAMPLE_MINE_PACK_TABLES_H
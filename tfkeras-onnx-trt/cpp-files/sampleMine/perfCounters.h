@@ -0,0 +1,189 @@
+#ifndef SAMPLE_MINE_PERF_COUNTERS_H
+#define SAMPLE_MINE_PERF_COUNTERS_H
+
+//
+// Hardware event counters of the calling thread through perf_event_open(2):
+// cycles, instructions, last level cache misses and branch misses, read as one
+// group so they cover the same instructions. Only user space is counted, which
+// the default perf_event_paranoid (2) allows without privileges.
+//
+// Counters may be missing: containers often block perf_event_open, and VMs may
+// expose no PMU or no LLC event. Whatever cannot be opened reads as absent
+// rather than zero.
+//
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstring>
+
+namespace mine
+{
+
+enum class PerfCounter : int
+{
+    kCYCLES = 0,
+    kINSTRUCTIONS = 1,
+    kLLC_MISSES = 2,
+    kBRANCH_MISSES = 3,
+    kCOUNT = 4
+};
+
+inline const char* perfCounterName(PerfCounter counter)
+{
+    static const char* const names[] = {"cycles", "instructions", "llc_misses", "branch_misses"};
+    return names[static_cast<int>(counter)];
+}
+
+//!
+//! \brief One reading, or the difference of two; has[c] is false where counter c is unavailable.
+//!
+struct PerfCounterValues
+{
+    uint64_t value[static_cast<int>(PerfCounter::kCOUNT)]{};
+    bool has[static_cast<int>(PerfCounter::kCOUNT)]{};
+
+    uint64_t operator[](PerfCounter counter) const
+    {
+        return value[static_cast<int>(counter)];
+    }
+
+    //!
+    //! \brief The events between an earlier reading and this one.
+    //!
+    PerfCounterValues operator-(const PerfCounterValues& earlier) const
+    {
+        PerfCounterValues delta;
+        for (int c = 0; c < static_cast<int>(PerfCounter::kCOUNT); ++c)
+        {
+            delta.has[c] = has[c] && earlier.has[c];
+            delta.value[c] = delta.has[c] && value[c] > earlier.value[c] ? value[c] - earlier.value[c] : 0;
+        }
+        return delta;
+    }
+};
+
+//!
+//! \brief The counter group of one thread; read() only from the thread that opened it.
+//!
+class PerfCounterGroup
+{
+public:
+    PerfCounterGroup() = default;
+
+    ~PerfCounterGroup()
+    {
+        close();
+    }
+
+    PerfCounterGroup(const PerfCounterGroup&) = delete;
+    PerfCounterGroup& operator=(const PerfCounterGroup&) = delete;
+
+    //!
+    //! \brief Starts counting the calling thread. False if not even the cycle counter opens; the
+    //!        other counters are optional.
+    //!
+    bool open()
+    {
+        close();
+        static const uint64_t configs[] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+            PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+        for (int c = 0; c < static_cast<int>(PerfCounter::kCOUNT); ++c)
+        {
+            mFds[c] = openCounter(configs[c], mFds[0]);
+            if (c == 0 && mFds[0] < 0)
+            {
+                return false;
+            }
+            if (mFds[c] >= 0)
+            {
+                mSlot[c] = mMembers++;
+            }
+        }
+        ioctl(mFds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(mFds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        return true;
+    }
+
+    bool isOpen() const
+    {
+        return mFds[0] >= 0;
+    }
+
+    //!
+    //! \brief Counts since open(), scaled up if the kernel had to multiplex the group.
+    //!
+    bool read(PerfCounterValues& values) const
+    {
+        // PERF_FORMAT_GROUP layout: nr, time_enabled, time_running, then one value per member
+        uint64_t buffer[3 + static_cast<int>(PerfCounter::kCOUNT)];
+        if (!isOpen() || ::read(mFds[0], buffer, sizeof(buffer)) < static_cast<ssize_t>(3 * sizeof(uint64_t))
+            || buffer[0] != static_cast<uint64_t>(mMembers))
+        {
+            return false;
+        }
+        const double scale = buffer[2] > 0 && buffer[2] < buffer[1] ? static_cast<double>(buffer[1]) / buffer[2] : 1.0;
+        for (int c = 0; c < static_cast<int>(PerfCounter::kCOUNT); ++c)
+        {
+            values.has[c] = mFds[c] >= 0;
+            values.value[c] = values.has[c] ? static_cast<uint64_t>(buffer[3 + mSlot[c]] * scale) : 0;
+        }
+        return true;
+    }
+
+    void close()
+    {
+        for (int c = 0; c < static_cast<int>(PerfCounter::kCOUNT); ++c)
+        {
+            if (mFds[c] >= 0)
+            {
+                ::close(mFds[c]);
+            }
+            mFds[c] = -1;
+            mSlot[c] = -1;
+        }
+        mMembers = 0;
+    }
+
+private:
+    static int openCounter(uint64_t config, int leader)
+    {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = config;
+        attr.disabled = leader < 0 ? 1 : 0; // The leader enables the whole group at once
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        return static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, leader, PERF_FLAG_FD_CLOEXEC));
+    }
+
+    int mFds[static_cast<int>(PerfCounter::kCOUNT)]{-1, -1, -1, -1};
+    int mSlot[static_cast<int>(PerfCounter::kCOUNT)]{-1, -1, -1, -1}; //!< Position in the group read
+    int mMembers{0};
+};
+
+//!
+//! \brief Reads the calling thread's counters, opening its group on first use; false wherever
+//!        perf_event_open is not allowed.
+//!
+inline bool readThreadPerfCounters(PerfCounterValues& values)
+{
+    thread_local PerfCounterGroup group;
+    thread_local bool tried = false;
+    if (!tried)
+    {
+        tried = true;
+        group.open();
+    }
+    return group.read(values);
+}
+
+} // namespace mine
+
+#endif // SAMPLE_MINE_PERF_COUNTERS_H
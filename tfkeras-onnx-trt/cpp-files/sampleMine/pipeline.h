@@ -0,0 +1,316 @@
+#ifndef SAMPLE_MINE_PIPELINE_H
+#define SAMPLE_MINE_PIPELINE_H
+
+//
+// Three-stage pipelined inference. A dedicated thread runs each stage:
+//
+//   preprocess (decode, resize, pack) -> execute (H2D, run, D2H) -> postprocess (softmax)
+//
+// Every in-flight batch leases one ExecutionSlot, so with three slots batch N+1 is
+// preprocessed while batch N executes and batch N-1 is post-processed. Bounded
+// queues between the stages keep memory fixed and push back on the producer, and
+// throughput approaches the slowest stage rather than the sum of all three. A
+// stage that throws fails its batch; the stage threads carry on.
+//
+
+#include "executionSlot.h"
+#include "inferenceBackend.h"
+#include "slotPool.h"
+#include "traceEvents.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace mine
+{
+
+//!
+//! \brief Blocking FIFO holding at most capacity items.
+//!
+template <typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(size_t capacity)
+        : mCapacity(capacity)
+    {
+    }
+
+    //!
+    //! \brief Waits for room, then appends item. Returns false if the queue was closed.
+    //!
+    bool push(T item)
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mNotFull.wait(lock, [this]() { return mClosed || mItems.size() < mCapacity; });
+        if (mClosed)
+        {
+            return false;
+        }
+        mItems.push_back(std::move(item));
+        mNotEmpty.notify_one();
+        return true;
+    }
+
+    //!
+    //! \brief Waits for an item. Returns false once the queue is closed and empty.
+    //!
+    bool pop(T& item)
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mNotEmpty.wait(lock, [this]() { return mClosed || !mItems.empty(); });
+        if (mItems.empty())
+        {
+            return false;
+        }
+        item = std::move(mItems.front());
+        mItems.pop_front();
+        mNotFull.notify_one();
+        return true;
+    }
+
+    //!
+    //! \brief Rejects further pushes; items already queued can still be popped.
+    //!
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mClosed = true;
+        mNotEmpty.notify_all();
+        mNotFull.notify_all();
+    }
+
+private:
+    const size_t mCapacity;
+    std::deque<T> mItems;
+    std::mutex mMutex;
+    std::condition_variable mNotEmpty;
+    std::condition_variable mNotFull;
+    bool mClosed{false};
+};
+
+//!
+//! \brief The host-side halves of inference, run by the pipeline around ExecutionSlot::run().
+//!
+class BatchStages
+{
+public:
+    virtual ~BatchStages() = default;
+
+    //! Fills slot.hostInput() with the input tensors of requests and sizes predictions to match.
+    //! A request that cannot be prepared gets predictions[i].ok unset; false fails the whole batch.
+    virtual bool preprocess(const std::vector<const ImageRequest*>& requests, ExecutionSlot& slot,
+        std::vector<Prediction>& predictions)
+        = 0;
+
+    //! Turns slot.hostOutput() into the predictions of the requests preprocess() left ok.
+    virtual bool postprocess(
+        const std::vector<const ImageRequest*>& requests, ExecutionSlot& slot, std::vector<Prediction>& predictions)
+        = 0;
+};
+
+//!
+//! \brief An InferenceBackend that overlaps the preprocess, execute and postprocess stages of
+//!        consecutive batches, one ExecutionSlot per in-flight batch.
+//!
+class PipelinedBackend : public InferenceBackend
+{
+public:
+    //!
+    //! \brief Busy time of every stage, to compare with the wall time of a run.
+    //!
+    struct Stats
+    {
+        uint64_t batches;
+        double preprocessMs;
+        double executeMs;
+        double postprocessMs;
+    };
+
+    //!
+    //! \param slots Leased one per batch in flight: two for double buffering, three for full
+    //!              overlap of all stages. Must outlive the backend.
+    //!
+    PipelinedBackend(BatchStages& stages, SlotPool& slots, int maxBatchSize)
+        : mStages(stages)
+        , mSlots(slots)
+        , mMaxBatchSize(maxBatchSize)
+        , mIncoming(std::max(1, slots.size()))
+        , mToExecute(std::max(1, slots.size()))
+        , mToPostprocess(std::max(1, slots.size()))
+    {
+        mPreprocessThread = std::thread([this]() { preprocessLoop(); });
+        mExecuteThread = std::thread([this]() { executeLoop(); });
+        mPostprocessThread = std::thread([this]() { postprocessLoop(); });
+    }
+
+    //!
+    //! \brief Finishes every queued batch, then stops the stage threads.
+    //!
+    ~PipelinedBackend()
+    {
+        mIncoming.close();
+        mPreprocessThread.join();
+        mExecuteThread.join();
+        mPostprocessThread.join();
+    }
+
+    PipelinedBackend(const PipelinedBackend&) = delete;
+    PipelinedBackend& operator=(const PipelinedBackend&) = delete;
+
+    int maxBatchSize() const override
+    {
+        return mMaxBatchSize;
+    }
+
+    bool infer(const std::vector<const ImageRequest*>& requests, std::vector<Prediction>& predictions) override
+    {
+        std::promise<bool> finished;
+        inferAsync(requests, [&finished, &predictions](bool ok, std::vector<Prediction>& result) {
+            predictions.swap(result);
+            finished.set_value(ok);
+        });
+        return finished.get_future().get();
+    }
+
+    //!
+    //! \brief Queues a batch; blocks only while every slot is busy and the input queue is full.
+    //!
+    void inferAsync(const std::vector<const ImageRequest*>& requests, BatchCallback done) override
+    {
+        Job job;
+        job.requests = requests;
+        job.done = done;
+        if (!mIncoming.push(std::move(job)))
+        {
+            std::vector<Prediction> none;
+            done(false, none);
+        }
+    }
+
+    Stats stats() const
+    {
+        return Stats{mBatches.load(), mPreprocessNs.load() * 1e-6, mExecuteNs.load() * 1e-6,
+            mPostprocessNs.load() * 1e-6};
+    }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Job
+    {
+        std::vector<const ImageRequest*> requests;
+        BatchCallback done;
+        SlotPool::Lease slot;
+        bool ok{false};
+        std::vector<Prediction> predictions; //!< Sized and marked per request by the preprocess stage
+    };
+
+    static uint64_t elapsedNs(Clock::time_point start)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+    }
+
+    //!
+    //! \brief stage(), or false if it throws, which would otherwise end the stage thread and
+    //!        the process with it.
+    //!
+    template <typename Stage>
+    static bool runStage(Stage stage)
+    {
+        try
+        {
+            return stage();
+        }
+        catch (...)
+        {
+            return false;
+        }
+    }
+
+    void preprocessLoop()
+    {
+        traceThreadName("pipeline preprocess");
+        Job job;
+        while (mIncoming.pop(job))
+        {
+            {
+                const TraceScope trace("wait for slot");
+                job.slot = mSlots.acquire();
+            }
+            const Clock::time_point start = Clock::now();
+            job.ok = job.slot && runStage([&job, this]() {
+                return mStages.preprocess(job.requests, *job.slot, job.predictions);
+            });
+            mPreprocessNs += elapsedNs(start);
+            mToExecute.push(std::move(job));
+        }
+        mToExecute.close();
+    }
+
+    void executeLoop()
+    {
+        traceThreadName("pipeline execute");
+        Job job;
+        while (mToExecute.pop(job))
+        {
+            const Clock::time_point start = Clock::now();
+            job.ok = job.ok && runStage([&job]() { return job.slot->run(); });
+            mExecuteNs += elapsedNs(start);
+            mToPostprocess.push(std::move(job));
+        }
+        mToPostprocess.close();
+    }
+
+    void postprocessLoop()
+    {
+        traceThreadName("pipeline postprocess");
+        Job job;
+        while (mToPostprocess.pop(job))
+        {
+            const Clock::time_point start = Clock::now();
+            job.ok = job.ok
+                && runStage([&job, this]() { return mStages.postprocess(job.requests, *job.slot, job.predictions); });
+            mPostprocessNs += elapsedNs(start);
+            job.slot.reset();
+            ++mBatches;
+            // The callback is the caller's; one that throws must not stop the pipeline for the others
+            try
+            {
+                job.done(job.ok, job.predictions);
+            }
+            catch (...)
+            {
+            }
+        }
+    }
+
+    BatchStages& mStages;
+    SlotPool& mSlots;
+    const int mMaxBatchSize;
+
+    BoundedQueue<Job> mIncoming;
+    BoundedQueue<Job> mToExecute;
+    BoundedQueue<Job> mToPostprocess;
+
+    std::atomic<uint64_t> mBatches{0};
+    std::atomic<uint64_t> mPreprocessNs{0};
+    std::atomic<uint64_t> mExecuteNs{0};
+    std::atomic<uint64_t> mPostprocessNs{0};
+
+    std::thread mPreprocessThread;
+    std::thread mExecuteThread;
+    std::thread mPostprocessThread;
+};
+
+} // namespace mine
+
+#endif // SAMPLE_MINE_PIPELINE_H
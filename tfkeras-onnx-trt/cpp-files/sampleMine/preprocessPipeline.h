@@ -0,0 +1,180 @@
+#ifndef SAMPLE_MINE_PREPROCESS_PIPELINE_H
+#define SAMPLE_MINE_PREPROCESS_PIPELINE_H
+
+//
+// A PreprocessSpec compiled for the input binding of an engine. Everything that does
+// not depend on the image is settled once: the resize-and-pack kernel for the shape,
+// layout and element type, the per-channel lookup tables (or the plain multiply when
+// it gives the same values), the output plane of each color and the letterbox color.
+// Each decoded image then goes through a single pass into its slot of the input
+// tensor. Only the filters other than linear resize with cv::resize first, into
+// arena scratch memory, which the pass then packs without resampling.
+//
+
+#include "hostArena.h"
+#include "jpegDecode.h"
+#include "packKernels.h"
+#include "packTables.h"
+#include "preprocessSpec.h"
+#include "tensorDesc.h"
+
+#include "opencv2/imgproc.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace mine
+{
+
+class PreprocessPipeline
+{
+public:
+    //!
+    //! \brief Compiles spec for one image of desc, which must be a 3-channel image binding.
+    //!        specialized = false takes the generic kernel and tables = true the lookup tables
+    //!        even where the multiply is exact, for comparisons.
+    //!
+    bool compile(const PreprocessSpec& spec, const TensorDesc& desc, std::string& error, bool specialized = true,
+        bool tables = false)
+    {
+        if (!desc.isImage() || desc.channels() != 3)
+        {
+            error = "preprocessing needs a 3-channel image input, not " + tensorDescString(desc);
+            return false;
+        }
+        mSpec = spec;
+        mShape = PackShape{3, desc.height(), desc.width(), desc.layout, spec.type};
+        mKernel = selectPackKernel(mShape, specialized);
+        if (!mKernel.fn)
+        {
+            error = "no packing kernel for " + tensorDescString(desc);
+            return false;
+        }
+        mParams = preprocessPackParams(spec);
+        makePackTables(spec.mean, spec.stddev, spec.order == ColorOrder::kBGR, mTables);
+        mMultiply = !tables && spec.type == InputType::kFLOAT && spec.order == ColorOrder::kRGB && multiplyIsExact();
+        mPadBGR[0] = spec.padRGB[2];
+        mPadBGR[1] = spec.padRGB[1];
+        mPadBGR[2] = spec.padRGB[0];
+        return true;
+    }
+
+    //!
+    //! \brief Decodes an encoded image to BGR as the spec says; denom receives the JPEG scale used.
+    //!
+    bool decode(const uint8_t* data, size_t size, cv::Mat& bgr, int& denom) const
+    {
+        return decodeImageScaled(data, size, mShape.width, mShape.height, mSpec.resize, bgr, denom,
+            mSpec.decode == DecodeMode::kFULL ? 1 : 8);
+    }
+
+    //!
+    //! \brief Resizes, normalizes and lays out one decoded BGR image at dst, the start of its batch
+    //!        slot. Safe to call from several threads at once.
+    //!
+    void pack(const uint8_t* src, size_t step, int srcW, int srcH, void* dst) const
+    {
+        if (mSpec.filter == ResizeFilter::kLINEAR || (srcW == mShape.width && srcH == mShape.height))
+        {
+            packResized(src, step, srcW, srcH, dst);
+            return;
+        }
+        const ArenaScope scratch;
+        const int width = mShape.width;
+        const int height = mShape.height;
+        cv::Mat resized(height, width, CV_8UC3, scratch.arena().allocate<uint8_t>(3 * size_t(width) * height));
+        resized.setTo(cv::Scalar(mPadBGR[0], mPadBGR[1], mPadBGR[2]));
+        const ResizeGeometry g = computeResizeGeometry(srcW, srcH, width, height, mSpec.resize);
+        const cv::Mat source(srcH, srcW, CV_8UC3, const_cast<uint8_t*>(src), step);
+        cv::Mat target = resized(cv::Rect(g.dst.x, g.dst.y, g.dst.width, g.dst.height));
+        const int interpolation = mSpec.filter == ResizeFilter::kNEAREST ? cv::INTER_NEAREST
+            : mSpec.filter == ResizeFilter::kCUBIC                        ? cv::INTER_CUBIC
+                                                                          : cv::INTER_AREA;
+        cv::resize(source(cv::Rect(g.src.x, g.src.y, g.src.width, g.src.height)), target,
+            cv::Size(g.dst.width, g.dst.height), 0, 0, interpolation);
+        packResized(resized.ptr<uint8_t>(), resized.step, width, height, dst);
+    }
+
+    const PreprocessSpec& spec() const
+    {
+        return mSpec;
+    }
+
+    const PackShape& shape() const
+    {
+        return mShape;
+    }
+
+    //!
+    //! \brief The normalization as scale and bias, for the device (uint8 input) and shard headers.
+    //!
+    const PackParams& params() const
+    {
+        return mParams;
+    }
+
+    //!
+    //! \brief Whether the kernel is compiled for the input shape.
+    //!
+    bool specialized() const
+    {
+        return mKernel.specialized;
+    }
+
+    //!
+    //! \brief "tables" or "multiply": how values are normalized.
+    //!
+    const char* normalization() const
+    {
+        return mMultiply ? "multiply" : "tables";
+    }
+
+private:
+    //!
+    //! \brief Whether v * scale gives every table value, so the arithmetic kernels may be used. A bias
+    //!        is a second rounding the tables do not have, so it never is.
+    //!
+    bool multiplyIsExact() const
+    {
+        for (int c = 0; c < 3; ++c)
+        {
+            if (mParams.bias[c] != 0.0f)
+            {
+                return false;
+            }
+            for (int v = 0; v < 256; ++v)
+            {
+                if (float(v) * mParams.scale[c] != mTables.value[c][v])
+                {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    void packResized(const uint8_t* src, size_t step, int srcW, int srcH, void* dst) const
+    {
+        if (mMultiply)
+        {
+            mKernel.fn(src, step, srcW, srcH, mShape, dst, mParams, mSpec.resize, mPadBGR);
+        }
+        else
+        {
+            mKernel.tableFn(src, step, srcW, srcH, mShape, dst, mTables, mSpec.resize, mPadBGR);
+        }
+    }
+
+    PreprocessSpec mSpec;
+    PackShape mShape{3, 0, 0, TensorLayout::kNCHW, InputType::kFLOAT};
+    PackKernelChoice mKernel{nullptr, nullptr, false};
+    PackParams mParams{};
+    PackTables mTables{};
+    bool mMultiply{false};
+    uint8_t mPadBGR[3]{0, 0, 0};
+};
+
+} // namespace mine
+
+#endif // SAMPLE_MINE_PREPROCESS_PIPELINE_H
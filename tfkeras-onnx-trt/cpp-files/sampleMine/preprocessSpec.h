@@ -0,0 +1,276 @@
+#ifndef SAMPLE_MINE_PREPROCESS_SPEC_H
+#define SAMPLE_MINE_PREPROCESS_SPEC_H
+
+//
+// What a model expects of its input image, declared instead of hard-coded: how
+// the image is decoded, the resize filter, how it is fit to the input, the channel
+// order, the per-channel mean and standard deviation and the element type. A spec
+// is a small text file of key = value lines ('#' starts a comment):
+//
+//   decode = scaled         # scaled (reduced-size JPEG decode) or full
+//   filter = linear         # linear (fused resampler), nearest, cubic or area
+//   resize = stretch        # stretch, crop or letterbox
+//   pad    = 0, 0, 0        # letterbox border color, R, G, B
+//   order  = rgb            # rgb or bgr
+//   mean   = 0, 0, 0        # per output channel, in pixel units
+//   std    = 255, 255, 255  # out = (pixel - mean) / std
+//   dtype  = float          # float, half or uint8
+//
+// Keys left out keep their values, the ones above by default, which are what the
+// dogs-vs-cats model was trained with. preprocessPipeline.h compiles a spec for the
+// input binding into a single resize-and-pack pass.
+//
+
+#include "imagePacking.h"
+#include "imageResize.h"
+#include "inputType.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+namespace mine
+{
+
+enum class DecodeMode : int
+{
+    kSCALED = 0, //!< JPEGs decoded at the smallest DCT scale that still covers the input
+    kFULL = 1    //!< Always decoded at full size, as reference pipelines do
+};
+
+enum class ResizeFilter : int
+{
+    kLINEAR = 0,  //!< Fused fixed-point bilinear resampler, as cv::resize INTER_LINEAR
+    kNEAREST = 1, //!< cv::resize INTER_NEAREST, then packed
+    kCUBIC = 2,   //!< cv::resize INTER_CUBIC, then packed
+    kAREA = 3     //!< cv::resize INTER_AREA, then packed
+};
+
+enum class ColorOrder : int
+{
+    kRGB = 0,
+    kBGR = 1 //!< Caffe-style models
+};
+
+inline const char* decodeModeName(DecodeMode mode)
+{
+    return mode == DecodeMode::kFULL ? "full" : "scaled";
+}
+
+inline const char* resizeFilterName(ResizeFilter filter)
+{
+    switch (filter)
+    {
+    case ResizeFilter::kNEAREST: return "nearest";
+    case ResizeFilter::kCUBIC: return "cubic";
+    case ResizeFilter::kAREA: return "area";
+    default: return "linear";
+    }
+}
+
+inline const char* colorOrderName(ColorOrder order)
+{
+    return order == ColorOrder::kBGR ? "bgr" : "rgb";
+}
+
+//!
+//! \brief One model's preprocessing. mean and stddev are indexed in output (order) order.
+//!
+struct PreprocessSpec
+{
+    DecodeMode decode{DecodeMode::kSCALED};
+    ResizeFilter filter{ResizeFilter::kLINEAR};
+    ResizeMode resize{ResizeMode::kSTRETCH};
+    uint8_t padRGB[3]{0, 0, 0};
+    ColorOrder order{ColorOrder::kRGB};
+    float mean[3]{0.0f, 0.0f, 0.0f};
+    float stddev[3]{255.0f, 255.0f, 255.0f};
+    InputType type{InputType::kFLOAT};
+};
+
+//!
+//! \brief The spec as the affine normalization the arithmetic kernels, the device and the shard
+//!        headers use: scale = 1 / std, bias = -mean / std, in output order.
+//!
+inline PackParams preprocessPackParams(const PreprocessSpec& spec)
+{
+    PackParams params;
+    for (int c = 0; c < 3; ++c)
+    {
+        params.scale[c] = 1.0f / spec.stddev[c];
+        params.bias[c] = 0.0f - spec.mean[c] / spec.stddev[c];
+    }
+    return params;
+}
+
+//!
+//! \brief One line for logs and result files, in the file syntax.
+//!
+inline std::string preprocessSpecString(const PreprocessSpec& spec)
+{
+    std::ostringstream out;
+    out << "decode=" << decodeModeName(spec.decode) << " filter=" << resizeFilterName(spec.filter)
+        << " resize=" << resizeModeName(spec.resize) << " pad=" << int(spec.padRGB[0]) << ","
+        << int(spec.padRGB[1]) << "," << int(spec.padRGB[2]) << " order=" << colorOrderName(spec.order)
+        << " mean=" << spec.mean[0] << "," << spec.mean[1] << "," << spec.mean[2] << " std=" << spec.stddev[0]
+        << "," << spec.stddev[1] << "," << spec.stddev[2] << " dtype=" << inputTypeName(spec.type);
+    return out.str();
+}
+
+namespace detail
+{
+
+inline std::string trimSpace(const std::string& text)
+{
+    const size_t begin = text.find_first_not_of(" \t\r");
+    if (begin == std::string::npos)
+    {
+        return std::string();
+    }
+    return text.substr(begin, text.find_last_not_of(" \t\r") + 1 - begin);
+}
+
+//!
+//! \brief Three comma-separated numbers, or one for all three channels.
+//!
+inline bool parseTriple(const std::string& text, float values[3])
+{
+    std::istringstream in(text);
+    std::string item;
+    int count = 0;
+    while (std::getline(in, item, ','))
+    {
+        item = trimSpace(item);
+        char* end = nullptr;
+        const float value = std::strtof(item.c_str(), &end);
+        if (count == 3 || item.empty() || *end != '\0')
+        {
+            return false;
+        }
+        values[count++] = value;
+    }
+    if (count == 1)
+    {
+        values[1] = values[2] = values[0];
+    }
+    return count == 1 || count == 3;
+}
+
+} // namespace detail
+
+//!
+//! \brief Applies the key = value lines of in to spec. On failure error says which line is wrong
+//!        and spec may be partly updated.
+//!
+inline bool parsePreprocessSpec(std::istream& in, PreprocessSpec& spec, std::string& error)
+{
+    std::string line;
+    for (int number = 1; std::getline(in, line); ++number)
+    {
+        line = detail::trimSpace(line.substr(0, line.find('#')));
+        if (line.empty())
+        {
+            continue;
+        }
+        const size_t equals = line.find('=');
+        const std::string key = detail::trimSpace(line.substr(0, equals));
+        const std::string value
+            = equals == std::string::npos ? std::string() : detail::trimSpace(line.substr(equals + 1));
+        if (value.empty())
+        {
+            error = "line " + std::to_string(number) + ": expected key = value";
+            return false;
+        }
+        bool ok = true;
+        if (key == "decode")
+        {
+            ok = value == "scaled" || value == "full";
+            spec.decode = value == "full" ? DecodeMode::kFULL : DecodeMode::kSCALED;
+        }
+        else if (key == "filter")
+        {
+            const ResizeFilter filters[]
+                = {ResizeFilter::kLINEAR, ResizeFilter::kNEAREST, ResizeFilter::kCUBIC, ResizeFilter::kAREA};
+            ok = false;
+            for (ResizeFilter filter : filters)
+            {
+                if (value == resizeFilterName(filter))
+                {
+                    spec.filter = filter;
+                    ok = true;
+                }
+            }
+        }
+        else if (key == "resize")
+        {
+            ok = parseResizeMode(value, spec.resize);
+        }
+        else if (key == "pad")
+        {
+            float pad[3];
+            ok = detail::parseTriple(value, pad);
+            for (int c = 0; ok && c < 3; ++c)
+            {
+                ok = pad[c] >= 0.0f && pad[c] <= 255.0f;
+            }
+            for (int c = 0; ok && c < 3; ++c)
+            {
+                spec.padRGB[c] = static_cast<uint8_t>(pad[c] + 0.5f);
+            }
+        }
+        else if (key == "order")
+        {
+            ok = value == "rgb" || value == "bgr";
+            spec.order = value == "bgr" ? ColorOrder::kBGR : ColorOrder::kRGB;
+        }
+        else if (key == "mean")
+        {
+            ok = detail::parseTriple(value, spec.mean);
+        }
+        else if (key == "std")
+        {
+            ok = detail::parseTriple(value, spec.stddev) && spec.stddev[0] != 0.0f && spec.stddev[1] != 0.0f
+                && spec.stddev[2] != 0.0f;
+        }
+        else if (key == "dtype")
+        {
+            ok = parseInputType(value, spec.type);
+        }
+        else
+        {
+            error = "line " + std::to_string(number) + ": unknown key \"" + key + "\"";
+            return false;
+        }
+        if (!ok)
+        {
+            error = "line " + std::to_string(number) + ": bad value \"" + value + "\" for " + key;
+            return false;
+        }
+    }
+    return true;
+}
+
+//!
+//! \brief parsePreprocessSpec on the file at path.
+//!
+inline bool loadPreprocessSpec(const std::string& path, PreprocessSpec& spec, std::string& error)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        error = "cannot open " + path;
+        return false;
+    }
+    if (!parsePreprocessSpec(file, spec, error))
+    {
+        error = path + ", " + error;
+        return false;
+    }
+    return true;
+}
+
+} // namespace mine
+
+#endif // SAMPLE_MINE_PREPROCESS_SPEC_H
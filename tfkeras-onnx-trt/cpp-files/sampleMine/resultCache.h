@@ -0,0 +1,449 @@
+#ifndef SAMPLE_MINE_RESULT_CACHE_H
+#define SAMPLE_MINE_RESULT_CACHE_H
+
+//
+// Content-addressed cache of predictions, in front of a backend.
+//
+// Images are keyed by a 64-bit XXH64 hash of their encoded bytes (or of their
+// pixels, for BGR views), seeded with the identity of the engine and of the
+// preprocessing settings, so a result is only ever reused for the very same
+// input run through the very same model. A hit is answered from memory without
+// decoding, preprocessing or executing anything; only the misses of a batch go
+// on to the backend, and their predictions are added on the way back. Behind a
+// BatchScheduler, images are hashed and looked up as they are submitted, on the
+// submitting thread, so hits never wait for a batch and the dispatcher never
+// hashes or reads a file. The cache
+// holds a fixed number of bytes and evicts the least recently used results.
+//
+
+#include "inferenceBackend.h"
+#include "jpegDecode.h"
+
+#include <cstdint>
+#include <cstring>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace mine
+{
+
+namespace detail
+{
+
+const uint64_t kXxhPrime1 = 0x9E3779B185EBCA87ull;
+const uint64_t kXxhPrime2 = 0xC2B2AE3D27D4EB4Full;
+const uint64_t kXxhPrime3 = 0x165667B19E3779F9ull;
+const uint64_t kXxhPrime4 = 0x85EBCA77C2B2CA63ull;
+const uint64_t kXxhPrime5 = 0x27D4EB2F165667C5ull;
+
+inline uint64_t rotl64(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+inline uint64_t read64(const uint8_t* p)
+{
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint32_t read32(const uint8_t* p)
+{
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint64_t xxhRound(uint64_t acc, uint64_t input)
+{
+    return rotl64(acc + input * kXxhPrime2, 31) * kXxhPrime1;
+}
+
+inline uint64_t xxhMerge(uint64_t acc, uint64_t lane)
+{
+    return (acc ^ xxhRound(0, lane)) * kXxhPrime1 + kXxhPrime4;
+}
+
+} // namespace detail
+
+//!
+//! \brief XXH64 of size bytes at data; several GB/s, so hashing an image costs far less than
+//!        decoding it. Reads the input as little-endian, which all our targets are.
+//!
+inline uint64_t hash64(const void* data, size_t size, uint64_t seed = 0)
+{
+    using namespace detail;
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    const uint8_t* const end = p + size;
+    uint64_t h;
+    if (size >= 32)
+    {
+        uint64_t v1 = seed + kXxhPrime1 + kXxhPrime2;
+        uint64_t v2 = seed + kXxhPrime2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - kXxhPrime1;
+        for (const uint8_t* const last = end - 32; p <= last; p += 32)
+        {
+            v1 = xxhRound(v1, read64(p));
+            v2 = xxhRound(v2, read64(p + 8));
+            v3 = xxhRound(v3, read64(p + 16));
+            v4 = xxhRound(v4, read64(p + 24));
+        }
+        h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+        h = xxhMerge(h, v1);
+        h = xxhMerge(h, v2);
+        h = xxhMerge(h, v3);
+        h = xxhMerge(h, v4);
+    }
+    else
+    {
+        h = seed + kXxhPrime5;
+    }
+    h += size;
+    for (; p + 8 <= end; p += 8)
+    {
+        h = rotl64(h ^ xxhRound(0, read64(p)), 27) * kXxhPrime1 + kXxhPrime4;
+    }
+    if (p + 4 <= end)
+    {
+        h = rotl64(h ^ (read32(p) * kXxhPrime1), 23) * kXxhPrime2 + kXxhPrime3;
+        p += 4;
+    }
+    for (; p < end; ++p)
+    {
+        h = rotl64(h ^ (*p * kXxhPrime5), 11) * kXxhPrime1;
+    }
+    h ^= h >> 33;
+    h *= kXxhPrime2;
+    h ^= h >> 29;
+    h *= kXxhPrime3;
+    h ^= h >> 32;
+    return h;
+}
+
+//!
+//! \brief What a cached prediction is looked up by.
+//!
+struct ResultKey
+{
+    uint64_t hash; //!< hash64 of the image, seeded with the engine identity
+    uint64_t size; //!< Bytes hashed, a cheap extra guard against collisions
+
+    bool operator==(const ResultKey& other) const
+    {
+        return hash == other.hash && size == other.size;
+    }
+};
+
+struct ResultKeyHasher
+{
+    size_t operator()(const ResultKey& key) const
+    {
+        return static_cast<size_t>(key.hash);
+    }
+};
+
+//!
+//! \brief Key of request under engine, reading the file of path-only requests into loaded.
+//!        False for what is not cached: preprocessed tensors and unreadable files.
+//!
+inline bool resultKey(const ImageRequest& request, uint64_t engine, ResultKey& key, std::vector<uint8_t>& loaded)
+{
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    uint64_t seed = engine;
+    if (request.tensor.data)
+    {
+        return false;
+    }
+    if (request.view.data)
+    {
+        data = request.view.data;
+        size = request.view.size;
+        // Pixels of a different shape are a different image
+        seed ^= (static_cast<uint64_t>(request.view.width) << 32 | static_cast<uint32_t>(request.view.height))
+            * detail::kXxhPrime3;
+    }
+    else if (!request.bytes.empty())
+    {
+        data = request.bytes.data();
+        size = request.bytes.size();
+    }
+    else if (readFileBytes(request.path, loaded) && !loaded.empty())
+    {
+        data = loaded.data();
+        size = loaded.size();
+    }
+    else
+    {
+        return false;
+    }
+    key.hash = hash64(data, size, seed);
+    key.size = size;
+    return true;
+}
+
+//!
+//! \brief Thread-safe LRU map from image keys to predictions, holding at most capacityBytes.
+//!
+class ResultCache
+{
+public:
+    struct Stats
+    {
+        uint64_t hits{0};
+        uint64_t misses{0};
+        uint64_t evictions{0};
+        size_t entries{0};
+        size_t bytes{0}; //!< Estimated memory held, entries and bookkeeping
+        size_t capacityBytes{0};
+
+        double hitRate() const
+        {
+            return hits + misses > 0 ? static_cast<double>(hits) / (hits + misses) : 0.0;
+        }
+    };
+
+    explicit ResultCache(size_t capacityBytes)
+        : mCapacityBytes(capacityBytes)
+    {
+    }
+
+    //!
+    //! \brief Copies the prediction for key into prediction and makes it the most recently used.
+    //!
+    bool lookup(const ResultKey& key, Prediction& prediction)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        const auto found = mIndex.find(key);
+        if (found == mIndex.end())
+        {
+            ++mMisses;
+            return false;
+        }
+        ++mHits;
+        mEntries.splice(mEntries.begin(), mEntries, found->second);
+        prediction = found->second->prediction;
+        return true;
+    }
+
+    //!
+    //! \brief Stores prediction under key, evicting the least recently used entries to make room.
+    //!
+    void insert(const ResultKey& key, const Prediction& prediction)
+    {
+        const size_t bytes = entryBytes(prediction);
+        if (bytes > mCapacityBytes)
+        {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mMutex);
+        const auto found = mIndex.find(key);
+        if (found != mIndex.end())
+        {
+            // The same image was in flight twice; keep the first result
+            mEntries.splice(mEntries.begin(), mEntries, found->second);
+            return;
+        }
+        while (mBytes + bytes > mCapacityBytes)
+        {
+            const Entry& oldest = mEntries.back();
+            mBytes -= oldest.bytes;
+            mIndex.erase(oldest.key);
+            mEntries.pop_back();
+            ++mEvictions;
+        }
+        mEntries.push_front(Entry{key, prediction, bytes});
+        mIndex.emplace(key, mEntries.begin());
+        mBytes += bytes;
+    }
+
+    Stats stats() const
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        Stats stats;
+        stats.hits = mHits;
+        stats.misses = mMisses;
+        stats.evictions = mEvictions;
+        stats.entries = mEntries.size();
+        stats.bytes = mBytes;
+        stats.capacityBytes = mCapacityBytes;
+        return stats;
+    }
+
+private:
+    struct Entry
+    {
+        ResultKey key;
+        Prediction prediction;
+        size_t bytes;
+    };
+
+    //! Memory one entry takes: itself, its probabilities, a list node and an index node
+    static size_t entryBytes(const Prediction& prediction)
+    {
+        return sizeof(Entry) + prediction.probabilities.size() * sizeof(float) + 2 * sizeof(void*)
+            + sizeof(ResultKey) + sizeof(std::list<Entry>::iterator) + 3 * sizeof(void*);
+    }
+
+    mutable std::mutex mMutex;
+    std::list<Entry> mEntries; //!< Most recently used first
+    std::unordered_map<ResultKey, std::list<Entry>::iterator, ResultKeyHasher> mIndex;
+    size_t mCapacityBytes;
+    size_t mBytes{0};
+    uint64_t mHits{0};
+    uint64_t mMisses{0};
+    uint64_t mEvictions{0};
+};
+
+//!
+//! \brief Answers the images of a batch it has seen before from a ResultCache, and sends only
+//!        the others on to the wrapped backend.
+//!
+//! engine identifies the model and everything that changes its output for a given image
+//! (preprocessing, top-k), see SampleMine::engineIdentity(). A batch the wrapped backend fails
+//! fails as a whole, hits included, as it would have without the cache.
+//!
+class CachingBackend : public InferenceBackend
+{
+public:
+    CachingBackend(InferenceBackend& backend, ResultCache& cache, uint64_t engine)
+        : mBackend(backend)
+        , mCache(cache)
+        , mEngine(engine)
+    {
+    }
+
+    int maxBatchSize() const override
+    {
+        return mBackend.maxBatchSize();
+    }
+
+    bool infer(const std::vector<const ImageRequest*>& requests, std::vector<Prediction>& predictions) override
+    {
+        Batch batch;
+        lookup(requests, batch);
+        std::vector<Prediction> computed;
+        if (!batch.misses.empty() && !mBackend.infer(batch.misses, computed))
+        {
+            return false;
+        }
+        const bool ok = complete(batch, computed);
+        predictions.swap(batch.predictions);
+        return ok;
+    }
+
+    //!
+    //! \brief Answers a hit; a miss keeps its key in request.cacheTag, and a path-only miss its
+    //!        file in request.bytes, so its batch neither hashes nor reads it again.
+    //!
+    bool answerNow(ImageRequest& request, Prediction& prediction) override
+    {
+        ResultKey key{0, 0};
+        std::vector<uint8_t> loaded;
+        if (!resultKey(request, mEngine, key, loaded))
+        {
+            return false;
+        }
+        if (mCache.lookup(key, prediction))
+        {
+            return true;
+        }
+        if (!loaded.empty())
+        {
+            request.bytes.swap(loaded);
+        }
+        request.cacheTag.hash = key.hash;
+        request.cacheTag.size = key.size;
+        return false;
+    }
+
+    void inferAsync(const std::vector<const ImageRequest*>& requests, BatchCallback done) override
+    {
+        std::shared_ptr<Batch> batch = std::make_shared<Batch>();
+        lookup(requests, *batch);
+        if (batch->misses.empty())
+        {
+            done(true, batch->predictions);
+            return;
+        }
+        // batch owns the files read for the misses, which must outlive the inner batch
+        const std::vector<const ImageRequest*> misses = batch->misses;
+        mBackend.inferAsync(misses, [this, batch, done](bool ok, std::vector<Prediction>& computed) {
+            ok = ok && complete(*batch, computed);
+            done(ok, batch->predictions);
+        });
+    }
+
+private:
+    //!
+    //! \brief The hits and misses of one batch, and where the predictions of the misses go.
+    //!
+    struct Batch
+    {
+        std::vector<Prediction> predictions;
+        std::vector<const ImageRequest*> misses;
+        std::vector<size_t> missIndex; //!< Position of misses[j] in the batch
+        std::vector<ResultKey> missKeys;
+        std::vector<bool> cacheable; //!< misses[j] has a key in missKeys[j]
+        std::vector<std::unique_ptr<ImageRequest>> loaded; //!< Path-only misses, with the file read once
+    };
+
+    void lookup(const std::vector<const ImageRequest*>& requests, Batch& batch)
+    {
+        batch.predictions.resize(requests.size());
+        for (size_t i = 0; i < requests.size(); ++i)
+        {
+            ResultKey key{requests[i]->cacheTag.hash, requests[i]->cacheTag.size};
+            std::vector<uint8_t> loaded;
+            // A tagged request was looked up, and missed, when it was submitted (answerNow())
+            const bool tagged = key.size > 0;
+            const bool cacheable = tagged || resultKey(*requests[i], mEngine, key, loaded);
+            if (!tagged && cacheable && mCache.lookup(key, batch.predictions[i]))
+            {
+                continue;
+            }
+            const ImageRequest* miss = requests[i];
+            if (!loaded.empty())
+            {
+                // The backend decodes the bytes already read rather than the file again
+                batch.loaded.emplace_back(new ImageRequest(*requests[i]));
+                batch.loaded.back()->bytes.swap(loaded);
+                miss = batch.loaded.back().get();
+            }
+            batch.misses.push_back(miss);
+            batch.missIndex.push_back(i);
+            batch.missKeys.push_back(key);
+            batch.cacheable.push_back(cacheable);
+        }
+    }
+
+    bool complete(Batch& batch, std::vector<Prediction>& computed)
+    {
+        if (computed.size() != batch.misses.size())
+        {
+            return false;
+        }
+        for (size_t j = 0; j < computed.size(); ++j)
+        {
+            if (batch.cacheable[j] && computed[j].ok)
+            {
+                mCache.insert(batch.missKeys[j], computed[j]);
+            }
+            batch.predictions[batch.missIndex[j]] = std::move(computed[j]);
+        }
+        return true;
+    }
+
+    InferenceBackend& mBackend;
+    ResultCache& mCache;
+    uint64_t mEngine;
+};
+
+} // namespace mine
+
+#endif // SAMPLE_MINE_RESULT_CACHE_H
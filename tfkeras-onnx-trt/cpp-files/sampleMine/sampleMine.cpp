@@ -1,103 +1,338 @@
-#include "BatchStream.h"
-#include "EntropyCalibrator.h"
 #include "argsParser.h"
+#include "batchScheduler.h"
+#include "bulkInput.h"
 #include "buffers.h"
+#include "calibrationCache.h"
 #include "common.h"
+#include "executionSlot.h"
+#include "fileReader.h"
+#include "hostArena.h"
+#include "httpServer.h"
+#include "imageBatchStream.h"
+#include "imagePacking.h"
+#include "imageResize.h"
+#include "inferenceBackend.h"
+#include "inputType.h"
+#include "int8Calibrator.h"
+#include "jpegDecode.h"
+#include "layoutConvert.h"
 #include "logger.h"
+#include "mappedFile.h"
+#include "packKernels.h"
 #include "parserOnnxConfig.h"
+#include "perfCounters.h"
+#include "pipeline.h"
+#include "preprocessPipeline.h"
+#include "preprocessSpec.h"
+#include "resultCache.h"
+#include "shmRing.h"
+#include "slotPool.h"
+#include "softmax.h"
+#include "stageStats.h"
+#include "tensorDesc.h"
+#include "tensorShard.h"
+#include "threadPool.h"
+#include "traceEvents.h"
+#include "trtExecutionSlot.h"
 
 #include "opencv2/highgui.hpp"
 #include "opencv2/imgproc.hpp"
 
 #include "NvInfer.h"
+#include "NvOnnxParser.h"
 #include <cuda_runtime_api.h>
 
+#include <atomic>
+#include <condition_variable>
+#include <csignal>
 #include <cstdlib>
+#include <cstring>
+#include <deque>
 #include <fstream>
 #include <iostream>
+#include <mutex>
 #include <sstream>
+#include <thread>
+
+#include <unistd.h>
 
 // Given a serialized engine plan for inception_v3 model (channels_first),
-// deserialize engine and run inference on an image
+// deserialize engine and run inference on single-image requests, batched
+// dynamically by a mine::BatchScheduler and optionally pipelined over several
+// execution slots by a mine::PipelinedBackend
 
 const std::string gSampleName = "TensorRT.sample_mine";
 
+// Available images, submitted round robin as individual requests
+const std::vector<std::string> gImageList = {"dog.0.jpg", "cat.0.jpg", "dog.1.jpg", "cat.1.jpg"};
+const std::vector<std::string> gClassNames = {"cat", "dog"};
+
+// gLogger streams are not thread safe; pipeline stages log from their own threads
+std::mutex gLogMutex;
+
 //
 // !! https://forums.developer.nvidia.com/t/custom-trained-ssd-inception-model-in-tensorrt-c-version/143048/14
 //
-void readImage(const std::string& filename, cv::Mat &image)
+// Decoded as preprocess says: JPEGs at the smallest DCT scale (1/2, 1/4, 1/8) that
+// still covers the region of the input the image is resized into, unless the spec
+// asks for full size. Called from preprocessing workers, so it does not log; denom
+// receives the scale used. BGR pixels in a view are wrapped, not copied. A file is
+// read into the calling thread's arena, so call it within an ArenaScope that
+// outlives image.
+//
+bool readImage(
+    const mine::ImageRequest& request, const mine::PreprocessPipeline& preprocess, cv::Mat& image, int& denom)
 {
-    image = cv::imread(filename, cv::IMREAD_COLOR);
-    if( image.empty() )
+    const mine::ImageView& view = request.view;
+    if (view.data && view.width > 0)
+    {
+        image = cv::Mat(view.height, view.width, CV_8UC3, const_cast<uint8_t*>(view.data));
+        denom = 1;
+        return true;
+    }
+    if (view.data)
+    {
+        return preprocess.decode(view.data, view.size, image, denom);
+    }
+    if (!request.bytes.empty())
     {
-        std::cout << "Cannot open image " << filename << std::endl;
-        exit(0);
+        return preprocess.decode(request.bytes.data(), request.bytes.size(), image, denom);
     }
-    gLogInfo << filename <<   " " << image.channels() <<  "x" << image.rows<<  "x" << image.cols<< "HWC original" <<std::endl;
-    cv::resize(image, image, cv::Size(299,299));
-    gLogInfo << filename <<   " " << image.channels() <<  "x" << image.rows<<  "x" << image.cols<< "HWC resized" <<std::endl;
+    const uint8_t* bytes = nullptr;
+    size_t size = 0;
+    return mine::readFileToArena(request.path, mine::threadArena(), bytes, size)
+        && preprocess.decode(bytes, size, image, denom);
 }
 
+//!
+//! \brief The sample_mine specific parameters, on top of the common ONNX sample ones
+//!
+struct SampleMineParams : public samplesCommon::OnnxSampleParams
+{
+    mine::PreprocessSpec preprocess;                         //!< Decode, resize, normalization and host input type
+    int preprocessThreads{0};                                //!< Batch preprocessing workers, 0 = one per core
+    int maxQueueDelayUs{2000};                               //!< Longest a request waits for its batch to fill
+    int pipelineSlots{0};                                    //!< Batches in flight at once, 0 = no pipelining
+    int contexts{1};                                         //!< Execution slots created up front and reused
+    int topK{1};                                             //!< Classes reported per image
+    bool logImages{true};                                    //!< Log the decode and top classes of every image
+    std::string bulkInput;                                   //!< Directory or manifest to score, empty = gImageList
+    std::string bulkOutput;                                  //!< CSV results of bulk mode, empty = stdout
+    std::string bulkCheckpoint;                              //!< Progress file of bulk mode, empty = none
+    bool bulkResume{false};                                  //!< Continue from bulkCheckpoint
+    int checkpointEvery{1000};                               //!< Rows between checkpoints
+    int prefetchDepth{0};                                    //!< Image files read ahead, 0 = read when decoding
+    mine::FileReaderKind fileReader{mine::FileReaderKind::kAUTO}; //!< How prefetched files are read
+    std::string calibrationInput;                            //!< INT8 calibration images, empty = gImageList
+    std::string calibrationCache;                            //!< Calibration scales reused across INT8 builds
+    int calibrationBatches{64};                              //!< Most batches INT8 calibration reads
+    bool benchmark{false};                                   //!< Time full batches instead of scoring images
+    int warmupBatches{10};                                   //!< Untimed batches before the benchmark
+    int benchmarkBatches{100};                               //!< Timed batches of the benchmark
+    std::string benchmarkJson;                               //!< Benchmark results file, empty = log only
+    std::string traceFile;                                   //!< Chrome trace written at exit, empty = no tracing
+    bool perfCounters{false};                                //!< The benchmark also counts hardware events
+    std::string shmName;                                     //!< Shared memory ring to serve, empty = none
+    int shmSlots{64};                                        //!< Request slots of the ring, a power of two
+    int shmSlotBytes{1 << 20};                               //!< Largest image one request can carry
+    int shmClients{16};                                      //!< Client processes the ring has room for
+    std::string httpHost{"127.0.0.1"};                       //!< Address the HTTP server listens on
+    int httpPort{-1};                                        //!< HTTP server port, 0 = any free one, -1 = none
+    size_t resultCacheBytes{0};                              //!< Predictions of repeated images kept, 0 = no cache
+    int fakeLatencyUs{-1};                                   //!< >= 0: the engine is faked, see useFakeEngine()
+};
+
+//!
+//! \brief The sample_mine specific command line options, on top of the common ones
+//!
+struct SampleMineArgs : public samplesCommon::Args
+{
+    mine::PreprocessSpec preprocess; //!< --preprocess file, then --resize and --inputType
+    bool inputTypeGiven{false};      //!< Otherwise --fp16 selects half input
+    int batchSize{1};
+    int threads{0};
+    int maxQueueDelayUs{2000};
+    int requests{0};          //!< Requests to submit, 0 = one per image in gImageList
+    int fakeLatencyUs{-1};    //!< >= 0 replaces engine execution with a sleep of this many us per batch
+    int pipeline{0};          //!< Execution slots of the pipeline, 0 = run batches one at a time
+    int contexts{0};          //!< Size of the execution slot pool, 0 = as many as the pipeline needs
+    int topK{1};
+    int logImages{-1};        //!< -1 = on, except in bulk mode
+    std::string input;
+    std::string output;
+    std::string checkpoint;
+    bool resume{false};
+    int checkpointEvery{1000};
+    int prefetch{-1};         //!< -1 = 64 in bulk mode, off otherwise
+    mine::FileReaderKind reader{mine::FileReaderKind::kAUTO};
+    std::string calibInput;
+    std::string calibCache{"dogs_vs_cats_model.calib"};
+    int calibBatches{64};
+    bool benchmark{false};
+    int warmup{10};
+    int iterations{100};
+    std::string json;
+    std::string trace;
+    int traceEvents{0}; //!< 0 = the tracer's default
+    bool perfCounters{false};
+    std::string shm;
+    int shmSlots{64};
+    int shmSlotKiB{1024};
+    std::string httpHost{"127.0.0.1"};
+    int httpPort{-1};
+    int cacheMiB{0};
+};
+
 
-class SampleMine
+class SampleMine : public mine::InferenceBackend, public mine::BatchStages
 {
     template <typename T>
     using SampleUniquePtr = std::unique_ptr<T, samplesCommon::InferDeleter>;
 
 public:
-    SampleMine(const samplesCommon::OnnxSampleParams& params)
+    SampleMine(const SampleMineParams& params)
         : mParams(params)
         , mEngine(nullptr)
+        , mPreprocessPool(params.preprocessThreads)
     {
     }
 
     //!
-    //! \brief Builds the network engine
+    //! \brief Builds the network engine: deserializes the plan, or with --int8 builds a calibrated
+    //!        INT8 engine from the ONNX model
     //!
     bool build();
 
     //!
-    //! \brief Runs the TensorRT inference engine for this sample
+    //! \brief Skips the engine: slots sleep latency per batch instead of executing, and output
+    //!        uniform scores. Preprocessing and post-processing still run for real. False if the
+    //!        preprocessing cannot be compiled.
     //!
-    bool infer();
+    bool useFakeEngine(std::chrono::microseconds latency);
 
-private:
-    samplesCommon::OnnxSampleParams mParams;
+    //!
+    //! \brief Buffers and execution context for one batch in flight, nullptr on failure
+    //!
+    std::unique_ptr<mine::ExecutionSlot> createSlot();
+
+    //!
+    //! \brief Pre-creates the execution slots infer() and the pipeline check out; call after build()
+    //!
+    bool createSlotPool(int size);
+
+    mine::SlotPool& slotPool()
+    {
+        return *mSlotPool;
+    }
+
+    //!
+    //! \brief Records the time of every stage into stats from now on; nullptr stops recording.
+    //!
+    void recordStageStats(mine::StageStats* stats)
+    {
+        mStageStats = stats;
+    }
 
-    nvinfer1::Dims mInputDims;  //!< The dimensions of the input to the network.
-    nvinfer1::Dims mOutputDims; //!< The dimensions of the output to the network.
+    int preprocessThreads() const
+    {
+        return mPreprocessPool.size();
+    }
+
+    //!
+    //! \brief Identifies the engine and the settings that change its prediction for an image, so
+    //!        results cached under one are never returned for another; call after build()
+    //!
+    uint64_t engineIdentity() const
+    {
+        const std::string preprocess = mine::preprocessSpecString(mParams.preprocess);
+        const uint64_t settings[] = {mEngineHash, mine::hash64(preprocess.data(), preprocess.size()),
+            static_cast<uint64_t>(mParams.topK)};
+        return mine::hash64(settings, sizeof(settings));
+    }
+
+    int maxBatchSize() const override
+    {
+        return mParams.batchSize;
+    }
+
+    //!
+    //! \brief Runs the TensorRT inference engine on one batch of requests; called by the batch scheduler
+    //!
+    bool infer(
+        const std::vector<const mine::ImageRequest*>& requests, std::vector<mine::Prediction>& predictions) override;
+
+    bool preprocess(const std::vector<const mine::ImageRequest*>& requests, mine::ExecutionSlot& slot,
+        std::vector<mine::Prediction>& predictions) override
+    {
+        return processInput(slot.hostInput(), requests, predictions);
+    }
 
-    cv::Mat image;  // the test IMAGE
+    bool postprocess(const std::vector<const mine::ImageRequest*>& requests, mine::ExecutionSlot& slot,
+        std::vector<mine::Prediction>& predictions) override
+    {
+        if (!mStageStats)
+        {
+            return verifyOutput(slot.hostOutput(), requests, predictions);
+        }
+        // The slot has run by now, so its step times are those of this batch
+        const mine::ExecutionSlot::StepTimes steps = slot.lastStepTimes();
+        mStageStats->record(mine::Stage::kH2D, steps.h2dUs);
+        mStageStats->record(mine::Stage::kEXECUTE, steps.executeUs);
+        mStageStats->record(mine::Stage::kD2H, steps.d2hUs);
+        mine::PerfCounterValues before, after;
+        const bool counting = mStageStats->countEvents() && mine::readThreadPerfCounters(before);
+        const auto start = std::chrono::steady_clock::now();
+        const bool ok = verifyOutput(slot.hostOutput(), requests, predictions);
+        mStageStats->record(mine::Stage::kSOFTMAX,
+            std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+        if (counting && mine::readThreadPerfCounters(after))
+        {
+            mStageStats->recordCounters(mine::Stage::kSOFTMAX, after - before);
+        }
+        return ok;
+    }
+
+private:
+    SampleMineParams mParams;
+
+    mine::TensorDesc mInputDesc;  //!< Shape, layout and type of the input binding
+    mine::TensorDesc mOutputDesc; //!< Shape and type of the output binding, one row of class scores per image
 
     std::shared_ptr<nvinfer1::ICudaEngine> mEngine; //!< The TensorRT engine used to run the network
+    bool mFakeEngine{false};                        //!< Slots are mine::FakeExecutionSlot, see useFakeEngine()
+    std::chrono::microseconds mFakeLatency{0};
+    uint64_t mEngineHash{0};                        //!< hash64 of the serialized engine, see engineIdentity()
+
+    mine::ThreadPool mPreprocessPool; //!< Decodes, resizes and packs the images of a batch in parallel
+    mine::PreprocessPipeline mPreprocess; //!< mParams.preprocess compiled for the input binding
+
+    std::unique_ptr<mine::SlotPool> mSlotPool; //!< Buffers and contexts reused across batches
+
+    mine::StageStats* mStageStats{nullptr}; //!< Where stage times go, see recordStageStats()
+
+    bool loadPlan();
+
+    bool buildInt8Engine();
+
+    bool checkBindings() const;
+
+    bool compilePreprocess();
 
-    bool processInput(const samplesCommon::BufferManager& buffers);
+    bool processInput(void* hostDataBuffer, const std::vector<const mine::ImageRequest*>& requests,
+        std::vector<mine::Prediction>& predictions);
 
-    bool verifyOutput(const samplesCommon::BufferManager& buffers);
+    bool verifyOutput(const float* output, const std::vector<const mine::ImageRequest*>& requests,
+        std::vector<mine::Prediction>& predictions);
 };
 
 //!
-//! \brief BUILD - read serialized engine
+//! \brief BUILD - read serialized engine, or build an INT8 one
 //!
 bool SampleMine::build()
 {
-
-    gLogInfo << "... Importing TensorRT engine "<<mParams.onnxFileName << locateFile(mParams.onnxFileName, mParams.dataDirs).c_str() << std::endl;
-    std::ifstream ifs(locateFile(mParams.onnxFileName, mParams.dataDirs).c_str(), std::ios::binary | std::ios::ate);
-        
-    std::ifstream::pos_type len = ifs.tellg();
-    std::vector<char> blob(len);
-    ifs.seekg(0, std::ios::beg);
-    ifs.read(&blob[0], len);
-    IRuntime* runtime = createInferRuntime(gLogger);
-    mEngine = std::shared_ptr<nvinfer1::ICudaEngine>(
-        runtime->deserializeCudaEngine(&blob[0], blob.size(), nullptr),
-	samplesCommon::InferDeleter());
-
-    runtime->destroy();
-    if (!mEngine)
+    const mine::TraceScope trace("build");
+    if (!(mParams.int8 ? buildInt8Engine() : loadPlan()))
     {
-        gLogInfo << "COULD NOT LOAD ENGINE?"<<std::endl;
         return false;
     }
 
@@ -107,204 +342,1804 @@ bool SampleMine::build()
     for (int b = 0; b < nbindings; ++b)
     {
         nvinfer1::Dims dims = mEngine.get()->getBindingDimensions(b);
+        const mine::TensorDesc desc = mine::describeTensor(dims,
+            static_cast<mine::ElementType>(mEngine.get()->getBindingDataType(b)),
+            mEngine.get()->hasImplicitBatchDimension());
         if (mEngine.get()->bindingIsInput(b))
         {
-            mInputDims = dims;
+            mInputDesc = desc;
             if (true) //mParams.verbose)
             {
-                gLogInfo << "Found input: " << mEngine.get()->getBindingName(b) << " shape=" << dims
-                         << " dtype=" << (int) mEngine.get()->getBindingDataType(b) << std::endl;
+                gLogInfo << "Found input: " << mEngine.get()->getBindingName(b) << " shape=" << dims << " "
+                         << mine::tensorDescString(desc) << std::endl;
             }
         }
         else
         {
-            mOutputDims = dims;
+            mOutputDesc = desc;
             if (true) //mParams.verbose)
             {
-                gLogInfo << "Found output: " << mEngine.get()->getBindingName(b) << " shape=" << dims
-                         << " dtype=" << (int) mEngine.get()->getBindingDataType(b) << std::endl;
+                gLogInfo << "Found output: " << mEngine.get()->getBindingName(b) << " shape=" << dims << " "
+                         << mine::tensorDescString(desc) << std::endl;
             }
         }
     }
     //---
 
-    return true;
+    return checkBindings() && compilePreprocess();
 }
 
+//!
+//! \brief The input must be a fixed 3-channel image, in either layout, and an explicit batch must
+//!        hold --batch images: the images past it would be written but never run.
+//!
+bool SampleMine::checkBindings() const
+{
+    if (!mInputDesc.isImage() || mInputDesc.channels() != 3)
+    {
+        gLogError << "The input is " << mine::tensorDescString(mInputDesc)
+                  << ", expected a fixed 3-channel NCHW or NHWC image" << std::endl;
+        return false;
+    }
+    if (mInputDesc.batchAxis >= 0 && mInputDesc.batch() < mParams.batchSize)
+    {
+        gLogError << "The engine takes batches of " << mInputDesc.batch() << ", --batch is " << mParams.batchSize
+                  << "; export it with BATCH=" << mParams.batchSize << std::endl;
+        return false;
+    }
+    if (mInputDesc.type != mine::ElementType::kFLOAT && mInputDesc.type != mine::ElementType::kHALF)
+    {
+        gLogError << "The input is " << mine::tensorDescString(mInputDesc) << ", expected float or half values"
+                  << std::endl;
+        return false;
+    }
+    // A half binding is filled straight from the host buffer, so nothing else may be packed into it
+    if (mInputDesc.type == mine::ElementType::kHALF && mParams.preprocess.type != mine::InputType::kHALF)
+    {
+        gLogError << "The engine takes half input (HALF_INPUT=1), --inputType is "
+                  << mine::inputTypeName(mParams.preprocess.type) << "; run it with --inputType=half" << std::endl;
+        return false;
+    }
+    if (mOutputDesc.sampleElements() == 0)
+    {
+        gLogError << "The output is " << mine::tensorDescString(mOutputDesc) << ", expected class scores"
+                  << std::endl;
+        return false;
+    }
+    return true;
+}
 
+//!
+//! \brief Compiles the preprocessing spec for the input binding, once for every batch to come
+//!
+bool SampleMine::compilePreprocess()
+{
+    std::string error;
+    if (!mPreprocess.compile(mParams.preprocess, mInputDesc, error))
+    {
+        gLogError << "Cannot compile the preprocessing: " << error << std::endl;
+        return false;
+    }
+    gLogInfo << "Preprocessing: " << mine::preprocessSpecString(mParams.preprocess) << "; "
+             << mPreprocess.normalization() << ", kernel "
+             << (mPreprocess.specialized() ? "specialized for the shape" : "generic") << std::endl;
+    return true;
+}
 
-//! \brief INFER
 //!
-bool SampleMine::infer()
+//! \brief Maps and deserializes the plan built by model-to-onnx-to-trt.sh
+//!
+bool SampleMine::loadPlan()
 {
-    // Create RAII buffer manager object
-    samplesCommon::BufferManager buffers(mEngine, mParams.batchSize);
-    auto context = SampleUniquePtr<nvinfer1::IExecutionContext>(mEngine->createExecutionContext());
-    if (!context)
+    const mine::TraceScope trace("loadPlan");
+    gLogInfo << "... Importing TensorRT engine "<<mParams.onnxFileName << locateFile(mParams.onnxFileName, mParams.dataDirs).c_str() << std::endl;
+    // The plan is mapped rather than read into a heap copy; deserialization reads it straight
+    // from the page cache, and the mapping is dropped as soon as the engine exists
+    mine::MappedFile plan;
+    if (!plan.open(locateFile(mParams.onnxFileName, mParams.dataDirs)))
     {
+        gLogError << plan.error() << std::endl;
         return false;
     }
 
-    // Read the input data into the managed buffers
-    assert(mParams.inputTensorNames.size() == 1);
-    if (!processInput(buffers))
+    mEngineHash = mine::hash64(plan.data(), plan.size());
+    const auto deserializeStart = std::chrono::steady_clock::now();
+    IRuntime* runtime = createInferRuntime(gLogger);
+    mEngine = std::shared_ptr<nvinfer1::ICudaEngine>(
+        runtime->deserializeCudaEngine(plan.data(), plan.size(), nullptr),
+	samplesCommon::InferDeleter());
+
+    runtime->destroy();
+    const double deserializeMs
+        = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - deserializeStart).count();
+    gLogInfo << "... plan " << plan.size() / (1024 * 1024) << " MiB: open " << std::fixed << std::setprecision(2)
+             << plan.timings().openMs << " ms, map " << plan.timings().mapMs << " ms, deserialize " << deserializeMs
+             << " ms" << std::endl;
+    plan.close();
+    if (!mEngine)
+    {
+        gLogInfo << "COULD NOT LOAD ENGINE?"<<std::endl;
+        return false;
+    }
+    return true;
+}
+
+//!
+//! \brief Builds an INT8 engine from the ONNX model. The calibration batches are the calibration
+//!        images preprocessed like inference input; if the cache holds scales calibrated the same
+//!        way, TensorRT takes them from there and no image is decoded.
+//!
+bool SampleMine::buildInt8Engine()
+{
+    const mine::TraceScope trace("buildInt8Engine");
+    const std::string onnx = locateFile(mParams.onnxFileName, mParams.dataDirs);
+    gLogInfo << "... Building INT8 engine from " << onnx << std::endl;
+    auto builder = SampleUniquePtr<nvinfer1::IBuilder>(nvinfer1::createInferBuilder(gLogger.getTRTLogger()));
+    if (!builder || !builder->platformHasFastInt8())
+    {
+        gLogError << "This platform has no fast INT8" << std::endl;
+        return false;
+    }
+    const auto explicitBatch = 1U << static_cast<uint32_t>(NetworkDefinitionCreationFlag::kEXPLICIT_BATCH);
+    auto network = SampleUniquePtr<nvinfer1::INetworkDefinition>(builder->createNetworkV2(explicitBatch));
+    auto config = SampleUniquePtr<nvinfer1::IBuilderConfig>(builder->createBuilderConfig());
+    auto parser
+        = SampleUniquePtr<nvonnxparser::IParser>(nvonnxparser::createParser(*network, gLogger.getTRTLogger()));
+    if (!network || !config || !parser
+        || !parser->parseFromFile(onnx.c_str(), static_cast<int>(gLogger.getReportableSeverity())))
     {
+        gLogError << "Cannot parse " << onnx << std::endl;
         return false;
     }
 
-    // Memcpy from host input buffers to device input buffers
-    buffers.copyInputToDevice();
+    std::vector<mine::ImageEntry> images;
+    if (mParams.calibrationInput.empty())
+    {
+        for (const auto& name : gImageList)
+        {
+            images.push_back(mine::ImageEntry{name, locateFile(name, mParams.dataDirs)});
+        }
+    }
+    else
+    {
+        std::unique_ptr<mine::ImageSource> source = mine::openImageSource(mParams.calibrationInput);
+        if (!source)
+        {
+            gLogError << "Cannot open " << mParams.calibrationInput << std::endl;
+            return false;
+        }
+        mine::ImageEntry entry;
+        while (source->next(entry))
+        {
+            images.push_back(entry);
+        }
+    }
 
-    bool status = context->executeV2(buffers.getDeviceBindings().data());
-    if (!status)
+    const nvinfer1::Dims inputDims = network->getInput(0)->getDimensions();
+    mine::ImageBatchStream stream(
+        std::move(images), inputDims, mParams.calibrationBatches, mParams.preprocess, mParams.preprocessThreads);
+    if (!stream.valid())
+    {
+        gLogError << "INT8 calibration needs a fixed batch of 3-channel NCHW or NHWC images, the model takes "
+                  << inputDims << std::endl;
+        return false;
+    }
+    // Scales only carry over to the very same model: a re-exported ONNX at the same path gets new ones
+    mine::MappedFile model;
+    if (!model.open(onnx, false))
+    {
+        gLogError << "Cannot hash the model: " << model.error() << std::endl;
+        return false;
+    }
+    mine::CalibrationCache cache(mParams.calibrationCache, stream.key(mine::hash64(model.data(), model.size())));
+    model.close();
+    mine::Int8ImageCalibrator calibrator(stream, cache, mParams.inputTensorNames[0]);
+    if (!calibrator.valid())
     {
+        gLogError << "Cannot allocate the calibration batch" << std::endl;
         return false;
     }
 
-    // Memcpy from device output buffers to host output buffers
-    buffers.copyOutputToHost();
+    config->setMaxWorkspaceSize(1ULL << 30);
+    config->setFlag(BuilderFlag::kINT8);
+    if (mParams.fp16)
+    {
+        config->setFlag(BuilderFlag::kFP16);
+    }
+    config->setInt8Calibrator(&calibrator);
+    samplesCommon::enableDLA(builder.get(), config.get(), mParams.dlaCore);
 
-    // Verify results
-    if (!verifyOutput(buffers))
+    const auto buildStart = std::chrono::steady_clock::now();
+    mEngine = std::shared_ptr<nvinfer1::ICudaEngine>(
+        builder->buildEngineWithConfig(*network, *config), samplesCommon::InferDeleter());
+    const double buildSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - buildStart).count();
+    if (!mEngine)
     {
+        gLogError << "Cannot build the INT8 engine" << std::endl;
         return false;
     }
+    // Builds are not reproducible, so the identity is that of the engine, not of its inputs
+    const SampleUniquePtr<nvinfer1::IHostMemory> serialized(mEngine->serialize());
+    mEngineHash = serialized ? mine::hash64(serialized->data(), serialized->size()) : 0;
+    gLogInfo << "... INT8 engine built in " << std::fixed << std::setprecision(1) << buildSeconds << " s, ";
+    if (calibrator.cacheUsed())
+    {
+        gLogInfo << "scales from " << cache.path() << std::endl;
+    }
+    else
+    {
+        gLogInfo << "calibrated on " << stream.getBatchesRead() << " batches (" << stream.failed()
+                 << " unreadable images skipped), scales saved to " << cache.path() << std::endl;
+    }
+    return true;
+}
+
+
+
+bool SampleMine::useFakeEngine(std::chrono::microseconds latency)
+{
+    mFakeEngine = true;
+    mFakeLatency = latency;
+    mEngineHash = mine::hash64("fake", 4);
+    // The bindings of the exported plan: explicit batch, NCHW input
+    mInputDesc = mine::describeTensor(
+        nvinfer1::Dims4(mParams.batchSize, 3, 299, 299), mine::ElementType::kFLOAT, false);
+    mOutputDesc = mine::describeTensor(
+        nvinfer1::Dims2(mParams.batchSize, static_cast<int>(gClassNames.size())), mine::ElementType::kFLOAT, false);
+    return compilePreprocess();
+}
+
+std::unique_ptr<mine::ExecutionSlot> SampleMine::createSlot()
+{
+    if (mFakeEngine)
+    {
+        const size_t inputBytes
+            = mParams.batchSize * mInputDesc.batchStride() * mine::inputElementSize(mParams.preprocess.type);
+        const size_t outputCount = mParams.batchSize * mOutputDesc.batchStride();
+        return std::unique_ptr<mine::ExecutionSlot>(new mine::FakeExecutionSlot(inputBytes, outputCount, mFakeLatency));
+    }
+
+    assert(mParams.inputTensorNames.size() == 1);
+    auto slot = new mine::TrtExecutionSlot(mEngine, mParams.batchSize, mParams.inputTensorNames[0],
+        mParams.outputTensorNames[0], mParams.preprocess.type, mPreprocess.params());
+    std::unique_ptr<mine::ExecutionSlot> owner(slot);
+    if (!slot->valid())
+    {
+        gLogError << "Cannot create an execution context, stream or " << mine::inputTypeName(mParams.preprocess.type)
+                  << " input buffers" << std::endl;
+        return nullptr;
+    }
+    return owner;
+}
 
+bool SampleMine::createSlotPool(int size)
+{
+    mSlotPool.reset(new mine::SlotPool(size, [this]() { return createSlot(); }));
+    if (!mSlotPool->valid())
+    {
+        gLogError << "Created " << mSlotPool->size() << " of " << size << " execution slots" << std::endl;
+        return false;
+    }
     return true;
 }
 
-bool SampleMine::processInput(const samplesCommon::BufferManager& buffers)
+//! \brief INFER one batch. Requests may be fewer than the engine batch; the spare slots are run but ignored.
+//!
+bool SampleMine::infer(
+    const std::vector<const mine::ImageRequest*>& requests, std::vector<mine::Prediction>& predictions)
 {
-    const int inputC = mInputDims.d[0];
-    const int inputH = mInputDims.d[1];
-    const int inputW = mInputDims.d[2];
-    gLogInfo << "... inputC " << inputC <<std::endl;
-    gLogInfo << "... inputH " << inputH <<std::endl;
-    gLogInfo << "... inputW " << inputW <<std::endl;
+    const mine::TraceScope trace("infer");
+
+    // Buffers and execution context checked out of the pool, returned when slot goes out of scope
+    mine::SlotPool::Lease slot = mSlotPool->acquire();
+    if (!slot)
+    {
+        return false;
+    }
 
-    const int batchSize = mParams.batchSize;
+    // Read the input data into the host buffers, run, and verify results
+    return preprocess(requests, *slot, predictions) && slot->run() && postprocess(requests, *slot, predictions);
+}
 
-    // Available images
-    std::vector<std::string> imageList = {"dog.0.jpg"};
-    for (int i = 0; i < batchSize; ++i)
+bool SampleMine::processInput(void* hostDataBuffer, const std::vector<const mine::ImageRequest*>& requests,
+    std::vector<mine::Prediction>& predictions)
+{
+    const mine::TraceScope trace("processInput");
+    // C, H and W wherever the binding keeps them, past its batch axis
+    const int inputC = mInputDesc.channels();
+    const int inputH = mInputDesc.height();
+    const int inputW = mInputDesc.width();
+
+    // Batch slot i gets request i
+    const int batchSize = static_cast<int>(requests.size());
+    assert(batchSize <= mParams.batchSize);
+
+    if (mParams.logImages)
     {
-        readImage(locateFile(imageList[i], mParams.dataDirs), image);
+        std::lock_guard<std::mutex> lock(gLogMutex);
+        gLogInfo << "... inputC " << inputC <<std::endl;
+        gLogInfo << "... inputH " << inputH <<std::endl;
+        gLogInfo << "... inputW " << inputW <<std::endl;
+        gLogInfo << "... layout " << mine::tensorLayoutName(mInputDesc.layout) << std::endl;
+        gLogInfo << "... packing kernel " << mine::simdLevelName(mine::detectSimdLevel())
+                 << (mPreprocess.specialized() ? ", specialized for the shape" : ", generic") << std::endl;
+        gLogInfo << "... preprocess " << mine::preprocessSpecString(mParams.preprocess) << std::endl;
+        gLogInfo << "... normalization " << mPreprocess.normalization() << std::endl;
+        gLogInfo << "... preprocessing " << batchSize << " images on " << mPreprocessPool.size() << " threads"
+                 << std::endl;
     }
 
-    float* hostDataBuffer = static_cast<float*>(buffers.getHostBuffer(mParams.inputTensorNames[0]));
-    for (int i = 0, volImg = inputH * inputW; i < mParams.batchSize; ++i)
+    // Each worker decodes one image and resamples it, as normalized float or half, or as 8-bit
+    // values left for the device to normalize, straight into its own slot of the host buffer in
+    // the layout and channel order of the binding, all as the compiled spec says. Shard tensors
+    // only need converting, or copying when the types match, and interleaving for an NHWC input.
+    struct SlotInfo
     {
-        for (unsigned j = 0, volChl = inputH * inputW; j < inputH; ++j)
+        bool ok;
+        int rows, cols, denom;
+        std::string error; //!< What the worker threw, if it did
+    };
+    std::vector<SlotInfo> slots(batchSize);
+    const size_t plane = static_cast<size_t>(inputH) * inputW;
+    const size_t elementSize = mine::inputElementSize(mParams.preprocess.type);
+    const bool packed8 = mParams.preprocess.type == mine::InputType::kUINT8;
+    const bool packedHalf = mParams.preprocess.type == mine::InputType::kHALF;
+    auto fill = [&](int i) {
+        // The file, decoded pixels and resize scratch of this image come from the worker's
+        // arena and go back to it at the end, so the steady state does not touch the heap
+        const mine::ArenaScope scratch;
+        cv::Mat image;
+        image.allocator = mine::arenaMatAllocator();
+        SlotInfo& slot = slots[i];
+        const mine::ShardTensor& tensor = requests[i]->tensor;
+        if (tensor.data)
         {
-            for( unsigned k = 0; k < inputW; ++ k)
+            const mine::TraceScope trace("unpack tensor");
+            // fp16 shards are already normalized and cannot go back to 8 bits (runBulk refuses them)
+            slot.ok = tensor.format->channels == inputC && tensor.format->height == inputH
+                && tensor.format->width == inputW && (!packed8 || tensor.format->type == mine::ShardDataType::kUINT8);
+            slot.rows = inputH;
+            slot.cols = inputW;
+            slot.denom = 0;
+            if (!slot.ok)
+            {
+                return;
+            }
+            // Shards hold CHW tensors
+            void* const out = mine::batchItem(hostDataBuffer, mInputDesc, elementSize, i);
+            const bool nhwc = mInputDesc.layout == mine::TensorLayout::kNHWC;
+            void* const planes = nhwc ? scratch.arena().allocate(inputC * plane * elementSize) : out;
+            if (packed8)
+            {
+                std::memcpy(planes, tensor.data, inputC * plane);
+            }
+            else if (packedHalf)
+            {
+                mine::unpackShardTensor(tensor, static_cast<uint16_t*>(planes));
+            }
+            else
             {
-		// THIS INCLUDES BGR 012 -> 210 RGB
-                cv::Vec3b bgr = image.at<cv::Vec3b>(j,k);
-                hostDataBuffer[i * volImg + 0 * volChl + j * inputW + k] = (1.0 / 255.0) * float(bgr[2]);
-                hostDataBuffer[i * volImg + 1 * volChl + j * inputW + k] = (1.0 / 255.0) * float(bgr[1]);
-                hostDataBuffer[i * volImg + 2 * volChl + j * inputW + k] = (1.0 / 255.0) * float(bgr[0]);
+                mine::unpackShardTensor(tensor, static_cast<float*>(planes));
             }
+            if (nhwc)
+            {
+                mine::planarToInterleaved(planes, inputC, plane, elementSize, out);
+            }
+            return;
+        }
+        // Hardware events of this worker around each step, when the stage stats want them
+        mine::PerfCounterValues atDecode, atResize, atDone;
+        const bool counting = mStageStats && mStageStats->countEvents() && mine::readThreadPerfCounters(atDecode);
+        const auto decodeStart = std::chrono::steady_clock::now();
+        slot.ok = readImage(*requests[i], mPreprocess, image, slot.denom);
+        if (!slot.ok)
+        {
+            return;
+        }
+        slot.rows = image.rows;
+        slot.cols = image.cols;
+        const auto resizeStart = std::chrono::steady_clock::now();
+        const bool countedDecode = counting && mine::readThreadPerfCounters(atResize);
+        mPreprocess.pack(image.ptr<uint8_t>(), image.step, image.cols, image.rows,
+            mine::batchItem(hostDataBuffer, mInputDesc, elementSize, i));
+        const auto done = std::chrono::steady_clock::now();
+        mine::traceEvent("decode", decodeStart, resizeStart);
+        mine::traceEvent("resize+pack", resizeStart, done);
+        if (mStageStats)
+        {
+            mStageStats->record(
+                mine::Stage::kDECODE, std::chrono::duration<double, std::micro>(resizeStart - decodeStart).count());
+            mStageStats->record(
+                mine::Stage::kRESIZE_PACK, std::chrono::duration<double, std::micro>(done - resizeStart).count());
+        }
+        if (countedDecode && mine::readThreadPerfCounters(atDone))
+        {
+            mStageStats->recordCounters(mine::Stage::kDECODE, atResize - atDecode);
+            mStageStats->recordCounters(mine::Stage::kRESIZE_PACK, atDone - atResize);
+        }
+    };
+    // A throw (an image too large for memory, say) fails only the slot it came from
+    mPreprocessPool.parallelFor(batchSize, [&](int i) {
+        try
+        {
+            fill(i);
+        }
+        catch (const std::exception& e)
+        {
+            slots[i].ok = false;
+            slots[i].error = e.what();
+        }
+    });
+
+    // A request that could not be prepared fails alone: its slot of the batch still runs, but
+    // postprocessing skips it
+    predictions.assign(batchSize, mine::Prediction());
+    int prepared = 0;
+    std::lock_guard<std::mutex> lock(gLogMutex);
+    for (int i = 0; i < batchSize; ++i)
+    {
+        predictions[i].ok = slots[i].ok;
+        prepared += slots[i].ok ? 1 : 0;
+        if (!slots[i].ok && !slots[i].error.empty())
+        {
+            gLogError << "Cannot preprocess image " << requests[i]->name << ": " << slots[i].error << std::endl;
+        }
+        else if (!slots[i].ok && requests[i]->tensor.data)
+        {
+            const mine::ShardFormat& format = *requests[i]->tensor.format;
+            gLogError << requests[i]->name << " in " << requests[i]->path << " is " << format.channels << "x"
+                      << format.height << "x" << format.width << ", the engine takes " << inputC << "x" << inputH
+                      << "x" << inputW << std::endl;
+        }
+        else if (!slots[i].ok)
+        {
+            gLogError << "Cannot open image " << requests[i]->name << std::endl;
+        }
+        else if (mParams.logImages && requests[i]->tensor.data)
+        {
+            gLogInfo << requests[i]->name << " " << mine::shardDataTypeName(requests[i]->tensor.format->type)
+                     << " tensor from " << requests[i]->path << std::endl;
+        }
+        else if (mParams.logImages)
+        {
+            gLogInfo << requests[i]->name << " 3x" << slots[i].rows << "x" << slots[i].cols << "HWC decoded at 1/"
+                     << slots[i].denom << std::endl;
         }
     }
-    
-    return true;
+    // With no image left there is nothing to run the engine for
+    return prepared > 0;
 }
 
 
 //!
-//! \brief Classifies digits and verify result
+//! \brief Softmax per request row of the output plus its top classes, stored in predictions,
+//!        for the requests processInput() left ok. The output buffer is left untouched.
 //!
-bool SampleMine::verifyOutput(const samplesCommon::BufferManager& buffers)
+bool SampleMine::verifyOutput(const float* output, const std::vector<const mine::ImageRequest*>& requests,
+    std::vector<mine::Prediction>& predictions)
 {
-    const int outputSize = mOutputDims.d[1];
-    float* output = static_cast<float*>(buffers.getHostBuffer(mParams.outputTensorNames[0]));
-    float val{0.0f};
-    //int idx{0};
+    const mine::TraceScope trace("verifyOutput");
+    // Every element of a batch item is a class score, whatever shape the row has ([N, classes] or
+    // [N, 1, 1, classes] alike)
+    const int outputSize = static_cast<int>(mOutputDesc.sampleElements());
+    const size_t rowStride = mOutputDesc.batchStride();
+    predictions.resize(requests.size());
 
-    // Calculate Softmax
-    float sum{0.0f};
-    for (int i = 0; i < outputSize; i++)
+    const mine::SoftmaxRowFn softmax = mine::softmaxRow();
+    for (size_t r = 0; r < requests.size(); ++r, output += rowStride)
     {
-        output[i] = exp(output[i]);
-        sum += output[i];
+        mine::Prediction& prediction = predictions[r];
+        if (!prediction.ok)
+        {
+            continue;
+        }
+        prediction.probabilities.resize(outputSize);
+        softmax(output, outputSize, prediction.probabilities.data());
+        prediction.top = mine::topK(prediction.probabilities.data(), outputSize, mParams.topK);
     }
 
-    gLogInfo << "Output:" << std::endl;
-    for (int i = 0; i < outputSize; i++)
+    if (!mParams.logImages)
     {
-        output[i] /= sum;
-        val = std::max(val, output[i]);
-        //if (val == output[i])
-        //{
-        //    idx = i;
-        //}
-
-        gLogInfo << " Prob " << i << "  " << std::fixed << std::setw(5) << std::setprecision(4) << output[i] << " "
-                 << "Class " << i << ": " << std::string(int(std::floor(output[i] * 10 + 0.5f)), '*') << std::endl;
+        return true;
+    }
+    std::lock_guard<std::mutex> lock(gLogMutex);
+    for (size_t r = 0; r < requests.size(); ++r)
+    {
+        if (!predictions[r].ok)
+        {
+            continue;
+        }
+        const mine::TopK& top = predictions[r].top;
+        gLogInfo << "Output " << requests[r]->name << ":" << std::endl;
+        for (int i = 0; i < top.count; i++)
+        {
+            const int c = top.classes[i];
+            const float p = top.probabilities[i];
+            gLogInfo << " Prob " << c << "  " << std::fixed << std::setw(5) << std::setprecision(4) << p << " "
+                     << "Class " << (c < static_cast<int>(gClassNames.size()) ? gClassNames[c] : std::to_string(c))
+                     << ": " << std::string(int(std::floor(p * 10 + 0.5f)), '*') << std::endl;
+        }
+        gLogInfo << std::endl;
     }
-    gLogInfo << std::endl;
 
-    // return idx == mNumber && val > 0.9f;
     return true;
 }
 
 
 
 //!
-//! \brief Initializes members of the params struct using the command line args
+//! \brief One result row, name,cat,p,dog,p as printed by inference-from-trt.py
 //!
-samplesCommon::OnnxSampleParams initializeSampleParams(const samplesCommon::Args& args)
+std::string formatResultRow(const std::string& name, const mine::Prediction& prediction)
 {
-    samplesCommon::OnnxSampleParams params;
-    if (args.dataDirs.empty()) //!< Use default directories if user hasn't provided directory paths
-    {
-        params.dataDirs.push_back("data/mine/");
-        params.dataDirs.push_back("data/samples/mine/");
-    }
-    else //!< Use the data directory provided by the user
+    std::ostringstream row;
+    row << name << std::fixed << std::setprecision(4);
+    for (size_t c = 0; c < prediction.probabilities.size() && c < gClassNames.size(); ++c)
     {
-        params.dataDirs = args.dataDirs;
+        row << "," << gClassNames[c] << "," << prediction.probabilities[c];
     }
-    //params.onnxFileName = "mnist.onnx";
-    //params.inputTensorNames.push_back("Input3");
-    params.onnxFileName = "dogs_vs_cats_model.trt";
-    params.inputTensorNames.push_back("inception_v3_input:0");
-    params.batchSize = 1;
-    //params.outputTensorNames.push_back("Plus214_Output_0");
-    params.outputTensorNames.push_back("dense_1");
-    params.dlaCore = args.useDLACore;
-    params.int8 = args.runInInt8;
-    params.fp16 = args.runInFp16;
-
-    return params;
+    return row.str();
 }
 
-
 //!
-//! \brief Prints the help information for running this sample
+//! \brief The /predict answer: top classes, most likely first, and every class probability.
 //!
-void printHelpInfo()
+std::string formatPredictionJson(const mine::Prediction& prediction)
 {
-    std::cout
-        << "Usage: ./sample_melinda [-h or --help] [-d or --datadir=<path to data directory>] [--useDLACore=<int>]\n";
-    std::cout << "--help          Display help information\n";
-    std::cout << "--datadir       Specify path to a data directory, overriding the default. This option can be used "
-                 "multiple times to add multiple directories. If no data directories are given, the default is to use "
-                 "data/samples/mine/ and data/mine/"
-              << std::endl;
-    std::cout << "--useDLACore=N  Specify a DLA engine for layers that support DLA. Value can range from 0 to n-1, "
-                 "where n is the number of DLA engines on the platform."
-              << std::endl;
+    const auto className = [](int c) {
+        return c >= 0 && c < static_cast<int>(gClassNames.size()) ? gClassNames[c] : std::to_string(c);
+    };
+    std::ostringstream json;
+    json << std::fixed << std::setprecision(6) << "{\"top\": [";
+    for (int k = 0; k < prediction.top.count; ++k)
+    {
+        json << (k ? ", " : "") << "{\"class\": \"" << className(prediction.top.classes[k])
+             << "\", \"index\": " << prediction.top.classes[k]
+             << ", \"probability\": " << prediction.top.probabilities[k] << "}";
+    }
+    json << "], \"probabilities\": {";
+    for (size_t c = 0; c < prediction.probabilities.size(); ++c)
+    {
+        json << (c ? ", " : "") << "\"" << className(static_cast<int>(c)) << "\": " << prediction.probabilities[c];
+    }
+    json << "}}\n";
+    return json.str();
 }
 
-
 //!
-//! \brief MAIN
+//! \brief Hands out the requests of source, with their file contents already read if
+//!        params.prefetchDepth > 0; otherwise preprocessing reads each file itself. Requests
+//!        from shards carry their preprocessed tensor and read no file at all.
+//!
+class RequestStream
+{
+public:
+    RequestStream(mine::ImageSource& source, const SampleMineParams& params, const mine::ShardSource* shards = nullptr)
+        : mSource(source)
+        , mShards(shards)
+    {
+        if (params.prefetchDepth > 0 && !shards)
+        {
+            mReader = mine::createFileReader(params.fileReader, params.prefetchDepth);
+            if (mReader)
+            {
+                mPrefetcher.reset(new mine::Prefetcher(source, *mReader));
+                gLogInfo << "... prefetching " << params.prefetchDepth << " files with " << mReader->name()
+                         << std::endl;
+            }
+        }
+    }
+
+    //!
+    //! \brief False if prefetching was asked for but the requested reader is not available.
+    //!
+    bool valid(const SampleMineParams& params) const
+    {
+        return params.prefetchDepth == 0 || mShards || mPrefetcher;
+    }
+
+    bool next(mine::ImageRequest& request)
+    {
+        mine::ImageEntry entry;
+        request.bytes.clear();
+        bool readOk = true;
+        if (mPrefetcher ? !mPrefetcher->next(entry, request.bytes, readOk) : !mSource.next(entry))
+        {
+            return false;
+        }
+        // A failed prefetch leaves bytes empty, so preprocessing retries the path and reports it
+        request.name = std::move(entry.name);
+        request.path = std::move(entry.path);
+        request.tensor = mShards ? mShards->tensor() : mine::ShardTensor();
+        return true;
+    }
+
+private:
+    mine::ImageSource& mSource;
+    const mine::ShardSource* mShards;
+    std::unique_ptr<mine::AsyncFileReader> mReader;
+    std::unique_ptr<mine::Prefetcher> mPrefetcher; //!< After mReader: destroyed first
+};
+
+//!
+//! \brief Submits numRequests requests cycling over gImageList and logs their result rows
+//!
+bool runImageList(mine::InferenceBackend& backend, const SampleMineParams& params, int numRequests,
+    mine::BatchScheduler::Stats& stats)
+{
+    std::vector<mine::ImageEntry> entries;
+    for (int i = 0; i < numRequests; ++i)
+    {
+        const std::string& name = gImageList[i % gImageList.size()];
+        entries.push_back(mine::ImageEntry{name, locateFile(name, params.dataDirs)});
+    }
+    mine::VectorSource source(entries);
+    RequestStream stream(source, params);
+    if (!stream.valid(params))
+    {
+        gLogError << "The requested file reader is not available" << std::endl;
+        return false;
+    }
+
+    // Every image is its own request; the scheduler coalesces them into engine batches
+    std::vector<std::string> names;
+    std::vector<std::future<mine::InferResult>> futures;
+    {
+        mine::BatchScheduler scheduler(backend, params.batchSize, std::chrono::microseconds(params.maxQueueDelayUs));
+        mine::ImageRequest request;
+        while (stream.next(request))
+        {
+            names.push_back(request.name);
+            futures.push_back(scheduler.submit(std::move(request)));
+        }
+        for (auto& future : futures)
+        {
+            future.wait();
+        }
+        stats = scheduler.stats();
+    }
+
+    bool pass = true;
+    for (int i = 0; i < numRequests; ++i)
+    {
+        const mine::InferResult result = futures[i].get();
+        if (!result.ok)
+        {
+            gLogError << names[i] << " failed" << std::endl;
+            pass = false;
+            continue;
+        }
+        gLogInfo << formatResultRow(names[i], result.prediction) << std::endl;
+    }
+    return pass;
+}
+
+//!
+//! \brief BULK mode: streams every image of params.bulkInput through one engine and writes the
+//!        result rows in input order.
+//!
+//! At most a fixed window of requests is in flight, so memory does not grow with the input.
+//! Every params.checkpointEvery rows the results are flushed and the checkpoint records the
+//! input offset and results size reached; --resume continues from there. Images that cannot be
+//! decoded are logged and left out of the results. Once a whole batch fails, the checkpoint stays
+//! before its first image, so that --resume retries it; rows written after that are redone too.
+//!
+bool runBulk(mine::InferenceBackend& backend, const SampleMineParams& params, mine::BatchScheduler::Stats& stats)
+{
+    std::unique_ptr<mine::ImageSource> source;
+    mine::ShardSource* shards = nullptr;
+    if (mine::isShardList(params.bulkInput))
+    {
+        // Shards preprocessed any other way than this run would are stale; refuse them up front
+        shards = new mine::ShardSource;
+        source.reset(shards);
+        mine::ShardFormat expected;
+        expected.channels = 0;
+        expected.resizeMode = params.preprocess.resize;
+        expected.normalization = mine::preprocessPackParams(params.preprocess);
+        std::string error;
+        if (!shards->open(params.bulkInput, error) || !mine::checkShardFormat(shards->format(), expected, error))
+        {
+            gLogError << "Cannot use " << params.bulkInput << ": " << error << std::endl;
+            return false;
+        }
+        // sample_mine_shard only writes RGB resampled with the linear filter
+        const mine::PreprocessSpec& spec = params.preprocess;
+        if (spec.order != mine::ColorOrder::kRGB || spec.filter != mine::ResizeFilter::kLINEAR)
+        {
+            gLogError << "Cannot use " << params.bulkInput << ": shards hold linearly resized RGB, the spec asks for "
+                      << mine::resizeFilterName(spec.filter) << " " << mine::colorOrderName(spec.order) << std::endl;
+            return false;
+        }
+        if (params.preprocess.type == mine::InputType::kUINT8
+            && shards->format().type != mine::ShardDataType::kUINT8)
+        {
+            gLogError << "--inputType=uint8 needs uint8 shards, " << params.bulkInput << " holds "
+                      << mine::shardDataTypeName(shards->format().type) << std::endl;
+            return false;
+        }
+        gLogInfo << "Reading " << mine::shardDataTypeName(shards->format().type) << " tensors from shards"
+                 << std::endl;
+    }
+    else
+    {
+        source = mine::openImageSource(params.bulkInput);
+    }
+    if (!source)
+    {
+        gLogError << "Cannot open " << params.bulkInput << std::endl;
+        return false;
+    }
+
+    mine::BulkCheckpoint checkpoint;
+    const bool resume = params.bulkResume && !params.bulkCheckpoint.empty()
+        && mine::readCheckpoint(params.bulkCheckpoint, checkpoint);
+    if (resume)
+    {
+        if (!params.bulkOutput.empty()
+            && truncate(params.bulkOutput.c_str(), static_cast<off_t>(checkpoint.outputBytes)) != 0)
+        {
+            gLogError << "Cannot truncate " << params.bulkOutput << " to the checkpoint" << std::endl;
+            return false;
+        }
+        if (!source->skip(checkpoint.offset))
+        {
+            gLogError << params.bulkInput << " has fewer than " << checkpoint.offset << " images" << std::endl;
+            return false;
+        }
+        gLogInfo << "Resuming " << params.bulkInput << " at offset " << checkpoint.offset << std::endl;
+    }
+    RequestStream stream(*source, params, shards);
+    if (!stream.valid(params))
+    {
+        gLogError << "The requested file reader is not available" << std::endl;
+        return false;
+    }
+
+    std::ofstream file;
+    if (!params.bulkOutput.empty())
+    {
+        file.open(params.bulkOutput, resume ? std::ios::app : std::ios::trunc);
+        if (!file)
+        {
+            gLogError << "Cannot write " << params.bulkOutput << std::endl;
+            return false;
+        }
+    }
+    std::ostream& out = params.bulkOutput.empty() ? std::cout : file;
+
+    const auto saveCheckpoint = [&]() {
+        out.flush();
+        if (params.bulkCheckpoint.empty())
+        {
+            return true;
+        }
+        checkpoint.outputBytes = file.is_open() ? static_cast<uint64_t>(file.tellp()) : 0;
+        return mine::writeCheckpoint(params.bulkCheckpoint, checkpoint);
+    };
+
+    // Enough requests in flight to keep every slot busy with full batches
+    const size_t window = 4 * static_cast<size_t>(params.batchSize) * std::max(1, params.contexts);
+    std::deque<std::pair<std::string, std::future<mine::InferResult>>> inFlight;
+    uint64_t images = 0;
+    uint64_t failed = 0;
+    bool ok = true;
+    bool held = false; //!< A batch failed; the checkpoint stays before its first row from then on
+    const auto start = std::chrono::steady_clock::now();
+    {
+        mine::BatchScheduler scheduler(backend, params.batchSize, std::chrono::microseconds(params.maxQueueDelayUs));
+        const auto writeOldest = [&]() {
+            const mine::InferResult result = inFlight.front().second.get();
+            if (result.ok)
+            {
+                out << formatResultRow(inFlight.front().first, result.prediction) << "\n";
+            }
+            else if (result.rejected)
+            {
+                // The image itself is bad and would fail again, so the checkpoint may pass it
+                gLogError << inFlight.front().first << " cannot be read or decoded" << std::endl;
+                ++failed;
+            }
+            else
+            {
+                // Its batch failed, so the image may well be fine; a resumed run has to retry it.
+                // Everything written so far is saved, and the checkpoint moves no further.
+                gLogError << inFlight.front().first << " failed with its batch" << std::endl;
+                ++failed;
+                if (!held && !saveCheckpoint())
+                {
+                    gLogError << "Cannot write checkpoint " << params.bulkCheckpoint << std::endl;
+                }
+                held = true;
+                ok = false;
+            }
+            inFlight.pop_front();
+            ++images;
+            if (!held && ++checkpoint.offset % params.checkpointEvery == 0 && !saveCheckpoint())
+            {
+                gLogError << "Cannot write checkpoint " << params.bulkCheckpoint << std::endl;
+                ok = false;
+            }
+        };
+
+        mine::ImageRequest request;
+        while (ok && stream.next(request))
+        {
+            if (inFlight.size() >= window)
+            {
+                writeOldest();
+            }
+            const std::string name = request.name;
+            inFlight.emplace_back(name, scheduler.submit(std::move(request)));
+        }
+        while (!inFlight.empty())
+        {
+            writeOldest();
+        }
+        stats = scheduler.stats();
+    }
+    ok = (held || saveCheckpoint()) && ok;
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    gLogInfo << images << " images (" << failed << " failed) up to offset " << checkpoint.offset << " in "
+             << std::fixed << std::setprecision(1) << seconds << " s, " << images / std::max(seconds, 1e-9)
+             << " images/s" << std::endl;
+    if (held)
+    {
+        gLogError << "A batch failed; rerun with --resume to retry from offset " << checkpoint.offset << std::endl;
+    }
+    return ok && static_cast<bool>(out);
+}
+
+volatile std::sig_atomic_t gStopServing = 0;
+
+void stopServing(int)
+{
+    gStopServing = 1;
+}
+
+//!
+//! \brief SHM mode: answers the images local processes submit through the shared memory ring
+//!        params.shmName, until SIGINT or SIGTERM, or until maxRequests (if > 0) are answered.
+//!
+//! Images are decoded straight out of their ring slots, and a slot is only handed back once
+//! its completion is posted. Completions go out in the order the requests were taken, which
+//! is also the order their batches finish in.
+//!
+bool runShmServer(mine::InferenceBackend& backend, const SampleMineParams& params, uint64_t maxRequests,
+    mine::BatchScheduler::Stats& stats)
+{
+    mine::ShmRingServer ring;
+    if (!ring.create(params.shmName, params.shmSlots, params.shmSlotBytes, params.shmClients))
+    {
+        gLogError << ring.error() << std::endl;
+        return false;
+    }
+    gLogInfo << "Serving shared memory " << params.shmName << ": " << ring.capacity() << " slots of "
+             << ring.slotBytes() / 1024 << " KiB, up to " << ring.maxClients() << " clients" << std::endl;
+    gStopServing = 0;
+    std::signal(SIGINT, stopServing);
+    std::signal(SIGTERM, stopServing);
+
+    struct Pending
+    {
+        mine::ShmRequest slot;
+        std::future<mine::InferResult> result;
+    };
+    const auto answer = [&ring](Pending& pending) {
+        const mine::InferResult result = pending.result.get();
+        mine::ShmCompletion completion;
+        std::memset(&completion, 0, sizeof(completion));
+        completion.requestId = pending.slot.requestId;
+        completion.ok = result.ok ? 1 : 0;
+        if (result.ok)
+        {
+            const mine::TopK& top = result.prediction.top;
+            completion.count = top.count;
+            std::copy(top.classes, top.classes + top.count, completion.classes);
+            std::copy(top.probabilities, top.probabilities + top.count, completion.probabilities);
+        }
+        ring.complete(pending.slot, completion);
+    };
+
+    std::deque<Pending> inFlight; // At most the ring's slots: each holds one until answered
+    uint64_t answered = 0;
+    const auto start = std::chrono::steady_clock::now();
+    {
+        mine::BatchScheduler scheduler(backend, params.batchSize, std::chrono::microseconds(params.maxQueueDelayUs));
+        mine::Backoff backoff;
+        while (!gStopServing && (maxRequests == 0 || answered < maxRequests))
+        {
+            bool progress = false;
+            mine::ShmRequest slot;
+            while (ring.next(slot))
+            {
+                mine::ImageRequest request;
+                request.name = "shm:" + std::to_string(slot.clientId) + "/" + std::to_string(slot.requestId & 0xffffffff);
+                request.view.data = slot.data;
+                request.view.size = slot.size;
+                if (slot.kind == mine::ShmImageKind::kBGR)
+                {
+                    request.view.width = slot.width;
+                    request.view.height = slot.height;
+                }
+                Pending pending;
+                pending.slot = slot;
+                pending.result = scheduler.submit(std::move(request));
+                inFlight.push_back(std::move(pending));
+                progress = true;
+            }
+            while (!inFlight.empty()
+                && inFlight.front().result.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+            {
+                answer(inFlight.front());
+                inFlight.pop_front();
+                ++answered;
+                progress = true;
+            }
+            if (progress)
+            {
+                backoff.reset();
+            }
+            else if (!inFlight.empty())
+            {
+                inFlight.front().result.wait_for(std::chrono::microseconds(100));
+            }
+            else
+            {
+                backoff.pause();
+            }
+        }
+        // Whatever was taken off the ring is still answered, so no client waits in vain
+        for (Pending& pending : inFlight)
+        {
+            answer(pending);
+            ++answered;
+        }
+        stats = scheduler.stats();
+    }
+    std::signal(SIGINT, SIG_DFL);
+    std::signal(SIGTERM, SIG_DFL);
+
+    const mine::ShmRingServer::Stats ringStats = ring.stats();
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    gLogInfo << answered << " shared memory requests answered (" << ringStats.rejected << " malformed, "
+             << ringStats.dropped << " completions dropped) in " << std::fixed << std::setprecision(1) << seconds
+             << " s, " << answered / std::max(seconds, 1e-9) << " images/s" << std::endl;
+    return true;
+}
+
+mine::HttpServer* gHttpServer = nullptr;
+
+void stopHttpServer(int)
+{
+    if (gHttpServer)
+    {
+        gHttpServer->stop();
+    }
+}
+
+//!
+//! \brief JPEG, PNG or BMP, judged by the signature only, as decodeImageScaled() reads them.
+//!
+bool looksLikeImage(const std::vector<uint8_t>& bytes)
+{
+    static const uint8_t png[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    return mine::isJpeg(bytes.data(), bytes.size())
+        || (bytes.size() > sizeof(png) && std::equal(png, png + sizeof(png), bytes.begin()))
+        || (bytes.size() > 2 && bytes[0] == 'B' && bytes[1] == 'M');
+}
+
+//!
+//! \brief HTTP mode: answers POST /predict, one image per request body, with its top classes
+//!        as JSON, until SIGINT or SIGTERM, or until maxRequests (if > 0) predictions are answered.
+//!
+//! The event loop only parses requests and hands the images to the BatchScheduler, so requests
+//! from all connections batch together; results are answered from whichever thread finishes
+//! the batch. Past 256 MiB of queued images the server answers 503 rather than queue more;
+//! short of that, a client is only held back by the server's per-connection pipelining limit.
+//!
+bool runHttpServer(mine::InferenceBackend& backend, const SampleMineParams& params, uint64_t maxRequests,
+    const mine::ResultCache* cache, mine::BatchScheduler::Stats& stats)
+{
+    mine::HttpLimits limits;
+    const uint64_t fileLimit = mine::raiseOpenFileLimit();
+    limits.maxConnections = static_cast<int>(
+        std::min<uint64_t>(limits.maxConnections, fileLimit > 128 ? fileLimit - 128 : 64));
+    mine::HttpServer server;
+    if (!server.listen(params.httpHost, params.httpPort, limits))
+    {
+        gLogError << server.error() << std::endl;
+        return false;
+    }
+    gLogInfo << "Serving http://" << params.httpHost << ":" << server.port() << "/predict, up to "
+             << limits.maxConnections << " connections" << std::endl;
+    gHttpServer = &server;
+    std::signal(SIGINT, stopHttpServer);
+    std::signal(SIGTERM, stopHttpServer);
+
+    const uint64_t maxQueuedBytes = 256 << 20;
+    std::atomic<uint64_t> queued{0};
+    std::atomic<uint64_t> queuedBytes{0};
+    std::atomic<uint64_t> answered{0};
+    std::atomic<uint64_t> failed{0};
+    uint64_t busy = 0;
+    const auto start = std::chrono::steady_clock::now();
+    {
+        mine::BatchScheduler scheduler(backend, params.batchSize, std::chrono::microseconds(params.maxQueueDelayUs));
+        const mine::HttpServer::Handler handler = [&](mine::HttpRequest& request, mine::HttpServer::Ticket ticket) {
+            mine::HttpResponse response;
+            const std::string path = request.target.substr(0, request.target.find('?'));
+            const uint64_t bytes = request.body.size();
+            if (path == "/predict" && request.method == "POST" && looksLikeImage(request.body)
+                && queuedBytes.load() + bytes <= maxQueuedBytes)
+            {
+                mine::ImageRequest image;
+                image.name = "http:" + std::to_string(ticket.connection) + "/" + std::to_string(ticket.sequence);
+                image.bytes = std::move(request.body);
+                ++queued;
+                queuedBytes += bytes;
+                scheduler.submit(std::move(image), [&, ticket, bytes](mine::InferResult& result) {
+                    mine::HttpResponse answer;
+                    if (result.ok)
+                    {
+                        answer.body = formatPredictionJson(result.prediction);
+                    }
+                    else if (result.rejected)
+                    {
+                        // Only this image failed; the rest of its batch was answered
+                        answer.status = 422;
+                        answer.body = "{\"error\": \"cannot decode image\"}\n";
+                        ++failed;
+                    }
+                    else
+                    {
+                        answer.status = 500;
+                        answer.body = "{\"error\": \"inference failed\"}\n";
+                        ++failed;
+                    }
+                    server.respond(ticket, std::move(answer));
+                    if (++answered == maxRequests)
+                    {
+                        server.stop();
+                    }
+                    queuedBytes -= bytes;
+                    --queued;
+                });
+                return;
+            }
+            if (path == "/predict" && request.method != "POST")
+            {
+                response.status = 405;
+            }
+            else if (path == "/predict" && !looksLikeImage(request.body))
+            {
+                response.status = 415;
+            }
+            else if (path == "/predict")
+            {
+                response.status = 503;
+                ++busy;
+            }
+            else if (path == "/health")
+            {
+                response.body = "{\"status\": \"ok\"}\n";
+            }
+            else if (path == "/stats")
+            {
+                const mine::HttpServer::Stats http = server.stats();
+                const mine::BatchScheduler::Stats batching = scheduler.stats();
+                std::ostringstream json;
+                json << "{\"connections\": " << http.connections << ", \"peak_connections\": "
+                     << http.peakConnections << ", \"requests\": " << http.requests << ", \"predictions\": "
+                     << answered.load() << ", \"failed\": " << failed.load() << ", \"queued\": " << queued.load()
+                     << ", \"busy\": " << busy << ", \"batches\": " << batching.batches << ", \"mean_batch\": "
+                     << std::fixed << std::setprecision(2) << batching.meanBatchSize();
+                if (cache)
+                {
+                    const mine::ResultCache::Stats cached = cache->stats();
+                    json << ", \"cache\": {\"hits\": " << cached.hits << ", \"misses\": " << cached.misses
+                         << ", \"entries\": " << cached.entries << ", \"bytes\": " << cached.bytes
+                         << ", \"evictions\": " << cached.evictions << "}";
+                }
+                json << "}\n";
+                response.body = json.str();
+            }
+            else
+            {
+                response.status = 404;
+            }
+            if (response.status != 200)
+            {
+                response.body = std::string("{\"error\": \"") + mine::httpReason(response.status) + "\"}\n";
+            }
+            server.respond(ticket, std::move(response));
+        };
+        if (!server.run(handler))
+        {
+            gLogError << server.error() << std::endl;
+        }
+        // The callbacks of images still in the scheduler or the backend refer to the server
+        while (queued.load() > 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        stats = scheduler.stats();
+    }
+    std::signal(SIGINT, SIG_DFL);
+    std::signal(SIGTERM, SIG_DFL);
+    gHttpServer = nullptr;
+
+    const mine::HttpServer::Stats http = server.stats();
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    gLogInfo << answered.load() << " predictions (" << failed.load() << " failed, " << busy << " turned away busy) "
+             << "over " << http.accepted << " connections (peak " << http.peakConnections << "), "
+             << http.rejected << " malformed requests, in " << std::fixed << std::setprecision(1) << seconds
+             << " s, " << answered.load() / std::max(seconds, 1e-9) << " images/s" << std::endl;
+    return true;
+}
+
+//!
+//! \brief Writes one "name": {count, mean, p50, p90, p99, max} JSON member.
+//!
+void writeLatencyJson(std::ostream& out, const std::string& name, const char* per, const mine::LatencySummary& l)
+{
+    out << "    \"" << name << "\": {\"per\": \"" << per << "\", \"count\": " << l.count << ", \"mean_us\": " << l.mean
+        << ", \"p50_us\": " << l.p50 << ", \"p90_us\": " << l.p90 << ", \"p99_us\": " << l.p99
+        << ", \"max_us\": " << l.max << "}";
+}
+
+void logLatencyRow(const std::string& name, const char* per, const mine::LatencySummary& l)
+{
+    gLogInfo << std::left << std::setw(14) << name << std::setw(7) << per << std::right << std::setw(8) << l.count
+             << std::fixed << std::setprecision(1) << std::setw(11) << l.mean << std::setw(11) << l.p50
+             << std::setw(11) << l.p90 << std::setw(11) << l.p99 << std::setw(11) << l.max << std::endl;
+}
+
+//!
+//! \brief Mean events of each counter per unit, per sample or (scale = samples / batches) per
+//!        batch; -1 where a counter was unavailable.
+//!
+void counterMeans(const mine::CounterTotals& totals, double scale, double means[])
+{
+    for (int c = 0; c < static_cast<int>(mine::PerfCounter::kCOUNT); ++c)
+    {
+        const double mean = totals.mean(static_cast<mine::PerfCounter>(c));
+        means[c] = mean < 0.0 ? -1.0 : mean * scale;
+    }
+}
+
+//!
+//! \brief Writes one "per": {cycles, instructions, ipc, llc_misses, branch_misses} JSON member,
+//!        null where a counter was unavailable.
+//!
+void writeCountersJson(std::ostream& out, const char* per, const double means[])
+{
+    const auto value = [&out](double v) -> std::ostream& { return v < 0.0 ? out << "null" : out << v; };
+    const double cycles = means[static_cast<int>(mine::PerfCounter::kCYCLES)];
+    const double instructions = means[static_cast<int>(mine::PerfCounter::kINSTRUCTIONS)];
+    out << "\"" << per << "\": {";
+    for (int c = 0; c < static_cast<int>(mine::PerfCounter::kCOUNT); ++c)
+    {
+        out << "\"" << mine::perfCounterName(static_cast<mine::PerfCounter>(c)) << "\": ";
+        value(means[c]) << ", ";
+    }
+    out << "\"ipc\": ";
+    value(cycles > 0.0 && instructions >= 0.0 ? instructions / cycles : -1.0) << "}";
+}
+
+//!
+//! \brief One row of the hardware events table; composed first, since every gLogInfo statement
+//!        is logged as a line of its own.
+//!
+void logCounterRow(const std::string& name, const char* per, const double means[])
+{
+    std::ostringstream row;
+    row << std::left << std::setw(14) << name << std::setw(7) << per << std::right << std::fixed
+        << std::setprecision(0);
+    for (int c = 0; c < static_cast<int>(mine::PerfCounter::kCOUNT); ++c)
+    {
+        if (means[c] < 0.0)
+        {
+            row << std::setw(15) << "n/a";
+        }
+        else
+        {
+            row << std::setw(15) << means[c];
+        }
+    }
+    const double cycles = means[static_cast<int>(mine::PerfCounter::kCYCLES)];
+    const double instructions = means[static_cast<int>(mine::PerfCounter::kINSTRUCTIONS)];
+    if (cycles > 0.0 && instructions >= 0.0)
+    {
+        row << std::setw(7) << std::setprecision(2) << instructions / cycles;
+    }
+    else
+    {
+        row << std::setw(7) << "n/a";
+    }
+    gLogInfo << row.str() << std::endl;
+}
+
+//!
+//! \brief --benchmark: params.warmupBatches untimed batches, then params.benchmarkBatches timed
+//!        ones, each a full batch of the bundled images with up to the pipeline depth in flight.
+//!
+//! The images are read into memory once, so the decode stage measures decoding and no file I/O.
+//! Batch latency is from inferAsync() to its callback. The per-stage breakdown comes from the
+//! stage stats the sample records: decode and resize+pack per image (summed over workers, not
+//! wall time), the device steps and softmax per batch. With params.perfCounters the CPU stages
+//! also count cycles, instructions, LLC misses and branch misses of the threads running them.
+//!
+bool runBenchmark(SampleMine& sample, mine::InferenceBackend& backend, const SampleMineParams& params)
+{
+    typedef std::chrono::steady_clock Clock;
+
+    // Every batch shares these requests; nothing writes to them while batches are in flight
+    std::vector<mine::ImageRequest> images(params.batchSize);
+    std::vector<const mine::ImageRequest*> batch;
+    for (int i = 0; i < params.batchSize; ++i)
+    {
+        images[i].name = gImageList[i % gImageList.size()];
+        images[i].path = locateFile(images[i].name, params.dataDirs);
+        if (!mine::readFileBytes(images[i].path, images[i].bytes))
+        {
+            gLogError << "Cannot open image " << images[i].name << std::endl;
+            return false;
+        }
+        batch.push_back(&images[i]);
+    }
+
+    const int maxInFlight = std::max(1, params.pipelineSlots);
+    std::mutex mutex;
+    std::condition_variable finished;
+    int inFlight = 0;
+    bool ok = true;
+    std::vector<double> latencies;
+    const auto runBatches = [&](int count, bool timed) {
+        for (int b = 0; b < count; ++b)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                finished.wait(lock, [&]() { return inFlight < maxInFlight; });
+                ++inFlight;
+            }
+            const Clock::time_point submitted = Clock::now();
+            backend.inferAsync(batch, [&, submitted, timed](bool batchOk, std::vector<mine::Prediction>&) {
+                const double us = std::chrono::duration<double, std::micro>(Clock::now() - submitted).count();
+                std::lock_guard<std::mutex> lock(mutex);
+                ok = ok && batchOk;
+                if (timed)
+                {
+                    latencies.push_back(us);
+                }
+                --inFlight;
+                finished.notify_all();
+            });
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        finished.wait(lock, [&]() { return inFlight == 0; });
+    };
+
+    mine::PerfCounterValues probe;
+    if (params.perfCounters && !mine::readThreadPerfCounters(probe))
+    {
+        gLogWarning << "Hardware counters unavailable (perf_event_open failed; see perf_event_paranoid), "
+                       "timing only"
+                    << std::endl;
+    }
+    mine::StageStats stages(params.perfCounters);
+    sample.recordStageStats(&stages);
+    runBatches(params.warmupBatches, false);
+    stages.reset();
+    const Clock::time_point start = Clock::now();
+    runBatches(params.benchmarkBatches, true);
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    sample.recordStageStats(nullptr);
+    if (!ok)
+    {
+        gLogError << "Some benchmark batches failed" << std::endl;
+        return false;
+    }
+
+    const mine::LatencySummary batchLatency = mine::summarizeLatencies(latencies);
+    const double imagesPerSecond = params.benchmarkBatches * params.batchSize / std::max(seconds, 1e-9);
+    const std::string engine
+        = params.fakeLatencyUs < 0 ? "tensorrt" : "fake " + std::to_string(params.fakeLatencyUs) + " us";
+    gLogInfo << "Benchmark: " << params.benchmarkBatches << " batches of " << params.batchSize << " after "
+             << params.warmupBatches << " warmup, " << maxInFlight << " in flight, " << sample.preprocessThreads()
+             << " preprocessing threads, " << engine << " engine" << std::endl;
+    gLogInfo << std::fixed << std::setprecision(1) << imagesPerSecond << " images/s, "
+             << params.benchmarkBatches / std::max(seconds, 1e-9) << " batches/s" << std::endl;
+    gLogInfo << std::left << std::setw(14) << "stage" << std::setw(7) << "per" << std::right << std::setw(8)
+             << "count" << std::setw(11) << "mean us" << std::setw(11) << "p50 us" << std::setw(11) << "p90 us"
+             << std::setw(11) << "p99 us" << std::setw(11) << "max us" << std::endl;
+    logLatencyRow("end-to-end", "batch", batchLatency);
+    for (int s = 0; s < static_cast<int>(mine::Stage::kCOUNT); ++s)
+    {
+        const mine::Stage stage = static_cast<mine::Stage>(s);
+        logLatencyRow(mine::stageName(stage), mine::perImageStage(stage) ? "image" : "batch", stages.summary(stage));
+    }
+    const double batches = std::max(1, params.benchmarkBatches);
+    double means[static_cast<int>(mine::PerfCounter::kCOUNT)];
+    bool counted = false;
+    for (int s = 0; s < static_cast<int>(mine::Stage::kCOUNT); ++s)
+    {
+        const mine::Stage stage = static_cast<mine::Stage>(s);
+        const mine::CounterTotals totals = stages.counters(stage);
+        if (totals.samples == 0)
+        {
+            continue;
+        }
+        if (!counted)
+        {
+            gLogInfo << "Hardware events, user space, mean per image or batch:" << std::endl;
+            std::ostringstream header;
+            header << std::left << std::setw(14) << "stage" << std::setw(7) << "per" << std::right;
+            for (int c = 0; c < static_cast<int>(mine::PerfCounter::kCOUNT); ++c)
+            {
+                header << std::setw(15) << mine::perfCounterName(static_cast<mine::PerfCounter>(c));
+            }
+            gLogInfo << header.str() << std::setw(7) << "IPC" << std::endl;
+            counted = true;
+        }
+        counterMeans(totals, 1.0, means);
+        logCounterRow(mine::stageName(stage), mine::perImageStage(stage) ? "image" : "batch", means);
+        if (mine::perImageStage(stage))
+        {
+            counterMeans(totals, totals.samples / batches, means);
+            logCounterRow(mine::stageName(stage), "batch", means);
+        }
+    }
+
+    if (params.benchmarkJson.empty())
+    {
+        return true;
+    }
+    std::ofstream json(params.benchmarkJson, std::ios::trunc);
+    json << std::fixed << std::setprecision(3);
+    json << "{\n  \"config\": {\"batch\": " << params.batchSize << ", \"warmup_batches\": " << params.warmupBatches
+         << ", \"batches\": " << params.benchmarkBatches << ", \"in_flight\": " << maxInFlight
+         << ", \"preprocess_threads\": " << sample.preprocessThreads() << ", \"engine\": \"" << engine
+         << "\", \"input_type\": \"" << mine::inputTypeName(params.preprocess.type) << "\", \"resize\": \""
+         << mine::resizeModeName(params.preprocess.resize) << "\", \"preprocess\": \""
+         << mine::preprocessSpecString(params.preprocess) << "\", \"packing\": \""
+         << mine::simdLevelName(mine::detectSimdLevel()) << "\"},\n";
+    json << "  \"images_per_second\": " << imagesPerSecond << ",\n  \"seconds\": " << seconds << ",\n";
+    json << "  \"latency\": {\n";
+    writeLatencyJson(json, "end-to-end", "batch", batchLatency);
+    for (int s = 0; s < static_cast<int>(mine::Stage::kCOUNT); ++s)
+    {
+        const mine::Stage stage = static_cast<mine::Stage>(s);
+        json << ",\n";
+        writeLatencyJson(json, mine::stageName(stage), mine::perImageStage(stage) ? "image" : "batch",
+            stages.summary(stage));
+    }
+    json << "\n  }";
+    if (counted)
+    {
+        json << ",\n  \"counters\": {";
+        const char* separator = "\n";
+        for (int s = 0; s < static_cast<int>(mine::Stage::kCOUNT); ++s)
+        {
+            const mine::Stage stage = static_cast<mine::Stage>(s);
+            const mine::CounterTotals totals = stages.counters(stage);
+            if (totals.samples == 0)
+            {
+                continue;
+            }
+            json << separator << "    \"" << mine::stageName(stage) << "\": {\"samples\": " << totals.samples << ", ";
+            counterMeans(totals, 1.0, means);
+            writeCountersJson(json, mine::perImageStage(stage) ? "image" : "batch", means);
+            if (mine::perImageStage(stage))
+            {
+                json << ", ";
+                counterMeans(totals, totals.samples / batches, means);
+                writeCountersJson(json, "batch", means);
+            }
+            json << "}";
+            separator = ",\n";
+        }
+        json << "\n  }";
+    }
+    json << "\n}\n";
+    if (!json.flush())
+    {
+        gLogError << "Cannot write " << params.benchmarkJson << std::endl;
+        return false;
+    }
+    gLogInfo << "Benchmark results written to " << params.benchmarkJson << std::endl;
+    return true;
+}
+
+//!
+//! \brief Initializes members of the params struct using the command line args
+//!
+SampleMineParams initializeSampleParams(const SampleMineArgs& args)
+{
+    SampleMineParams params;
+    if (args.dataDirs.empty()) //!< Use default directories if user hasn't provided directory paths
+    {
+        params.dataDirs.push_back("data/mine/");
+        params.dataDirs.push_back("data/samples/mine/");
+    }
+    else //!< Use the data directory provided by the user
+    {
+        params.dataDirs = args.dataDirs;
+    }
+    //params.onnxFileName = "mnist.onnx";
+    //params.inputTensorNames.push_back("Input3");
+    params.onnxFileName = args.runInInt8 ? "dogs_vs_cats_model.onnx" : "dogs_vs_cats_model.trt";
+    params.inputTensorNames.push_back("inception_v3_input:0");
+    params.batchSize = args.batchSize;
+    //params.outputTensorNames.push_back("Plus214_Output_0");
+    params.outputTensorNames.push_back("dense_1");
+    params.dlaCore = args.useDLACore;
+    params.int8 = args.runInInt8;
+    params.fp16 = args.runInFp16;
+    params.preprocess = args.preprocess;
+    if (!args.inputTypeGiven && args.runInFp16)
+    {
+        params.preprocess.type = mine::InputType::kHALF;
+    }
+    params.preprocessThreads = args.threads;
+    params.maxQueueDelayUs = args.maxQueueDelayUs;
+    params.pipelineSlots = args.pipeline;
+    params.contexts = args.contexts > 0 ? args.contexts : std::max(1, args.pipeline);
+    params.topK = args.topK;
+    params.logImages
+        = args.logImages < 0 ? args.input.empty() && !args.benchmark && args.shm.empty() && args.httpPort < 0
+                             : args.logImages != 0;
+    params.bulkInput = args.input;
+    params.bulkOutput = args.output;
+    params.bulkCheckpoint = args.checkpoint.empty() && !args.output.empty() ? args.output + ".ckpt" : args.checkpoint;
+    params.bulkResume = args.resume;
+    params.checkpointEvery = args.checkpointEvery;
+    params.prefetchDepth = args.prefetch < 0 ? (args.input.empty() ? 0 : 64) : args.prefetch;
+    params.fileReader = args.reader;
+    params.calibrationInput = args.calibInput;
+    params.calibrationCache = args.calibCache;
+    params.calibrationBatches = args.calibBatches;
+    params.benchmark = args.benchmark;
+    params.warmupBatches = args.warmup;
+    params.benchmarkBatches = args.iterations;
+    params.benchmarkJson = args.json;
+    params.fakeLatencyUs = args.fakeLatencyUs;
+    params.traceFile = args.trace;
+    params.perfCounters = args.perfCounters;
+    params.shmName = args.shm;
+    params.shmSlots = args.shmSlots;
+    params.shmSlotBytes = args.shmSlotKiB * 1024;
+    params.httpHost = args.httpHost;
+    params.httpPort = args.httpPort;
+    params.resultCacheBytes = static_cast<size_t>(args.cacheMiB) << 20;
+
+    return params;
+}
+
+
+//!
+//! \brief Consumes the sample_mine specific options from argv, leaving the rest for samplesCommon::parseArgs
+//!
+bool parseMineArgs(SampleMineArgs& args, int& argc, char** argv)
+{
+    int kept = 1;
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg(argv[i]);
+        const std::string value = arg.substr(arg.find('=') + 1);
+        if (arg.compare(0, 9, "--resize=") == 0)
+        {
+            if (!mine::parseResizeMode(value, args.preprocess.resize))
+            {
+                gLogError << "Unknown resize mode " << value << std::endl;
+                return false;
+            }
+        }
+        else if (arg.compare(0, 8, "--batch=") == 0)
+        {
+            args.batchSize = std::atoi(value.c_str());
+            if (args.batchSize < 1)
+            {
+                gLogError << "Invalid batch size " << value << std::endl;
+                return false;
+            }
+        }
+        else if (arg.compare(0, 10, "--threads=") == 0)
+        {
+            args.threads = std::atoi(value.c_str());
+        }
+        else if (arg.compare(0, 18, "--maxQueueDelayUs=") == 0)
+        {
+            args.maxQueueDelayUs = std::max(0, std::atoi(value.c_str()));
+        }
+        else if (arg.compare(0, 11, "--requests=") == 0)
+        {
+            args.requests = std::max(0, std::atoi(value.c_str()));
+        }
+        else if (arg.compare(0, 16, "--fakeLatencyUs=") == 0)
+        {
+            args.fakeLatencyUs = std::max(0, std::atoi(value.c_str()));
+        }
+        else if (arg.compare(0, 11, "--pipeline=") == 0)
+        {
+            args.pipeline = std::max(0, std::atoi(value.c_str()));
+        }
+        else if (arg.compare(0, 11, "--contexts=") == 0)
+        {
+            args.contexts = std::max(0, std::atoi(value.c_str()));
+        }
+        else if (arg.compare(0, 12, "--inputType=") == 0)
+        {
+            if (!mine::parseInputType(value, args.preprocess.type))
+            {
+                gLogError << "Unknown input type " << value << std::endl;
+                return false;
+            }
+            args.inputTypeGiven = true;
+        }
+        else if (arg.compare(0, 13, "--preprocess=") == 0)
+        {
+            std::string error;
+            if (!mine::loadPreprocessSpec(value, args.preprocess, error))
+            {
+                gLogError << "Bad preprocessing spec: " << error << std::endl;
+                return false;
+            }
+            args.inputTypeGiven = true;
+        }
+        else if (arg.compare(0, 7, "--topK=") == 0)
+        {
+            args.topK = std::atoi(value.c_str());
+            if (args.topK < 1 || args.topK > mine::TopK::kMaxK)
+            {
+                gLogError << "--topK must be between 1 and " << mine::TopK::kMaxK << std::endl;
+                return false;
+            }
+        }
+        else if (arg.compare(0, 12, "--logImages=") == 0)
+        {
+            args.logImages = std::atoi(value.c_str()) != 0;
+        }
+        else if (arg.compare(0, 8, "--input=") == 0)
+        {
+            args.input = value;
+        }
+        else if (arg.compare(0, 9, "--output=") == 0)
+        {
+            args.output = value;
+        }
+        else if (arg.compare(0, 13, "--checkpoint=") == 0)
+        {
+            args.checkpoint = value;
+        }
+        else if (arg == "--resume")
+        {
+            args.resume = true;
+        }
+        else if (arg.compare(0, 18, "--checkpointEvery=") == 0)
+        {
+            args.checkpointEvery = std::max(1, std::atoi(value.c_str()));
+        }
+        else if (arg.compare(0, 11, "--prefetch=") == 0)
+        {
+            args.prefetch = std::max(0, std::atoi(value.c_str()));
+        }
+        else if (arg.compare(0, 9, "--reader=") == 0)
+        {
+            if (!mine::parseFileReaderKind(value, args.reader))
+            {
+                gLogError << "Unknown file reader " << value << std::endl;
+                return false;
+            }
+        }
+        else if (arg.compare(0, 13, "--calibInput=") == 0)
+        {
+            args.calibInput = value;
+        }
+        else if (arg.compare(0, 13, "--calibCache=") == 0)
+        {
+            args.calibCache = value;
+        }
+        else if (arg.compare(0, 15, "--calibBatches=") == 0)
+        {
+            args.calibBatches = std::max(1, std::atoi(value.c_str()));
+        }
+        else if (arg == "--benchmark")
+        {
+            args.benchmark = true;
+        }
+        else if (arg.compare(0, 9, "--warmup=") == 0)
+        {
+            args.warmup = std::max(0, std::atoi(value.c_str()));
+        }
+        else if (arg.compare(0, 13, "--iterations=") == 0)
+        {
+            args.iterations = std::max(1, std::atoi(value.c_str()));
+        }
+        else if (arg.compare(0, 7, "--json=") == 0)
+        {
+            args.json = value;
+        }
+        else if (arg.compare(0, 8, "--trace=") == 0)
+        {
+            args.trace = value;
+        }
+        else if (arg.compare(0, 14, "--traceEvents=") == 0)
+        {
+            args.traceEvents = std::max(1, std::atoi(value.c_str()));
+        }
+        else if (arg == "--perfCounters")
+        {
+            args.perfCounters = true;
+        }
+        else if (arg.compare(0, 6, "--shm=") == 0)
+        {
+            args.shm = value;
+        }
+        else if (arg.compare(0, 11, "--shmSlots=") == 0)
+        {
+            args.shmSlots = std::atoi(value.c_str());
+            if (args.shmSlots < 2 || (args.shmSlots & (args.shmSlots - 1)) != 0)
+            {
+                gLogError << "--shmSlots must be a power of two" << std::endl;
+                return false;
+            }
+        }
+        else if (arg.compare(0, 13, "--shmSlotKiB=") == 0)
+        {
+            args.shmSlotKiB = std::max(1, std::min(1 << 20, std::atoi(value.c_str())));
+        }
+        else if (arg.compare(0, 7, "--http=") == 0)
+        {
+            // [HOST:]PORT
+            const size_t colon = value.rfind(':');
+            if (colon != std::string::npos)
+            {
+                args.httpHost = value.substr(0, colon);
+            }
+            const std::string port = colon == std::string::npos ? value : value.substr(colon + 1);
+            args.httpPort = port.empty() || port.find_first_not_of("0123456789") != std::string::npos
+                ? -1
+                : std::atoi(port.c_str());
+            if (args.httpPort < 0 || args.httpPort > 65535)
+            {
+                gLogError << "Invalid --http port " << port << std::endl;
+                return false;
+            }
+        }
+        else if (arg.compare(0, 11, "--cacheMiB=") == 0)
+        {
+            args.cacheMiB = std::max(0, std::min(1 << 20, std::atoi(value.c_str())));
+        }
+        else
+        {
+            argv[kept++] = argv[i];
+        }
+    }
+    argc = kept;
+    return true;
+}
+
+
+//!
+//! \brief Prints the help information for running this sample
+//!
+void printHelpInfo()
+{
+    std::cout
+        << "Usage: ./sample_melinda [-h or --help] [-d or --datadir=<path to data directory>] [--useDLACore=<int>]\n";
+    std::cout << "--help          Display help information\n";
+    std::cout << "--datadir       Specify path to a data directory, overriding the default. This option can be used "
+                 "multiple times to add multiple directories. If no data directories are given, the default is to use "
+                 "data/samples/mine/ and data/mine/"
+              << std::endl;
+    std::cout << "--useDLACore=N  Specify a DLA engine for layers that support DLA. Value can range from 0 to n-1, "
+                 "where n is the number of DLA engines on the platform."
+              << std::endl;
+    std::cout << "--fp16          Use half input buffers (--inputType=half) unless --inputType or --preprocess says "
+                 "otherwise."
+              << std::endl;
+    std::cout << "--resize=M      How images are fit to the model input: stretch (default), crop (center crop) or "
+                 "letterbox (aspect preserving, black borders)."
+              << std::endl;
+    std::cout << "--batch=N       Images per inference, must match the batch the engine was exported with "
+                 "(BATCH=N ./model-to-onnx-to-trt.sh). Default 1."
+              << std::endl;
+    std::cout << "--threads=N     Threads decoding and preprocessing a batch in parallel. Default one per core."
+              << std::endl;
+    std::cout << "--maxQueueDelayUs=N  Longest a request waits for others to fill its batch. Default 2000."
+              << std::endl;
+    std::cout << "--requests=N    Single-image requests to submit, cycling over the bundled images. Default 4."
+              << std::endl;
+    std::cout << "--fakeLatencyUs=N  Replace engine execution with an N us sleep per batch and uniform scores (no GPU "
+                 "needed); images are still decoded and preprocessed."
+              << std::endl;
+    std::cout << "--pipeline=N    Overlap preprocessing, execution and post-processing of up to N batches, each in "
+                 "its own buffers and execution context (2 = double, 3 = triple buffering). Default 0 (off)."
+              << std::endl;
+    std::cout << "--contexts=N    Execution contexts and buffer sets created up front and reused by every batch. "
+                 "Default the --pipeline depth, or 1."
+              << std::endl;
+    std::cout << "--inputType=T   Host input buffer: float (default, normalized on the host), half (normalized on the "
+                 "host, half the bytes; the default with --fp16) or uint8 (resized pixels, a quarter of the bytes, "
+                 "normalized on the device)."
+              << std::endl;
+    std::cout << "--preprocess=F  Preprocessing spec file (see preprocessSpec.h and preprocess/ for examples): decode, "
+                 "resize filter and mode, channel order, per-channel mean and std and input type, compiled into one "
+                 "pass for the engine input. --resize and --inputType after it override its values."
+              << std::endl;
+    std::cout << "--topK=N        Most likely classes logged per image, 1 to 5. Default 1." << std::endl;
+    std::cout << "--logImages=0|1 Log the decode and top classes of every image. Default 1, 0 in bulk mode."
+              << std::endl;
+    std::cout << "--input=P       Bulk mode: score every image of directory P, or of manifest file P (one path per "
+                 "line, relative to the manifest), streaming name,cat,p,dog,p rows in input order. P may also be "
+                 "a comma separated list of .shard files written by sample_mine_shard."
+              << std::endl;
+    std::cout << "--output=F      Bulk mode results file. Default stdout." << std::endl;
+    std::cout << "--checkpoint=F  Bulk mode progress file, rewritten every --checkpointEvery=N rows (default 1000). "
+                 "Default <output>.ckpt when --output is given."
+              << std::endl;
+    std::cout << "--resume        Bulk mode: skip the images already in the checkpoint and append to --output."
+              << std::endl;
+    std::cout << "--prefetch=N    Image files read ahead of preprocessing, asynchronously. Default 64 in bulk mode, "
+                 "0 (read while decoding) otherwise."
+              << std::endl;
+    std::cout << "--reader=R      How prefetched files are read: auto (default, io_uring where available), uring or "
+                 "pread (thread pool)."
+              << std::endl;
+    std::cout << "--int8          Build an INT8 engine from dogs_vs_cats_model.onnx instead of loading the plan, "
+                 "calibrated on the --calibInput images."
+              << std::endl;
+    std::cout << "--calibInput=P  INT8 calibration images: a directory or manifest as for --input. Default the bundled "
+                 "images."
+              << std::endl;
+    std::cout << "--calibCache=F  Calibration cache, reused while the images and preprocessing stay the same. Default "
+                 "dogs_vs_cats_model.calib."
+              << std::endl;
+    std::cout << "--calibBatches=N  Most batches calibration reads. Default 64." << std::endl;
+    std::cout << "--benchmark     Time full batches of the bundled images instead of scoring them: batch latency "
+                 "percentiles, images/s and a decode / resize+pack / h2d / execute / d2h / softmax breakdown. "
+                 "Combine with --batch, --threads, --pipeline, and --fakeLatencyUs to leave the GPU out."
+              << std::endl;
+    std::cout << "--warmup=N      Untimed batches before the benchmark. Default 10." << std::endl;
+    std::cout << "--iterations=N  Timed batches of the benchmark. Default 100." << std::endl;
+    std::cout << "--json=F        Also write the benchmark results to F as JSON." << std::endl;
+    std::cout << "--shm=NAME      Serve images that local processes submit through the shared memory ring NAME "
+                 "(sampleMine/shmRing.h, see sample_mine_shm_client) until SIGINT / SIGTERM, or --requests=N."
+              << std::endl;
+    std::cout << "--shmSlots=N    Request slots of the ring, a power of two; also the most requests one client "
+                 "can have in flight. Default 64."
+              << std::endl;
+    std::cout << "--shmSlotKiB=N  Largest image, encoded or BGR pixels, one request can carry. Default 1024."
+              << std::endl;
+    std::cout << "--http=[H:]P    Serve POST /predict on http://H:P (H default 127.0.0.1, P 0 = any free port): the "
+                 "body is one JPEG, the answer its top --topK classes and all probabilities as JSON. Keep-alive "
+                 "connections on one epoll thread; also GET /health and /stats. Runs until SIGINT / SIGTERM, or "
+                 "--requests=N predictions; see sample_mine_http_client."
+              << std::endl;
+    std::cout << "--cacheMiB=N    Keep the predictions of up to N MiB of recently seen images and answer repeats of "
+                 "byte-identical ones from memory, without decoding or running the engine. Default 0 (off); "
+                 "the benchmark never uses it."
+              << std::endl;
+    std::cout << "--perfCounters  With --benchmark, also count cycles, instructions, LLC misses and branch misses of "
+                 "decode, resize+pack and softmax, per image and per batch (perf_event_open, user space only)."
+              << std::endl;
+    std::cout << "--trace=F       Record a timeline of build, preprocessing, execution and post-processing on every "
+                 "thread, written to F as a Chrome trace (open in ui.perfetto.dev or chrome://tracing)."
+              << std::endl;
+    std::cout << "--traceEvents=N With --trace, keep at most N events per thread, the latest ones (default "
+              << mine::Tracer::kDefaultMaxEventsPerThread << ")." << std::endl;
+}
+
+
+//!
+//! \brief MAIN
 //!
 int main(int argc, char** argv)
 {
-    samplesCommon::Args args;
-    bool argsOK = samplesCommon::parseArgs(args, argc, argv);
+    SampleMineArgs args;
+    bool argsOK = parseMineArgs(args, argc, argv) && samplesCommon::parseArgs(args, argc, argv);
     if (!argsOK)
     {
         gLogError << "Invalid arguments" << std::endl;
@@ -322,16 +2157,142 @@ int main(int argc, char** argv)
 
     gLogger.reportTestStart(sampleTest);
 
-    SampleMine sample(initializeSampleParams(args));
+    const SampleMineParams params = initializeSampleParams(args);
+    if (!params.traceFile.empty())
+    {
+        // Before any thread starts, so every one gets a named track
+        if (args.traceEvents > 0)
+        {
+            mine::Tracer::instance().setMaxEventsPerThread(args.traceEvents);
+        }
+        mine::Tracer::instance().start();
+        mine::traceThreadName("main");
+    }
+    SampleMine sample(params);
+    mine::InferenceBackend* backend = &sample;
 
-    gLogInfo << "Building and running a GPU inference engine for DOGS.VS.CATS" << std::endl;
+    if (args.fakeLatencyUs >= 0)
+    {
+        gLogInfo << "Running a fake " << args.fakeLatencyUs << " us/batch engine for DOGS.VS.CATS" << std::endl;
+        if (!sample.useFakeEngine(std::chrono::microseconds(args.fakeLatencyUs)))
+        {
+            return gLogger.reportFail(sampleTest);
+        }
+    }
+    else
+    {
+        gLogInfo << "Building and running a GPU inference engine for DOGS.VS.CATS" << std::endl;
+        if (!sample.build())
+        {
+            return gLogger.reportFail(sampleTest);
+        }
+    }
 
-    if (!sample.build())
+    if (!sample.createSlotPool(params.contexts))
     {
         return gLogger.reportFail(sampleTest);
     }
 
-    if (!sample.infer())
+    std::unique_ptr<mine::PipelinedBackend> pipeline;
+    if (params.pipelineSlots > 0)
+    {
+        gLogInfo << "Pipelining over " << params.contexts << " execution slots" << std::endl;
+        pipeline.reset(new mine::PipelinedBackend(sample, sample.slotPool(), params.batchSize));
+        backend = pipeline.get();
+    }
+
+    // In front of everything else: the scheduler asks it about each request as it is submitted,
+    // so a hit is answered at once, never queued or preprocessed. The benchmark times the engine
+    // and never goes through it
+    std::unique_ptr<mine::ResultCache> resultCache;
+    std::unique_ptr<mine::CachingBackend> caching;
+    if (params.resultCacheBytes > 0 && !params.benchmark)
+    {
+        resultCache.reset(new mine::ResultCache(params.resultCacheBytes));
+        caching.reset(new mine::CachingBackend(*backend, *resultCache, sample.engineIdentity()));
+        backend = caching.get();
+        gLogInfo << "Caching the results of up to " << (params.resultCacheBytes >> 20) << " MiB of images, engine "
+                 << std::hex << sample.engineIdentity() << std::dec << std::endl;
+    }
+
+    mine::BatchScheduler::Stats stats;
+    bool pass;
+    if (params.benchmark)
+    {
+        pass = runBenchmark(sample, *backend, params);
+    }
+    else if (!params.shmName.empty())
+    {
+        pass = runShmServer(*backend, params, std::max(0, args.requests), stats);
+    }
+    else if (params.httpPort >= 0)
+    {
+        pass = runHttpServer(*backend, params, std::max(0, args.requests), resultCache.get(), stats);
+    }
+    else if (!params.bulkInput.empty())
+    {
+        pass = runBulk(*backend, params, stats);
+    }
+    else
+    {
+        const int numRequests = args.requests > 0 ? args.requests : static_cast<int>(gImageList.size());
+        pass = runImageList(*backend, params, numRequests, stats);
+    }
+    if (!params.benchmark)
+    {
+        gLogInfo << stats.requests << " requests in " << stats.batches << " batches, mean batch "
+                 << std::setprecision(2) << stats.meanBatchSize();
+        if (stats.answeredNow > 0)
+        {
+            gLogInfo << ", " << stats.answeredNow << " more answered from the cache";
+        }
+        gLogInfo << std::endl;
+    }
+    if (pipeline)
+    {
+        const mine::PipelinedBackend::Stats stages = pipeline->stats();
+        gLogInfo << "Pipeline busy ms: preprocess " << stages.preprocessMs << ", execute " << stages.executeMs
+                 << ", postprocess " << stages.postprocessMs << std::endl;
+    }
+    if (resultCache)
+    {
+        const mine::ResultCache::Stats cached = resultCache->stats();
+        gLogInfo << "Result cache: " << cached.hits << " hits, " << cached.misses << " misses (" << std::fixed
+                 << std::setprecision(1) << 100.0 * cached.hitRate() << "% hit), " << cached.entries << " entries in "
+                 << cached.bytes / 1024 << " KiB, " << cached.evictions << " evicted" << std::endl;
+    }
+    const mine::SlotPool::Stats poolStats = sample.slotPool().stats();
+    gLogInfo << "Slot pool: " << poolStats.slots << " slots, " << poolStats.acquired << " checkouts, "
+             << poolStats.exhausted << " exhausted, waited " << poolStats.waitMs << " ms (max "
+             << poolStats.maxWaitMs << " ms)" << std::endl;
+    gLogInfo << "Input " << mine::inputTypeName(params.preprocess.type) << ": " << std::setprecision(1)
+             << poolStats.bytesToDevice / (1024.0 * 1024.0) << " MiB copied to the device" << std::endl;
+    const mine::ArenaStats arenas = mine::arenaStats();
+    gLogInfo << "Host arenas: " << arenas.allocations << " allocations from " << arenas.slabs << " slabs, "
+             << (arenas.bytesMapped >> 20) << " MiB mapped (" << (arenas.hugeTlbBytes >> 20) << " MiB huge pages), "
+             << (arenas.bytesUnmapped >> 20) << " MiB given back after oversize images" << std::endl;
+    if (!params.traceFile.empty())
+    {
+        pipeline.reset(); // Joins the stage threads, so their last events are in
+        mine::Tracer::instance().stop();
+        if (!mine::Tracer::instance().write(params.traceFile))
+        {
+            gLogError << "Cannot write " << params.traceFile << std::endl;
+            pass = false;
+        }
+        else
+        {
+            gLogInfo << mine::Tracer::instance().eventCount() << " trace events written to " << params.traceFile
+                     << std::endl;
+            const uint64_t dropped = mine::Tracer::instance().droppedCount();
+            if (dropped > 0)
+            {
+                gLogWarning << dropped << " older trace events were dropped; raise --traceEvents to keep them"
+                            << std::endl;
+            }
+        }
+    }
+    if (!pass)
     {
         return gLogger.reportFail(sampleTest);
     }
@@ -0,0 +1,753 @@
+#ifndef SAMPLE_MINE_SHM_RING_H
+#define SAMPLE_MINE_SHM_RING_H
+
+//
+// Image submission from other processes on the same host through POSIX shared
+// memory instead of files. One segment holds a request ring, which any number
+// of clients write into and sample_mine --shm reads, and one completion ring per
+// client, which sample_mine posts the results to.
+//
+// The request ring is Vyukov's bounded queue: every slot has a sequence number,
+// producers only contend on the enqueue counter (one CAS per request), and the
+// single consumer needs no atomic read-modify-write at all. A slot carries the
+// image itself, encoded or as BGR pixels; the consumer decodes it in place and
+// only hands the slot back once the result is posted, so the image is never
+// copied on the server side. Completion rings are single producer, single
+// consumer, and a client never has more requests in flight than the ring has
+// slots, so they cannot overflow.
+//
+// Nothing blocks in the kernel: both sides wait by spinning, then yielding,
+// then sleeping 50 us (Backoff). A client that dies after claiming a slot but
+// before publishing it stalls the ring at that slot; one that dies with
+// requests in flight just leaves its completion ring for the next client.
+// Request ids carry the generation of the attach that sent them, which every
+// attach takes anew from the segment header, so the late completions of an
+// earlier owner of a completion ring, even the same process, are told apart.
+//
+// Every value the server reads from the segment is range checked, since any
+// process that can open it can write anything there.
+//
+
+#include "softmax.h"
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace mine
+{
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2,
+    "shared memory rings need address-free lock-free atomics");
+
+enum class ShmImageKind : uint32_t
+{
+    kENCODED = 0, //!< JPEG, PNG, ... bytes
+    kBGR = 1      //!< width x height pixels, 3 bytes each, rows packed
+};
+
+//!
+//! \brief Result of one request, as posted to its client's completion ring.
+//!
+struct ShmCompletion
+{
+    uint64_t requestId;
+    int32_t ok; //!< 0 when the image could not be decoded or the request was malformed
+    int32_t count;
+    int32_t classes[TopK::kMaxK];
+    float probabilities[TopK::kMaxK];
+};
+
+//!
+//! \brief Spins, then yields, then sleeps: cheap while the other side is about to answer,
+//!        and no CPU burnt while it is idle.
+//!
+class Backoff
+{
+public:
+    void pause()
+    {
+        if (mCount < 64)
+        {
+#if defined(__x86_64__) || defined(__i386__)
+            __builtin_ia32_pause();
+#endif
+        }
+        else if (mCount < 128)
+        {
+            std::this_thread::yield();
+        }
+        else
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+        ++mCount;
+    }
+
+    void reset()
+    {
+        mCount = 0;
+    }
+
+private:
+    int mCount{0};
+};
+
+//!
+//! \brief Layout and mapping of a segment, shared by ShmRingServer and ShmRingClient.
+//!
+class ShmRing
+{
+public:
+    ~ShmRing()
+    {
+        unmap();
+    }
+
+    ShmRing(const ShmRing&) = delete;
+    ShmRing& operator=(const ShmRing&) = delete;
+
+    //!
+    //! \brief Request slots, which is also the most requests one client may have in flight.
+    //!
+    uint32_t capacity() const
+    {
+        return mLayout.capacity;
+    }
+
+    //!
+    //! \brief Largest image one request can carry, in bytes.
+    //!
+    uint32_t slotBytes() const
+    {
+        return mLayout.slotBytes;
+    }
+
+    uint32_t maxClients() const
+    {
+        return mLayout.maxClients;
+    }
+
+    const std::string& error() const
+    {
+        return mError;
+    }
+
+protected:
+    static const uint64_t kMagic = 0x31474e4952454e4dull; // "MNERING1"
+    static const uint32_t kVersion = 2;
+    static const size_t kLine = 64;
+
+    struct Header
+    {
+        std::atomic<uint64_t> magic; //!< Stored last by the server, once everything else is set
+        uint32_t version;
+        uint32_t capacity;
+        uint32_t slotBytes;
+        uint32_t maxClients;
+        std::atomic<int32_t> serverPid;         //!< 0 once the server is gone
+        std::atomic<uint32_t> attachGeneration; //!< Taken by every client attach, for its request ids
+        alignas(kLine) std::atomic<uint64_t> enqueuePos;
+    };
+
+    struct SlotHeader
+    {
+        std::atomic<uint64_t> sequence; //!< pos: free for the producer of pos; pos + 1: published
+        uint64_t requestId;
+        uint32_t clientId;
+        uint32_t kind;
+        uint32_t size;
+        int32_t width;
+        int32_t height;
+    };
+
+    struct ClientHeader
+    {
+        std::atomic<int32_t> ownerPid;             //!< 0 while no client uses this completion ring
+        alignas(kLine) std::atomic<uint64_t> head; //!< Written by the server
+        alignas(kLine) std::atomic<uint64_t> tail; //!< Written by the client
+    };
+
+    //!
+    //! \brief Where everything is, derived from the header fields only, so each side computes
+    //!        it itself instead of trusting offsets found in the segment.
+    //!
+    struct Layout
+    {
+        uint32_t capacity{0};
+        uint32_t slotBytes{0};
+        uint32_t maxClients{0};
+        size_t slotStride{0};
+        size_t slotsOffset{0};
+        size_t clientStride{0};
+        size_t clientsOffset{0};
+        size_t totalBytes{0};
+    };
+
+    ShmRing() = default;
+
+    static size_t roundUp(size_t bytes)
+    {
+        return (bytes + kLine - 1) / kLine * kLine;
+    }
+
+    static Layout layout(uint32_t capacity, uint32_t slotBytes, uint32_t maxClients)
+    {
+        Layout l;
+        l.capacity = capacity;
+        l.slotBytes = slotBytes;
+        l.maxClients = maxClients;
+        l.slotStride = roundUp(sizeof(SlotHeader)) + roundUp(slotBytes);
+        l.slotsOffset = roundUp(sizeof(Header));
+        l.clientStride = roundUp(sizeof(ClientHeader)) + roundUp(sizeof(ShmCompletion) * capacity);
+        l.clientsOffset = l.slotsOffset + l.slotStride * capacity;
+        l.totalBytes = l.clientsOffset + l.clientStride * maxClients;
+        return l;
+    }
+
+    static bool processAlive(int32_t pid)
+    {
+        return pid > 0 && (kill(pid, 0) == 0 || errno == EPERM);
+    }
+
+    //!
+    //! \brief "/name" as shm_open wants it.
+    //!
+    static std::string segmentName(const std::string& name)
+    {
+        return name.empty() || name[0] == '/' ? name : "/" + name;
+    }
+
+    bool map(int fd, size_t size)
+    {
+        void* base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (base == MAP_FAILED)
+        {
+            mError = "cannot map shared memory " + mName;
+            return false;
+        }
+        mBase = static_cast<uint8_t*>(base);
+        mMappedBytes = size;
+        mHeader = reinterpret_cast<Header*>(mBase);
+        return true;
+    }
+
+    void unmap()
+    {
+        if (mBase)
+        {
+            munmap(mBase, mMappedBytes);
+        }
+        mBase = nullptr;
+        mHeader = nullptr;
+        mMappedBytes = 0;
+        mLayout = Layout();
+    }
+
+    SlotHeader* slot(uint64_t pos) const
+    {
+        return reinterpret_cast<SlotHeader*>(
+            mBase + mLayout.slotsOffset + (pos & (mLayout.capacity - 1)) * mLayout.slotStride);
+    }
+
+    static uint8_t* payload(SlotHeader* slot)
+    {
+        return reinterpret_cast<uint8_t*>(slot) + roundUp(sizeof(SlotHeader));
+    }
+
+    ClientHeader* client(uint32_t id) const
+    {
+        return reinterpret_cast<ClientHeader*>(mBase + mLayout.clientsOffset + id * mLayout.clientStride);
+    }
+
+    static ShmCompletion* completions(ClientHeader* client)
+    {
+        return reinterpret_cast<ShmCompletion*>(reinterpret_cast<uint8_t*>(client) + roundUp(sizeof(ClientHeader)));
+    }
+
+    std::string mName;
+    std::string mError;
+    uint8_t* mBase{nullptr};
+    size_t mMappedBytes{0};
+    Header* mHeader{nullptr};
+    Layout mLayout;
+};
+
+//!
+//! \brief One request taken off the ring. data points into the slot, valid until complete().
+//!
+struct ShmRequest
+{
+    uint64_t position;
+    uint64_t requestId;
+    uint32_t clientId;
+    ShmImageKind kind;
+    const uint8_t* data;
+    size_t size;
+    int width;
+    int height;
+};
+
+//!
+//! \brief The consumer side: creates the segment, takes requests, posts completions. One thread.
+//!
+class ShmRingServer : public ShmRing
+{
+public:
+    struct Stats
+    {
+        uint64_t received{0};
+        uint64_t completed{0};
+        uint64_t rejected{0}; //!< Malformed requests, completed as failed right away
+        uint64_t dropped{0};  //!< Completions for clients that left, or did not read theirs
+    };
+
+    ShmRingServer() = default;
+
+    //!
+    //! \brief Closes the rings to clients and removes the segment.
+    //!
+    ~ShmRingServer()
+    {
+        if (mHeader)
+        {
+            mHeader->serverPid.store(0, std::memory_order_release);
+            shm_unlink(mName.c_str());
+        }
+    }
+
+    //!
+    //! \brief Creates segment name with capacity request slots (a power of two) of slotBytes each
+    //!        and room for maxClients clients. A segment left by a server that died is replaced;
+    //!        one whose server still runs is not.
+    //!
+    bool create(const std::string& name, uint32_t capacity, uint32_t slotBytes, uint32_t maxClients)
+    {
+        mName = segmentName(name);
+        if (capacity < 2 || (capacity & (capacity - 1)) != 0 || slotBytes == 0 || maxClients == 0)
+        {
+            mError = "shared memory ring capacity must be a power of two, with room for an image and a client";
+            return false;
+        }
+        const Layout l = layout(capacity, slotBytes, maxClients);
+        int fd = shm_open(mName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd < 0 && errno == EEXIST)
+        {
+            const int32_t owner = existingServer();
+            if (processAlive(owner))
+            {
+                mError = "shared memory " + mName + " is served by process " + std::to_string(owner);
+                return false;
+            }
+            shm_unlink(mName.c_str());
+            fd = shm_open(mName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        }
+        if (fd < 0 || ftruncate(fd, static_cast<off_t>(l.totalBytes)) != 0)
+        {
+            mError = "cannot create shared memory " + mName;
+            if (fd >= 0)
+            {
+                ::close(fd);
+                shm_unlink(mName.c_str());
+            }
+            return false;
+        }
+        if (!map(fd, l.totalBytes))
+        {
+            shm_unlink(mName.c_str());
+            return false;
+        }
+        mLayout = l;
+
+        // ftruncate zero-filled everything; only what is not zero initially needs setting
+        for (uint64_t pos = 0; pos < capacity; ++pos)
+        {
+            slot(pos)->sequence.store(pos, std::memory_order_relaxed);
+        }
+        mHeader->version = kVersion;
+        mHeader->capacity = capacity;
+        mHeader->slotBytes = slotBytes;
+        mHeader->maxClients = maxClients;
+        mHeader->serverPid.store(getpid(), std::memory_order_relaxed);
+        mHeader->magic.store(kMagic, std::memory_order_release);
+        return true;
+    }
+
+    //!
+    //! \brief Takes the next published request, if any. Malformed ones are answered as failed
+    //!        and skipped.
+    //!
+    bool next(ShmRequest& request)
+    {
+        for (;;)
+        {
+            SlotHeader* s = slot(mDequeuePos);
+            if (s->sequence.load(std::memory_order_acquire) != mDequeuePos + 1)
+            {
+                return false;
+            }
+            // Copied out once: the slot belongs to the server now, but a rogue client could still
+            // write it, and the checks below must hold for the values actually used
+            request.position = mDequeuePos++;
+            request.requestId = s->requestId;
+            request.clientId = s->clientId;
+            request.kind = static_cast<ShmImageKind>(s->kind);
+            request.data = payload(s);
+            request.size = s->size;
+            request.width = s->width;
+            request.height = s->height;
+            ++mStats.received;
+            if (wellFormed(request))
+            {
+                return true;
+            }
+            ++mStats.rejected;
+            ShmCompletion failed;
+            std::memset(&failed, 0, sizeof(failed));
+            failed.requestId = request.requestId;
+            complete(request, failed);
+        }
+    }
+
+    //!
+    //! \brief Posts the result of request to its client and hands its slot back to producers.
+    //!
+    void complete(const ShmRequest& request, const ShmCompletion& completion)
+    {
+        if (request.clientId < mLayout.maxClients && post(client(request.clientId), completion))
+        {
+            ++mStats.completed;
+        }
+        else
+        {
+            ++mStats.dropped;
+        }
+        slot(request.position)->sequence.store(request.position + mLayout.capacity, std::memory_order_release);
+    }
+
+    Stats stats() const
+    {
+        return mStats;
+    }
+
+private:
+    //!
+    //! \brief serverPid of an existing segment, 0 if it cannot be read.
+    //!
+    int32_t existingServer() const
+    {
+        const int fd = shm_open(mName.c_str(), O_RDONLY, 0);
+        if (fd < 0)
+        {
+            return 0;
+        }
+        int32_t pid = 0;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= sizeof(Header))
+        {
+            void* base = mmap(nullptr, sizeof(Header), PROT_READ, MAP_SHARED, fd, 0);
+            if (base != MAP_FAILED)
+            {
+                pid = static_cast<const Header*>(base)->serverPid.load(std::memory_order_acquire);
+                munmap(base, sizeof(Header));
+            }
+        }
+        ::close(fd);
+        return pid;
+    }
+
+    bool wellFormed(const ShmRequest& request) const
+    {
+        if (request.clientId >= mLayout.maxClients || request.size == 0 || request.size > mLayout.slotBytes)
+        {
+            return false;
+        }
+        if (request.kind == ShmImageKind::kENCODED)
+        {
+            return true;
+        }
+        return request.kind == ShmImageKind::kBGR && request.width > 0 && request.height > 0
+            && static_cast<uint64_t>(request.width) * request.height * 3 == request.size;
+    }
+
+    bool post(ClientHeader* c, const ShmCompletion& completion)
+    {
+        if (c->ownerPid.load(std::memory_order_relaxed) == 0)
+        {
+            return false;
+        }
+        const uint64_t head = c->head.load(std::memory_order_relaxed);
+        if (head - c->tail.load(std::memory_order_acquire) >= mLayout.capacity)
+        {
+            return false;
+        }
+        completions(c)[head & (mLayout.capacity - 1)] = completion;
+        c->head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    uint64_t mDequeuePos{0};
+    Stats mStats;
+};
+
+//!
+//! \brief The producer side, for processes (or threads) submitting images. Each instance is one
+//!        client with its own completion ring; use it from one thread at a time.
+//!
+class ShmRingClient : public ShmRing
+{
+public:
+    ShmRingClient() = default;
+
+    ~ShmRingClient()
+    {
+        detach();
+    }
+
+    //!
+    //! \brief Maps segment name and claims a free completion ring; false, with error() set, if
+    //!        there is no server or every client ring is taken.
+    //!
+    bool attach(const std::string& name)
+    {
+        detach();
+        mName = segmentName(name);
+        const int fd = shm_open(mName.c_str(), O_RDWR, 0);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(Header))
+        {
+            mError = "no sample_mine serving shared memory " + mName;
+            if (fd >= 0)
+            {
+                ::close(fd);
+            }
+            return false;
+        }
+        if (!map(fd, static_cast<size_t>(st.st_size)))
+        {
+            return false;
+        }
+        if (mHeader->magic.load(std::memory_order_acquire) != kMagic || mHeader->version != kVersion
+            || !processAlive(mHeader->serverPid.load(std::memory_order_relaxed)))
+        {
+            mError = "shared memory " + mName + " has no live sample_mine server";
+            unmap();
+            return false;
+        }
+        const Layout l = layout(mHeader->capacity, mHeader->slotBytes, mHeader->maxClients);
+        if (l.totalBytes > mMappedBytes || l.capacity == 0 || (l.capacity & (l.capacity - 1)) != 0)
+        {
+            mError = "shared memory " + mName + " is malformed";
+            unmap();
+            return false;
+        }
+        mLayout = l;
+
+        const int32_t pid = getpid();
+        for (uint32_t id = 0; id < mLayout.maxClients; ++id)
+        {
+            ClientHeader* c = client(id);
+            int32_t owner = c->ownerPid.load(std::memory_order_relaxed);
+            if ((owner == 0 || (owner != pid && !processAlive(owner)))
+                && c->ownerPid.compare_exchange_strong(owner, pid))
+            {
+                // Completions meant for a previous owner are skipped
+                c->tail.store(c->head.load(std::memory_order_acquire), std::memory_order_release);
+                mClient = c;
+                mClientId = id;
+                const uint32_t generation = mHeader->attachGeneration.fetch_add(1, std::memory_order_relaxed) + 1;
+                mNextId = static_cast<uint64_t>(generation) << 32;
+                mInFlight = 0;
+                return true;
+            }
+        }
+        mError = "all " + std::to_string(mLayout.maxClients) + " clients of " + mName + " are taken";
+        unmap();
+        return false;
+    }
+
+    //!
+    //! \brief Gives the completion ring back; results still in flight are lost.
+    //!
+    void detach()
+    {
+        if (mClient)
+        {
+            mClient->ownerPid.store(0, std::memory_order_release);
+        }
+        mClient = nullptr;
+        unmap();
+    }
+
+    bool attached() const
+    {
+        return mClient != nullptr;
+    }
+
+    //!
+    //! \brief False once the server has shut down, or died.
+    //!
+    bool serverAlive() const
+    {
+        return mHeader && processAlive(mHeader->serverPid.load(std::memory_order_acquire));
+    }
+
+    //!
+    //! \brief Copies one image into a free request slot and publishes it; requestId identifies
+    //!        its completion. False right away if the ring is full or this client already has
+    //!        capacity() requests in flight, and (error() set) if the image cannot be sent.
+    //!
+    bool trySubmit(ShmImageKind kind, const void* data, size_t size, int width, int height, uint64_t& requestId)
+    {
+        mError.clear();
+        if (!mClient || size == 0 || size > mLayout.slotBytes)
+        {
+            mError = mClient ? "image of " + std::to_string(size) + " bytes does not fit a "
+                    + std::to_string(mLayout.slotBytes) + " byte slot"
+                             : "not attached";
+            return false;
+        }
+        if (mInFlight >= mLayout.capacity)
+        {
+            return false;
+        }
+        uint64_t pos = mHeader->enqueuePos.load(std::memory_order_relaxed);
+        SlotHeader* s;
+        for (;;)
+        {
+            s = slot(pos);
+            const int64_t diff = static_cast<int64_t>(s->sequence.load(std::memory_order_acquire) - pos);
+            if (diff == 0)
+            {
+                if (mHeader->enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false; // Full: the slot still holds a request from one lap ago
+            }
+            else
+            {
+                pos = mHeader->enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+        requestId = mNextId++;
+        s->requestId = requestId;
+        s->clientId = mClientId;
+        s->kind = static_cast<uint32_t>(kind);
+        s->size = static_cast<uint32_t>(size);
+        s->width = width;
+        s->height = height;
+        std::memcpy(payload(s), data, size);
+        s->sequence.store(pos + 1, std::memory_order_release);
+        ++mInFlight;
+        return true;
+    }
+
+    //!
+    //! \brief trySubmit() until it succeeds, the server is gone, or timeout passes.
+    //!
+    bool submit(ShmImageKind kind, const void* data, size_t size, int width, int height, uint64_t& requestId,
+        std::chrono::microseconds timeout = std::chrono::seconds(10))
+    {
+        const auto deadline = std::chrono::steady_clock::now() + timeout;
+        Backoff backoff;
+        while (!trySubmit(kind, data, size, width, height, requestId))
+        {
+            if (!mError.empty())
+            {
+                return false;
+            }
+            if (!serverRunning() || std::chrono::steady_clock::now() > deadline)
+            {
+                mError = serverAlive() ? "timed out waiting for a free request slot" : "the server has shut down";
+                return false;
+            }
+            backoff.pause();
+        }
+        return true;
+    }
+
+    //!
+    //! \brief Takes the next completion of this client, if one is there.
+    //!
+    bool poll(ShmCompletion& completion)
+    {
+        while (mClient)
+        {
+            const uint64_t tail = mClient->tail.load(std::memory_order_relaxed);
+            if (tail == mClient->head.load(std::memory_order_acquire))
+            {
+                return false;
+            }
+            completion = completions(mClient)[tail & (mLayout.capacity - 1)];
+            mClient->tail.store(tail + 1, std::memory_order_release);
+            // Completions of an earlier attach are dropped: they are not in mInFlight
+            if (completion.requestId >> 32 == mNextId >> 32)
+            {
+                --mInFlight;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    //!
+    //! \brief poll() until a completion arrives, the server is gone, or timeout passes.
+    //!
+    bool wait(ShmCompletion& completion, std::chrono::microseconds timeout = std::chrono::seconds(10))
+    {
+        const auto deadline = std::chrono::steady_clock::now() + timeout;
+        Backoff backoff;
+        while (!poll(completion))
+        {
+            if (!serverRunning() || std::chrono::steady_clock::now() > deadline)
+            {
+                mError = serverAlive() ? "timed out waiting for a result" : "the server has shut down";
+                return false;
+            }
+            backoff.pause();
+        }
+        return true;
+    }
+
+    //!
+    //! \brief Requests submitted whose completion was not taken yet.
+    //!
+    uint32_t inFlight() const
+    {
+        return mInFlight;
+    }
+
+private:
+    //!
+    //! \brief Cheaper than serverAlive() while waiting: only sees a clean shutdown, a crash shows
+    //!        as a timeout.
+    //!
+    bool serverRunning() const
+    {
+        return mHeader->serverPid.load(std::memory_order_relaxed) != 0;
+    }
+
+    ClientHeader* mClient{nullptr};
+    uint32_t mClientId{0};
+    uint64_t mNextId{0};
+    uint32_t mInFlight{0};
+};
+
+} // namespace mine
+
+#endif // SAMPLE_MINE_SHM_RING_H
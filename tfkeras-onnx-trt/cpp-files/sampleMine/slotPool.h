@@ -0,0 +1,219 @@
+#ifndef SAMPLE_MINE_SLOT_POOL_H
+#define SAMPLE_MINE_SLOT_POOL_H
+
+//
+// A fixed set of ExecutionSlots (buffers + execution context) created once up
+// front and checked out per batch, instead of allocating device memory and a
+// context on every inference. Slots come from a SlotFactory, so the pool runs
+// just as well on mine::FakeExecutionSlot without a GPU.
+//
+
+#include "executionSlot.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace mine
+{
+
+//! Creates one slot, nullptr on failure.
+typedef std::function<std::unique_ptr<ExecutionSlot>()> SlotFactory;
+
+class SlotPool
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Stats
+    {
+        uint64_t slots{0};         //!< Slots owned by the pool
+        uint64_t acquired{0};      //!< Successful checkouts
+        uint64_t exhausted{0};     //!< Checkouts that found every slot in use and had to wait
+        double waitMs{0.0};        //!< Total time spent waiting for a slot
+        double maxWaitMs{0.0};     //!< Longest single wait
+        uint64_t bytesToDevice{0}; //!< Input bytes copied host to device by all slots
+    };
+
+    //!
+    //! \brief A checked-out slot, handed back to the pool when the lease goes away.
+    //!
+    class Lease
+    {
+    public:
+        Lease() = default;
+
+        Lease(Lease&& other)
+            : mPool(other.mPool)
+            , mSlot(other.mSlot)
+        {
+            other.mPool = nullptr;
+            other.mSlot = nullptr;
+        }
+
+        Lease& operator=(Lease&& other)
+        {
+            if (this != &other)
+            {
+                reset();
+                mPool = other.mPool;
+                mSlot = other.mSlot;
+                other.mPool = nullptr;
+                other.mSlot = nullptr;
+            }
+            return *this;
+        }
+
+        ~Lease()
+        {
+            reset();
+        }
+
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+
+        ExecutionSlot* get() const
+        {
+            return mSlot;
+        }
+
+        ExecutionSlot* operator->() const
+        {
+            return mSlot;
+        }
+
+        ExecutionSlot& operator*() const
+        {
+            return *mSlot;
+        }
+
+        explicit operator bool() const
+        {
+            return mSlot != nullptr;
+        }
+
+        //!
+        //! \brief Returns the slot to the pool early.
+        //!
+        void reset()
+        {
+            if (mPool)
+            {
+                mPool->release(mSlot);
+            }
+            mPool = nullptr;
+            mSlot = nullptr;
+        }
+
+    private:
+        friend class SlotPool;
+
+        Lease(SlotPool* pool, ExecutionSlot* slot)
+            : mPool(pool)
+            , mSlot(slot)
+        {
+        }
+
+        SlotPool* mPool{nullptr};
+        ExecutionSlot* mSlot{nullptr};
+    };
+
+    //!
+    //! \brief Creates size slots with factory. Stops at the first failure; check valid().
+    //!
+    SlotPool(int size, const SlotFactory& factory)
+        : mRequested(std::max(1, size))
+    {
+        for (int i = 0; i < mRequested; ++i)
+        {
+            std::unique_ptr<ExecutionSlot> slot = factory();
+            if (!slot)
+            {
+                break;
+            }
+            mFree.push_back(slot.get());
+            mSlots.push_back(std::move(slot));
+        }
+        mStats.slots = mSlots.size();
+    }
+
+    SlotPool(const SlotPool&) = delete;
+    SlotPool& operator=(const SlotPool&) = delete;
+
+    //!
+    //! \brief True if every requested slot could be created.
+    //!
+    bool valid() const
+    {
+        return static_cast<int>(mSlots.size()) == mRequested;
+    }
+
+    int size() const
+    {
+        return static_cast<int>(mSlots.size());
+    }
+
+    //!
+    //! \brief Checks out a slot, waiting while all of them are leased. Every lease must be gone
+    //!        before the pool is destroyed.
+    //!
+    Lease acquire()
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        if (mSlots.empty())
+        {
+            return Lease();
+        }
+        if (mFree.empty())
+        {
+            const Clock::time_point start = Clock::now();
+            ++mStats.exhausted;
+            mReleased.wait(lock, [this]() { return !mFree.empty(); });
+            const double waitMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+            mStats.waitMs += waitMs;
+            mStats.maxWaitMs = std::max(mStats.maxWaitMs, waitMs);
+        }
+        ExecutionSlot* slot = mFree.back();
+        mFree.pop_back();
+        ++mStats.acquired;
+        return Lease(this, slot);
+    }
+
+    Stats stats() const
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        Stats stats = mStats;
+        for (const auto& slot : mSlots)
+        {
+            stats.bytesToDevice += slot->bytesToDevice();
+        }
+        return stats;
+    }
+
+private:
+    void release(ExecutionSlot* slot)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mFree.push_back(slot);
+        }
+        mReleased.notify_one();
+    }
+
+    const int mRequested;
+    std::vector<std::unique_ptr<ExecutionSlot>> mSlots;
+
+    mutable std::mutex mMutex;
+    std::condition_variable mReleased;
+    std::vector<ExecutionSlot*> mFree; //!< LIFO, so the most recently used (cache-warm) slot goes out first
+    Stats mStats;
+};
+
+} // namespace mine
+
+#endif // SAMPLE_MINE_SLOT_POOL_H
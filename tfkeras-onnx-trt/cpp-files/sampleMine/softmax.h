@@ -0,0 +1,324 @@
+#ifndef SAMPLE_MINE_SOFTMAX_H
+#define SAMPLE_MINE_SOFTMAX_H
+
+//
+// Post-processing of the engine output: a numerically stable softmax over every
+// row of a [batch, classes] logit tensor, and the top-k classes of a row.
+//
+// Each row is shifted by its maximum before exponentiation, so large logits
+// cannot overflow to inf (and NaN after the division). The logits are only
+// read; the probabilities go to a separate buffer. exp() is evaluated with a
+// polynomial on AVX2 / AVX-512, picked at runtime like the packing kernels.
+//
+
+#include "imagePacking.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+namespace mine
+{
+
+//!
+//! \brief Writes softmax(logits[0..count)) to probs. logits and probs must not overlap.
+//!
+typedef void (*SoftmaxRowFn)(const float* logits, int count, float* probs);
+
+//!
+//! \brief Scalar reference, also used for the tail of every SIMD row.
+//!
+inline void softmaxRowScalar(const float* logits, int count, float* probs)
+{
+    if (count <= 0)
+    {
+        return;
+    }
+    float maxLogit = logits[0];
+    for (int i = 1; i < count; ++i)
+    {
+        maxLogit = logits[i] > maxLogit ? logits[i] : maxLogit;
+    }
+    float sum = 0.0f;
+    for (int i = 0; i < count; ++i)
+    {
+        probs[i] = std::exp(logits[i] - maxLogit);
+        sum += probs[i];
+    }
+    const float inv = 1.0f / sum;
+    for (int i = 0; i < count; ++i)
+    {
+        probs[i] *= inv;
+    }
+}
+
+#ifdef SAMPLE_MINE_X86
+
+//
+// exp(x) for x <= 0 as 2^n * p(r), n = round(x / ln2), r = x - n * ln2 in [-ln2/2, ln2/2],
+// p a degree 5 polynomial (Cephes expf coefficients); about 2 ulp. Inputs below
+// kExpMin underflow to 0 like expf does.
+//
+const float kExpMin = -87.33654f;
+const float kLog2e = 1.44269504088896341f;
+const float kLn2Hi = 0.693359375f;
+const float kLn2Lo = -2.12194440e-4f;
+const float kExpP[6] = {1.9875691500e-4f, 1.3981999507e-3f, 8.3334519073e-3f, 4.1665795894e-2f,
+    1.6666665459e-1f, 5.0000001201e-1f};
+
+__attribute__((target("avx2"))) inline __m256 expNonPositiveAVX2(__m256 x)
+{
+    const __m256 tooSmall = _mm256_cmp_ps(x, _mm256_set1_ps(kExpMin), _CMP_LT_OQ);
+    x = _mm256_max_ps(x, _mm256_set1_ps(kExpMin));
+    const __m256 n = _mm256_round_ps(
+        _mm256_mul_ps(x, _mm256_set1_ps(kLog2e)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256 r = _mm256_sub_ps(x, _mm256_mul_ps(n, _mm256_set1_ps(kLn2Hi)));
+    r = _mm256_sub_ps(r, _mm256_mul_ps(n, _mm256_set1_ps(kLn2Lo)));
+
+    __m256 p = _mm256_set1_ps(kExpP[0]);
+    for (int i = 1; i < 6; ++i)
+    {
+        p = _mm256_add_ps(_mm256_mul_ps(p, r), _mm256_set1_ps(kExpP[i]));
+    }
+    p = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(p, r), r), _mm256_add_ps(r, _mm256_set1_ps(1.0f)));
+
+    const __m256i e = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127)), 23);
+    return _mm256_andnot_ps(tooSmall, _mm256_mul_ps(p, _mm256_castsi256_ps(e)));
+}
+
+__attribute__((target("avx2"))) inline float horizontalMaxAVX2(__m256 v)
+{
+    __m128 m = _mm_max_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    m = _mm_max_ps(m, _mm_movehl_ps(m, m));
+    m = _mm_max_ss(m, _mm_shuffle_ps(m, m, 1));
+    return _mm_cvtss_f32(m);
+}
+
+__attribute__((target("avx2"))) inline float horizontalSumAVX2(__m256 v)
+{
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    return _mm_cvtss_f32(s);
+}
+
+__attribute__((target("avx2"))) inline void softmaxRowAVX2(const float* logits, int count, float* probs)
+{
+    if (count < 8)
+    {
+        softmaxRowScalar(logits, count, probs);
+        return;
+    }
+    const int vecEnd = count & ~7;
+    __m256 vmax = _mm256_loadu_ps(logits);
+    for (int i = 8; i < vecEnd; i += 8)
+    {
+        vmax = _mm256_max_ps(vmax, _mm256_loadu_ps(logits + i));
+    }
+    float maxLogit = horizontalMaxAVX2(vmax);
+    for (int i = vecEnd; i < count; ++i)
+    {
+        maxLogit = logits[i] > maxLogit ? logits[i] : maxLogit;
+    }
+
+    const __m256 shift = _mm256_set1_ps(maxLogit);
+    __m256 vsum = _mm256_setzero_ps();
+    for (int i = 0; i < vecEnd; i += 8)
+    {
+        const __m256 e = expNonPositiveAVX2(_mm256_sub_ps(_mm256_loadu_ps(logits + i), shift));
+        _mm256_storeu_ps(probs + i, e);
+        vsum = _mm256_add_ps(vsum, e);
+    }
+    float sum = horizontalSumAVX2(vsum);
+    for (int i = vecEnd; i < count; ++i)
+    {
+        probs[i] = std::exp(logits[i] - maxLogit);
+        sum += probs[i];
+    }
+
+    const float inv = 1.0f / sum;
+    for (int i = 0; i < vecEnd; i += 8)
+    {
+        _mm256_storeu_ps(probs + i, _mm256_mul_ps(_mm256_loadu_ps(probs + i), _mm256_set1_ps(inv)));
+    }
+    for (int i = vecEnd; i < count; ++i)
+    {
+        probs[i] *= inv;
+    }
+}
+
+// maskz forms below as in imagePacking.h: same result, no GCC -Wmaybe-uninitialized on _mm512_undefined_*
+const __mmask16 kAll16 = 0xFFFF;
+
+__attribute__((target("avx512f"))) inline __m512 expNonPositiveAVX512(__m512 x)
+{
+    // Lanes below kExpMin (and the masked-off lanes of a tail) come out as 0
+    const __mmask16 inRange = _mm512_cmp_ps_mask(x, _mm512_set1_ps(kExpMin), _CMP_GE_OQ);
+    const __m512 n = _mm512_maskz_roundscale_ps(
+        kAll16, _mm512_mul_ps(x, _mm512_set1_ps(kLog2e)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m512 r = _mm512_fnmadd_ps(n, _mm512_set1_ps(kLn2Hi), x);
+    r = _mm512_fnmadd_ps(n, _mm512_set1_ps(kLn2Lo), r);
+
+    __m512 p = _mm512_set1_ps(kExpP[0]);
+    for (int i = 1; i < 6; ++i)
+    {
+        p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(kExpP[i]));
+    }
+    p = _mm512_fmadd_ps(_mm512_mul_ps(p, r), r, _mm512_add_ps(r, _mm512_set1_ps(1.0f)));
+
+    // scalef computes p * 2^n directly, no exponent bit fiddling needed
+    return _mm512_maskz_scalef_ps(inRange, p, n);
+}
+
+__attribute__((target("avx512f"))) inline float horizontalMaxAVX512(__m512 v)
+{
+    alignas(64) float lanes[16];
+    _mm512_store_ps(lanes, v);
+    float m = lanes[0];
+    for (int i = 1; i < 16; ++i)
+    {
+        m = lanes[i] > m ? lanes[i] : m;
+    }
+    return m;
+}
+
+__attribute__((target("avx512f"))) inline float horizontalSumAVX512(__m512 v)
+{
+    alignas(64) float lanes[16];
+    _mm512_store_ps(lanes, v);
+    float s = 0.0f;
+    for (int i = 0; i < 16; ++i)
+    {
+        s += lanes[i];
+    }
+    return s;
+}
+
+//!
+//! \brief Masked loads cover the tail, so no scalar loop is needed after the last full vector.
+//!
+__attribute__((target("avx512f"))) inline void softmaxRowAVX512(const float* logits, int count, float* probs)
+{
+    if (count < 16)
+    {
+        // Short rows (the two dogs-vs-cats classes) are faster without the vector setup
+        softmaxRowScalar(logits, count, probs);
+        return;
+    }
+    const int vecEnd = count & ~15;
+    const __mmask16 tail = static_cast<__mmask16>((1u << (count - vecEnd)) - 1);
+    const __m512 lowest = _mm512_set1_ps(-INFINITY);
+
+    __m512 vmax = lowest;
+    for (int i = 0; i < vecEnd; i += 16)
+    {
+        vmax = _mm512_maskz_max_ps(kAll16, vmax, _mm512_loadu_ps(logits + i));
+    }
+    vmax = _mm512_maskz_max_ps(kAll16, vmax, _mm512_mask_loadu_ps(lowest, tail, logits + vecEnd));
+    const __m512 shift = _mm512_set1_ps(horizontalMaxAVX512(vmax));
+
+    __m512 vsum = _mm512_setzero_ps();
+    for (int i = 0; i < vecEnd; i += 16)
+    {
+        const __m512 e = expNonPositiveAVX512(_mm512_sub_ps(_mm512_loadu_ps(logits + i), shift));
+        _mm512_storeu_ps(probs + i, e);
+        vsum = _mm512_add_ps(vsum, e);
+    }
+    const __m512 eTail = _mm512_maskz_mov_ps(
+        tail, expNonPositiveAVX512(_mm512_sub_ps(_mm512_mask_loadu_ps(shift, tail, logits + vecEnd), shift)));
+    _mm512_mask_storeu_ps(probs + vecEnd, tail, eTail);
+    vsum = _mm512_add_ps(vsum, eTail);
+
+    const __m512 inv = _mm512_set1_ps(1.0f / horizontalSumAVX512(vsum));
+    for (int i = 0; i < vecEnd; i += 16)
+    {
+        _mm512_storeu_ps(probs + i, _mm512_mul_ps(_mm512_loadu_ps(probs + i), inv));
+    }
+    _mm512_mask_storeu_ps(probs + vecEnd, tail, _mm512_mul_ps(_mm512_maskz_loadu_ps(tail, probs + vecEnd), inv));
+}
+
+#endif // SAMPLE_MINE_X86
+
+//!
+//! \brief Row kernel for an explicit level; the level must be supported by this CPU. There is no
+//!        SSE4.1 kernel, that level uses the scalar one.
+//!
+inline SoftmaxRowFn getSoftmaxRow(SimdLevel level)
+{
+#ifdef SAMPLE_MINE_X86
+    switch (level)
+    {
+    case SimdLevel::kAVX512: return softmaxRowAVX512;
+    case SimdLevel::kAVX2: return softmaxRowAVX2;
+    default: break;
+    }
+#endif
+    (void) level;
+    return softmaxRowScalar;
+}
+
+//!
+//! \brief Row kernel for this CPU, resolved on first use.
+//!
+inline SoftmaxRowFn softmaxRow()
+{
+    static const SoftmaxRowFn fn = getSoftmaxRow(detectSimdLevel());
+    return fn;
+}
+
+//!
+//! \brief Softmax of every row of a rows x cols logit matrix into probs (same shape).
+//!
+inline void softmaxRows(const float* logits, int rows, int cols, float* probs, SoftmaxRowFn fn = softmaxRow())
+{
+    for (int r = 0; r < rows; ++r)
+    {
+        fn(logits + static_cast<size_t>(r) * cols, cols, probs + static_cast<size_t>(r) * cols);
+    }
+}
+
+//!
+//! \brief The k most likely classes of one image, most likely first. Fixed size, no allocation.
+//!
+struct TopK
+{
+    static const int kMaxK = 5;
+
+    int count{0};            //!< Valid entries, min(k, classes)
+    int classes[kMaxK];      //!< Class indices
+    float probabilities[kMaxK];
+};
+
+//!
+//! \brief Selects the k (<= TopK::kMaxK) largest of probs[0..count) by insertion into a k-entry
+//!        list: one pass, O(count * k), no sort of the whole row. Ties keep the lower index first.
+//!
+inline TopK topK(const float* probs, int count, int k)
+{
+    TopK top;
+    k = k < TopK::kMaxK ? k : TopK::kMaxK;
+    if (k <= 0)
+    {
+        return top;
+    }
+    for (int i = 0; i < count; ++i)
+    {
+        if (top.count == k && !(probs[i] > top.probabilities[k - 1]))
+        {
+            continue;
+        }
+        int pos = top.count < k ? top.count++ : k - 1;
+        for (; pos > 0 && probs[i] > top.probabilities[pos - 1]; --pos)
+        {
+            top.classes[pos] = top.classes[pos - 1];
+            top.probabilities[pos] = top.probabilities[pos - 1];
+        }
+        top.classes[pos] = i;
+        top.probabilities[pos] = probs[i];
+    }
+    return top;
+}
+
+} // namespace mine
+
+#endif // SAMPLE_MINE_SOFTMAX_H
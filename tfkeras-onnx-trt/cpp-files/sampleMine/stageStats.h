@@ -0,0 +1,192 @@
+#ifndef SAMPLE_MINE_STAGE_STATS_H
+#define SAMPLE_MINE_STAGE_STATS_H
+
+//
+// Latency samples per stage of the inference path, for --benchmark: decode and
+// resize+pack are recorded per image by the preprocessing workers, the device
+// steps and softmax per batch.
+//
+// Resize and pack are one fused pass (imageResize.h), so they are one stage.
+//
+// The CPU stages (decode, resize+pack, softmax) can also record the hardware
+// events of the thread that ran them (perfCounters.h), summed per stage.
+//
+
+#include "perfCounters.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace mine
+{
+
+enum class Stage : int
+{
+    kDECODE = 0,      //!< File read (unless prefetched) and scaled decode, per image
+    kRESIZE_PACK = 1, //!< Fused resample and pack into the host input buffer, per image
+    kH2D = 2,         //!< Host to device input copy, per batch
+    kEXECUTE = 3,     //!< Engine execution, per batch
+    kD2H = 4,         //!< Device to host output copy, per batch
+    kSOFTMAX = 5,     //!< Softmax and top-k of every row, per batch
+    kCOUNT = 6
+};
+
+inline const char* stageName(Stage stage)
+{
+    static const char* const names[] = {"decode", "resize+pack", "h2d", "execute", "d2h", "softmax"};
+    return names[static_cast<int>(stage)];
+}
+
+//!
+//! \brief True for the stages recorded once per image rather than once per batch.
+//!
+inline bool perImageStage(Stage stage)
+{
+    return stage == Stage::kDECODE || stage == Stage::kRESIZE_PACK;
+}
+
+struct LatencySummary
+{
+    uint64_t count{0};
+    double mean{0.0};
+    double p50{0.0};
+    double p90{0.0};
+    double p99{0.0};
+    double max{0.0};
+};
+
+//!
+//! \brief Nearest-rank percentiles of samples, in the samples' unit.
+//!
+inline LatencySummary summarizeLatencies(std::vector<double> samples)
+{
+    LatencySummary summary;
+    summary.count = samples.size();
+    if (samples.empty())
+    {
+        return summary;
+    }
+    std::sort(samples.begin(), samples.end());
+    const auto rank = [&samples](double p) {
+        const size_t n = samples.size();
+        const size_t r = static_cast<size_t>(std::ceil(p / 100.0 * n));
+        return samples[std::min(n - 1, r > 0 ? r - 1 : 0)];
+    };
+    double sum = 0.0;
+    for (double s : samples)
+    {
+        sum += s;
+    }
+    summary.mean = sum / samples.size();
+    summary.p50 = rank(50.0);
+    summary.p90 = rank(90.0);
+    summary.p99 = rank(99.0);
+    summary.max = samples.back();
+    return summary;
+}
+
+//!
+//! \brief Hardware events summed over the samples of one stage.
+//!
+struct CounterTotals
+{
+    uint64_t samples{0};
+    uint64_t value[static_cast<int>(PerfCounter::kCOUNT)]{};
+    uint64_t counted[static_cast<int>(PerfCounter::kCOUNT)]{}; //!< Samples the counter was available in
+
+    //!
+    //! \brief Mean events per sample of counter, -1 if it was never available.
+    //!
+    double mean(PerfCounter counter) const
+    {
+        const int c = static_cast<int>(counter);
+        return counted[c] ? static_cast<double>(value[c]) / counted[c] : -1.0;
+    }
+};
+
+//!
+//! \brief Microsecond samples, and optionally hardware events, per Stage; record() and
+//!        recordCounters() may be called from any thread.
+//!
+class StageStats
+{
+public:
+    //!
+    //! \brief countEvents asks the stages to also call recordCounters().
+    //!
+    explicit StageStats(bool countEvents = false)
+        : mCountEvents(countEvents)
+    {
+    }
+
+    bool countEvents() const
+    {
+        return mCountEvents;
+    }
+
+    void record(Stage stage, double us)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mSamples[static_cast<int>(stage)].push_back(us);
+    }
+
+    void recordCounters(Stage stage, const PerfCounterValues& events)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        CounterTotals& totals = mCounters[static_cast<int>(stage)];
+        ++totals.samples;
+        for (int c = 0; c < static_cast<int>(PerfCounter::kCOUNT); ++c)
+        {
+            if (events.has[c])
+            {
+                totals.value[c] += events.value[c];
+                ++totals.counted[c];
+            }
+        }
+    }
+
+    //!
+    //! \brief Drops everything recorded so far, e.g. after warmup.
+    //!
+    void reset()
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        for (auto& samples : mSamples)
+        {
+            samples.clear();
+        }
+        for (auto& totals : mCounters)
+        {
+            totals = CounterTotals();
+        }
+    }
+
+    LatencySummary summary(Stage stage) const
+    {
+        std::vector<double> samples;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            samples = mSamples[static_cast<int>(stage)];
+        }
+        return summarizeLatencies(std::move(samples));
+    }
+
+    CounterTotals counters(Stage stage) const
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mCounters[static_cast<int>(stage)];
+    }
+
+private:
+    const bool mCountEvents;
+    mutable std::mutex mMutex;
+    std::vector<double> mSamples[static_cast<int>(Stage::kCOUNT)];
+    CounterTotals mCounters[static_cast<int>(Stage::kCOUNT)];
+};
+
+} // namespace mine
+
+#endif // SAMPLE_MINE_STAGE_STATS_H
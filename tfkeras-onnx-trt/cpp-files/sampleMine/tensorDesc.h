@@ -0,0 +1,204 @@
+#ifndef SAMPLE_MINE_TENSOR_DESC_H
+#define SAMPLE_MINE_TENSOR_DESC_H
+
+//
+// What an engine binding holds, read from its dimensions instead of assumed:
+// dims, strides, element type, which axis is the batch and, for an image input,
+// whether the channels come first (NCHW) or last (NHWC). tf2onnx exports Keras
+// models NHWC unless told otherwise; with the layout known, preprocessing writes
+// whichever one the engine takes, and no transpose has to be added to the model.
+//
+
+#include <cstddef>
+#include <cstdint>
+#include <sstream>
+#include <string>
+
+namespace mine
+{
+
+//!
+//! \brief Order of the values of one image in the input tensor.
+//!
+enum class TensorLayout : int
+{
+    kNCHW = 0, //!< One plane per channel (R, G, B), what the inception_v3 plan takes
+    kNHWC = 1  //!< Interleaved RGB pixels, what tf2onnx exports by default
+};
+
+inline const char* tensorLayoutName(TensorLayout layout)
+{
+    return layout == TensorLayout::kNHWC ? "NHWC" : "NCHW";
+}
+
+//!
+//! \brief Element type of a binding; the values are those of nvinfer1::DataType.
+//!
+enum class ElementType : int
+{
+    kFLOAT = 0,
+    kHALF = 1,
+    kINT8 = 2,
+    kINT32 = 3,
+    kBOOL = 4
+};
+
+inline const char* elementTypeName(ElementType type)
+{
+    switch (type)
+    {
+    case ElementType::kHALF: return "half";
+    case ElementType::kINT8: return "int8";
+    case ElementType::kINT32: return "int32";
+    case ElementType::kBOOL: return "bool";
+    default: return "float";
+    }
+}
+
+inline size_t elementTypeSize(ElementType type)
+{
+    return type == ElementType::kHALF ? 2 : type == ElementType::kINT8 || type == ElementType::kBOOL ? 1 : 4;
+}
+
+//!
+//! \brief A dense row-major tensor: dims, strides in elements, element type and batch axis.
+//!
+//! For an image tensor (three dimensions besides the batch) layout says where the channels are,
+//! and channels(), height() and width() read them from the right place.
+//!
+struct TensorDesc
+{
+    static const int kMaxDims = 8;
+
+    int nbDims{0};
+    int dims[kMaxDims]{};
+    size_t strides[kMaxDims]{};
+    ElementType type{ElementType::kFLOAT};
+    int batchAxis{-1}; //!< -1 when the batch is implicit, outside the dims
+    TensorLayout layout{TensorLayout::kNCHW};
+
+    //!
+    //! \brief Images per tensor, 0 for an implicit batch.
+    //!
+    int batch() const
+    {
+        return batchAxis < 0 ? 0 : dims[batchAxis];
+    }
+
+    //!
+    //! \brief Elements of one batch item (one image, one output row).
+    //!
+    size_t sampleElements() const
+    {
+        size_t count = 1;
+        for (int i = 0; i < nbDims; ++i)
+        {
+            count *= i == batchAxis ? 1 : static_cast<size_t>(dims[i] > 0 ? dims[i] : 0);
+        }
+        return count;
+    }
+
+    //!
+    //! \brief Elements between batch item n and n + 1.
+    //!
+    size_t batchStride() const
+    {
+        return batchAxis < 0 ? sampleElements() : strides[batchAxis];
+    }
+
+    //!
+    //! \brief True for exactly three dimensions besides the batch, all of them fixed.
+    //!
+    bool isImage() const
+    {
+        const int first = imageAxis();
+        return nbDims - first == 3 && dims[first] > 0 && dims[first + 1] > 0 && dims[first + 2] > 0;
+    }
+
+    int channels() const
+    {
+        return dims[imageAxis() + (layout == TensorLayout::kNHWC ? 2 : 0)];
+    }
+
+    int height() const
+    {
+        return dims[imageAxis() + (layout == TensorLayout::kNHWC ? 0 : 1)];
+    }
+
+    int width() const
+    {
+        return dims[imageAxis() + (layout == TensorLayout::kNHWC ? 1 : 2)];
+    }
+
+private:
+    int imageAxis() const
+    {
+        return batchAxis < 0 ? 0 : batchAxis + 1;
+    }
+};
+
+//!
+//! \brief Describes a binding of nbDims / d[] dimensions (nvinfer1::Dims or any type like it).
+//!
+//! With an explicit batch the batch is the first dimension, as tf2onnx and keras2onnx export it.
+//! An image is taken as NHWC when its last dimension is a channel count (at most 4) and its
+//! first is not; anything else, including a 3x3x3 image, is NCHW.
+//!
+template <typename Dims>
+TensorDesc describeTensor(const Dims& dims, ElementType type, bool implicitBatch)
+{
+    const int maxDims = TensorDesc::kMaxDims;
+    TensorDesc desc;
+    desc.nbDims = dims.nbDims < 0 ? 0 : dims.nbDims < maxDims ? dims.nbDims : maxDims;
+    desc.type = type;
+    desc.batchAxis = implicitBatch || desc.nbDims == 0 ? -1 : 0;
+    size_t stride = 1;
+    for (int i = desc.nbDims - 1; i >= 0; --i)
+    {
+        desc.dims[i] = dims.d[i];
+        desc.strides[i] = stride;
+        stride *= static_cast<size_t>(dims.d[i] > 0 ? dims.d[i] : 0);
+    }
+    if (desc.isImage())
+    {
+        const int first = desc.batchAxis + 1;
+        const int last = first + 2;
+        desc.layout = desc.dims[last] <= 4 && desc.dims[first] > 4 ? TensorLayout::kNHWC : TensorLayout::kNCHW;
+    }
+    return desc;
+}
+
+//!
+//! \brief e.g. "float NCHW 3x299x299, batch 8" or "float 2, implicit batch".
+//!
+inline std::string tensorDescString(const TensorDesc& desc)
+{
+    std::ostringstream out;
+    out << elementTypeName(desc.type) << " ";
+    if (desc.isImage())
+    {
+        out << tensorLayoutName(desc.layout) << " ";
+    }
+    bool first = true;
+    for (int i = 0; i < desc.nbDims; ++i)
+    {
+        if (i != desc.batchAxis)
+        {
+            out << (first ? "" : "x") << desc.dims[i];
+            first = false;
+        }
+    }
+    if (desc.batchAxis < 0)
+    {
+        out << ", implicit batch";
+    }
+    else
+    {
+        out << ", batch " << desc.batch();
+    }
+    return out.str();
+}
+
+} // namespace mine
+
+#endif // SAMPLE_MINE_TENSOR_DESC_H
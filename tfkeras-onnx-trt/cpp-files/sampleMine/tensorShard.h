@@ -0,0 +1,531 @@
+#ifndef SAMPLE_MINE_TENSOR_SHARD_H
+#define SAMPLE_MINE_TENSOR_SHARD_H
+
+//
+// Shards of already preprocessed input tensors, so re-scoring an unchanged
+// corpus after a model update skips JPEG decode and resize entirely. A shard
+// is written once by sample_mine_shard and mapped read-only by sample_mine,
+// which only widens each tensor into its float host buffer.
+//
+// Layout, all little-endian:
+//
+//   ShardHeader          128 bytes, padded to kShardDataAlignment
+//   tensors              count x tensorStride bytes, each CHW uint8 or fp16
+//   ShardIndexEntry      count x 16 bytes
+//   names                namesBytes bytes, not terminated
+//
+// uint8 tensors hold the resized pixel values and normalization is applied
+// when they are read; fp16 tensors hold the normalized values. Either way the
+// header records the normalization and resize mode, and a shard whose
+// recorded preprocessing or version differs from the current one is rejected
+// rather than silently scored with stale inputs.
+//
+
+#include "bulkInput.h"
+#include "halfFloat.h"
+#include "imagePacking.h"
+#include "imageResize.h"
+#include "mappedFile.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace mine
+{
+
+//! Bumped whenever the layout or the meaning of a field changes.
+const uint32_t kShardVersion = 1;
+const char kShardMagic[8] = {'M', 'I', 'N', 'E', 'S', 'H', 'R', 'D'};
+//! The first tensor starts on a page, every following one on a cache line.
+const uint64_t kShardDataAlignment = 4096;
+const uint64_t kShardTensorAlignment = 64;
+
+enum class ShardDataType : uint32_t
+{
+    kUINT8 = 0,
+    kFP16 = 1
+};
+
+inline const char* shardDataTypeName(ShardDataType type)
+{
+    return type == ShardDataType::kFP16 ? "fp16" : "uint8";
+}
+
+inline bool parseShardDataType(const std::string& name, ShardDataType& type)
+{
+    if (name == "uint8")
+    {
+        type = ShardDataType::kUINT8;
+        return true;
+    }
+    if (name == "fp16")
+    {
+        type = ShardDataType::kFP16;
+        return true;
+    }
+    return false;
+}
+
+//!
+//! \brief What the tensors of a shard are: element type, CHW shape and the preprocessing
+//!        that produced them.
+//!
+struct ShardFormat
+{
+    ShardDataType type{ShardDataType::kUINT8};
+    int channels{3};
+    int height{0};
+    int width{0};
+    ResizeMode resizeMode{ResizeMode::kSTRETCH};
+    PackParams normalization = defaultPackParams();
+
+    size_t tensorBytes() const
+    {
+        return static_cast<size_t>(channels) * height * width * (type == ShardDataType::kFP16 ? 2 : 1);
+    }
+};
+
+//!
+//! \brief Fails, saying why, if tensors of format shard were not preprocessed the way expected
+//!        says. The element type may differ; expected dimensions of 0 match any.
+//!
+inline bool checkShardFormat(const ShardFormat& shard, const ShardFormat& expected, std::string& error)
+{
+    std::ostringstream why;
+    if ((expected.channels && shard.channels != expected.channels)
+        || (expected.height && shard.height != expected.height) || (expected.width && shard.width != expected.width))
+    {
+        why << "tensors are " << shard.channels << "x" << shard.height << "x" << shard.width << ", expected "
+            << expected.channels << "x" << expected.height << "x" << expected.width;
+    }
+    else if (shard.resizeMode != expected.resizeMode)
+    {
+        why << "resized with " << resizeModeName(shard.resizeMode) << ", expected "
+            << resizeModeName(expected.resizeMode);
+    }
+    else if (std::memcmp(&shard.normalization, &expected.normalization, sizeof(PackParams)) != 0)
+    {
+        why << "normalized with a different scale and bias";
+    }
+    error = why.str();
+    return error.empty();
+}
+
+//!
+//! \brief On-disk header. Fields are fixed-size and naturally aligned, so it is read in place.
+//!
+struct ShardHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t dataType;    //!< ShardDataType
+    uint32_t channels;
+    uint32_t height;
+    uint32_t width;
+    uint32_t resizeMode;  //!< ResizeMode
+    float scale[3];       //!< Normalization, value = pixel * scale[c] + bias[c]
+    float bias[3];
+    uint64_t count;       //!< Tensors in the shard
+    uint64_t tensorStride;
+    uint64_t dataOffset;  //!< First tensor
+    uint64_t indexOffset; //!< count ShardIndexEntry
+    uint64_t namesOffset;
+    uint64_t namesBytes;
+    uint8_t reserved[24];
+};
+static_assert(sizeof(ShardHeader) == 128, "ShardHeader is part of the file format");
+
+struct ShardIndexEntry
+{
+    uint64_t nameOffset; //!< From namesOffset
+    uint32_t nameBytes;
+    uint32_t reserved;
+};
+static_assert(sizeof(ShardIndexEntry) == 16, "ShardIndexEntry is part of the file format");
+
+//!
+//! \brief One tensor inside a mapped shard. Valid while its ShardReader is open.
+//!
+struct ShardTensor
+{
+    const void* data{nullptr};
+    const ShardFormat* format{nullptr};
+};
+
+//!
+//! \brief Widens tensor into dst as the normalized float CHW the engine takes.
+//!
+inline void unpackShardTensor(const ShardTensor& tensor, float* dst)
+{
+    const ShardFormat& format = *tensor.format;
+    const size_t plane = static_cast<size_t>(format.height) * format.width;
+    for (int c = 0; c < format.channels; ++c)
+    {
+        float* out = dst + c * plane;
+        if (format.type == ShardDataType::kFP16)
+        {
+            const uint16_t* in = static_cast<const uint16_t*>(tensor.data) + c * plane;
+            for (size_t i = 0; i < plane; ++i)
+            {
+                out[i] = halfToFloat(in[i]);
+            }
+        }
+        else
+        {
+            const uint8_t* in = static_cast<const uint8_t*>(tensor.data) + c * plane;
+            const float scale = format.normalization.scale[c % 3];
+            const float bias = format.normalization.bias[c % 3];
+            for (size_t i = 0; i < plane; ++i)
+            {
+                out[i] = in[i] * scale + bias;
+            }
+        }
+    }
+}
+
+//!
+//! \brief As above, into IEEE half: fp16 tensors are copied as they are, uint8 ones normalized
+//!        and rounded to nearest even.
+//!
+inline void unpackShardTensor(const ShardTensor& tensor, uint16_t* dst)
+{
+    const ShardFormat& format = *tensor.format;
+    if (format.type == ShardDataType::kFP16)
+    {
+        std::memcpy(dst, tensor.data, format.tensorBytes());
+        return;
+    }
+    const size_t plane = static_cast<size_t>(format.height) * format.width;
+    for (int c = 0; c < format.channels; ++c)
+    {
+        const uint8_t* in = static_cast<const uint8_t*>(tensor.data) + c * plane;
+        uint16_t* out = dst + c * plane;
+        const float scale = format.normalization.scale[c % 3];
+        const float bias = format.normalization.bias[c % 3];
+        for (size_t i = 0; i < plane; ++i)
+        {
+            out[i] = floatToHalf(in[i] * scale + bias);
+        }
+    }
+}
+
+//!
+//! \brief Writes one shard. The file appears under its name only once finish() succeeds.
+//!
+class ShardWriter
+{
+public:
+    //!
+    //! \brief Starts path.tmp. format.normalization is recorded as is; for fp16 it must already be
+    //!        applied to the tensors passed to add().
+    //!
+    bool open(const std::string& path, const ShardFormat& format)
+    {
+        mPath = path;
+        mFormat = format;
+        mStride = (format.tensorBytes() + kShardTensorAlignment - 1) / kShardTensorAlignment * kShardTensorAlignment;
+        mIndex.clear();
+        mNames.clear();
+        mFile.open(path + ".tmp", std::ios::binary | std::ios::trunc);
+        const std::vector<char> header(kShardDataAlignment, 0);
+        mFile.write(header.data(), header.size());
+        return static_cast<bool>(mFile);
+    }
+
+    //!
+    //! \brief Appends a tensor of format().tensorBytes() bytes, CHW.
+    //!
+    bool add(const std::string& name, const void* tensor)
+    {
+        static const char padding[kShardTensorAlignment] = {};
+        mFile.write(static_cast<const char*>(tensor), mFormat.tensorBytes());
+        mFile.write(padding, mStride - mFormat.tensorBytes());
+        ShardIndexEntry entry;
+        entry.nameOffset = mNames.size();
+        entry.nameBytes = static_cast<uint32_t>(name.size());
+        entry.reserved = 0;
+        mIndex.push_back(entry);
+        mNames += name;
+        return static_cast<bool>(mFile);
+    }
+
+    //!
+    //! \brief Appends the index and names, fills in the header and renames the file into place.
+    //!        The writer is then empty and can open() the next shard.
+    //!
+    bool finish()
+    {
+        ShardHeader header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, kShardMagic, sizeof(header.magic));
+        header.version = kShardVersion;
+        header.dataType = static_cast<uint32_t>(mFormat.type);
+        header.channels = mFormat.channels;
+        header.height = mFormat.height;
+        header.width = mFormat.width;
+        header.resizeMode = static_cast<uint32_t>(mFormat.resizeMode);
+        std::copy(mFormat.normalization.scale, mFormat.normalization.scale + 3, header.scale);
+        std::copy(mFormat.normalization.bias, mFormat.normalization.bias + 3, header.bias);
+        header.count = mIndex.size();
+        header.tensorStride = mStride;
+        header.dataOffset = kShardDataAlignment;
+        header.indexOffset = header.dataOffset + header.count * mStride;
+        header.namesOffset = header.indexOffset + header.count * sizeof(ShardIndexEntry);
+        header.namesBytes = mNames.size();
+
+        mFile.write(reinterpret_cast<const char*>(mIndex.data()), mIndex.size() * sizeof(ShardIndexEntry));
+        mFile.write(mNames.data(), mNames.size());
+        mFile.seekp(0);
+        mFile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        mFile.close();
+        mIndex.clear();
+        mNames.clear();
+        return !mFile.fail() && std::rename((mPath + ".tmp").c_str(), mPath.c_str()) == 0;
+    }
+
+    uint64_t size() const
+    {
+        return mIndex.size();
+    }
+
+    const ShardFormat& format() const
+    {
+        return mFormat;
+    }
+
+private:
+    std::string mPath;
+    ShardFormat mFormat;
+    uint64_t mStride{0};
+    std::ofstream mFile;
+    std::vector<ShardIndexEntry> mIndex;
+    std::string mNames;
+};
+
+//!
+//! \brief One shard mapped read-only; tensors are read straight from the page cache.
+//!
+class ShardReader
+{
+public:
+    //!
+    //! \brief Maps and validates path. Returns false and leaves error() set if it is not a shard of
+    //!        this version or is truncated.
+    //!
+    bool open(const std::string& path)
+    {
+        mPath = path;
+        // Shards can be far larger than RAM: read ahead instead of prefaulting the whole file
+        if (!mFile.open(path, false))
+        {
+            mError = mFile.error();
+            return false;
+        }
+        const uint8_t* base = static_cast<const uint8_t*>(mFile.data());
+        const uint64_t size = mFile.size();
+        if (size < sizeof(ShardHeader) || std::memcmp(base, kShardMagic, sizeof(kShardMagic)) != 0)
+        {
+            return fail("not a tensor shard");
+        }
+        std::memcpy(&mHeader, base, sizeof(mHeader));
+        if (mHeader.version != kShardVersion)
+        {
+            std::ostringstream why;
+            why << "shard version " << mHeader.version << ", expected " << kShardVersion
+                << "; rewrite it with sample_mine_shard";
+            return fail(why.str());
+        }
+        if (mHeader.dataType > static_cast<uint32_t>(ShardDataType::kFP16)
+            || mHeader.resizeMode > static_cast<uint32_t>(ResizeMode::kLETTERBOX) || mHeader.channels == 0
+            || mHeader.height == 0 || mHeader.width == 0)
+        {
+            return fail("corrupt header");
+        }
+        mFormat.type = static_cast<ShardDataType>(mHeader.dataType);
+        mFormat.channels = static_cast<int>(mHeader.channels);
+        mFormat.height = static_cast<int>(mHeader.height);
+        mFormat.width = static_cast<int>(mHeader.width);
+        mFormat.resizeMode = static_cast<ResizeMode>(mHeader.resizeMode);
+        std::copy(mHeader.scale, mHeader.scale + 3, mFormat.normalization.scale);
+        std::copy(mHeader.bias, mHeader.bias + 3, mFormat.normalization.bias);
+
+        // Bounds, in an order that cannot overflow for any count that fits in the file
+        const uint64_t count = mHeader.count;
+        if (mHeader.tensorStride < mFormat.tensorBytes() || mHeader.dataOffset > size
+            || count > (size - mHeader.dataOffset) / mHeader.tensorStride
+            || mHeader.indexOffset % alignof(ShardIndexEntry) != 0
+            || mHeader.indexOffset < mHeader.dataOffset + count * mHeader.tensorStride || mHeader.indexOffset > size
+            || count > (size - mHeader.indexOffset) / sizeof(ShardIndexEntry)
+            || mHeader.namesOffset < mHeader.indexOffset + count * sizeof(ShardIndexEntry)
+            || mHeader.namesOffset > size || mHeader.namesBytes > size - mHeader.namesOffset)
+        {
+            return fail("truncated or corrupt");
+        }
+        mIndex = reinterpret_cast<const ShardIndexEntry*>(base + mHeader.indexOffset);
+        for (uint64_t i = 0; i < count; ++i)
+        {
+            if (mIndex[i].nameOffset > mHeader.namesBytes
+                || mIndex[i].nameBytes > mHeader.namesBytes - mIndex[i].nameOffset)
+            {
+                return fail("corrupt index");
+            }
+        }
+        return true;
+    }
+
+    uint64_t size() const
+    {
+        return mHeader.count;
+    }
+
+    const ShardFormat& format() const
+    {
+        return mFormat;
+    }
+
+    std::string name(uint64_t i) const
+    {
+        const char* names = static_cast<const char*>(mFile.data()) + mHeader.namesOffset;
+        return std::string(names + mIndex[i].nameOffset, mIndex[i].nameBytes);
+    }
+
+    ShardTensor tensor(uint64_t i) const
+    {
+        ShardTensor tensor;
+        tensor.data = static_cast<const uint8_t*>(mFile.data()) + mHeader.dataOffset + i * mHeader.tensorStride;
+        tensor.format = &mFormat;
+        return tensor;
+    }
+
+    const std::string& path() const
+    {
+        return mPath;
+    }
+
+    const std::string& error() const
+    {
+        return mError;
+    }
+
+private:
+    bool fail(const std::string& why)
+    {
+        mError = mPath + ": " + why;
+        mFile.close();
+        return false;
+    }
+
+    std::string mPath;
+    MappedFile mFile;
+    ShardHeader mHeader;
+    ShardFormat mFormat;
+    const ShardIndexEntry* mIndex{nullptr};
+    std::string mError;
+};
+
+//!
+//! \brief True if path is a comma separated list of .shard files.
+//!
+inline bool isShardList(const std::string& path)
+{
+    std::istringstream list(path);
+    std::string item;
+    bool any = false;
+    while (std::getline(list, item, ','))
+    {
+        const std::string ext = ".shard";
+        if (item.size() <= ext.size() || item.compare(item.size() - ext.size(), ext.size(), ext) != 0)
+        {
+            return false;
+        }
+        any = true;
+    }
+    return any;
+}
+
+//!
+//! \brief The tensors of a list of shards, in order, as an ImageSource whose entries come with
+//!        their tensor already preprocessed. All shards must share one format.
+//!
+class ShardSource : public ImageSource
+{
+public:
+    //!
+    //! \brief Opens the comma separated shard files of list; false with error set on the first
+    //!        that cannot be used.
+    //!
+    bool open(const std::string& list, std::string& error)
+    {
+        std::istringstream paths(list);
+        std::string path;
+        while (std::getline(paths, path, ','))
+        {
+            std::unique_ptr<ShardReader> shard(new ShardReader);
+            if (!shard->open(path))
+            {
+                error = shard->error();
+                return false;
+            }
+            std::string why;
+            if (!mShards.empty() && shard->format().type != format().type)
+            {
+                why = std::string("element type ") + shardDataTypeName(shard->format().type);
+            }
+            if (!mShards.empty() && (!why.empty() || !checkShardFormat(shard->format(), format(), why)))
+            {
+                error = path + " differs from " + mShards.front()->path() + ": " + why;
+                return false;
+            }
+            mShards.push_back(std::move(shard));
+        }
+        return !mShards.empty();
+    }
+
+    const ShardFormat& format() const
+    {
+        return mShards.front()->format();
+    }
+
+    bool next(ImageEntry& entry) override
+    {
+        while (mShard < mShards.size() && mIndex >= mShards[mShard]->size())
+        {
+            ++mShard;
+            mIndex = 0;
+        }
+        if (mShard == mShards.size())
+        {
+            return false;
+        }
+        entry.name = mShards[mShard]->name(mIndex);
+        entry.path = mShards[mShard]->path();
+        mTensor = mShards[mShard]->tensor(mIndex);
+        ++mIndex;
+        ++mOffset;
+        return true;
+    }
+
+    //!
+    //! \brief The tensor of the entry next() returned last.
+    //!
+    const ShardTensor& tensor() const
+    {
+        return mTensor;
+    }
+
+private:
+    std::vector<std::unique_ptr<ShardReader>> mShards;
+    size_t mShard{0};
+    uint64_t mIndex{0};
+    ShardTensor mTensor;
+};
+
+} // namespace mine
+
+#endif // SAMPLE_MINE_TENSOR_SHARD_H
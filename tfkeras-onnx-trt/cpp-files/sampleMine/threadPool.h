@@ -0,0 +1,184 @@
+#ifndef SAMPLE_MINE_THREAD_POOL_H
+#define SAMPLE_MINE_THREAD_POOL_H
+
+#include "traceEvents.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace mine
+{
+
+//!
+//! \brief A fixed set of worker threads created once and reused for every batch.
+//!
+class ThreadPool
+{
+public:
+    //!
+    //! \param numThreads Worker count; 0 uses one per hardware thread.
+    //!
+    explicit ThreadPool(int numThreads = 0)
+    {
+        if (numThreads <= 0)
+        {
+            numThreads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        for (int i = 0; i < numThreads; ++i)
+        {
+            mWorkers.emplace_back([this]() { workerLoop(); });
+        }
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStop = true;
+        }
+        mCondition.notify_all();
+        for (auto& worker : mWorkers)
+        {
+            worker.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    int size() const
+    {
+        return static_cast<int>(mWorkers.size());
+    }
+
+    //!
+    //! \brief Queues a task to run on some worker. A task that throws is abandoned where it threw
+    //!        and counted in failedTasks(); the worker goes on with the next one, so a task that
+    //!        has to report its outcome must catch what it can fail with itself.
+    //!
+    void enqueue(std::function<void()> task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mTasks.push_back(std::move(task));
+        }
+        mCondition.notify_one();
+    }
+
+    //!
+    //! \brief Tasks that ended in an exception since the pool was created.
+    //!
+    uint64_t failedTasks() const
+    {
+        return mFailedTasks.load();
+    }
+
+    //!
+    //! \brief Runs fn(i) for every i in [0, n) on the workers and the calling thread, and
+    //!        returns once all of them have finished. Must not be called from a pool worker.
+    //!
+    //! An exception thrown by fn(i) ends only that index; every other index still runs, and the
+    //! first exception is rethrown here once all have finished. Callers that want a status per
+    //! index catch inside fn.
+    //!
+    void parallelFor(int n, const std::function<void(int)>& fn)
+    {
+        struct Shared
+        {
+            std::atomic<int> next{0};
+            std::mutex mutex;
+            std::condition_variable done;
+            int running{0};
+            std::exception_ptr error; //!< First exception of any index
+        };
+        auto shared = std::make_shared<Shared>();
+        auto drain = [shared, n, &fn]() {
+            for (int i = shared->next++; i < n; i = shared->next++)
+            {
+                try
+                {
+                    fn(i);
+                }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> lock(shared->mutex);
+                    if (!shared->error)
+                    {
+                        shared->error = std::current_exception();
+                    }
+                }
+            }
+        };
+
+        const int helpers = std::min(n - 1, size());
+        shared->running = helpers;
+        for (int h = 0; h < helpers; ++h)
+        {
+            enqueue([shared, drain]() {
+                drain();
+                std::lock_guard<std::mutex> lock(shared->mutex);
+                if (--shared->running == 0)
+                {
+                    shared->done.notify_one();
+                }
+            });
+        }
+        drain();
+
+        // fn is only borrowed, so wait for every helper, including ones that found no work left.
+        std::unique_lock<std::mutex> lock(shared->mutex);
+        shared->done.wait(lock, [&shared]() { return shared->running <= 0; });
+        if (shared->error)
+        {
+            std::rethrow_exception(shared->error);
+        }
+    }
+
+private:
+    void workerLoop()
+    {
+        traceThreadName("pool worker");
+        for (;;)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mMutex);
+                mCondition.wait(lock, [this]() { return mStop || !mTasks.empty(); });
+                if (mTasks.empty())
+                {
+                    return;
+                }
+                task = std::move(mTasks.front());
+                mTasks.pop_front();
+            }
+            try
+            {
+                task();
+            }
+            catch (...)
+            {
+                ++mFailedTasks;
+            }
+        }
+    }
+
+    std::vector<std::thread> mWorkers;
+    std::deque<std::function<void()>> mTasks;
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    bool mStop{false};
+    std::atomic<uint64_t> mFailedTasks{0};
+};
+
+} // namespace mine
+
+#endif // SAMPLE_MINE_THREAD_POOL_H
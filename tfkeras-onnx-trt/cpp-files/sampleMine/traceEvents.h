@@ -0,0 +1,318 @@
+#ifndef SAMPLE_MINE_TRACE_EVENTS_H
+#define SAMPLE_MINE_TRACE_EVENTS_H
+
+//
+// Timeline of the inference path for --trace: scoped events go to a buffer of
+// the thread that records them and are written once, at the end, as a Chrome
+// trace (JSON Object Format), which chrome://tracing and ui.perfetto.dev open
+// with one track per thread.
+//
+// While tracing is off a TraceScope costs one relaxed atomic load. While it is
+// on, an event is two clock reads and an append under its thread's own mutex,
+// which only the final write ever contends.
+//
+// Each thread keeps at most maxEventsPerThread() events, about 6 MiB at the
+// default: a long run keeps its latest events, and the trace records how many
+// older ones were dropped.
+//
+// Event names are not copied: they must be string literals, or otherwise live
+// until the trace is written.
+//
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace mine
+{
+
+class Tracer
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    static Tracer& instance()
+    {
+        static Tracer tracer;
+        return tracer;
+    }
+
+    static bool enabled()
+    {
+        return instance().mEnabled.load(std::memory_order_relaxed);
+    }
+
+    //!
+    //! \brief Starts recording; event times are relative to the first start().
+    //!
+    void start()
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (!mStarted)
+        {
+            mOrigin = Clock::now();
+            mStarted = true;
+        }
+        mEnabled.store(true, std::memory_order_relaxed);
+    }
+
+    void stop()
+    {
+        mEnabled.store(false, std::memory_order_relaxed);
+    }
+
+    static const size_t kDefaultMaxEventsPerThread = 256 * 1024;
+
+    //!
+    //! \brief Events kept per thread; past it, each new event replaces the oldest of its thread.
+    //!        A buffer over a lowered maximum shrinks to its latest events as it next records.
+    //!
+    void setMaxEventsPerThread(size_t maxEvents)
+    {
+        mMaxEvents.store(std::max<size_t>(1, maxEvents), std::memory_order_relaxed);
+    }
+
+    size_t maxEventsPerThread() const
+    {
+        return mMaxEvents.load(std::memory_order_relaxed);
+    }
+
+    //!
+    //! \brief Records a complete event of the calling thread, whether or not tracing is on.
+    //!
+    void record(const char* name, Clock::time_point start, Clock::time_point end)
+    {
+        ThreadBuffer& buffer = threadBuffer();
+        const size_t maxEvents = maxEventsPerThread();
+        std::lock_guard<std::mutex> lock(buffer.mutex);
+        if (buffer.events.size() < maxEvents)
+        {
+            buffer.events.push_back(Event{name, start, end});
+            return;
+        }
+        if (buffer.events.size() > maxEvents)
+        {
+            // The maximum was lowered: keep the latest events, oldest first
+            std::rotate(buffer.events.begin(), buffer.events.begin() + buffer.next, buffer.events.end());
+            buffer.dropped += buffer.events.size() - maxEvents;
+            buffer.events.erase(buffer.events.begin(), buffer.events.end() - maxEvents);
+            buffer.next = 0;
+        }
+        buffer.events[buffer.next] = Event{name, start, end};
+        buffer.next = (buffer.next + 1) % buffer.events.size();
+        ++buffer.dropped;
+    }
+
+    //!
+    //! \brief Names the calling thread's track in the trace.
+    //!
+    void nameThread(const std::string& name)
+    {
+        ThreadBuffer& buffer = threadBuffer();
+        std::lock_guard<std::mutex> lock(buffer.mutex);
+        buffer.name = name;
+    }
+
+    //!
+    //! \brief Events recorded so far, over every thread.
+    //!
+    size_t eventCount()
+    {
+        size_t count = 0;
+        std::lock_guard<std::mutex> lock(mMutex);
+        for (const auto& buffer : mBuffers)
+        {
+            std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+            count += buffer->events.size();
+        }
+        return count;
+    }
+
+    //!
+    //! \brief Events overwritten so far because their thread's buffer was full, over every thread.
+    //!
+    uint64_t droppedCount()
+    {
+        uint64_t count = 0;
+        std::lock_guard<std::mutex> lock(mMutex);
+        for (const auto& buffer : mBuffers)
+        {
+            std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+            count += buffer->dropped;
+        }
+        return count;
+    }
+
+    //!
+    //! \brief Writes everything recorded so far as a Chrome trace; false if path cannot be written.
+    //!        Threads may keep recording meanwhile; their later events are not in the file. The
+    //!        number of events dropped for full buffers is in otherData.droppedEvents.
+    //!
+    bool write(const std::string& path)
+    {
+        std::ofstream out(path, std::ios::trunc);
+        if (!out)
+        {
+            return false;
+        }
+        const long pid = static_cast<long>(getpid());
+        out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+        out << "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": " << pid
+            << ", \"args\": {\"name\": \"sample_mine\"}}";
+        uint64_t dropped = 0;
+        std::lock_guard<std::mutex> lock(mMutex);
+        for (const auto& buffer : mBuffers)
+        {
+            std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+            dropped += buffer->dropped;
+            if (!buffer->name.empty())
+            {
+                out << ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": " << pid << ", \"tid\": " << buffer->tid
+                    << ", \"args\": {\"name\": \"" << escape(buffer->name) << "\"}}";
+            }
+            // Oldest first: a full buffer wraps at next
+            const size_t size = buffer->events.size();
+            for (size_t i = 0; i < size; ++i)
+            {
+                const Event& event = buffer->events[(buffer->next + i) % size];
+                out << ",\n{\"name\": \"" << escape(event.name) << "\", \"cat\": \"mine\", \"ph\": \"X\", \"pid\": "
+                    << pid << ", \"tid\": " << buffer->tid << ", \"ts\": " << microseconds(event.start)
+                    << ", \"dur\": " << microseconds(event.end) - microseconds(event.start) << "}";
+            }
+        }
+        out << "\n], \"otherData\": {\"droppedEvents\": " << dropped << "}}\n";
+        return static_cast<bool>(out.flush());
+    }
+
+private:
+    struct Event
+    {
+        const char* name;
+        Clock::time_point start;
+        Clock::time_point end;
+    };
+
+    //!
+    //! \brief Owned by the tracer as well as the thread, so the events of threads that already
+    //!        exited are still written.
+    //!
+    struct ThreadBuffer
+    {
+        std::mutex mutex;
+        int tid{0};
+        std::string name;
+        std::vector<Event> events;
+        size_t next{0};      //!< Oldest event, once the buffer is full
+        uint64_t dropped{0}; //!< Events overwritten because the buffer was full
+    };
+
+    Tracer() = default;
+
+    ThreadBuffer& threadBuffer()
+    {
+        thread_local std::shared_ptr<ThreadBuffer> buffer;
+        if (!buffer)
+        {
+            buffer = std::make_shared<ThreadBuffer>();
+            buffer->events.reserve(1024);
+            std::lock_guard<std::mutex> lock(mMutex);
+            buffer->tid = static_cast<int>(mBuffers.size()) + 1;
+            mBuffers.push_back(buffer);
+        }
+        return *buffer;
+    }
+
+    //!
+    //! \brief Whole microseconds since the first start(), as trace timestamps are.
+    //!
+    int64_t microseconds(Clock::time_point t) const
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(t - mOrigin).count();
+    }
+
+    static std::string escape(const std::string& text)
+    {
+        std::string escaped;
+        for (char c : text)
+        {
+            if (c == '"' || c == '\\')
+            {
+                escaped += '\\';
+            }
+            escaped += static_cast<unsigned char>(c) < 0x20 ? ' ' : c;
+        }
+        return escaped;
+    }
+
+    std::atomic<bool> mEnabled{false};
+    std::atomic<size_t> mMaxEvents{kDefaultMaxEventsPerThread};
+    std::mutex mMutex; //!< Guards mBuffers and mOrigin
+    bool mStarted{false};
+    Clock::time_point mOrigin;
+    std::vector<std::shared_ptr<ThreadBuffer>> mBuffers;
+};
+
+//!
+//! \brief Records the enclosing scope as one event, if tracing was on when it began.
+//!
+class TraceScope
+{
+public:
+    explicit TraceScope(const char* name)
+        : mName(Tracer::enabled() ? name : nullptr)
+    {
+        if (mName)
+        {
+            mStart = Tracer::Clock::now();
+        }
+    }
+
+    ~TraceScope()
+    {
+        if (mName)
+        {
+            Tracer::instance().record(mName, mStart, Tracer::Clock::now());
+        }
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* mName;
+    Tracer::Clock::time_point mStart;
+};
+
+//!
+//! \brief Records an event from times the caller measured anyway, if tracing is on.
+//!
+inline void traceEvent(const char* name, Tracer::Clock::time_point start, Tracer::Clock::time_point end)
+{
+    if (Tracer::enabled())
+    {
+        Tracer::instance().record(name, start, end);
+    }
+}
+
+//!
+//! \brief Names the calling thread's track, if tracing is on; call where the thread starts.
+//!
+inline void traceThreadName(const std::string& name)
+{
+    if (Tracer::enabled())
+    {
+        Tracer::instance().nameThread(name);
+    }
+}
+
+} // namespace mine
+
+#endif // SAMPLE_MINE_TRACE_EVENTS_H
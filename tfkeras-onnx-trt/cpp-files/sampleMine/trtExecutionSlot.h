@@ -0,0 +1,231 @@
+#ifndef SAMPLE_MINE_TRT_EXECUTION_SLOT_H
+#define SAMPLE_MINE_TRT_EXECUTION_SLOT_H
+
+#include "buffers.h"
+#include "common.h"
+#include "executionSlot.h"
+#include "imagePacking.h"
+#include "inputType.h"
+#include "normalizeInput.h"
+#include "tensorDesc.h"
+
+#include "NvInfer.h"
+#include <cuda_runtime_api.h>
+
+#include <memory>
+#include <string>
+
+namespace mine
+{
+
+//!
+//! \brief The batchSize to give BufferManager. An explicit-batch binding already has N in its
+//!        dims; TensorRT 7.0's BufferManager would multiply by it again, and 7.1 and later assert
+//!        that it is 0.
+//!
+inline int bufferManagerBatch(const nvinfer1::ICudaEngine& engine, int batchSize)
+{
+    if (engine.hasImplicitBatchDimension())
+    {
+        return batchSize;
+    }
+#if NV_TENSORRT_MAJOR > 7 || (NV_TENSORRT_MAJOR == 7 && NV_TENSORRT_MINOR >= 1)
+    return 0;
+#else
+    return 1;
+#endif
+}
+
+//!
+//! \brief An ExecutionSlot backed by a TensorRT execution context, its own host/device
+//!        buffers and its own CUDA stream, so slots do not serialize on the default stream.
+//!
+//! With InputType::kUINT8 the host input is a pinned 8-bit staging buffer; copyInputToDevice()
+//! moves those bytes and normalizes them into the engine's float input binding on the device.
+//! InputType::kHALF is staged the same way and widened, unless the binding itself is half (an
+//! engine built with fp16 input I/O), in which case the binding's own buffers are used as is.
+//!
+//! Every step is bracketed by CUDA events, so lastStepTimes() reports device time rather than
+//! the time to queue the work.
+//!
+class TrtExecutionSlot : public ExecutionSlot
+{
+public:
+    TrtExecutionSlot(std::shared_ptr<nvinfer1::ICudaEngine> engine, int batchSize, const std::string& inputName,
+        const std::string& outputName, InputType inputType = InputType::kFLOAT,
+        const PackParams& normalization = defaultPackParams())
+        : mBuffers(engine, bufferManagerBatch(*engine, batchSize))
+        , mContext(engine->createExecutionContext())
+        , mInputName(inputName)
+        , mOutputName(outputName)
+        , mInputType(inputType)
+        , mNormalization(normalization)
+    {
+        if (cudaStreamCreate(&mStream) != cudaSuccess)
+        {
+            mStream = nullptr;
+        }
+        for (cudaEvent_t& event : mEvents)
+        {
+            if (cudaEventCreate(&event) != cudaSuccess)
+            {
+                event = nullptr;
+            }
+        }
+        const int binding = engine->getBindingIndex(inputName.c_str());
+        const nvinfer1::DataType bindingType = engine->getBindingDataType(binding);
+        const TensorDesc desc = describeTensor(engine->getBindingDimensions(binding),
+            static_cast<ElementType>(bindingType), engine->hasImplicitBatchDimension());
+        mInputCount = static_cast<size_t>(desc.batch() > 0 ? desc.batch() : batchSize) * desc.batchStride();
+        mStaged = mInputType == InputType::kUINT8
+            || (mInputType == InputType::kHALF && bindingType != nvinfer1::DataType::kHALF);
+        if (mStaged)
+        {
+            // The device kernel takes the channel of value i as (i / plane) % channels: a plane of
+            // H x W values in NCHW, of a single value in NHWC
+            mChannels = desc.channels();
+            mPlane = desc.layout == TensorLayout::kNHWC ? 1 : static_cast<size_t>(desc.height()) * desc.width();
+            const size_t bytes = mInputCount * inputElementSize(mInputType);
+            if (cudaMallocHost(&mHostStage, bytes) != cudaSuccess)
+            {
+                mHostStage = nullptr;
+            }
+            if (cudaMalloc(&mDeviceStage, bytes) != cudaSuccess)
+            {
+                mDeviceStage = nullptr;
+            }
+        }
+    }
+
+    ~TrtExecutionSlot()
+    {
+        if (mStream)
+        {
+            cudaStreamDestroy(mStream);
+        }
+        for (cudaEvent_t event : mEvents)
+        {
+            if (event)
+            {
+                cudaEventDestroy(event);
+            }
+        }
+        if (mHostStage)
+        {
+            cudaFreeHost(mHostStage);
+        }
+        if (mDeviceStage)
+        {
+            cudaFree(mDeviceStage);
+        }
+    }
+
+    TrtExecutionSlot(const TrtExecutionSlot&) = delete;
+    TrtExecutionSlot& operator=(const TrtExecutionSlot&) = delete;
+
+    //!
+    //! \brief False if the context, the stream, the events or the staging buffers could not be created.
+    //!
+    bool valid() const
+    {
+        return mContext && mStream && mEvents[0] && mEvents[1] && mEvents[2] && mEvents[3]
+            && (!mStaged || (mHostStage && mDeviceStage));
+    }
+
+    void* hostInput() override
+    {
+        return mStaged ? mHostStage : mBuffers.getHostBuffer(mInputName);
+    }
+
+    float* hostOutput() override
+    {
+        return static_cast<float*>(mBuffers.getHostBuffer(mOutputName));
+    }
+
+    bool copyInputToDevice() override
+    {
+        cudaEventRecord(mEvents[0], mStream);
+        const bool ok = queueInputCopy();
+        cudaEventRecord(mEvents[1], mStream);
+        return ok;
+    }
+
+    bool execute() override
+    {
+        const bool ok = mContext->enqueueV2(mBuffers.getDeviceBindings().data(), mStream, nullptr);
+        cudaEventRecord(mEvents[2], mStream);
+        return ok;
+    }
+
+    //!
+    //! \brief Queues the copy back and waits for everything queued on the stream so far.
+    //!
+    bool copyOutputToHost() override
+    {
+        mBuffers.copyOutputToHostAsync(mStream);
+        cudaEventRecord(mEvents[3], mStream);
+        return cudaStreamSynchronize(mStream) == cudaSuccess;
+    }
+
+    StepTimes lastStepTimes() const override
+    {
+        float ms[3] = {0.0f, 0.0f, 0.0f};
+        for (int i = 0; i < 3; ++i)
+        {
+            if (cudaEventElapsedTime(&ms[i], mEvents[i], mEvents[i + 1]) != cudaSuccess)
+            {
+                ms[i] = 0.0f;
+            }
+        }
+        return StepTimes{ms[0] * 1e3, ms[1] * 1e3, ms[2] * 1e3};
+    }
+
+private:
+    bool queueInputCopy()
+    {
+        // The host input holds mInputCount values of the host type whichever way it is copied
+        const size_t bytes = mInputCount * inputElementSize(mInputType);
+        countBytesToDevice(bytes);
+        if (mStaged)
+        {
+            float* const binding = static_cast<float*>(mBuffers.getDeviceBuffer(mInputName));
+            if (cudaMemcpyAsync(mDeviceStage, mHostStage, bytes, cudaMemcpyHostToDevice, mStream) != cudaSuccess)
+            {
+                return false;
+            }
+            if (mInputType == InputType::kHALF)
+            {
+                return widenHalf(static_cast<const uint16_t*>(mDeviceStage), binding, mInputCount, mStream)
+                    == cudaSuccess;
+            }
+            // Groups of one value per channel: images for NCHW, pixels for NHWC
+            const int groups = static_cast<int>(mInputCount / (mChannels * mPlane));
+            return normalizeU8Planes(static_cast<const uint8_t*>(mDeviceStage), binding, groups, mChannels, mPlane,
+                       mNormalization.scale, mNormalization.bias, mStream)
+                == cudaSuccess;
+        }
+        return cudaMemcpyAsync(mBuffers.getDeviceBuffer(mInputName), mBuffers.getHostBuffer(mInputName), bytes,
+                   cudaMemcpyHostToDevice, mStream)
+            == cudaSuccess;
+    }
+
+    samplesCommon::BufferManager mBuffers;
+    std::unique_ptr<nvinfer1::IExecutionContext, samplesCommon::InferDeleter> mContext;
+    std::string mInputName;
+    std::string mOutputName;
+    cudaStream_t mStream{nullptr};
+    cudaEvent_t mEvents[4]{}; //!< Before the input copy, then after each step
+
+    InputType mInputType;
+    PackParams mNormalization;
+    bool mStaged{false};          //!< Host input narrower than the binding, converted on the device
+    int mChannels{0};
+    size_t mPlane{0};
+    size_t mInputCount{0};        //!< Input values per batch, from the binding's dims
+    void* mHostStage{nullptr};    //!< Pinned, so the copy is a real async DMA
+    void* mDeviceStage{nullptr};
+};
+
+} // namespace mine
+
+#endif // SAMPLE_MINE_TRT_EXECUTION_SLOT_H
@@ -0,0 +1,324 @@
+#include "common.h"
+
+#include "../sampleMine/hostArena.h"
+#include "../sampleMine/imagePacking.h"
+#include "../sampleMine/imageResize.h"
+#include "../sampleMine/jpegDecode.h"
+
+#include "opencv2/core.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+
+// Counts the heap allocations of sample_mine's preprocessing per image, on the
+// bundled cat/dog images: every malloc of the process is wrapped, so it is
+// built on its own rather than into sample_mine_bench.
+
+// Every heap allocation of the process, libjpeg's and OpenCV's included, goes through these
+// wrappers around glibc's allocator, so benchArena can count the ones its thread makes. They
+// live in this binary alone, so no other benchmark pays for them.
+extern "C"
+{
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* p, size_t size);
+void* __libc_memalign(size_t align, size_t size);
+void __libc_free(void* p);
+}
+
+namespace
+{
+__thread uint64_t tHeapAllocations = 0;
+}
+
+extern "C" void* malloc(size_t size) noexcept
+{
+    ++tHeapAllocations;
+    return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size) noexcept
+{
+    ++tHeapAllocations;
+    return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* p, size_t size) noexcept
+{
+    ++tHeapAllocations;
+    return __libc_realloc(p, size);
+}
+
+extern "C" void* memalign(size_t align, size_t size) noexcept
+{
+    ++tHeapAllocations;
+    return __libc_memalign(align, size);
+}
+
+extern "C" void* aligned_alloc(size_t align, size_t size) noexcept
+{
+    ++tHeapAllocations;
+    return __libc_memalign(align, size);
+}
+
+extern "C" int posix_memalign(void** p, size_t align, size_t size) noexcept
+{
+    ++tHeapAllocations;
+    *p = __libc_memalign(align, size);
+    return *p || size == 0 ? 0 : ENOMEM;
+}
+
+extern "C" void free(void* p) noexcept
+{
+    __libc_free(p);
+}
+
+namespace
+{
+
+struct BenchArgs
+{
+    std::vector<std::string> dataDirs;
+    int iterations{500};
+};
+
+const std::vector<std::string> gBenchImages = {"cat.0.jpg", "cat.1.jpg", "dog.0.jpg", "dog.1.jpg"};
+const int kInputH = 299;
+const int kInputW = 299;
+
+//!
+//! \brief Reads the bundled images as encoded bytes, one entry per gBenchImages name.
+//!
+bool loadEncodedImages(const BenchArgs& args, std::vector<std::vector<uint8_t>>& encoded)
+{
+    encoded.resize(gBenchImages.size());
+    for (size_t i = 0; i < gBenchImages.size(); ++i)
+    {
+        if (!mine::readFileBytes(locateFile(gBenchImages[i], args.dataDirs), encoded[i]))
+        {
+            std::cout << "Cannot open image " << gBenchImages[i] << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+//!
+//! \brief Minor page faults taken by the calling thread so far.
+//!
+long threadPageFaults()
+{
+    rusage usage;
+    getrusage(RUSAGE_THREAD, &usage);
+    return usage.ru_minflt;
+}
+
+//!
+//! \brief Heap allocations, page faults and time per image of preprocessing, counted by the
+//!        malloc wrappers above: libjpeg decoding on its own, then file read + decode + resize
+//!        into a std::vector and a default cv::Mat vs into the thread's arena, as sample_mine does.
+//!        Once warm, neither libjpeg nor the arena path may allocate at all.
+//!
+bool benchArena(const BenchArgs& args)
+{
+    std::vector<std::vector<uint8_t>> encoded;
+    if (!loadEncodedImages(args, encoded))
+    {
+        return false;
+    }
+    std::vector<std::string> paths;
+    for (const auto& name : gBenchImages)
+    {
+        paths.push_back(locateFile(name, args.dataDirs));
+    }
+    std::vector<float> tensor(3 * kInputH * kInputW);
+    const mine::PackParams packParams = mine::defaultPackParams();
+    const mine::ResizeMode mode = mine::ResizeMode::kSTRETCH;
+    const int rounds = std::max(2, args.iterations / 10);
+
+    struct Cost
+    {
+        double allocations;
+        double pageFaults;
+        double us;
+        uint64_t slabs; //!< Arena slabs mapped after the warm-up round
+        bool ok;
+    };
+    // image(i) over every bundled image, one untimed round and then rounds timed ones
+    const auto measure = [&](const std::function<bool(size_t)>& image) {
+        Cost cost{0.0, 0.0, 0.0, 0, true};
+        for (size_t i = 0; i < paths.size(); ++i)
+        {
+            cost.ok = image(i) && cost.ok;
+        }
+        const uint64_t allocations = tHeapAllocations;
+        const long faults = threadPageFaults();
+        const uint64_t slabs = mine::arenaStats().slabs;
+        const auto start = std::chrono::steady_clock::now();
+        for (int r = 0; r < rounds; ++r)
+        {
+            for (size_t i = 0; i < paths.size(); ++i)
+            {
+                cost.ok = image(i) && cost.ok;
+            }
+        }
+        const double images = static_cast<double>(rounds * paths.size());
+        cost.us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / images;
+        cost.allocations = (tHeapAllocations - allocations) / images;
+        cost.pageFaults = (threadPageFaults() - faults) / images;
+        cost.slabs = mine::arenaStats().slabs - slabs;
+        return cost;
+    };
+
+    // libjpeg on its own, on the thread's decompressor: every image into a Mat already of its size
+    std::vector<cv::Mat> decoded(paths.size());
+    const Cost libjpeg = measure([&](size_t i) {
+        int denom = 1;
+        return mine::decodeImageScaled(
+            encoded[i].data(), encoded[i].size(), kInputW, kInputH, mode, decoded[i], denom);
+    });
+    const Cost heap = measure([&](size_t i) {
+        std::vector<uint8_t> bytes;
+        cv::Mat image;
+        int denom = 1;
+        if (!mine::readFileBytes(paths[i], bytes)
+            || !mine::decodeImageScaled(bytes.data(), bytes.size(), kInputW, kInputH, mode, image, denom))
+        {
+            return false;
+        }
+        mine::resizeBGRToPlanarRGB(image.ptr<uint8_t>(), image.step, image.cols, image.rows, kInputW, kInputH,
+            tensor.data(), packParams, mode);
+        return true;
+    });
+    const Cost arena = measure([&](size_t i) {
+        const mine::ArenaScope scratch;
+        cv::Mat image;
+        image.allocator = mine::arenaMatAllocator();
+        const uint8_t* bytes = nullptr;
+        size_t size = 0;
+        int denom = 1;
+        if (!mine::readFileToArena(paths[i], scratch.arena(), bytes, size)
+            || !mine::decodeImageScaled(bytes, size, kInputW, kInputH, mode, image, denom))
+        {
+            return false;
+        }
+        mine::resizeBGRToPlanarRGB(image.ptr<uint8_t>(), image.step, image.cols, image.rows, kInputW, kInputH,
+            tensor.data(), packParams, mode);
+        return true;
+    });
+
+    std::cout << "arena: per bundled image, " << rounds << " rounds; file read, reduced-scale decode and resize into a "
+              << kInputH << "x" << kInputW << " float tensor" << std::endl;
+    std::cout << std::left << std::setw(26) << "  path" << std::right << std::setw(10) << "mallocs" << std::setw(13)
+              << "page faults" << std::setw(10) << "us" << std::endl;
+    const auto row = [](const char* name, const Cost& cost) {
+        std::cout << std::left << std::setw(26) << name << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(10) << cost.allocations << std::setw(13) << cost.pageFaults << std::setw(10) << cost.us
+                  << std::endl;
+    };
+    row("  libjpeg decode only", libjpeg);
+    row("  std::vector + cv::Mat", heap);
+    row("  thread arena", arena);
+    const mine::ArenaStats stats = mine::arenaStats();
+    // The decompressor draws its working memory from its own arena, so nothing is left to the heap
+    const bool noHeap = libjpeg.allocations == 0 && arena.allocations == 0;
+    std::cout << "  " << stats.slabs << " slabs, " << (stats.bytesMapped >> 20) << " MiB mapped ("
+              << (stats.hugeTlbBytes >> 20) << " MiB on huge pages), " << arena.slabs
+              << " mapped after warm-up; no heap allocation per image: " << (noHeap ? "yes" : "NO")
+              << std::endl;
+
+    // Oversize input: refused from its header, given back once freed, or failing to map at all
+    cv::Mat refused;
+    int denom = 1;
+    const bool capped = !mine::decodeImageScaled(
+        encoded[0].data(), encoded[0].size(), kInputW, kInputH, mode, refused, denom, 8, 1000);
+    mine::Arena small(2 << 20, 4 << 20);
+    const uint64_t unmapped = mine::arenaStats().slabsUnmapped;
+    {
+        const mine::ArenaScope scratch(small);
+        small.allocate(1 << 20);
+        small.allocate(16 << 20);
+    }
+    const bool trimmed = small.mapped() <= (4u << 20) && mine::arenaStats().slabsUnmapped > unmapped;
+    bool thrown = false;
+    try
+    {
+        const mine::ArenaScope scratch(small);
+        small.allocate(size_t(1) << 60);
+    }
+    catch (const std::bad_alloc&)
+    {
+        thrown = true;
+    }
+    {
+        const mine::ArenaScope scratch(small);
+        thrown = thrown && small.allocate(1 << 20) != nullptr;
+    }
+    std::cout << "  JPEG over a 1000 pixel limit " << (capped ? "refused" : "DECODED") << "; after a 16 MiB image "
+              << (small.mapped() >> 20) << " MiB stay mapped of a 4 MiB limit; an unmappable size "
+              << (thrown ? "throws bad_alloc and the arena goes on" : "DID NOT THROW") << std::endl;
+    return libjpeg.ok && heap.ok && arena.ok && noHeap && arena.slabs == 0 && capped && trimmed && thrown;
+}
+
+void printHelpInfo()
+{
+    std::cout << "Usage: ./sample_mine_alloc_bench [-h or --help] [-d or --datadir=<path to data directory>] "
+                 "[--iterations=<N>]\n";
+    std::cout << "--datadir       Directory holding the bundled images, default data/mine/ and data/samples/mine/\n";
+    std::cout << "--iterations    Rounds over the images are a tenth of it, default 500" << std::endl;
+}
+
+bool parseBenchArgs(BenchArgs& args, int argc, char** argv)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg(argv[i]);
+        const std::string value = arg.substr(arg.find('=') + 1);
+        if (arg == "-h" || arg == "--help")
+        {
+            return false;
+        }
+        else if (arg.compare(0, 10, "--datadir=") == 0 || arg.compare(0, 3, "-d=") == 0)
+        {
+            args.dataDirs.push_back(value);
+        }
+        else if (arg.compare(0, 13, "--iterations=") == 0)
+        {
+            args.iterations = std::max(1, std::atoi(value.c_str()));
+        }
+        else
+        {
+            std::cout << "Unknown argument " << arg << std::endl;
+            return false;
+        }
+    }
+    if (args.dataDirs.empty())
+    {
+        args.dataDirs.push_back("data/mine/");
+        args.dataDirs.push_back("data/samples/mine/");
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    BenchArgs args;
+    if (!parseBenchArgs(args, argc, argv))
+    {
+        printHelpInfo();
+        return EXIT_FAILURE;
+    }
+    return benchArena(args) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,2776 @@
+#include "common.h"
+
+#include "../sampleMine/batchScheduler.h"
+#include "../sampleMine/bulkInput.h"
+#include "../sampleMine/calibrationCache.h"
+#include "../sampleMine/fileReader.h"
+#include "../sampleMine/hostArena.h"
+#include "../sampleMine/httpClient.h"
+#include "../sampleMine/httpServer.h"
+#include "../sampleMine/imageBatchStream.h"
+#include "../sampleMine/imagePacking.h"
+#include "../sampleMine/imageResize.h"
+#include "../sampleMine/inputType.h"
+#include "../sampleMine/jpegDecode.h"
+#include "../sampleMine/layoutConvert.h"
+#include "../sampleMine/mappedFile.h"
+#include "../sampleMine/packKernels.h"
+#include "../sampleMine/perfCounters.h"
+#include "../sampleMine/pipeline.h"
+#include "../sampleMine/preprocessPipeline.h"
+#include "../sampleMine/resultCache.h"
+#include "../sampleMine/shmRing.h"
+#include "../sampleMine/slotPool.h"
+#include "../sampleMine/softmax.h"
+#include "../sampleMine/tensorDesc.h"
+#include "../sampleMine/tensorShard.h"
+#include "../sampleMine/threadPool.h"
+#include "../sampleMine/traceEvents.h"
+
+#include "opencv2/highgui.hpp"
+#include "opencv2/imgproc.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Microbenchmarks for the host-side stages of sample_mine, run on the bundled
+// cat/dog images.
+
+namespace
+{
+
+struct BenchArgs
+{
+    std::vector<std::string> dataDirs;
+    std::string bench;  //!< Run only this benchmark; all when empty.
+    int iterations{500};
+};
+
+const std::vector<std::string> gBenchImages = {"cat.0.jpg", "cat.1.jpg", "dog.0.jpg", "dog.1.jpg"};
+const int kInputH = 299;
+const int kInputW = 299;
+
+//!
+//! \brief Average wall time of f() in nanoseconds.
+//!
+template <typename F>
+double timeNs(int iterations, F f)
+{
+    f(); // warm caches and page in the output buffers
+    const auto start = std::chrono::high_resolution_clock::now();
+    for (int it = 0; it < iterations; ++it)
+    {
+        f();
+    }
+    const auto stop = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double, std::nano>(stop - start).count() / iterations;
+}
+
+//!
+//! \brief Decodes the bundled images, optionally cv::resize'd to the model input size.
+//!
+bool loadImages(const BenchArgs& args, std::vector<cv::Mat>& images, bool resized)
+{
+    for (const auto& name : gBenchImages)
+    {
+        cv::Mat image = cv::imread(locateFile(name, args.dataDirs), cv::IMREAD_COLOR);
+        if (image.empty())
+        {
+            std::cout << "Cannot open image " << name << std::endl;
+            return false;
+        }
+        if (resized)
+        {
+            cv::resize(image, image, cv::Size(kInputW, kInputH));
+        }
+        images.push_back(image);
+    }
+    return true;
+}
+
+//!
+//! \brief Reads the bundled images as encoded bytes, one entry per gBenchImages name.
+//!
+bool loadEncodedImages(const BenchArgs& args, std::vector<std::vector<uint8_t>>& encoded)
+{
+    encoded.resize(gBenchImages.size());
+    for (size_t i = 0; i < gBenchImages.size(); ++i)
+    {
+        if (!mine::readFileBytes(locateFile(gBenchImages[i], args.dataDirs), encoded[i]))
+        {
+            std::cout << "Cannot open image " << gBenchImages[i] << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+//!
+//! \brief The per-pixel loop processInput used before the packing kernel; the baseline.
+//!
+void packReference(const cv::Mat& image, int inputH, int inputW, float* hostDataBuffer)
+{
+    for (int j = 0, volChl = inputH * inputW; j < inputH; ++j)
+    {
+        for (int k = 0; k < inputW; ++k)
+        {
+            cv::Vec3b bgr = image.at<cv::Vec3b>(j, k);
+            hostDataBuffer[0 * volChl + j * inputW + k] = (1.0 / 255.0) * float(bgr[2]);
+            hostDataBuffer[1 * volChl + j * inputW + k] = (1.0 / 255.0) * float(bgr[1]);
+            hostDataBuffer[2 * volChl + j * inputW + k] = (1.0 / 255.0) * float(bgr[0]);
+        }
+    }
+}
+
+float maxAbsDiff(const std::vector<float>& a, const std::vector<float>& b)
+{
+    float diff = 0.0f;
+    for (size_t i = 0; i < a.size(); ++i)
+    {
+        diff = std::max(diff, std::fabs(a[i] - b[i]));
+    }
+    return diff;
+}
+
+void printRow(const std::string& name, double nsPerImage, double baselineNs, float diff)
+{
+    std::cout << std::left << std::setw(16) << name << std::right << std::fixed << std::setprecision(0)
+              << std::setw(12) << nsPerImage << std::setprecision(1) << std::setw(10)
+              << kInputH * kInputW / (nsPerImage * 1e-3) << std::setprecision(2) << std::setw(9)
+              << baselineNs / nsPerImage << "x" << std::scientific << std::setprecision(1) << std::setw(11) << diff
+              << std::endl;
+}
+
+//!
+//! \brief BGR HWC uint8 -> RGB CHW float packing: baseline loop vs every kernel this CPU runs.
+//!
+bool benchPack(const BenchArgs& args)
+{
+    std::vector<cv::Mat> images;
+    if (!loadImages(args, images, true))
+    {
+        return false;
+    }
+    const size_t vol = 3 * kInputH * kInputW;
+    std::vector<float> reference(vol * images.size());
+    std::vector<float> packed(vol * images.size());
+
+    std::cout << "pack: " << images.size() << " images " << kInputH << "x" << kInputW << ", " << args.iterations
+              << " iterations" << std::endl;
+    std::cout << std::left << std::setw(16) << "kernel" << std::right << std::setw(12) << "ns/image" << std::setw(10)
+              << "Mpix/s" << std::setw(10) << "speedup" << std::setw(11) << "max|diff|" << std::endl;
+
+    const double baselineNs = timeNs(args.iterations, [&]() {
+        for (size_t i = 0; i < images.size(); ++i)
+        {
+            packReference(images[i], kInputH, kInputW, &reference[i * vol]);
+        }
+    }) / images.size();
+    printRow("reference", baselineNs, baselineNs, 0.0f);
+
+    const mine::PackParams params = mine::defaultPackParams();
+    const mine::SimdLevel levels[]
+        = {mine::SimdLevel::kSCALAR, mine::SimdLevel::kSSE41, mine::SimdLevel::kAVX2, mine::SimdLevel::kAVX512};
+    for (mine::SimdLevel level : levels)
+    {
+        if (!mine::simdLevelSupported(level))
+        {
+            continue;
+        }
+        const mine::PackRowFn fn = mine::getPackRow(level);
+        const double ns = timeNs(args.iterations, [&]() {
+            for (size_t i = 0; i < images.size(); ++i)
+            {
+                mine::packBGRToPlanarRGB(
+                    images[i].ptr<uint8_t>(), images[i].step, kInputW, kInputH, &packed[i * vol], params, fn);
+            }
+        }) / images.size();
+        printRow(mine::simdLevelName(level), ns, baselineNs, maxAbsDiff(reference, packed));
+    }
+    std::cout << "dispatch selects " << mine::simdLevelName(mine::detectSimdLevel()) << std::endl;
+    return true;
+}
+
+//!
+//! \brief Decoded image -> input tensor: cv::resize then pack vs the fused resample-and-pack pass.
+//!
+bool benchResize(const BenchArgs& args)
+{
+    std::vector<cv::Mat> images;
+    if (!loadImages(args, images, false))
+    {
+        return false;
+    }
+    const size_t vol = 3 * kInputH * kInputW;
+    std::vector<float> reference(vol * images.size());
+    std::vector<float> packed(vol * images.size());
+    const mine::PackParams params = mine::defaultPackParams();
+
+    std::cout << "resize: " << images.size() << " decoded images -> " << kInputH << "x" << kInputW << ", "
+              << args.iterations << " iterations" << std::endl;
+    std::cout << std::left << std::setw(16) << "path" << std::right << std::setw(12) << "ns/image" << std::setw(10)
+              << "Mpix/s" << std::setw(10) << "speedup" << std::setw(11) << "max|diff|" << std::endl;
+
+    const double baselineNs = timeNs(args.iterations, [&]() {
+        cv::Mat resized;
+        for (size_t i = 0; i < images.size(); ++i)
+        {
+            cv::resize(images[i], resized, cv::Size(kInputW, kInputH));
+            mine::packBGRToPlanarRGB(
+                resized.ptr<uint8_t>(), resized.step, kInputW, kInputH, &reference[i * vol], params);
+        }
+    }) / images.size();
+    printRow("cv+pack", baselineNs, baselineNs, 0.0f);
+
+    const mine::ResizeMode modes[]
+        = {mine::ResizeMode::kSTRETCH, mine::ResizeMode::kCENTER_CROP, mine::ResizeMode::kLETTERBOX};
+    for (mine::ResizeMode mode : modes)
+    {
+        const double ns = timeNs(args.iterations, [&]() {
+            for (size_t i = 0; i < images.size(); ++i)
+            {
+                mine::resizeBGRToPlanarRGB(images[i].ptr<uint8_t>(), images[i].step, images[i].cols, images[i].rows,
+                    kInputW, kInputH, &packed[i * vol], params, mode);
+            }
+        }) / images.size();
+        // Only the stretch output is comparable with cv::resize; it differs by at most a rounding step.
+        printRow(std::string("fused-") + mine::resizeModeName(mode), ns, baselineNs,
+            mode == mine::ResizeMode::kSTRETCH ? maxAbsDiff(reference, packed) : 0.0f);
+    }
+    return true;
+}
+
+//!
+//! \brief Resize-and-pack kernels compiled for 3x299x299 and 3x224x224 vs the generic kernel, per
+//!        element type, from the decoded images and from copies already of the input size.
+//!
+bool benchShapes(const BenchArgs& args)
+{
+    std::vector<cv::Mat> images;
+    if (!loadImages(args, images, false))
+    {
+        return false;
+    }
+    const mine::PackParams params = mine::defaultPackParams();
+    const mine::InputType types[] = {mine::InputType::kFLOAT, mine::InputType::kHALF, mine::InputType::kUINT8};
+    const int sides[] = {299, 224};
+
+    std::cout << "shapes: " << images.size() << " images, " << args.iterations << " iterations, "
+              << mine::simdLevelName(mine::detectSimdLevel()) << " dispatch" << std::endl;
+    std::cout << std::left << std::setw(12) << "shape" << std::setw(8) << "type" << std::setw(8) << "source"
+              << std::right << std::setw(12) << "generic ns" << std::setw(12) << "fixed ns" << std::setw(10)
+              << "speedup" << std::setw(11) << "identical" << std::endl;
+
+    bool identical = true;
+    for (int side : sides)
+    {
+        std::vector<cv::Mat> sized(images.size());
+        for (size_t i = 0; i < images.size(); ++i)
+        {
+            cv::resize(images[i], sized[i], cv::Size(side, side));
+        }
+        for (mine::InputType type : types)
+        {
+            const mine::PackShape shape{3, side, side, mine::TensorLayout::kNCHW, type};
+            const mine::PackKernelChoice generic = mine::selectPackKernel(shape, false);
+            const mine::PackKernelChoice fixed = mine::selectPackKernel(shape);
+            const size_t bytes = 3 * static_cast<size_t>(side) * side * mine::inputElementSize(type);
+            std::vector<uint8_t> expected(bytes * images.size());
+            std::vector<uint8_t> actual(bytes * images.size());
+            for (const std::vector<cv::Mat>* source : {&images, &sized})
+            {
+                auto run = [&](const mine::PackKernelChoice& kernel, std::vector<uint8_t>& out) {
+                    for (size_t i = 0; i < source->size(); ++i)
+                    {
+                        const cv::Mat& image = (*source)[i];
+                        kernel.fn(image.ptr<uint8_t>(), image.step, image.cols, image.rows, shape, &out[i * bytes],
+                            params, mine::ResizeMode::kSTRETCH, nullptr);
+                    }
+                };
+                const double genericNs = timeNs(args.iterations, [&]() { run(generic, expected); }) / images.size();
+                const double fixedNs = timeNs(args.iterations, [&]() { run(fixed, actual); }) / images.size();
+                const bool same = expected == actual;
+                identical = identical && same && fixed.specialized;
+                const std::string name = "3x" + std::to_string(side) + "x" + std::to_string(side);
+                std::cout << std::left << std::setw(12) << name << std::setw(8) << mine::inputTypeName(type)
+                          << std::setw(8) << (source == &images ? "resize" : "pack") << std::right << std::fixed
+                          << std::setprecision(0) << std::setw(12) << genericNs << std::setw(12) << fixedNs
+                          << std::setprecision(2) << std::setw(9) << genericNs / fixedNs << "x" << std::setw(11)
+                          << (same ? "yes" : "NO") << std::endl;
+            }
+        }
+    }
+    return identical;
+}
+
+//!
+//! \brief NCHW <-> NHWC conversion of a 3x299x299 image per element size, SSE4.1 vs the plain loop,
+//!        then the bundled images resized straight into either layout vs NCHW converted after.
+//!
+bool benchLayout(const BenchArgs& args)
+{
+    const size_t plane = static_cast<size_t>(kInputH) * kInputW;
+    const mine::InputType types[] = {mine::InputType::kUINT8, mine::InputType::kHALF, mine::InputType::kFLOAT};
+    std::mt19937 rng(11);
+
+    std::cout << "layout: 3x" << kInputH << "x" << kInputW << ", " << args.iterations << " iterations" << std::endl;
+    std::cout << std::left << std::setw(16) << "conversion" << std::setw(8) << "type" << std::right << std::setw(12)
+              << "scalar ns" << std::setw(12) << "sse4.1 ns" << std::setw(10) << "speedup" << std::setw(10) << "GB/s"
+              << std::setw(11) << "identical" << std::endl;
+    bool ok = true;
+    for (mine::InputType type : types)
+    {
+        const size_t elementSize = mine::inputElementSize(type);
+        const size_t bytes = 3 * plane * elementSize;
+        std::vector<uint8_t> planar(bytes);
+        std::vector<uint8_t> scalar(bytes);
+        std::vector<uint8_t> simd(bytes);
+        std::vector<uint8_t> back(bytes);
+        for (uint8_t& b : planar)
+        {
+            b = static_cast<uint8_t>(rng());
+        }
+        for (int direction = 0; direction < 2; ++direction)
+        {
+            const bool toNHWC = direction == 0;
+            const uint8_t* src = toNHWC ? planar.data() : scalar.data();
+            auto convert = [&](uint8_t* dst, bool useSimd) {
+                if (toNHWC)
+                {
+                    mine::planarToInterleaved(src, 3, plane, elementSize, dst, useSimd);
+                }
+                else
+                {
+                    mine::interleavedToPlanar(src, 3, plane, elementSize, dst, useSimd);
+                }
+            };
+            uint8_t* const reference = toNHWC ? scalar.data() : back.data();
+            const double scalarNs = timeNs(args.iterations, [&]() { convert(reference, false); });
+            const double simdNs = timeNs(args.iterations, [&]() { convert(simd.data(), true); });
+            // NHWC -> NCHW must give back the original planes
+            const bool same = toNHWC ? simd == scalar : simd == planar && back == planar;
+            ok = ok && same;
+            std::cout << std::left << std::setw(16) << (toNHWC ? "NCHW->NHWC" : "NHWC->NCHW") << std::setw(8)
+                      << mine::inputTypeName(type) << std::right << std::fixed << std::setprecision(0)
+                      << std::setw(12) << scalarNs << std::setw(12) << simdNs << std::setprecision(2) << std::setw(9)
+                      << scalarNs / simdNs << "x" << std::setprecision(1) << std::setw(10) << 2 * bytes / simdNs
+                      << std::setw(11) << (same ? "yes" : "NO") << std::endl;
+        }
+    }
+
+    std::vector<cv::Mat> images;
+    if (!loadImages(args, images, false))
+    {
+        return false;
+    }
+    const mine::PackParams params = mine::defaultPackParams();
+    const int batch = static_cast<int>(images.size());
+    const struct
+    {
+        int nbDims;
+        int d[4];
+    } nhwcDims{4, {batch, kInputH, kInputW, 3}};
+    const mine::TensorDesc nhwc = mine::describeTensor(nhwcDims, mine::ElementType::kFLOAT, false);
+    const mine::PackShape nchwShape{3, kInputH, kInputW, mine::TensorLayout::kNCHW, mine::InputType::kFLOAT};
+    const mine::PackShape nhwcShape{3, kInputH, kInputW, mine::TensorLayout::kNHWC, mine::InputType::kFLOAT};
+    const mine::PackKernelChoice nchwKernel = mine::selectPackKernel(nchwShape);
+    const mine::PackKernelChoice nhwcKernel = mine::selectPackKernel(nhwcShape);
+    std::vector<float> planes(3 * plane * batch);
+    std::vector<float> direct(3 * plane * batch);
+    std::vector<float> converted(3 * plane * batch);
+    std::vector<float> image(3 * plane);
+    auto resize = [&](const mine::PackKernelChoice& kernel, const mine::PackShape& shape, int i, float* dst) {
+        kernel.fn(images[i].ptr<uint8_t>(), images[i].step, images[i].cols, images[i].rows, shape, dst, params,
+            mine::ResizeMode::kSTRETCH, nullptr);
+    };
+    const double nchwNs = timeNs(args.iterations, [&]() {
+        for (int i = 0; i < batch; ++i)
+        {
+            resize(nchwKernel, nchwShape, i, &planes[i * 3 * plane]);
+        }
+    }) / batch;
+    const double nhwcNs = timeNs(args.iterations, [&]() {
+        for (int i = 0; i < batch; ++i)
+        {
+            resize(nhwcKernel, nhwcShape, i, static_cast<float*>(mine::batchItem(direct.data(), nhwc, 4, i)));
+        }
+    }) / batch;
+    const double convertNs = timeNs(args.iterations, [&]() {
+        for (int i = 0; i < batch; ++i)
+        {
+            resize(nchwKernel, nchwShape, i, image.data());
+            mine::writeImage(image.data(), mine::TensorLayout::kNCHW, nhwc, sizeof(float), i, converted.data());
+        }
+    }) / batch;
+    const bool same = direct == converted;
+    ok = ok && same;
+    std::cout << "resize+pack per image into " << mine::tensorDescString(nhwc) << ": NCHW " << std::fixed
+              << std::setprecision(0) << nchwNs << " ns, NHWC " << nhwcNs << " ns, NCHW then converted "
+              << convertNs << " ns; " << (same ? "identical" : "DIFFERENT") << std::endl;
+    return ok;
+}
+
+//!
+//! \brief The bundled images through preprocessing specs compiled by preprocessPipeline.h vs the
+//!        multiply-add kernels with the same scale and bias, per spec and element type: time per
+//!        image and values that differ from (v - mean) / std rounded once. The compiled pipeline
+//!        must not differ anywhere.
+//!
+bool benchPreprocess(const BenchArgs& args)
+{
+    std::vector<cv::Mat> images;
+    if (!loadImages(args, images, false))
+    {
+        return false;
+    }
+    const struct
+    {
+        const char* name;
+        float mean[3];
+        float stddev[3];
+        mine::ColorOrder order;
+    } cases[] = {
+        {"dogs-vs-cats", {0.0f, 0.0f, 0.0f}, {255.0f, 255.0f, 255.0f}, mine::ColorOrder::kRGB},
+        {"keras-tf", {127.5f, 127.5f, 127.5f}, {127.5f, 127.5f, 127.5f}, mine::ColorOrder::kRGB},
+        {"torchvision", {123.675f, 116.28f, 103.53f}, {58.395f, 57.12f, 57.375f}, mine::ColorOrder::kRGB},
+        {"caffe-bgr", {104.0f, 117.0f, 123.0f}, {1.0f, 1.0f, 1.0f}, mine::ColorOrder::kBGR},
+    };
+    const mine::InputType types[] = {mine::InputType::kFLOAT, mine::InputType::kHALF};
+    const struct
+    {
+        int nbDims;
+        int d[4];
+    } dims{4, {1, 3, kInputH, kInputW}};
+    const mine::TensorDesc desc = mine::describeTensor(dims, mine::ElementType::kFLOAT, false);
+    const size_t plane = static_cast<size_t>(kInputH) * kInputW;
+    const size_t count = images.size();
+
+    // The resized 8-bit R, G and B planes the exact values are computed from
+    mine::PreprocessSpec rawSpec;
+    rawSpec.type = mine::InputType::kUINT8;
+    mine::PreprocessPipeline raw;
+    std::string error;
+    if (!raw.compile(rawSpec, desc, error))
+    {
+        std::cout << error << std::endl;
+        return false;
+    }
+    std::vector<uint8_t> pixels(3 * plane * count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        raw.pack(images[i].ptr<uint8_t>(), images[i].step, images[i].cols, images[i].rows, &pixels[i * 3 * plane]);
+    }
+
+    std::cout << "preprocess: " << count << " images -> " << mine::tensorDescString(desc) << ", " << args.iterations
+              << " iterations, " << mine::simdLevelName(mine::detectSimdLevel()) << " dispatch" << std::endl;
+    std::cout << std::left << std::setw(14) << "spec" << std::setw(7) << "type" << std::setw(10) << "compiled"
+              << std::right << std::setw(13) << "multiply ns" << std::setw(13) << "compiled ns" << std::setw(15)
+              << "multiply off" << std::setw(15) << "compiled off" << std::endl;
+    bool ok = true;
+    for (const auto& c : cases)
+    {
+        for (mine::InputType type : types)
+        {
+            mine::PreprocessSpec spec;
+            std::copy(c.mean, c.mean + 3, spec.mean);
+            std::copy(c.stddev, c.stddev + 3, spec.stddev);
+            spec.order = c.order;
+            spec.type = type;
+            mine::PreprocessPipeline compiled;
+            if (!compiled.compile(spec, desc, error))
+            {
+                std::cout << error << std::endl;
+                return false;
+            }
+            // The arithmetic kernels write R, G, B planes; give each color the normalization of its plane
+            const bool bgr = spec.order == mine::ColorOrder::kBGR;
+            mine::PackParams params;
+            for (int color = 0; color < 3; ++color)
+            {
+                const int o = bgr ? 2 - color : color;
+                params.scale[color] = 1.0f / spec.stddev[o];
+                params.bias[color] = 0.0f - spec.mean[o] / spec.stddev[o];
+            }
+            const mine::PackShape& shape = compiled.shape();
+            const mine::PackKernelChoice kernel = mine::selectPackKernel(shape);
+            const size_t bytes = 3 * plane * mine::inputElementSize(type);
+            std::vector<uint8_t> multiplied(bytes * count);
+            std::vector<uint8_t> packed(bytes * count);
+            const double multiplyNs = timeNs(args.iterations, [&]() {
+                for (size_t i = 0; i < count; ++i)
+                {
+                    kernel.fn(images[i].ptr<uint8_t>(), images[i].step, images[i].cols, images[i].rows, shape,
+                        &multiplied[i * bytes], params, mine::ResizeMode::kSTRETCH, nullptr);
+                }
+            }) / count;
+            const double compiledNs = timeNs(args.iterations, [&]() {
+                for (size_t i = 0; i < count; ++i)
+                {
+                    compiled.pack(images[i].ptr<uint8_t>(), images[i].step, images[i].cols, images[i].rows,
+                        &packed[i * bytes]);
+                }
+            }) / count;
+
+            auto differs = [&](const std::vector<uint8_t>& out, size_t index, float exact) {
+                if (type == mine::InputType::kHALF)
+                {
+                    uint16_t h;
+                    std::memcpy(&h, &out[index * 2], 2);
+                    return h != mine::floatToHalf(exact);
+                }
+                float f;
+                std::memcpy(&f, &out[index * 4], 4);
+                return f != exact;
+            };
+            size_t multiplyOff = 0;
+            size_t compiledOff = 0;
+            for (size_t i = 0; i < count; ++i)
+            {
+                for (int color = 0; color < 3; ++color)
+                {
+                    const int o = bgr ? 2 - color : color;
+                    for (size_t p = 0; p < plane; ++p)
+                    {
+                        const int v = pixels[(i * 3 + color) * plane + p];
+                        const float exact
+                            = static_cast<float>((v - static_cast<double>(spec.mean[o])) / spec.stddev[o]);
+                        multiplyOff += differs(multiplied, (i * 3 + color) * plane + p, exact);
+                        compiledOff += differs(packed, (i * 3 + o) * plane + p, exact);
+                    }
+                }
+            }
+            ok = ok && compiledOff == 0;
+            const double total = 3.0 * plane * count;
+            std::cout << std::left << std::setw(14) << c.name << std::setw(7) << mine::inputTypeName(type)
+                      << std::setw(10) << compiled.normalization() << std::right << std::fixed << std::setprecision(0)
+                      << std::setw(13) << multiplyNs << std::setw(13) << compiledNs << std::setprecision(2)
+                      << std::setw(14) << 100.0 * multiplyOff / total << "%" << std::setw(14)
+                      << 100.0 * compiledOff / total << "%" << std::endl;
+        }
+    }
+    return ok;
+}
+
+float meanAbsDiff(const std::vector<float>& a, const std::vector<float>& b)
+{
+    double sum = 0.0;
+    for (size_t i = 0; i < a.size(); ++i)
+    {
+        sum += std::fabs(a[i] - b[i]);
+    }
+    return static_cast<float>(sum / a.size());
+}
+
+//!
+//! \brief Encoded JPEG -> input tensor: full cv::imdecode vs reduced-scale libjpeg-turbo decode.
+//!
+//! Runs on the bundled images and on 4x upscaled re-encoded copies standing in for multi-megapixel
+//! photos. The mean tensor difference against the full-size decode doubles as the regression check.
+//!
+bool benchDecode(const BenchArgs& args)
+{
+    struct Encoded
+    {
+        std::string name;
+        std::vector<uint8_t> bytes;
+    };
+    std::vector<std::vector<uint8_t>> encoded;
+    if (!loadEncodedImages(args, encoded))
+    {
+        return false;
+    }
+    std::vector<Encoded> inputs;
+    for (size_t i = 0; i < encoded.size(); ++i)
+    {
+        const std::string& name = gBenchImages[i];
+        Encoded original{name, encoded[i]};
+        inputs.push_back(original);
+
+        cv::Mat image = cv::imdecode(cv::Mat(1, static_cast<int>(original.bytes.size()), CV_8UC1, &original.bytes[0]),
+            cv::IMREAD_COLOR);
+        cv::resize(image, image, cv::Size(4 * image.cols, 4 * image.rows), 0, 0, cv::INTER_CUBIC);
+        Encoded upscaled{"4x-" + name, {}};
+        cv::imencode(".jpg", image, upscaled.bytes);
+        inputs.push_back(upscaled);
+    }
+
+    const mine::ResizeMode mode = mine::ResizeMode::kSTRETCH;
+    const mine::PackParams params = mine::defaultPackParams();
+    const int iterations = std::max(1, args.iterations / 10);
+    std::vector<float> reference(3 * kInputH * kInputW);
+    std::vector<float> scaled(reference.size());
+
+    std::cout << "decode: encoded JPEG -> " << kInputH << "x" << kInputW << " tensor, " << iterations << " iterations"
+              << std::endl;
+    std::cout << std::left << std::setw(16) << "image" << std::right << std::setw(11) << "size" << std::setw(7)
+              << "scale" << std::setw(11) << "full us" << std::setw(11) << "scaled us" << std::setw(10) << "speedup"
+              << std::setw(12) << "mean|diff|" << std::endl;
+    for (const auto& input : inputs)
+    {
+        cv::Mat image;
+        int width = 0;
+        int height = 0;
+        const double fullNs = timeNs(iterations, [&]() {
+            image = cv::imdecode(
+                cv::Mat(1, static_cast<int>(input.bytes.size()), CV_8UC1, const_cast<uint8_t*>(&input.bytes[0])),
+                cv::IMREAD_COLOR);
+            width = image.cols;
+            height = image.rows;
+            mine::resizeBGRToPlanarRGB(image.ptr<uint8_t>(), image.step, image.cols, image.rows, kInputW, kInputH,
+                &reference[0], params, mode);
+        });
+        int denom = 1;
+        const double scaledNs = timeNs(iterations, [&]() {
+            mine::decodeImageScaled(&input.bytes[0], input.bytes.size(), kInputW, kInputH, mode, image, denom);
+            mine::resizeBGRToPlanarRGB(image.ptr<uint8_t>(), image.step, image.cols, image.rows, kInputW, kInputH,
+                &scaled[0], params, mode);
+        });
+        std::cout << std::left << std::setw(16) << input.name << std::right << std::setw(11)
+                  << std::to_string(width) + "x" + std::to_string(height) << std::setw(7)
+                  << "1/" + std::to_string(denom) << std::fixed << std::setprecision(0) << std::setw(11) << fullNs * 1e-3 << std::setw(11)
+                  << scaledNs * 1e-3 << std::setprecision(2) << std::setw(9) << fullNs / scaledNs << "x"
+                  << std::setprecision(4) << std::setw(12) << meanAbsDiff(reference, scaled) << std::endl;
+    }
+    return true;
+}
+
+double percentile(std::vector<double> values, double p)
+{
+    if (values.empty())
+    {
+        return 0.0;
+    }
+    std::sort(values.begin(), values.end());
+    const size_t index = std::min(values.size() - 1, static_cast<size_t>(p / 100.0 * values.size()));
+    return values[index];
+}
+
+//!
+//! \brief A fake backend whose every other batch throws, as an engine out of memory would.
+//!
+class ThrowingBackend : public mine::FakeBackend
+{
+public:
+    ThrowingBackend()
+        : FakeBackend(1, 2, std::chrono::microseconds(0))
+    {
+    }
+
+    bool infer(const std::vector<const mine::ImageRequest*>& requests, std::vector<mine::Prediction>& predictions)
+        override
+    {
+        if (mCalls++ % 2 == 0)
+        {
+            throw std::bad_alloc();
+        }
+        return FakeBackend::infer(requests, predictions);
+    }
+
+private:
+    int mCalls{0};
+};
+
+//!
+//! \brief Exceptions thrown on pool workers and by the backend fail what threw and nothing else,
+//!        and reach the caller instead of terminating the process.
+//!
+bool checkExceptions()
+{
+    mine::ThreadPool pool(4);
+    std::vector<char> ran(64, 0);
+    bool rethrown = false;
+    try
+    {
+        pool.parallelFor(static_cast<int>(ran.size()), [&ran](int i) {
+            if (i == 7)
+            {
+                throw std::runtime_error("slot 7");
+            }
+            ran[i] = 1;
+        });
+    }
+    catch (const std::runtime_error&)
+    {
+        rethrown = true;
+    }
+    const int others = static_cast<int>(std::count(ran.begin(), ran.end(), 1));
+    pool.enqueue([]() { throw std::runtime_error("task"); });
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (pool.failedTasks() == 0 && std::chrono::steady_clock::now() < deadline)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    ThrowingBackend backend;
+    int failed = 0;
+    {
+        mine::BatchScheduler scheduler(backend, 1, std::chrono::microseconds(0));
+        for (int r = 0; r < 8; ++r)
+        {
+            failed += scheduler.submit(mine::ImageRequest{"fake", "", {}, {}, {}, {}}).get().ok ? 0 : 1;
+        }
+    }
+    std::cout << "exceptions: parallelFor " << (rethrown ? "rethrew" : "swallowed") << " slot 7 and ran " << others
+              << " of 63 others; " << pool.failedTasks() << " failed pool task; " << failed
+              << " of 8 batches failed on a throwing backend" << std::endl;
+    return rethrown && others == 63 && pool.failedTasks() == 1 && failed == 4;
+}
+
+//!
+//! \brief Dynamic batching against a fake backend: throughput and tail latency per max queueing delay.
+//!
+//! 16 closed-loop clients each submit one image at a time to a mine::BatchScheduler in front of a
+//! mine::FakeBackend that takes 2 ms + 0.1 ms/image per batch of up to 32, like a GPU would.
+//!
+bool benchBatching(const BenchArgs& args)
+{
+    const int clients = 16;
+    const int maxBatch = 32;
+    const int requestsPerClient = std::max(1, args.iterations / 5);
+    const int delaysUs[] = {0, 500, 2000, 5000};
+
+    std::cout << "batching: " << clients << " clients x " << requestsPerClient
+              << " requests, fake backend 2000us + 100us/image, max batch " << maxBatch << std::endl;
+    std::cout << std::left << std::setw(16) << "max delay us" << std::right << std::setw(12) << "req/s"
+              << std::setw(12) << "mean batch" << std::setw(10) << "p50 us" << std::setw(10) << "p99 us"
+              << std::setw(10) << "max us" << std::endl;
+    for (int delayUs : delaysUs)
+    {
+        mine::FakeBackend backend(maxBatch, 2, std::chrono::microseconds(2000), std::chrono::microseconds(100));
+        std::vector<std::vector<double>> latencies(clients);
+        mine::BatchScheduler::Stats stats;
+        const auto start = std::chrono::steady_clock::now();
+        {
+            mine::BatchScheduler scheduler(backend, maxBatch, std::chrono::microseconds(delayUs));
+            std::vector<std::thread> threads;
+            for (int c = 0; c < clients; ++c)
+            {
+                threads.emplace_back([&, c]() {
+                    for (int r = 0; r < requestsPerClient; ++r)
+                    {
+                        const auto submitted = std::chrono::steady_clock::now();
+                        scheduler.submit(mine::ImageRequest{"fake", "", {}, {}, {}, {}}).get();
+                        latencies[c].push_back(std::chrono::duration<double, std::micro>(
+                            std::chrono::steady_clock::now() - submitted).count());
+                    }
+                });
+            }
+            for (auto& thread : threads)
+            {
+                thread.join();
+            }
+            stats = scheduler.stats();
+        }
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::vector<double> all;
+        for (const auto& l : latencies)
+        {
+            all.insert(all.end(), l.begin(), l.end());
+        }
+        std::cout << std::left << std::setw(16) << delayUs << std::right << std::fixed << std::setprecision(0)
+                  << std::setw(12) << all.size() / seconds << std::setprecision(2) << std::setw(12)
+                  << stats.meanBatchSize() << std::setprecision(0) << std::setw(10) << percentile(all, 50)
+                  << std::setw(10) << percentile(all, 99) << std::setw(10) << percentile(all, 100) << std::endl;
+    }
+    return checkExceptions();
+}
+
+//!
+//! \brief Bundled JPEGs decoded and resized into the input slot of a batch, softmax afterwards.
+//!
+class DecodeStages : public mine::BatchStages
+{
+public:
+    bool preprocess(const std::vector<const mine::ImageRequest*>& requests, mine::ExecutionSlot& slot,
+        std::vector<mine::Prediction>& predictions) override
+    {
+        predictions.assign(requests.size(), mine::Prediction());
+        float* input = static_cast<float*>(slot.hostInput());
+        for (size_t r = 0; r < requests.size(); ++r, input += 3 * kInputH * kInputW)
+        {
+            cv::Mat image;
+            int denom = 1;
+            if (!mine::decodeImageScaled(requests[r]->bytes.data(), requests[r]->bytes.size(), kInputW, kInputH,
+                    mine::ResizeMode::kSTRETCH, image, denom))
+            {
+                predictions[r].ok = false;
+                continue;
+            }
+            mine::resizeBGRToPlanarRGB(image.ptr<uint8_t>(), image.step, image.cols, image.rows, kInputW, kInputH,
+                input, mine::defaultPackParams());
+        }
+        return true;
+    }
+
+    bool postprocess(const std::vector<const mine::ImageRequest*>& requests, mine::ExecutionSlot& slot,
+        std::vector<mine::Prediction>& predictions) override
+    {
+        const float* output = slot.hostOutput();
+        predictions.resize(requests.size());
+        for (size_t r = 0; r < requests.size(); ++r, output += 2)
+        {
+            if (!predictions[r].ok)
+            {
+                continue;
+            }
+            predictions[r].probabilities.resize(2);
+            mine::softmaxRow()(output, 2, predictions[r].probabilities.data());
+            predictions[r].top = mine::topK(predictions[r].probabilities.data(), 2, 1);
+        }
+        return true;
+    }
+};
+
+//!
+//! \brief Sequential vs pipelined batches: decode+resize on one thread, a fake engine that takes
+//!        as long as the decoding, and softmax, with 1, 2 and 3 execution slots in flight.
+//!
+bool benchPipeline(const BenchArgs& args)
+{
+    const int batchSize = 8;
+    const int batches = std::max(3, args.iterations / 10);
+
+    std::vector<std::vector<uint8_t>> encoded;
+    if (!loadEncodedImages(args, encoded))
+    {
+        return false;
+    }
+    std::vector<mine::ImageRequest> images;
+    for (size_t i = 0; i < encoded.size(); ++i)
+    {
+        images.push_back(mine::ImageRequest{gBenchImages[i], "", encoded[i], {}, {}, {}});
+    }
+    std::vector<const mine::ImageRequest*> batch;
+    for (int i = 0; i < batchSize; ++i)
+    {
+        batch.push_back(&images[i % images.size()]);
+    }
+
+    DecodeStages stages;
+    const size_t inputBytes = batchSize * 3 * kInputH * kInputW * sizeof(float);
+    const size_t outputCount = batchSize * 2;
+
+    // Make the fake engine as slow as preprocessing, the case pipelining helps most
+    std::vector<mine::Prediction> predictions;
+    mine::FakeExecutionSlot probe(inputBytes, outputCount, std::chrono::microseconds(0));
+    const double preprocessNs = timeNs(3, [&]() { stages.preprocess(batch, probe, predictions); });
+    const std::chrono::microseconds latency(static_cast<int>(preprocessNs / 1000));
+
+    std::cout << "pipeline: " << batches << " batches of " << batchSize << ", preprocess and fake engine "
+              << latency.count() << " us/batch" << std::endl;
+    std::cout << std::left << std::setw(16) << "mode" << std::right << std::setw(12) << "images/s" << std::setw(12)
+              << "speedup" << std::endl;
+
+    double baseline = 0.0;
+    for (int slots = 0; slots <= 3; ++slots)
+    {
+        bool ok = true;
+        const auto start = std::chrono::steady_clock::now();
+        if (slots == 0)
+        {
+            mine::FakeExecutionSlot slot(inputBytes, outputCount, latency);
+            for (int b = 0; b < batches; ++b)
+            {
+                predictions.clear();
+                ok = stages.preprocess(batch, slot, predictions) && slot.run()
+                    && stages.postprocess(batch, slot, predictions) && ok;
+            }
+        }
+        else
+        {
+            mine::SlotPool pool(slots, [&]() {
+                return std::unique_ptr<mine::ExecutionSlot>(
+                    new mine::FakeExecutionSlot(inputBytes, outputCount, latency));
+            });
+            mine::PipelinedBackend pipeline(stages, pool, batchSize);
+            std::vector<std::future<bool>> done;
+            for (int b = 0; b < batches; ++b)
+            {
+                auto promise = std::make_shared<std::promise<bool>>();
+                done.push_back(promise->get_future());
+                pipeline.inferAsync(batch, [promise](bool batchOk, std::vector<mine::Prediction>&) {
+                    promise->set_value(batchOk);
+                });
+            }
+            for (auto& f : done)
+            {
+                ok = f.get() && ok;
+            }
+        }
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        const double rate = batches * batchSize / seconds;
+        baseline = slots == 0 ? rate : baseline;
+        std::cout << std::left << std::setw(16) << (slots == 0 ? std::string("sequential")
+                                                               : std::to_string(slots) + " slots")
+                  << std::right << std::fixed << std::setprecision(0) << std::setw(12) << rate << std::setprecision(2)
+                  << std::setw(11) << rate / baseline << "x" << std::endl;
+        if (!ok)
+        {
+            std::cout << "pipeline: a batch failed" << std::endl;
+            return false;
+        }
+    }
+
+    // One image that does not decode fails alone; the rest of its batch is answered
+    mine::SlotPool pool(1, [&]() {
+        return std::unique_ptr<mine::ExecutionSlot>(
+            new mine::FakeExecutionSlot(inputBytes, outputCount, std::chrono::microseconds(0)));
+    });
+    mine::PipelinedBackend pipeline(stages, pool, batchSize);
+    mine::BatchScheduler scheduler(pipeline, batchSize, std::chrono::seconds(1));
+    std::vector<std::future<mine::InferResult>> results;
+    for (int i = 0; i < batchSize; ++i)
+    {
+        mine::ImageRequest request = *batch[i];
+        if (i == 3)
+        {
+            request.bytes.assign(64, 0xff);
+        }
+        results.push_back(scheduler.submit(std::move(request)));
+    }
+    int answered = 0;
+    int rejected = 0;
+    for (auto& result : results)
+    {
+        const mine::InferResult r = result.get();
+        answered += r.ok ? 1 : 0;
+        rejected += r.rejected ? 1 : 0;
+    }
+    std::cout << "pipeline: batch with a corrupt image, " << answered << " answered, " << rejected << " rejected"
+              << std::endl;
+    return answered == batchSize - 1 && rejected == 1;
+}
+
+//!
+//! \brief DecodeStages whose one "probability" per image is the mean of its input tensor, so a
+//!        result handed to the wrong image shows.
+//!
+class InputMeanStages : public DecodeStages
+{
+public:
+    bool postprocess(const std::vector<const mine::ImageRequest*>& requests, mine::ExecutionSlot& slot,
+        std::vector<mine::Prediction>& predictions) override
+    {
+        const size_t volume = 3 * kInputH * kInputW;
+        const float* input = static_cast<const float*>(slot.hostInput());
+        predictions.resize(requests.size());
+        for (size_t r = 0; r < requests.size(); ++r, input += volume)
+        {
+            if (!predictions[r].ok)
+            {
+                continue;
+            }
+            double sum = 0.0;
+            for (size_t i = 0; i < volume; ++i)
+            {
+                sum += input[i];
+            }
+            predictions[r].probabilities.assign(1, static_cast<float>(sum / volume));
+        }
+        return true;
+    }
+};
+
+//!
+//! \brief Hashing an image vs decoding it, the same stream of repeated images scored with and
+//!        without a mine::CachingBackend in front of the pipeline, and LRU eviction.
+//!
+bool benchCache(const BenchArgs& args)
+{
+    const int batchSize = 8;
+
+    // 64 distinct JPEGs: every bundled image re-encoded at 16 qualities
+    std::vector<std::vector<uint8_t>> encoded;
+    if (!loadEncodedImages(args, encoded))
+    {
+        return false;
+    }
+    std::vector<mine::ImageRequest> images;
+    size_t totalBytes = 0;
+    for (size_t i = 0; i < encoded.size(); ++i)
+    {
+        const std::string& name = gBenchImages[i];
+        std::vector<uint8_t>& bytes = encoded[i];
+        const cv::Mat image
+            = cv::imdecode(cv::Mat(1, static_cast<int>(bytes.size()), CV_8UC1, &bytes[0]), cv::IMREAD_COLOR);
+        for (int quality = 50; quality < 98; quality += 3)
+        {
+            mine::ImageRequest request{name + "@q" + std::to_string(quality), "", {}, {}, {}, {}};
+            cv::imencode(".jpg", image, request.bytes, {cv::IMWRITE_JPEG_QUALITY, quality});
+            totalBytes += request.bytes.size();
+            images.push_back(std::move(request));
+        }
+    }
+
+    std::vector<uint64_t> hashes(images.size());
+    const double hashNs = timeNs(args.iterations, [&]() {
+        for (size_t i = 0; i < images.size(); ++i)
+        {
+            hashes[i] = mine::hash64(images[i].bytes.data(), images[i].bytes.size());
+        }
+    }) / images.size();
+    std::sort(hashes.begin(), hashes.end());
+    const bool distinct = std::adjacent_find(hashes.begin(), hashes.end()) == hashes.end();
+    const double decodeNs = timeNs(std::max(1, args.iterations / 50), [&]() {
+        for (const auto& image : images)
+        {
+            cv::Mat decoded;
+            int denom = 1;
+            mine::decodeImageScaled(image.bytes.data(), image.bytes.size(), kInputW, kInputH,
+                mine::ResizeMode::kSTRETCH, decoded, denom);
+        }
+    }) / images.size();
+    std::cout << "cache: " << images.size() << " JPEGs of " << totalBytes / images.size() / 1024
+              << " KiB on average, hashes " << (distinct ? "distinct" : "COLLIDE") << std::endl;
+    std::cout << std::fixed << std::setprecision(2) << "  hash64 " << hashNs / 1000 << " us/image ("
+              << totalBytes / (hashNs * images.size()) << " GB/s), reduced-scale decode " << decodeNs / 1000
+              << " us/image, " << std::setprecision(0) << decodeNs / hashNs << "x the hash" << std::endl;
+
+    // Requests drawn at random from the 64 images, so most are repeats
+    const size_t requests = batchSize * std::max(16, args.iterations / batchSize);
+    std::vector<const mine::ImageRequest*> stream;
+    std::mt19937 random(7);
+    std::uniform_int_distribution<size_t> pick(0, images.size() - 1);
+    for (size_t i = 0; i < requests; ++i)
+    {
+        stream.push_back(&images[pick(random)]);
+    }
+
+    InputMeanStages stages;
+    const size_t inputBytes = batchSize * 3 * kInputH * kInputW * sizeof(float);
+    const size_t outputCount = batchSize * 2;
+    mine::SlotPool pool(2, [&]() {
+        return std::unique_ptr<mine::ExecutionSlot>(
+            new mine::FakeExecutionSlot(inputBytes, outputCount, std::chrono::microseconds(0)));
+    });
+    mine::PipelinedBackend pipeline(stages, pool, batchSize);
+
+    // Scores stream in batches through backend; the seconds it took, or -1 if a batch failed
+    const auto score = [&](mine::InferenceBackend& backend, std::vector<mine::Prediction>& results) {
+        results.assign(stream.size(), mine::Prediction());
+        std::vector<std::future<bool>> done;
+        const auto start = std::chrono::steady_clock::now();
+        for (size_t b = 0; b < stream.size(); b += batchSize)
+        {
+            const std::vector<const mine::ImageRequest*> batch(
+                stream.begin() + b, stream.begin() + std::min(stream.size(), b + batchSize));
+            auto promise = std::make_shared<std::promise<bool>>();
+            done.push_back(promise->get_future());
+            backend.inferAsync(batch, [promise, &results, b](bool batchOk, std::vector<mine::Prediction>& out) {
+                std::move(out.begin(), out.end(), results.begin() + b);
+                promise->set_value(batchOk);
+            });
+        }
+        bool ok = true;
+        for (auto& f : done)
+        {
+            ok = f.get() && ok;
+        }
+        return ok ? std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() : -1.0;
+    };
+
+    std::vector<mine::Prediction> reference;
+    std::vector<mine::Prediction> cached;
+    const double uncachedSeconds = score(pipeline, reference);
+    mine::ResultCache cache(1 << 20);
+    mine::CachingBackend caching(pipeline, cache, 1);
+    const double cachedSeconds = score(caching, cached);
+    if (uncachedSeconds < 0 || cachedSeconds < 0)
+    {
+        std::cout << "cache: a batch failed" << std::endl;
+        return false;
+    }
+    size_t wrong = 0;
+    for (size_t i = 0; i < stream.size(); ++i)
+    {
+        wrong += cached[i].probabilities != reference[i].probabilities;
+    }
+    const mine::ResultCache::Stats stats = cache.stats();
+    std::cout << "  " << stream.size() << " requests over " << images.size() << " images in batches of " << batchSize
+              << ", decode + resize + fake engine:" << std::endl;
+    std::cout << std::left << std::setw(16) << "  mode" << std::right << std::setw(12) << "images/s" << std::setw(9)
+              << "hits" << std::setw(11) << "speedup" << std::endl;
+    std::cout << std::left << std::setw(16) << "  no cache" << std::right << std::setprecision(0) << std::setw(12)
+              << stream.size() / uncachedSeconds << std::setw(9) << "-" << std::setw(11) << "1.00x" << std::endl;
+    std::cout << std::left << std::setw(16) << "  result cache" << std::right << std::setw(12)
+              << stream.size() / cachedSeconds << std::setprecision(1) << std::setw(8) << 100.0 * stats.hitRate()
+              << "%" << std::setprecision(2) << std::setw(10) << uncachedSeconds / cachedSeconds << "x" << std::endl;
+    std::cout << "  " << stats.entries << " entries in " << stats.bytes << " bytes, " << wrong
+              << " cached predictions differ from the computed ones" << std::endl;
+
+    // Behind a BatchScheduler, hits are answered as they are submitted and only misses are batched
+    mine::ResultCache submitted(1 << 20);
+    mine::CachingBackend front(pipeline, submitted, 1);
+    mine::BatchScheduler::Stats scheduled;
+    size_t wrongScheduled = 0;
+    {
+        mine::BatchScheduler scheduler(front, batchSize, std::chrono::microseconds(200));
+        std::vector<std::future<mine::InferResult>> results;
+        for (const mine::ImageRequest* request : stream)
+        {
+            results.push_back(scheduler.submit(*request));
+        }
+        for (size_t i = 0; i < results.size(); ++i)
+        {
+            const mine::InferResult result = results[i].get();
+            wrongScheduled += !result.ok || result.prediction.probabilities != reference[i].probabilities;
+        }
+        scheduled = scheduler.stats();
+    }
+    const mine::ResultCache::Stats submittedStats = submitted.stats();
+    const bool answeredNow = scheduled.answeredNow > 0 && scheduled.answeredNow == submittedStats.hits
+        && scheduled.requests == submittedStats.misses && wrongScheduled == 0;
+    std::cout << "  through a scheduler: " << scheduled.answeredNow << " answered at submission, "
+              << scheduled.requests << " batched, " << submittedStats.misses << " misses, " << wrongScheduled
+              << " wrong" << std::endl;
+
+    // 64 keys through room for 16: the least recently used go first
+    mine::Prediction prediction;
+    prediction.probabilities.assign(2, 0.5f);
+    mine::ResultCache probe(1 << 20);
+    probe.insert(mine::ResultKey{0, 1}, prediction);
+    const size_t entryBytes = probe.stats().bytes;
+    mine::ResultCache lru(16 * entryBytes);
+    for (uint64_t k = 0; k < 64; ++k)
+    {
+        lru.insert(mine::ResultKey{k, 1}, prediction);
+    }
+    mine::Prediction found;
+    const bool kept = lru.lookup(mine::ResultKey{48, 1}, found) && lru.lookup(mine::ResultKey{63, 1}, found)
+        && !lru.lookup(mine::ResultKey{47, 1}, found);
+    lru.insert(mine::ResultKey{64, 1}, prediction); // Evicts 49, 48 was used since
+    const bool order = lru.lookup(mine::ResultKey{48, 1}, found) && !lru.lookup(mine::ResultKey{49, 1}, found);
+    const mine::ResultCache::Stats evicted = lru.stats();
+    const bool bounded = evicted.entries == 16 && evicted.evictions == 49 && evicted.bytes <= evicted.capacityBytes;
+    std::cout << "  eviction: " << evicted.entries << " of 65 entries kept, " << evicted.evictions << " evicted, "
+              << evicted.bytes << " of " << evicted.capacityBytes << " bytes, least recently used first: "
+              << (kept && order ? "yes" : "NO") << std::endl;
+    return distinct && wrong == 0 && stats.hits > 0 && answeredNow && kept && order && bounded;
+}
+
+//!
+//! \brief Per-batch slot allocation vs checking slots out of a mine::SlotPool.
+//!
+//! Slots are FakeExecutionSlots sized for a batch of 8, so "allocate" pays the host side of
+//! what sample_mine used to do per inference (the device allocations and context come on
+//! top with a GPU). The contention rows run 4 threads against smaller pools.
+//!
+bool benchPool(const BenchArgs& args)
+{
+    const int batchSize = 8;
+    const size_t inputBytes = batchSize * 3 * kInputH * kInputW * sizeof(float);
+    const size_t outputCount = batchSize * 2;
+    const mine::SlotFactory factory = [&]() {
+        return std::unique_ptr<mine::ExecutionSlot>(
+            new mine::FakeExecutionSlot(inputBytes, outputCount, std::chrono::microseconds(0)));
+    };
+    // Stand-in for a batch worth of work done while the slot is held
+    const auto touch = [](mine::ExecutionSlot& slot) {
+        std::memset(slot.hostInput(), 1, 64 * 1024);
+        return slot.run();
+    };
+
+    std::cout << "pool: batch " << batchSize << ", " << inputBytes / 1024 << " KiB input per slot" << std::endl;
+    std::cout << std::left << std::setw(16) << "mode" << std::right << std::setw(12) << "us/batch" << std::setw(12)
+              << "exhausted" << std::setw(12) << "wait ms" << std::endl;
+
+    const double allocateNs = timeNs(args.iterations, [&]() {
+        std::unique_ptr<mine::ExecutionSlot> slot = factory();
+        touch(*slot);
+    });
+    std::cout << std::left << std::setw(16) << "allocate" << std::right << std::fixed << std::setprecision(2)
+              << std::setw(12) << allocateNs / 1000 << std::endl;
+
+    mine::SlotPool single(1, factory);
+    const double pooledNs = timeNs(args.iterations, [&]() {
+        mine::SlotPool::Lease slot = single.acquire();
+        touch(*slot);
+    });
+    std::cout << std::left << std::setw(16) << "pool of 1" << std::right << std::setw(12) << pooledNs / 1000
+              << std::setw(12) << single.stats().exhausted << std::endl;
+
+    const int threads = 4;
+    for (int poolSize : {1, 2, 4})
+    {
+        mine::SlotPool pool(poolSize, factory);
+        const auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; ++t)
+        {
+            workers.emplace_back([&]() {
+                for (int it = 0; it < args.iterations; ++it)
+                {
+                    mine::SlotPool::Lease slot = pool.acquire();
+                    touch(*slot);
+                }
+            });
+        }
+        for (auto& worker : workers)
+        {
+            worker.join();
+        }
+        const double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        const mine::SlotPool::Stats stats = pool.stats();
+        std::cout << std::left << std::setw(16) << (std::to_string(threads) + "T, pool " + std::to_string(poolSize))
+                  << std::right << std::setw(12) << ns / (threads * args.iterations) / 1000 << std::setw(12)
+                  << stats.exhausted << std::setw(12) << stats.waitMs << std::endl;
+    }
+    return true;
+}
+
+//!
+//! \brief Anonymous (heap) resident set in KiB, from /proc/self/status.
+//!
+long rssAnonKiB()
+{
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line))
+    {
+        if (line.compare(0, 8, "RssAnon:") == 0)
+        {
+            return std::atol(line.c_str() + 8);
+        }
+    }
+    return -1;
+}
+
+
+//!
+//! \brief Engine plan loading: std::ifstream into a heap blob vs mmap, on a 256 MiB stand-in plan.
+//!
+//! The checksum over every byte plays deserializeCudaEngine(), which reads the whole plan once.
+//! The file is in the page cache after the first pass, like a plan shared by many workers on a host.
+//!
+bool benchPlanLoad(const BenchArgs& args)
+{
+    const size_t planBytes = 256u << 20;
+    char path[] = "/tmp/sample_mine_bench_planXXXXXX";
+    const int fd = mkstemp(path);
+    if (fd < 0)
+    {
+        std::cout << "Cannot create " << path << std::endl;
+        return false;
+    }
+    std::vector<uint8_t> chunk(1 << 20);
+    for (size_t i = 0; i < chunk.size(); ++i)
+    {
+        chunk[i] = static_cast<uint8_t>(i * 2654435761u >> 24);
+    }
+    bool ok = true;
+    for (size_t written = 0; written < planBytes && ok; written += chunk.size())
+    {
+        ok = write(fd, chunk.data(), chunk.size()) == static_cast<ssize_t>(chunk.size());
+    }
+    close(fd);
+
+    const auto checksum = [](const uint8_t* data, size_t size) {
+        uint64_t sum = 0;
+        for (size_t i = 0; i < size; i += 64)
+        {
+            sum += data[i];
+        }
+        return sum;
+    };
+    const int iterations = std::max(1, std::min(args.iterations / 50, 10));
+    uint64_t expected = 0;
+
+    std::cout << "planload: " << (planBytes >> 20) << " MiB plan, warm page cache" << std::endl;
+    std::cout << std::left << std::setw(16) << "loader" << std::right << std::setw(12) << "ms" << std::setw(16)
+              << "+RssAnon MiB" << std::endl;
+
+    long heapKiB = 0;
+    const double readNs = timeNs(iterations, [&]() {
+        std::vector<uint8_t> blob;
+        const long before = rssAnonKiB();
+        ok = mine::readFileBytes(path, blob) && ok;
+        heapKiB = rssAnonKiB() - before;
+        expected = checksum(blob.data(), blob.size());
+    });
+    std::cout << std::left << std::setw(16) << "ifstream" << std::right << std::fixed << std::setprecision(2)
+              << std::setw(12) << readNs * 1e-6 << std::setw(16) << heapKiB / 1024.0 << std::endl;
+
+    for (bool populate : {true, false})
+    {
+        long mapKiB = 0;
+        const double mapNs = timeNs(iterations, [&]() {
+            mine::MappedFile plan;
+            const long before = rssAnonKiB();
+            ok = plan.open(path, populate) && ok;
+            mapKiB = rssAnonKiB() - before;
+            ok = checksum(static_cast<const uint8_t*>(plan.data()), plan.size()) == expected && ok;
+        });
+        std::cout << std::left << std::setw(16) << (populate ? "mmap populate" : "mmap willneed") << std::right
+                  << std::setw(12) << mapNs * 1e-6 << std::setw(16) << mapKiB / 1024.0 << std::endl;
+    }
+
+    unlink(path);
+    if (!ok)
+    {
+        std::cout << "planload: a loader failed or disagreed" << std::endl;
+    }
+    return ok;
+}
+
+//!
+//! \brief Drops path from the page cache so the next read goes to the device. Only clean pages
+//!        of a file on a real filesystem are dropped; on tmpfs this is a no-op.
+//!
+void evictFromPageCache(const std::string& path)
+{
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd >= 0)
+    {
+        fdatasync(fd);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+}
+
+//!
+//! \brief Reading a directory of images with a cold page cache: one blocking read per file, as
+//!        preprocessing does without --prefetch, vs the Prefetcher over pread and io_uring.
+//!
+//! The directory holds 2000 synthetic 128 KiB files plus the bundled images, created under
+//! $TMPDIR (default /tmp); point TMPDIR at the disk under test, tmpfs has no cold reads.
+//!
+bool benchPrefetch(const BenchArgs& args)
+{
+    const char* tmp = std::getenv("TMPDIR");
+    std::string dir = std::string(tmp && *tmp ? tmp : "/tmp") + "/sample_mine_bench_filesXXXXXX";
+    if (!mkdtemp(&dir[0]))
+    {
+        std::cout << "Cannot create " << dir << std::endl;
+        return false;
+    }
+    std::vector<std::vector<uint8_t>> encoded;
+    if (!loadEncodedImages(args, encoded))
+    {
+        return false;
+    }
+    std::vector<std::string> paths;
+    for (size_t i = 0; i < encoded.size(); ++i)
+    {
+        const std::vector<uint8_t>& bytes = encoded[i];
+        paths.push_back(dir + "/" + gBenchImages[i]);
+        std::ofstream(paths.back(), std::ios::binary).write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    }
+    const int syntheticFiles = 2000;
+    std::vector<char> chunk(128 << 10);
+    std::mt19937 rng(42);
+    for (int i = 0; i < syntheticFiles; ++i)
+    {
+        for (char& c : chunk)
+        {
+            c = static_cast<char>(rng());
+        }
+        paths.push_back(dir + "/synthetic." + std::to_string(i) + ".jpg");
+        std::ofstream(paths.back(), std::ios::binary).write(chunk.data(), chunk.size());
+    }
+    uint64_t totalBytes = 0;
+    for (const auto& path : paths)
+    {
+        struct stat st;
+        totalBytes += stat(path.c_str(), &st) == 0 ? st.st_size : 0;
+    }
+
+    std::cout << "prefetch: " << paths.size() << " files, " << (totalBytes >> 20) << " MiB in " << dir
+              << ", page cache dropped before each pass" << std::endl;
+    std::cout << std::left << std::setw(20) << "reader" << std::right << std::setw(12) << "ms" << std::setw(12)
+              << "MB/s" << std::setw(12) << "failed" << std::endl;
+
+    const auto evictAll = [&]() {
+        for (const auto& path : paths)
+        {
+            evictFromPageCache(path);
+        }
+    };
+    const auto printRead = [&](const std::string& name, double ms, int failed) {
+        std::cout << std::left << std::setw(20) << name << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(12) << ms << std::setw(12) << totalBytes / (ms * 1e3) << std::setw(12) << failed
+                  << std::endl;
+    };
+    typedef std::chrono::steady_clock Clock;
+    const int depth = 32;
+    bool ok = true;
+
+    {
+        evictAll();
+        int failed = 0;
+        const Clock::time_point start = Clock::now();
+        std::vector<uint8_t> bytes;
+        for (const auto& path : paths)
+        {
+            failed += mine::readFileBytes(path, bytes) ? 0 : 1;
+        }
+        printRead("blocking", std::chrono::duration<double, std::milli>(Clock::now() - start).count(), failed);
+        ok = failed == 0 && ok;
+    }
+
+    for (mine::FileReaderKind kind : {mine::FileReaderKind::kPREAD, mine::FileReaderKind::kIO_URING})
+    {
+        std::unique_ptr<mine::AsyncFileReader> reader = mine::createFileReader(kind, depth);
+        if (!reader)
+        {
+            std::cout << std::left << std::setw(20) << "io_uring" << "unavailable" << std::endl;
+            continue;
+        }
+        std::vector<mine::ImageEntry> entries;
+        for (const auto& path : paths)
+        {
+            entries.push_back(mine::ImageEntry{path, path});
+        }
+        mine::VectorSource source(entries);
+        evictAll();
+        int failed = 0;
+        const Clock::time_point start = Clock::now();
+        {
+            mine::Prefetcher prefetcher(source, *reader);
+            mine::ImageEntry entry;
+            std::vector<uint8_t> bytes;
+            bool readOk = false;
+            while (prefetcher.next(entry, bytes, readOk))
+            {
+                failed += readOk ? 0 : 1;
+            }
+        }
+        printRead(std::string(reader->name()) + " x" + std::to_string(depth),
+            std::chrono::duration<double, std::milli>(Clock::now() - start).count(), failed);
+        ok = failed == 0 && ok;
+    }
+
+    for (const auto& path : paths)
+    {
+        unlink(path.c_str());
+    }
+    rmdir(dir.c_str());
+    if (!ok)
+    {
+        std::cout << "prefetch: some files could not be read" << std::endl;
+    }
+    return ok;
+}
+
+//!
+//! \brief Host side of --inputType: resizing a batch of 8 decoded images into float vs half vs
+//!        uint8 input buffers, and the bytes each copies to the device per batch.
+//!
+//! The uint8 planes are normalized here the way the device kernel does; max|diff| against the
+//! float path checks that moving normalization off the host changes nothing. The halves may only
+//! differ from the floats by their rounding, half an ulp, and every half kernel the CPU runs must
+//! agree with the scalar one to within an ulp (an FMA the compiler fuses moves the float being
+//! converted by one float ulp, which can tip it across a half rounding boundary).
+//!
+bool benchInput(const BenchArgs& args)
+{
+    std::vector<cv::Mat> images;
+    if (!loadImages(args, images, false))
+    {
+        return false;
+    }
+    const int batch = 8;
+    const size_t volume = 3 * kInputH * kInputW;
+    const mine::PackParams params = mine::defaultPackParams();
+    const mine::ResizeMode mode = mine::ResizeMode::kSTRETCH;
+    const int iterations = std::max(1, args.iterations / 10);
+
+    std::vector<float> hostFloat(batch * volume);
+    std::vector<uint16_t> hostHalf(batch * volume);
+    std::vector<uint8_t> hostU8(batch * volume);
+    const double floatNs = timeNs(iterations, [&]() {
+        for (int i = 0; i < batch; ++i)
+        {
+            const cv::Mat& image = images[i % images.size()];
+            mine::resizeBGRToPlanarRGB(image.ptr<uint8_t>(), image.step, image.cols, image.rows, kInputW, kInputH,
+                &hostFloat[i * volume], params, mode);
+        }
+    });
+    const double halfNs = timeNs(iterations, [&]() {
+        for (int i = 0; i < batch; ++i)
+        {
+            const cv::Mat& image = images[i % images.size()];
+            mine::resizeBGRToPlanarRGBHalf(image.ptr<uint8_t>(), image.step, image.cols, image.rows, kInputW,
+                kInputH, &hostHalf[i * volume], params, mode);
+        }
+    });
+    const double u8Ns = timeNs(iterations, [&]() {
+        for (int i = 0; i < batch; ++i)
+        {
+            const cv::Mat& image = images[i % images.size()];
+            mine::resizeBGRToPlanarRGB8(image.ptr<uint8_t>(), image.step, image.cols, image.rows, kInputW, kInputH,
+                &hostU8[i * volume], mode);
+        }
+    });
+
+    std::vector<float> normalized(hostU8.size());
+    for (size_t i = 0; i < hostU8.size(); ++i)
+    {
+        const int c = static_cast<int>((i / (kInputH * kInputW)) % 3);
+        normalized[i] = hostU8[i] * params.scale[c] + params.bias[c];
+    }
+    const float diff = maxAbsDiff(hostFloat, normalized);
+
+    std::vector<float> widened(hostHalf.size());
+    bool halfRounded = true;
+    for (size_t i = 0; i < hostHalf.size(); ++i)
+    {
+        widened[i] = mine::halfToFloat(hostHalf[i]);
+        // Half has 11 significant bits; 3e-8 (about 2^-25) covers the subnormal range
+        halfRounded &= std::fabs(widened[i] - hostFloat[i]) <= std::fabs(hostFloat[i]) / 2048.0f + 3.0e-8f;
+    }
+    const float halfDiff = maxAbsDiff(hostFloat, widened);
+
+    // Every half kernel against the scalar one, on rows long enough to exercise the vector loops and tails
+    bool halfKernelsAgree = true;
+    uint64_t halfKernelsDiffer = 0;
+    const cv::Mat& row = images[0];
+    const int width = std::min(row.cols, 1000);
+    std::vector<uint16_t> expected(3 * width), actual(3 * width);
+    for (int y = 0; y < row.rows; ++y)
+    {
+        mine::packRowHalfScalar(
+            row.ptr<uint8_t>(y), width, &expected[0], &expected[width], &expected[2 * width], params);
+        const mine::SimdLevel levels[] = {mine::SimdLevel::kAVX2, mine::SimdLevel::kAVX512};
+        for (mine::SimdLevel level : levels)
+        {
+            if (mine::simdLevelSupported(level))
+            {
+                mine::getPackRowHalf(level)(
+                    row.ptr<uint8_t>(y), width, &actual[0], &actual[width], &actual[2 * width], params);
+                for (size_t i = 0; i < actual.size(); ++i)
+                {
+                    const float a = mine::halfToFloat(actual[i]);
+                    const float e = mine::halfToFloat(expected[i]);
+                    halfKernelsDiffer += actual[i] != expected[i];
+                    halfKernelsAgree &= std::fabs(a - e) <= std::max(std::fabs(e) / 1024.0f, 6.0e-8f);
+                }
+            }
+        }
+    }
+
+    std::cout << "input: batch of " << batch << " images resized into the host input buffer, " << iterations
+              << " iterations" << std::endl;
+    std::cout << std::left << std::setw(16) << "input type" << std::right << std::setw(12) << "us/batch"
+              << std::setw(10) << "speedup" << std::setw(16) << "bytes/batch" << std::setw(11) << "max|diff|"
+              << std::endl;
+    const mine::InputType types[] = {mine::InputType::kFLOAT, mine::InputType::kHALF, mine::InputType::kUINT8};
+    for (mine::InputType type : types)
+    {
+        const double ns = type == mine::InputType::kUINT8 ? u8Ns : type == mine::InputType::kHALF ? halfNs : floatNs;
+        const float typeDiff
+            = type == mine::InputType::kUINT8 ? diff : type == mine::InputType::kHALF ? halfDiff : 0.0f;
+        std::cout << std::left << std::setw(16) << mine::inputTypeName(type) << std::right << std::fixed
+                  << std::setprecision(1) << std::setw(12) << ns * 1e-3 << std::setprecision(2) << std::setw(9)
+                  << floatNs / ns << "x" << std::setw(16) << batch * volume * mine::inputElementSize(type)
+                  << std::scientific << std::setprecision(1) << std::setw(11)
+                  << typeDiff << std::fixed << std::endl;
+    }
+    std::cout << "half kernel " << mine::simdLevelName(mine::detectSimdLevel()) << ", " << halfKernelsDiffer
+              << " values differ from the scalar kernel, " << (halfKernelsAgree ? "all" : "NOT all")
+              << " within an ulp" << std::endl;
+    if (diff != 0.0f)
+    {
+        std::cout << "input: uint8 + normalization differs from the float path" << std::endl;
+    }
+    if (!halfRounded)
+    {
+        std::cout << "input: half differs from the float path by more than its rounding" << std::endl;
+    }
+    return diff == 0.0f && halfRounded && halfKernelsAgree;
+}
+
+//!
+//! \brief Filling the float input tensor of the bundled images: decode + resize as sample_mine does
+//!        for image files, vs widening the tensors of a mapped uint8 or fp16 shard.
+//!
+//! mean|diff| is against the decoded tensor; uint8 shards hold the same resized pixels, so only
+//! fp16 rounding shows up.
+//!
+bool benchShard(const BenchArgs& args)
+{
+    const mine::ResizeMode mode = mine::ResizeMode::kSTRETCH;
+    const mine::PackParams params = mine::defaultPackParams();
+    const mine::PackParams identity{{1.0f, 1.0f, 1.0f}, {0.0f, 0.0f, 0.0f}};
+    const size_t volume = 3 * kInputH * kInputW;
+    const int iterations = std::max(1, args.iterations / 10);
+
+    std::vector<std::vector<uint8_t>> encoded;
+    if (!loadEncodedImages(args, encoded))
+    {
+        return false;
+    }
+    std::vector<std::vector<float>> decoded(gBenchImages.size(), std::vector<float>(volume));
+    std::vector<std::vector<float>> pixels(gBenchImages.size(), std::vector<float>(volume));
+    for (size_t i = 0; i < gBenchImages.size(); ++i)
+    {
+        cv::Mat image;
+        int denom = 1;
+        if (!mine::decodeImageScaled(&encoded[i][0], encoded[i].size(), kInputW, kInputH, mode, image, denom))
+        {
+            std::cout << "Cannot decode image " << gBenchImages[i] << std::endl;
+            return false;
+        }
+        mine::resizeBGRToPlanarRGB(image.ptr<uint8_t>(), image.step, image.cols, image.rows, kInputW, kInputH,
+            &pixels[i][0], identity, mode);
+    }
+
+    std::vector<float> tensor(volume);
+    const double decodeNs = timeNs(iterations, [&]() {
+        for (size_t i = 0; i < encoded.size(); ++i)
+        {
+            cv::Mat image;
+            int denom = 1;
+            mine::decodeImageScaled(&encoded[i][0], encoded[i].size(), kInputW, kInputH, mode, image, denom);
+            mine::resizeBGRToPlanarRGB(image.ptr<uint8_t>(), image.step, image.cols, image.rows, kInputW, kInputH,
+                &decoded[i][0], params, mode);
+        }
+    }) / encoded.size();
+
+    std::cout << "shard: " << gBenchImages.size() << " images -> " << kInputH << "x" << kInputW << " float tensor, "
+              << iterations << " iterations" << std::endl;
+    std::cout << std::left << std::setw(16) << "source" << std::right << std::setw(12) << "us/image" << std::setw(10)
+              << "speedup" << std::setw(14) << "bytes/image" << std::setw(12) << "mean|diff|" << std::endl;
+    std::cout << std::left << std::setw(16) << "decode+resize" << std::right << std::fixed << std::setprecision(1)
+              << std::setw(12) << decodeNs * 1e-3 << std::setprecision(2) << std::setw(9) << 1.0 << "x"
+              << std::setw(14) << encoded[0].size() << std::setw(12) << 0.0 << std::endl;
+
+    bool ok = true;
+    for (mine::ShardDataType type : {mine::ShardDataType::kUINT8, mine::ShardDataType::kFP16})
+    {
+        const std::string path = "/tmp/sample_mine_bench_" + std::to_string(getpid()) + "-"
+            + mine::shardDataTypeName(type) + ".shard";
+        mine::ShardFormat format;
+        format.type = type;
+        format.height = kInputH;
+        format.width = kInputW;
+        format.resizeMode = mode;
+        mine::ShardWriter writer;
+        ok = writer.open(path, format) && ok;
+        std::vector<uint8_t> stored(format.tensorBytes());
+        for (size_t i = 0; i < pixels.size(); ++i)
+        {
+            for (size_t k = 0; k < volume; ++k)
+            {
+                if (type == mine::ShardDataType::kFP16)
+                {
+                    reinterpret_cast<uint16_t*>(&stored[0])[k] = mine::floatToHalf(decoded[i][k]);
+                }
+                else
+                {
+                    stored[k] = static_cast<uint8_t>(pixels[i][k]);
+                }
+            }
+            ok = writer.add(gBenchImages[i], &stored[0]) && ok;
+        }
+        ok = writer.finish() && ok;
+
+        mine::ShardReader shard;
+        if (!ok || !shard.open(path))
+        {
+            std::cout << "Cannot write " << path << " " << shard.error() << std::endl;
+            unlink(path.c_str());
+            return false;
+        }
+        const double shardNs = timeNs(iterations, [&]() {
+            for (uint64_t i = 0; i < shard.size(); ++i)
+            {
+                mine::unpackShardTensor(shard.tensor(i), &tensor[0]);
+            }
+        }) / shard.size();
+        float diff = 0.0f;
+        for (uint64_t i = 0; i < shard.size(); ++i)
+        {
+            mine::unpackShardTensor(shard.tensor(i), &tensor[0]);
+            diff = std::max(diff, meanAbsDiff(decoded[i], tensor));
+        }
+        std::cout << std::left << std::setw(16) << std::string(mine::shardDataTypeName(type)) + " shard" << std::right
+                  << std::setprecision(1) << std::setw(12) << shardNs * 1e-3 << std::setprecision(2) << std::setw(9)
+                  << decodeNs / shardNs << "x" << std::setw(14) << format.tensorBytes() << std::scientific
+                  << std::setprecision(1) << std::setw(12) << diff << std::fixed << std::endl;
+        unlink(path.c_str());
+    }
+    return ok;
+}
+
+//!
+//! \brief INT8 calibration input on the CPU: the image batch stream over the bundled images (each
+//!        4 times, plus a missing file) on one thread vs the preprocessing pool, and the
+//!        calibration cache round trip.
+//!
+//! Every batch must hold exactly what processInput() makes of its images, the missing file must
+//! be skipped and the partial last batch dropped; the cache must be reused under the same key
+//! and ignored under another.
+//!
+bool benchCalibration(const BenchArgs& args)
+{
+    mine::PreprocessSpec spec;
+    const size_t volume = 3 * kInputH * kInputW;
+    const int batch = 4;
+    const int iterations = std::max(1, args.iterations / 100);
+
+    nvinfer1::Dims dims;
+    dims.nbDims = 4;
+    dims.d[0] = batch;
+    dims.d[1] = 3;
+    dims.d[2] = kInputH;
+    dims.d[3] = kInputW;
+    mine::PreprocessPipeline preprocess;
+    std::string error;
+    if (!preprocess.compile(spec, mine::describeTensor(dims, mine::ElementType::kFLOAT, false), error))
+    {
+        std::cout << error << std::endl;
+        return false;
+    }
+
+    std::vector<std::vector<uint8_t>> encoded;
+    if (!loadEncodedImages(args, encoded))
+    {
+        return false;
+    }
+    std::vector<mine::ImageEntry> entries;
+    std::vector<std::vector<float>> expected;
+    for (int copy = 0; copy < 4; ++copy)
+    {
+        for (size_t i = 0; i < encoded.size(); ++i)
+        {
+            const std::string& name = gBenchImages[i];
+            if (copy == 1 && expected.size() == 5)
+            {
+                entries.push_back(mine::ImageEntry{"missing.jpg", "/nonexistent/missing.jpg"});
+            }
+            entries.push_back(mine::ImageEntry{name, locateFile(name, args.dataDirs)});
+            cv::Mat image;
+            int denom = 1;
+            expected.push_back(std::vector<float>(volume));
+            if (!preprocess.decode(&encoded[i][0], encoded[i].size(), image, denom))
+            {
+                std::cout << "Cannot decode image " << name << std::endl;
+                return false;
+            }
+            preprocess.pack(image.ptr<uint8_t>(), image.step, image.cols, image.rows, &expected.back()[0]);
+        }
+    }
+    // 16 readable images make 4 batches of 4; one more image only starts a 5th, which is dropped
+    entries.push_back(entries[0]);
+    const int wantBatches = static_cast<int>(expected.size()) / batch;
+
+    std::cout << "calib: " << entries.size() << " image entries in batches of " << batch << ", " << iterations
+              << " iterations" << std::endl;
+    std::cout << std::left << std::setw(16) << "threads" << std::right << std::setw(12) << "ms/batch" << std::setw(10)
+              << "speedup" << std::setw(10) << "batches" << std::setw(10) << "skipped" << std::setw(11)
+              << "max|diff|" << std::endl;
+    bool ok = true;
+    double baselineNs = 0.0;
+    for (int threads : {1, 0})
+    {
+        mine::ImageBatchStream stream(entries, dims, 1000, spec, threads);
+        float diff = 0.0f;
+        int batches = 0;
+        stream.reset(0);
+        while (stream.next())
+        {
+            for (int i = 0; i < batch; ++i)
+            {
+                const float* got = stream.getBatch() + i * volume;
+                diff = std::max(diff, maxAbsDiff(expected[batches * batch + i], std::vector<float>(got, got + volume)));
+            }
+            ++batches;
+        }
+        const uint64_t skipped = stream.failed();
+        const double ns = timeNs(iterations, [&]() {
+            stream.reset(0);
+            while (stream.next())
+            {
+            }
+        }) / wantBatches;
+        baselineNs = threads == 1 ? ns : baselineNs;
+        std::cout << std::left << std::setw(16) << (threads == 1 ? std::string("1") : "pool (default)") << std::right
+                  << std::fixed << std::setprecision(2) << std::setw(12) << ns * 1e-6 << std::setw(9)
+                  << baselineNs / ns << "x" << std::setw(10) << batches << std::setw(10) << skipped
+                  << std::scientific << std::setprecision(1) << std::setw(11) << diff << std::fixed << std::endl;
+        ok = ok && diff == 0.0f && batches == wantBatches && skipped == 1;
+    }
+
+    const std::string path = "/tmp/sample_mine_bench_" + std::to_string(getpid()) + ".calib";
+    const std::string table = "TRT-7000-EntropyCalibration2\ninception_v3_input:0: 3c010a14\n";
+    mine::PreprocessSpec cropSpec;
+    cropSpec.resize = mine::ResizeMode::kCENTER_CROP;
+    const mine::ImageBatchStream stream(entries, dims, 1000, spec);
+    const mine::ImageBatchStream cropped(entries, dims, 1000, cropSpec);
+    const uint64_t model = 1;
+    mine::CalibrationCache writer(path, stream.key(model));
+    mine::CalibrationCache same(path, stream.key(model));
+    mine::CalibrationCache other(path, cropped.key(model));
+    mine::CalibrationCache otherModel(path, stream.key(model + 1));
+    std::vector<char> data;
+    const bool written = writer.write(table.data(), table.size());
+    const bool reused = same.read(data) && std::string(data.begin(), data.end()) == table;
+    const bool ignored = !other.read(data) && !otherModel.read(data);
+    std::cout << "cache key \"" << stream.key(model) << "\": " << (written ? "written" : "NOT written") << ", "
+              << (reused ? "reused" : "NOT reused") << " under the same key, "
+              << (ignored ? "ignored" : "NOT ignored") << " after --resize=crop and for another model" << std::endl;
+    unlink(path.c_str());
+    unlink((path + ".key").c_str());
+
+    // An image rewritten in place under the same name changes the key
+    const std::string image = path + ".jpg";
+    std::ofstream(image, std::ios::binary).write(reinterpret_cast<const char*>(&encoded[0][0]), encoded[0].size());
+    const mine::ImageBatchStream single(
+        std::vector<mine::ImageEntry>(1, mine::ImageEntry{"rewritten.jpg", image}), dims, 1, spec);
+    const std::string before = single.key(model);
+    std::ofstream(image, std::ios::binary | std::ios::app).put('\0');
+    const bool rewritten = single.key(model) != before;
+    unlink(image.c_str());
+    std::cout << "cache key " << (rewritten ? "changes" : "does NOT change") << " when an image is rewritten"
+              << std::endl;
+
+    ok = ok && written && reused && ignored && rewritten;
+    if (!ok)
+    {
+        std::cout << "calib: batches or cache differ from what sample_mine expects" << std::endl;
+    }
+    return ok;
+}
+
+//!
+//! \brief Post-processing of a [64, classes] logit batch: the original in-place exp/sum loop vs
+//!        the stable softmax kernels, plus top-5 selection.
+//!
+//! max|diff| is against a double precision reference; the original loop is inf/NaN as soon
+//! as a logit exceeds ~88, which the last column counts on logits shifted by +100.
+//!
+bool benchSoftmax(const BenchArgs& args)
+{
+    const int rows = 64;
+    const int classCounts[] = {2, 1000};
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> uniform(-10.0f, 10.0f);
+
+    for (int cols : classCounts)
+    {
+        std::vector<float> logits(rows * cols);
+        for (float& v : logits)
+        {
+            v = uniform(rng);
+        }
+        std::vector<float> reference(logits.size());
+        for (int r = 0; r < rows; ++r)
+        {
+            const float* x = &logits[r * cols];
+            const double m = *std::max_element(x, x + cols);
+            double sum = 0.0;
+            for (int c = 0; c < cols; ++c)
+            {
+                sum += std::exp(x[c] - m);
+            }
+            for (int c = 0; c < cols; ++c)
+            {
+                reference[r * cols + c] = static_cast<float>(std::exp(x[c] - m) / sum);
+            }
+        }
+        std::vector<float> shifted(logits);
+        for (float& v : shifted)
+        {
+            v += 100.0f;
+        }
+        const auto nonFinite = [](const std::vector<float>& v) {
+            return std::count_if(v.begin(), v.end(), [](float x) { return !std::isfinite(x); });
+        };
+
+        std::cout << "softmax: " << rows << " x " << cols << ", " << args.iterations << " iterations" << std::endl;
+        std::cout << std::left << std::setw(16) << "kernel" << std::right << std::setw(12) << "ns/row" << std::setw(10)
+                  << "speedup" << std::setw(11) << "max|diff|" << std::setw(12) << "non-finite" << std::endl;
+
+        // The pre-stable verifyOutput loop, in place on a copy
+        std::vector<float> work(logits.size());
+        const auto original = [&](const std::vector<float>& in) {
+            work = in;
+            for (int r = 0; r < rows; ++r)
+            {
+                float* output = &work[r * cols];
+                float sum{0.0f};
+                for (int i = 0; i < cols; i++)
+                {
+                    output[i] = exp(output[i]);
+                    sum += output[i];
+                }
+                for (int i = 0; i < cols; i++)
+                {
+                    output[i] /= sum;
+                }
+            }
+        };
+        const double baselineNs = timeNs(args.iterations, [&]() { original(logits); }) / rows;
+        const float baselineDiff = maxAbsDiff(reference, work);
+        original(shifted);
+        std::cout << std::left << std::setw(16) << "original" << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(12) << baselineNs << std::setprecision(2) << std::setw(9) << 1.0 << "x"
+                  << std::scientific << std::setprecision(1) << std::setw(11) << baselineDiff << std::setw(12)
+                  << nonFinite(work) << std::endl;
+
+        std::vector<float> probs(logits.size());
+        const mine::SimdLevel levels[] = {mine::SimdLevel::kSCALAR, mine::SimdLevel::kAVX2, mine::SimdLevel::kAVX512};
+        for (mine::SimdLevel level : levels)
+        {
+            if (!mine::simdLevelSupported(level))
+            {
+                continue;
+            }
+            const mine::SoftmaxRowFn fn = mine::getSoftmaxRow(level);
+            const double ns
+                = timeNs(args.iterations, [&]() { mine::softmaxRows(logits.data(), rows, cols, probs.data(), fn); })
+                / rows;
+            const float diff = maxAbsDiff(reference, probs);
+            mine::softmaxRows(shifted.data(), rows, cols, probs.data(), fn);
+            std::cout << std::left << std::setw(16) << mine::simdLevelName(level) << std::right << std::fixed
+                      << std::setprecision(1) << std::setw(12) << ns << std::setprecision(2) << std::setw(9)
+                      << baselineNs / ns << "x" << std::scientific << std::setprecision(1) << std::setw(11) << diff
+                      << std::setw(12) << nonFinite(probs) << std::endl;
+        }
+
+        int checksum = 0;
+        const double topNs = timeNs(args.iterations, [&]() {
+            for (int r = 0; r < rows; ++r)
+            {
+                checksum += mine::topK(&probs[r * cols], cols, mine::TopK::kMaxK).classes[0];
+            }
+        }) / rows;
+        std::cout << std::left << std::setw(16) << "top-5" << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(12) << topNs << (checksum < 0 ? " " : "") << std::endl;
+    }
+    return true;
+}
+
+//!
+//! \brief Cost of a TraceScope with tracing off and on, and a trace of a few threads written out.
+//!
+bool benchTrace(const BenchArgs& args)
+{
+    const int scopes = args.iterations * 1000;
+    mine::Tracer& tracer = mine::Tracer::instance();
+    std::cout << "trace: " << scopes << " empty scopes per measurement" << std::endl;
+    std::cout << std::left << std::setw(16) << "tracing" << std::right << std::setw(12) << "ns/scope" << std::endl;
+    double offNs = 0.0;
+    double onNs = 0.0;
+    for (bool on : {false, true})
+    {
+        if (on)
+        {
+            tracer.start();
+        }
+        const double ns = timeNs(1, [&]() {
+            for (int i = 0; i < scopes; ++i)
+            {
+                const mine::TraceScope trace("empty");
+            }
+        }) / scopes;
+        tracer.stop();
+        (on ? onNs : offNs) = ns;
+        std::cout << std::left << std::setw(16) << (on ? "on" : "off") << std::right << std::fixed
+                  << std::setprecision(2) << std::setw(12) << ns << std::endl;
+    }
+
+    // Four threads of nested scopes, as pool workers and pipeline stages record them
+    const size_t before = tracer.eventCount();
+    const int perThread = 1000;
+    tracer.start();
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t)
+    {
+        threads.emplace_back([t, perThread]() {
+            mine::traceThreadName("bench thread " + std::to_string(t));
+            for (int i = 0; i < perThread; ++i)
+            {
+                const mine::TraceScope outer("outer");
+                const mine::TraceScope inner("inner");
+            }
+        });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    tracer.stop();
+    const size_t events = tracer.eventCount() - before;
+    const std::string path = "/tmp/sample_mine_bench_" + std::to_string(getpid()) + ".trace.json";
+    const auto writeStart = std::chrono::steady_clock::now();
+    const bool written = tracer.write(path);
+    const double writeMs
+        = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - writeStart).count();
+    std::ifstream file(path);
+    const std::string json((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    const bool named = json.find("\"bench thread 3\"") != std::string::npos;
+    std::cout << events << " events from 4 threads, " << (written ? "written" : "NOT written") << " in "
+              << std::setprecision(1) << writeMs << " ms (" << json.size() / 1024 << " KiB), thread names "
+              << (named ? "present" : "MISSING") << std::endl;
+    unlink(path.c_str());
+
+    // A long run: a thread past its maximum keeps its latest events and counts the rest as dropped
+    const size_t maxEvents = 100;
+    const size_t keptBefore = tracer.eventCount();
+    const uint64_t droppedBefore = tracer.droppedCount();
+    tracer.setMaxEventsPerThread(maxEvents);
+    tracer.start();
+    std::thread([perThread]() {
+        for (int i = 0; i < perThread; ++i)
+        {
+            const mine::TraceScope scope("capped");
+        }
+    }).join();
+    tracer.stop();
+    tracer.setMaxEventsPerThread(mine::Tracer::kDefaultMaxEventsPerThread);
+    const size_t kept = tracer.eventCount() - keptBefore;
+    const uint64_t dropped = tracer.droppedCount() - droppedBefore;
+    const bool capped = kept == maxEvents && dropped == perThread - maxEvents;
+    std::cout << perThread << " events past a maximum of " << maxEvents << ": " << kept << " kept, " << dropped
+              << " dropped" << std::endl;
+
+    const bool ok = written && named && events == 4u * 2 * perThread && capped && offNs < onNs;
+    if (!ok)
+    {
+        std::cout << "trace: events missing or not capped, or a scope costs no less with tracing off" << std::endl;
+    }
+    return ok;
+}
+
+//!
+//! \brief Hardware events per image of the pack and fused resize kernels at every SIMD level.
+//!
+bool benchCounters(const BenchArgs& args)
+{
+    std::vector<cv::Mat> decoded;
+    std::vector<cv::Mat> resized;
+    if (!loadImages(args, decoded, false) || !loadImages(args, resized, true))
+    {
+        return false;
+    }
+    mine::PerfCounterValues probe;
+    if (!mine::readThreadPerfCounters(probe))
+    {
+        std::cout << "counters: perf_event_open is not allowed here (see /proc/sys/kernel/perf_event_paranoid), "
+                     "skipped"
+                  << std::endl;
+        return true;
+    }
+    const size_t vol = 3 * kInputH * kInputW;
+    std::vector<float> packed(vol);
+    const mine::PackParams params = mine::defaultPackParams();
+    const int iterations = std::max(1, args.iterations / 10);
+
+    std::cout << "counters: " << decoded.size() << " images, " << iterations << " iterations, user space events "
+              << "per image" << std::endl;
+    std::cout << std::left << std::setw(16) << "kernel" << std::right << std::setw(12) << "ns/image";
+    for (int c = 0; c < static_cast<int>(mine::PerfCounter::kCOUNT); ++c)
+    {
+        std::cout << std::setw(15) << mine::perfCounterName(static_cast<mine::PerfCounter>(c));
+    }
+    std::cout << std::setw(7) << "IPC" << std::endl;
+
+    const mine::SimdLevel levels[]
+        = {mine::SimdLevel::kSCALAR, mine::SimdLevel::kSSE41, mine::SimdLevel::kAVX2, mine::SimdLevel::kAVX512};
+    for (bool fused : {false, true})
+    {
+        for (mine::SimdLevel level : levels)
+        {
+            if (!mine::simdLevelSupported(level))
+            {
+                continue;
+            }
+            const mine::PackRowFn fn = mine::getPackRow(level);
+            const std::vector<cv::Mat>& images = fused ? decoded : resized;
+            mine::PerfCounterValues before, after;
+            mine::readThreadPerfCounters(before);
+            const double ns = timeNs(iterations, [&]() {
+                for (const cv::Mat& image : images)
+                {
+                    if (fused)
+                    {
+                        mine::resizeBGRToPlanarRGB(image.ptr<uint8_t>(), image.step, image.cols, image.rows,
+                            kInputW, kInputH, packed.data(), params, mine::ResizeMode::kSTRETCH, nullptr, fn);
+                    }
+                    else
+                    {
+                        mine::packBGRToPlanarRGB(
+                            image.ptr<uint8_t>(), image.step, kInputW, kInputH, packed.data(), params, fn);
+                    }
+                }
+            }) / images.size();
+            mine::readThreadPerfCounters(after);
+            const mine::PerfCounterValues events = after - before;
+            const double perImage = 1.0 / ((iterations + 1) * images.size()); // timeNs runs f once untimed
+            std::cout << std::left << std::setw(16)
+                      << std::string(fused ? "resize-" : "pack-") + mine::simdLevelName(level) << std::right
+                      << std::fixed << std::setprecision(0) << std::setw(12) << ns;
+            for (int c = 0; c < static_cast<int>(mine::PerfCounter::kCOUNT); ++c)
+            {
+                if (events.has[c])
+                {
+                    std::cout << std::setw(15) << events.value[c] * perImage;
+                }
+                else
+                {
+                    std::cout << std::setw(15) << "n/a";
+                }
+            }
+            const uint64_t cycles = events[mine::PerfCounter::kCYCLES];
+            if (cycles > 0 && events.has[static_cast<int>(mine::PerfCounter::kINSTRUCTIONS)])
+            {
+                std::cout << std::setw(7) << std::setprecision(2)
+                          << static_cast<double>(events[mine::PerfCounter::kINSTRUCTIONS]) / cycles;
+            }
+            std::cout << std::endl;
+        }
+    }
+    return true;
+}
+
+//!
+//! \brief Byte i of the payload of a client's request number n, so the server can check every byte.
+//!
+uint8_t shmPattern(uint64_t n, size_t i)
+{
+    return static_cast<uint8_t>(i * 31 + n);
+}
+
+//!
+//! \brief A producer process of benchShm: sends count requests of varying size with up to window
+//!        in flight, plus one malformed one, and checks every completion. Returns the exit code.
+//!
+int runShmProducer(const std::string& name, int count, uint32_t window, size_t maxBytes)
+{
+    mine::ShmRingClient client;
+    if (!client.attach(name))
+    {
+        std::cout << "producer " << getpid() << ": " << client.error() << std::endl;
+        return 2;
+    }
+    std::vector<uint8_t> buffer(maxBytes);
+    std::deque<std::pair<uint64_t, size_t>> expected; // Completions arrive in submission order
+    int sent = 0;
+    int bad = 0;
+    while (sent < count || !expected.empty())
+    {
+        while (sent < count && client.inFlight() < window)
+        {
+            // Request 7 claims to be 4x4 BGR pixels but carries another size: the server rejects it
+            const bool malformed = sent == 7;
+            const size_t size = 1 + (static_cast<size_t>(sent) * 7919) % maxBytes;
+            for (size_t i = 0; i < size; ++i)
+            {
+                buffer[i] = shmPattern(sent, i);
+            }
+            uint64_t id = 0;
+            if (!client.submit(malformed ? mine::ShmImageKind::kBGR : mine::ShmImageKind::kENCODED, buffer.data(),
+                    size, malformed ? 4 : 0, malformed ? 4 : 0, id))
+            {
+                std::cout << "producer " << getpid() << ": " << client.error() << std::endl;
+                return 3;
+            }
+            expected.emplace_back(id, malformed ? 0 : size);
+            ++sent;
+        }
+        mine::ShmCompletion completion;
+        if (!client.wait(completion))
+        {
+            std::cout << "producer " << getpid() << ": " << client.error() << std::endl;
+            return 3;
+        }
+        // The echo server answers ok with the size it received if every byte matched
+        const bool match = completion.requestId == expected.front().first
+            && (expected.front().second == 0 ? completion.ok == 0
+                                             : completion.ok == 1
+                        && completion.classes[0] == static_cast<int32_t>(expected.front().second));
+        bad += match ? 0 : 1;
+        expected.pop_front();
+    }
+    return bad == 0 ? 0 : 4;
+}
+
+//!
+//! \brief A client that detaches with two requests in flight and attaches again from the same
+//!        process: the completions of its first attach arrive after the second and must be dropped.
+//!
+bool checkShmReattach(const std::string& name, mine::ShmRingServer& server)
+{
+    mine::ShmRingClient client;
+    const uint8_t byte = 0;
+    uint64_t id = 0;
+    bool ok = client.attach(name) && client.submit(mine::ShmImageKind::kENCODED, &byte, 1, 0, 0, id)
+        && client.submit(mine::ShmImageKind::kENCODED, &byte, 1, 0, 0, id);
+    client.detach();
+    ok = ok && client.attach(name) && client.submit(mine::ShmImageKind::kENCODED, &byte, 1, 0, 0, id);
+    int answered = 0;
+    mine::ShmRequest request;
+    while (ok && answered < 3 && server.next(request))
+    {
+        mine::ShmCompletion completion;
+        std::memset(&completion, 0, sizeof(completion));
+        completion.requestId = request.requestId;
+        completion.ok = 1;
+        server.complete(request, completion);
+        ++answered;
+    }
+    mine::ShmCompletion completion;
+    ok = ok && answered == 3 && client.wait(completion) && completion.requestId == id && client.inFlight() == 0
+        && !client.poll(completion);
+    std::cout << "re-attach with 2 requests in flight: " << (ok ? "their late completions dropped" : "MISROUTED")
+              << std::endl;
+    return ok;
+}
+
+//!
+//! \brief Shared memory ring stress test: forked producer processes against an echo server that
+//!        checks every byte, with a ring much smaller than the traffic, plus a client that dies
+//!        holding a completion ring that a later client must take over, and one that re-attaches.
+//!
+bool benchShm(const BenchArgs& args)
+{
+    const std::string name = "/sample_mine_bench_" + std::to_string(getpid());
+    const int producers = 4;
+    const uint32_t capacity = 64;
+    const size_t maxBytes = 8192;
+    const int perProducer = std::max(100, args.iterations * 20);
+
+    std::cout << "shm: " << producers << " producer processes x " << perProducer << " requests of 1-" << maxBytes
+              << " bytes through a " << capacity << "-slot ring" << std::endl;
+    mine::ShmRingServer server;
+    if (!server.create(name, capacity, static_cast<uint32_t>(maxBytes), producers))
+    {
+        std::cout << server.error() << std::endl;
+        return false;
+    }
+    std::cout.flush(); // Children must not inherit and print buffered output again
+
+    // Takes a client ring and exits without detaching; one of the producers has to reclaim it
+    const pid_t dead = fork();
+    if (dead == 0)
+    {
+        mine::ShmRingClient client;
+        _exit(client.attach(name) ? 0 : 1);
+    }
+    int status = 0;
+    const bool deadAttached = waitpid(dead, &status, 0) == dead && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+
+    std::vector<pid_t> children;
+    for (int p = 0; p < producers; ++p)
+    {
+        const pid_t child = fork();
+        if (child == 0)
+        {
+            _exit(runShmProducer(name, perProducer, capacity / 2, maxBytes));
+        }
+        children.push_back(child);
+    }
+
+    // Echo server: answers ok with the payload size if every byte is as the producer wrote it.
+    // next() answers the malformed request of each producer itself.
+    const uint64_t malformed = static_cast<uint64_t>(producers);
+    const uint64_t total = static_cast<uint64_t>(producers) * perProducer - malformed;
+    uint64_t answered = 0;
+    uint64_t corrupt = 0;
+    mine::Backoff backoff;
+    const auto start = std::chrono::steady_clock::now();
+    const auto deadline = start + std::chrono::seconds(60);
+    while (answered < total && std::chrono::steady_clock::now() < deadline)
+    {
+        mine::ShmRequest request;
+        if (!server.next(request))
+        {
+            backoff.pause();
+            continue;
+        }
+        backoff.reset();
+        bool intact = true;
+        const uint64_t n = request.requestId & 0xffffffff;
+        for (size_t i = 0; i < request.size; ++i)
+        {
+            intact = intact && request.data[i] == shmPattern(n, i);
+        }
+        corrupt += intact ? 0 : 1;
+        mine::ShmCompletion completion;
+        std::memset(&completion, 0, sizeof(completion));
+        completion.requestId = request.requestId;
+        completion.ok = intact ? 1 : 0;
+        completion.count = 1;
+        completion.classes[0] = intact ? static_cast<int32_t>(request.size) : -1;
+        server.complete(request, completion);
+        ++answered;
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    int failedProducers = 0;
+    for (pid_t child : children)
+    {
+        if (answered < total)
+        {
+            kill(child, SIGKILL);
+        }
+        failedProducers += waitpid(child, &status, 0) == child && WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : 1;
+    }
+    const mine::ShmRingServer::Stats stats = server.stats();
+    std::cout << answered << " requests (" << stats.rejected << " malformed, rejected) in " << std::fixed
+              << std::setprecision(2) << seconds << " s, " << std::setprecision(0) << answered / std::max(seconds, 1e-9)
+              << " requests/s, " << corrupt << " corrupt payloads, " << stats.dropped << " completions dropped, "
+              << failedProducers << " producers failed" << std::endl;
+
+    // With every client ring needed, the producers only all ran if one took over the dead client's
+    const bool ok = deadAttached && answered == total && failedProducers == 0
+        && stats.rejected == malformed && stats.dropped == 0 && corrupt == 0 && checkShmReattach(name, server);
+    if (!ok)
+    {
+        std::cout << "shm: the ring lost, corrupted or misrouted requests" << std::endl;
+    }
+    return ok;
+}
+
+//!
+//! \brief Sends request on a blocking socket and reads one response, waiting at most 5 s.
+//!
+bool httpExchange(int fd, const std::string& request, mine::HttpReply& reply, mine::HttpReplyReader& reader)
+{
+    for (size_t sent = 0; sent < request.size();)
+    {
+        const ssize_t n = send(fd, request.data() + sent, request.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0)
+        {
+            return false;
+        }
+        sent += static_cast<size_t>(n);
+    }
+    char buffer[16384];
+    int status;
+    while ((status = reader.next(reply)) == 0)
+    {
+        const ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+        if (n <= 0)
+        {
+            return false;
+        }
+        reader.append(buffer, static_cast<size_t>(n));
+    }
+    return status == 1;
+}
+
+//!
+//! \brief True once the server closed fd, within the 5 s receive timeout.
+//!
+bool httpClosedByPeer(int fd)
+{
+    char byte;
+    return recv(fd, &byte, 1, 0) == 0;
+}
+
+int httpConnect(int port)
+{
+    std::string error;
+    const int fd = mine::connectTcp("127.0.0.1", port, false, error);
+    if (fd < 0)
+    {
+        std::cout << error << std::endl;
+        return -1;
+    }
+    const timeval timeout{5, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    return fd;
+}
+
+//!
+//! \brief The echo server's answer to a body: its size and a checksum.
+//!
+std::string httpEcho(const uint8_t* data, size_t size)
+{
+    uint64_t sum = 0;
+    for (size_t i = 0; i < size; ++i)
+    {
+        sum = sum * 31 + data[i];
+    }
+    return std::to_string(size) + " " + std::to_string(sum);
+}
+
+//!
+//! \brief HttpServer under load and at its edges: hundreds of keep-alive connections pipelining
+//!        requests that are answered out of order from another thread, then malformed, oversized,
+//!        dribbled, 100-continue, HTTP/1.0 and idle clients.
+//!
+bool benchHttp(const BenchArgs& args)
+{
+    const uint64_t fileLimit = mine::raiseOpenFileLimit();
+    const int connections = static_cast<int>(std::min<uint64_t>(512, fileLimit > 64 ? (fileLimit - 64) / 2 : 0));
+    const int clientThreads = 8;
+    const int depth = 4; // Requests each connection pipelines
+    const int rounds = std::max(4, args.iterations / 10);
+    const size_t maxBody = 16 * 1024;
+
+    mine::HttpServer server;
+    mine::HttpLimits limits;
+    limits.maxBodyBytes = maxBody;
+    limits.idleTimeoutMs = 1000;
+    if (connections < clientThreads || !server.listen("127.0.0.1", 0, limits))
+    {
+        std::cout << "http: " << (server.error().empty() ? "too few file descriptors" : server.error()) << std::endl;
+        return false;
+    }
+
+    // Echo requests are answered by a responder thread, each batch it picks up in reverse order
+    std::mutex mutex;
+    std::condition_variable wakeResponder;
+    std::vector<std::pair<mine::HttpServer::Ticket, std::string>> queued;
+    bool stopResponder = false;
+    std::thread responder([&]() {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;)
+        {
+            wakeResponder.wait(lock, [&]() { return stopResponder || !queued.empty(); });
+            if (queued.empty())
+            {
+                return;
+            }
+            std::vector<std::pair<mine::HttpServer::Ticket, std::string>> batch;
+            batch.swap(queued);
+            lock.unlock();
+            for (auto it = batch.rbegin(); it != batch.rend(); ++it)
+            {
+                mine::HttpResponse response;
+                response.contentType = "text/plain";
+                response.body = std::move(it->second);
+                server.respond(it->first, std::move(response));
+            }
+            lock.lock();
+        }
+    });
+    const mine::HttpServer::Handler handler = [&](mine::HttpRequest& request, mine::HttpServer::Ticket ticket) {
+        if (request.target == "/echo" && request.method == "POST")
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queued.emplace_back(ticket, httpEcho(request.body.data(), request.body.size()));
+            wakeResponder.notify_one();
+            return;
+        }
+        mine::HttpResponse response;
+        response.status = request.target == "/echo" ? 405 : 404;
+        server.respond(ticket, std::move(response));
+    };
+    std::thread loop([&]() { server.run(handler); });
+
+    // Load: every client thread drives its share of the connections round robin, sending depth
+    // requests at once on each and checking every answer
+    std::cout << "http: " << connections << " keep-alive connections x " << rounds << " rounds x " << depth
+              << " pipelined requests of 1-" << maxBody << " bytes, " << clientThreads << " client threads"
+              << std::endl;
+    std::vector<int> fds;
+    for (int c = 0; c < connections; ++c)
+    {
+        const int fd = httpConnect(server.port());
+        if (fd < 0)
+        {
+            break;
+        }
+        fds.push_back(fd);
+    }
+    std::vector<uint64_t> wrong(clientThreads, 0);
+    std::vector<std::vector<double>> latencies(clientThreads);
+    std::vector<std::thread> clients;
+    const auto start = std::chrono::steady_clock::now();
+    for (int t = 0; t < clientThreads; ++t)
+    {
+        clients.emplace_back([&, t]() {
+            std::mt19937 random(t);
+            std::vector<mine::HttpReplyReader> readers(fds.size());
+            std::vector<uint8_t> body(maxBody);
+            for (int round = 0; round < rounds; ++round)
+            {
+                for (size_t c = t; c < fds.size(); c += clientThreads)
+                {
+                    std::string batch;
+                    std::vector<std::string> expected;
+                    for (int d = 0; d < depth; ++d)
+                    {
+                        const size_t size = 1 + random() % maxBody;
+                        for (size_t i = 0; i < size; ++i)
+                        {
+                            body[i] = static_cast<uint8_t>(random());
+                        }
+                        batch += mine::httpRequestHead("POST", "/echo", "localhost", "application/octet-stream", size);
+                        batch.append(reinterpret_cast<const char*>(body.data()), size);
+                        expected.push_back(httpEcho(body.data(), size));
+                    }
+                    const auto sent = std::chrono::steady_clock::now();
+                    mine::HttpReply reply;
+                    for (int d = 0; d < depth; ++d)
+                    {
+                        const bool ok = httpExchange(fds[c], d == 0 ? batch : std::string(), reply, readers[c]);
+                        wrong[t] += ok && reply.status == 200 && reply.body == expected[d] ? 0 : 1;
+                    }
+                    latencies[t].push_back(
+                        std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - sent).count());
+                }
+            }
+        });
+    }
+    for (auto& client : clients)
+    {
+        client.join();
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    uint64_t wrongTotal = 0;
+    std::vector<double> all;
+    for (int t = 0; t < clientThreads; ++t)
+    {
+        wrongTotal += wrong[t];
+        all.insert(all.end(), latencies[t].begin(), latencies[t].end());
+    }
+    const uint64_t requests = static_cast<uint64_t>(fds.size()) * rounds * depth;
+    std::cout << requests << " requests in " << std::fixed << std::setprecision(2) << seconds << " s, "
+              << std::setprecision(0) << requests / std::max(seconds, 1e-9) << " requests/s, " << wrongTotal
+              << " wrong answers; " << depth << "-request round trip us p50 " << percentile(all, 50) << ", p99 "
+              << percentile(all, 99) << std::endl;
+    bool ok = static_cast<int>(fds.size()) == connections && wrongTotal == 0;
+    for (int fd : fds)
+    {
+        close(fd);
+    }
+
+    // Edge cases, each on a fresh connection: what is sent, the status expected, and whether
+    // the server has to close the connection after it
+    struct EdgeCase
+    {
+        const char* name;
+        std::string request;
+        int status;
+        bool closes;
+    };
+    const std::string post = mine::httpRequestHead("POST", "/echo", "localhost", "image/jpeg", 5);
+    const std::vector<EdgeCase> edgeCases = {
+        {"not http", "HELLO\r\n\r\n", 400, true},
+        {"no version", "GET /\r\n\r\n", 400, true},
+        {"http/2", "GET / HTTP/2.0\r\n\r\n", 505, true},
+        {"bad length", "POST /echo HTTP/1.1\r\nContent-Length: 12x\r\n\r\n", 400, true},
+        {"two lengths", "POST /echo HTTP/1.1\r\nContent-Length: 1\r\nContent-Length: 2\r\n\r\nab", 400, true},
+        {"chunked", "POST /echo HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n0\r\n\r\n", 501, true},
+        {"too large", mine::httpRequestHead("POST", "/echo", "localhost", "image/jpeg", maxBody + 1), 413, true},
+        {"long header", "GET / HTTP/1.1\r\nX: " + std::string(limits.maxHeaderBytes, 'x') + "\r\n\r\n", 431, true},
+        {"bad expect", "POST /echo HTTP/1.1\r\nExpect: 200-ok\r\nContent-Length: 1\r\n\r\na", 417, true},
+        {"not found", "GET /nothing HTTP/1.1\r\n\r\n", 404, false},
+        {"wrong method", "GET /echo HTTP/1.1\r\n\r\n", 405, false},
+        {"keep-alive", post + "hello", 200, false},
+        {"close", mine::httpRequestHead("POST", "/echo", "localhost", "image/jpeg", 5, false) + "hello", 200, true},
+        {"http/1.0", "POST /echo HTTP/1.0\r\nContent-Length: 5\r\n\r\nhello", 200, true},
+        {"http/1.0 keep-alive", "POST /echo HTTP/1.0\r\nConnection: keep-alive\r\nContent-Length: 5\r\n\r\nhello",
+            200, false},
+    };
+    int failedCases = 0;
+    for (const EdgeCase& edge : edgeCases)
+    {
+        const int fd = httpConnect(server.port());
+        mine::HttpReplyReader reader;
+        mine::HttpReply reply;
+        const bool answered = fd >= 0 && httpExchange(fd, edge.request, reply, reader);
+        const bool pass = answered && reply.status == edge.status && reply.close == edge.closes
+            && (!edge.closes || httpClosedByPeer(fd));
+        if (!pass)
+        {
+            std::cout << "http: " << edge.name << " answered " << reply.status << (reply.close ? " close" : "")
+                      << ", expected " << edge.status << (edge.closes ? " close" : "") << std::endl;
+            ++failedCases;
+        }
+        close(fd);
+    }
+
+    // A request one byte per write, then 100-continue: the body only goes out after the interim
+    // response, as curl does it
+    {
+        const int fd = httpConnect(server.port());
+        mine::HttpReplyReader reader;
+        mine::HttpReply reply;
+        bool pass = fd >= 0;
+        const std::string dribbled = post + "hello";
+        for (size_t i = 0; pass && i + 1 < dribbled.size(); ++i)
+        {
+            pass = send(fd, &dribbled[i], 1, MSG_NOSIGNAL) == 1;
+        }
+        pass = pass && httpExchange(fd, dribbled.substr(dribbled.size() - 1), reply, reader) && reply.status == 200
+            && reply.body == httpEcho(reinterpret_cast<const uint8_t*>("hello"), 5);
+        failedCases += pass ? 0 : 1;
+        if (!pass)
+        {
+            std::cout << "http: dribbled request failed" << std::endl;
+        }
+
+        const std::string head = "POST /echo HTTP/1.1\r\nExpect: 100-continue\r\nContent-Length: 5\r\n\r\n";
+        char interim[64] = {};
+        pass = send(fd, head.data(), head.size(), MSG_NOSIGNAL) == static_cast<ssize_t>(head.size())
+            && recv(fd, interim, sizeof(interim) - 1, 0) > 0
+            && std::string(interim) == "HTTP/1.1 100 Continue\r\n\r\n" && httpExchange(fd, "hello", reply, reader)
+            && reply.status == 200;
+        failedCases += pass ? 0 : 1;
+        if (!pass)
+        {
+            std::cout << "http: 100-continue failed" << std::endl;
+        }
+        close(fd);
+    }
+
+    // An idle connection is closed after the idle timeout, checked once a second
+    {
+        const int fd = httpConnect(server.port());
+        const auto opened = std::chrono::steady_clock::now();
+        const bool pass = fd >= 0 && httpClosedByPeer(fd)
+            && std::chrono::steady_clock::now() - opened >= std::chrono::milliseconds(limits.idleTimeoutMs);
+        failedCases += pass ? 0 : 1;
+        if (!pass)
+        {
+            std::cout << "http: idle connection not closed" << std::endl;
+        }
+        close(fd);
+    }
+
+    server.stop();
+    loop.join();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopResponder = true;
+    }
+    wakeResponder.notify_one();
+    responder.join();
+    const mine::HttpServer::Stats stats = server.stats();
+    std::cout << edgeCases.size() + 3 - failedCases << " of " << edgeCases.size() + 3 << " edge cases pass; "
+              << stats.accepted << " connections (peak " << stats.peakConnections << "), " << stats.requests
+              << " requests, " << stats.rejected << " rejected, " << stats.dropped << " responses dropped, "
+              << stats.idleClosed << " idle closed" << std::endl;
+    return ok && failedCases == 0 && stats.dropped == 0;
+}
+
+struct Bench
+{
+    const char* name;
+    bool (*run)(const BenchArgs&);
+    const char* description;
+};
+
+const Bench gBenches[] = {
+    {"pack", benchPack, "BGR HWC uint8 -> RGB CHW float packing kernels vs the original loop"},
+    {"resize", benchResize, "cv::resize + pack vs fused resize-into-tensor (stretch, crop, letterbox)"},
+    {"shapes", benchShapes, "resize-and-pack kernels compiled for 3x299x299 / 3x224x224 vs the generic kernel"},
+    {"layout", benchLayout, "NCHW <-> NHWC conversion per element type, and resizing into either layout directly"},
+    {"preprocess", benchPreprocess, "compiled preprocessing specs vs the multiply-add kernels: time and exactness"},
+    {"decode", benchDecode, "full cv::imdecode vs reduced-scale JPEG decode, bundled and 4x upscaled images"},
+    {"batching", benchBatching, "dynamic batching scheduler on a fake backend: throughput and tail latency"},
+    {"softmax", benchSoftmax, "original in-place softmax vs stable SIMD softmax kernels, and top-5 selection"},
+    {"planload", benchPlanLoad, "engine plan loading, ifstream into a heap blob vs mmap (+MAP_POPULATE)"},
+    {"pool", benchPool, "per-batch buffer/context allocation vs a reused slot pool, with contention counters"},
+    {"pipeline", benchPipeline, "sequential vs decode/execute/softmax pipelined over 1-3 execution slots"},
+    {"cache", benchCache, "result cache: hash vs decode cost, repeated images with and without it, LRU eviction"},
+    {"prefetch", benchPrefetch, "cold-cache image file reads: blocking vs prefetched over pread and io_uring"},
+    {"input", benchInput, "host input buffer as normalized float vs half vs resized uint8 planes: time and bytes"},
+    {"shard", benchShard, "input tensor from decode + resize vs from a mapped uint8 / fp16 tensor shard"},
+    {"calib", benchCalibration, "INT8 calibration batches on 1 thread vs the pool, and the cache round trip"},
+    {"http", benchHttp, "epoll HTTP server: 512 keep-alive connections pipelining echo requests, and edge cases"},
+    {"shm", benchShm, "shared memory ring stress test: 4 producer processes against an echo server, bytes checked"},
+    {"counters", benchCounters, "cycles, instructions, LLC and branch misses per image of the pack / resize kernels"},
+    {"trace", benchTrace, "cost of a trace scope with tracing off and on, and writing a 4-thread Chrome trace"},
+};
+
+void printHelpInfo()
+{
+    std::cout << "Usage: ./sample_mine_bench [-h or --help] [-d or --datadir=<path to data directory>] "
+                 "[--bench=<name>] [--iterations=<N>]\n";
+    std::cout << "--datadir       Directory holding the bundled images, default data/mine/ and data/samples/mine/\n";
+    std::cout << "--bench         Run a single benchmark, default all of:\n";
+    for (const auto& bench : gBenches)
+    {
+        std::cout << "                  " << std::left << std::setw(10) << bench.name << bench.description << "\n";
+    }
+    std::cout << "--iterations    Timed iterations per kernel, default 500" << std::endl;
+}
+
+bool parseBenchArgs(BenchArgs& args, int argc, char** argv)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg(argv[i]);
+        const std::string value = arg.substr(arg.find('=') + 1);
+        if (arg == "-h" || arg == "--help")
+        {
+            return false;
+        }
+        else if (arg.compare(0, 10, "--datadir=") == 0 || arg.compare(0, 3, "-d=") == 0)
+        {
+            args.dataDirs.push_back(value);
+        }
+        else if (arg.compare(0, 8, "--bench=") == 0)
+        {
+            args.bench = value;
+        }
+        else if (arg.compare(0, 13, "--iterations=") == 0)
+        {
+            args.iterations = std::max(1, std::atoi(value.c_str()));
+        }
+        else
+        {
+            std::cout << "Unknown argument " << arg << std::endl;
+            return false;
+        }
+    }
+    if (args.dataDirs.empty())
+    {
+        args.dataDirs.push_back("data/mine/");
+        args.dataDirs.push_back("data/samples/mine/");
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    BenchArgs args;
+    if (!parseBenchArgs(args, argc, argv))
+    {
+        printHelpInfo();
+        return EXIT_FAILURE;
+    }
+
+    bool ok = true;
+    bool ran = false;
+    for (const auto& bench : gBenches)
+    {
+        if (args.bench.empty() || args.bench == bench.name)
+        {
+            ran = true;
+            ok = bench.run(args) && ok;
+            std::cout << std::endl;
+        }
+    }
+    if (!ran)
+    {
+        std::cout << "Unknown benchmark " << args.bench << std::endl;
+        printHelpInfo();
+        return EXIT_FAILURE;
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,468 @@
+#include "../sampleMine/bulkInput.h"
+#include "../sampleMine/httpClient.h"
+#include "../sampleMine/httpServer.h"
+#include "../sampleMine/jpegDecode.h"
+#include "../sampleMine/stageStats.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <sys/epoll.h>
+
+// Posts images to a sample_mine --http=PORT server over many connections at
+// once, from one epoll loop, and reports throughput, round-trip latency, the
+// response statuses and the classes the server answered. Each connection keeps
+// --pipeline requests in flight on one keep-alive connection, or, with --close,
+// opens a new connection per request.
+
+namespace
+{
+
+typedef std::chrono::steady_clock Clock;
+
+struct ClientArgs
+{
+    std::string host{"127.0.0.1"};
+    int port{8080};
+    std::string target{"/predict"};
+    std::string input;
+    int requests{0};     //!< 0 = every input image once
+    int connections{64};
+    int pipeline{1};     //!< Requests in flight per connection
+    bool close{false};   //!< Connection: close on every request
+};
+
+//!
+//! \brief One image, as a complete request ready to send.
+//!
+struct Payload
+{
+    std::string request;
+};
+
+bool loadPayloads(const ClientArgs& args, std::vector<Payload>& payloads)
+{
+    std::unique_ptr<mine::ImageSource> source = mine::openImageSource(args.input);
+    if (!source)
+    {
+        std::cout << "Cannot open " << args.input << std::endl;
+        return false;
+    }
+    mine::ImageEntry entry;
+    std::vector<uint8_t> bytes;
+    while ((args.requests == 0 || static_cast<int>(payloads.size()) < args.requests) && source->next(entry))
+    {
+        if (!mine::readFileBytes(entry.path, bytes))
+        {
+            std::cout << "Cannot read " << entry.path << std::endl;
+            return false;
+        }
+        Payload payload;
+        payload.request
+            = mine::httpRequestHead("POST", args.target, args.host, "image/jpeg", bytes.size(), !args.close);
+        payload.request.append(bytes.begin(), bytes.end());
+        payloads.push_back(std::move(payload));
+    }
+    if (payloads.empty())
+    {
+        std::cout << "No images in " << args.input << std::endl;
+        return false;
+    }
+    return true;
+}
+
+struct Connection
+{
+    int fd{-1};
+    uint32_t events{0};   //!< As registered with epoll
+    bool answered{false}; //!< Got at least one response
+    std::string out;
+    size_t written{0};
+    std::deque<Clock::time_point> sent; //!< Of the requests in flight, oldest first
+    mine::HttpReplyReader reader;
+};
+
+//!
+//! \brief Drives every connection from one epoll loop until all requests are answered.
+//!
+class LoadGenerator
+{
+public:
+    LoadGenerator(const ClientArgs& args, const std::vector<Payload>& payloads, int requests)
+        : mArgs(args)
+        , mPayloads(payloads)
+        , mRequests(requests)
+        , mConnections(args.connections)
+    {
+    }
+
+    ~LoadGenerator()
+    {
+        for (Connection& c : mConnections)
+        {
+            if (c.fd >= 0)
+            {
+                ::close(c.fd);
+            }
+        }
+        if (mEpoll >= 0)
+        {
+            ::close(mEpoll);
+        }
+    }
+
+    bool run()
+    {
+        mEpoll = epoll_create1(EPOLL_CLOEXEC);
+        for (size_t i = 0; i < mConnections.size(); ++i)
+        {
+            if (!open(i))
+            {
+                return false;
+            }
+        }
+        epoll_event events[256];
+        while (mAnswered + mFailed < mRequests)
+        {
+            const int n = epoll_wait(mEpoll, events, 256, 5000);
+            if (n == 0)
+            {
+                std::cout << "No response for 5 s, " << mRequests - mAnswered - mFailed << " requests outstanding"
+                          << std::endl;
+                return false;
+            }
+            for (int e = 0; e < n; ++e)
+            {
+                const size_t i = events[e].data.u64;
+                if (mConnections[i].fd < 0)
+                {
+                    continue;
+                }
+                if (serve(i, events[e].events) ? !watch(i, EPOLL_CTL_MOD) : !reopen(i))
+                {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    uint64_t answered() const
+    {
+        return mAnswered;
+    }
+
+    uint64_t failed() const
+    {
+        return mFailed;
+    }
+
+    uint64_t reconnects() const
+    {
+        return mReconnects;
+    }
+
+    const std::vector<double>& latenciesUs() const
+    {
+        return mLatenciesUs;
+    }
+
+    const std::map<int, uint64_t>& statuses() const
+    {
+        return mStatuses;
+    }
+
+    const std::map<std::string, uint64_t>& topClasses() const
+    {
+        return mTopClasses;
+    }
+
+private:
+    bool open(size_t i)
+    {
+        Connection& c = mConnections[i];
+        c = Connection();
+        std::string error;
+        c.fd = mine::connectTcp(mArgs.host, mArgs.port, true, error);
+        if (c.fd < 0)
+        {
+            std::cout << error << std::endl;
+            return false;
+        }
+        fill(c);
+        return watch(i, EPOLL_CTL_ADD);
+    }
+
+    //!
+    //! \brief Watches connection i for responses, and for room to send while it has requests
+    //!        unsent (which includes waiting for the connect).
+    //!
+    bool watch(size_t i, int op)
+    {
+        Connection& c = mConnections[i];
+        epoll_event event;
+        event.events = EPOLLIN;
+        if (!c.out.empty())
+        {
+            event.events |= EPOLLOUT;
+        }
+        event.data.u64 = i;
+        if (op == EPOLL_CTL_MOD && event.events == c.events)
+        {
+            return true;
+        }
+        c.events = event.events;
+        return epoll_ctl(mEpoll, op, c.fd, &event) == 0;
+    }
+
+    //!
+    //! \brief Closes connection i; requests still in flight on it count as failed. Opens a new
+    //!        one if there is anything left to send.
+    //!
+    bool reopen(size_t i)
+    {
+        Connection& c = mConnections[i];
+        mFailed += c.sent.size();
+        ::close(c.fd);
+        c.fd = -1;
+        if (!c.answered)
+        {
+            std::cout << "Connection to " << mArgs.host << ":" << mArgs.port << " failed before any response"
+                      << std::endl;
+            return false;
+        }
+        if (mSubmitted >= mRequests)
+        {
+            return true;
+        }
+        ++mReconnects;
+        return open(i);
+    }
+
+    //!
+    //! \brief Queues requests on c up to the pipeline depth.
+    //!
+    void fill(Connection& c)
+    {
+        while (static_cast<int>(c.sent.size()) < mArgs.pipeline && mSubmitted < mRequests)
+        {
+            c.out += mPayloads[mSubmitted % mPayloads.size()].request;
+            c.sent.push_back(Clock::now());
+            ++mSubmitted;
+            if (mArgs.close)
+            {
+                break;
+            }
+        }
+    }
+
+    //!
+    //! \brief False once the connection is done with: closed by the server or failed.
+    //!
+    bool serve(size_t i, uint32_t events)
+    {
+        Connection& c = mConnections[i];
+        if (events & EPOLLERR)
+        {
+            return false;
+        }
+        if (events & EPOLLIN)
+        {
+            char buffer[65536];
+            const ssize_t received = recv(c.fd, buffer, sizeof(buffer), 0);
+            if (received <= 0)
+            {
+                return received < 0 && (errno == EAGAIN || errno == EINTR);
+            }
+            c.reader.append(buffer, static_cast<size_t>(received));
+            mine::HttpReply reply;
+            int status;
+            while ((status = c.reader.next(reply)) == 1 && !c.sent.empty())
+            {
+                const Clock::time_point now = Clock::now();
+                mLatenciesUs.push_back(std::chrono::duration<double, std::micro>(now - c.sent.front()).count());
+                c.sent.pop_front();
+                c.answered = true;
+                ++mStatuses[reply.status];
+                if (reply.status == 200)
+                {
+                    ++mAnswered;
+                    countTopClass(reply.body);
+                }
+                else
+                {
+                    ++mFailed;
+                }
+                if (reply.close)
+                {
+                    return false;
+                }
+                fill(c);
+            }
+            if (status < 0)
+            {
+                return false;
+            }
+        }
+        while (c.written < c.out.size())
+        {
+            const ssize_t sent = send(c.fd, c.out.data() + c.written, c.out.size() - c.written, MSG_NOSIGNAL);
+            if (sent <= 0)
+            {
+                return sent < 0 && (errno == EAGAIN || errno == EINTR);
+            }
+            c.written += static_cast<size_t>(sent);
+        }
+        c.out.clear();
+        c.written = 0;
+        return true;
+    }
+
+    //!
+    //! \brief Counts the first "class" of a /predict answer.
+    //!
+    void countTopClass(const std::string& body)
+    {
+        const std::string key = "\"class\": \"";
+        const size_t begin = body.find(key);
+        const size_t end = begin == std::string::npos ? begin : body.find('"', begin + key.size());
+        if (end != std::string::npos)
+        {
+            ++mTopClasses[body.substr(begin + key.size(), end - begin - key.size())];
+        }
+    }
+
+    const ClientArgs& mArgs;
+    const std::vector<Payload>& mPayloads;
+    const uint64_t mRequests;
+    std::vector<Connection> mConnections;
+    int mEpoll{-1};
+    uint64_t mSubmitted{0};
+    uint64_t mAnswered{0};
+    uint64_t mFailed{0};
+    uint64_t mReconnects{0};
+    std::vector<double> mLatenciesUs;
+    std::map<int, uint64_t> mStatuses;
+    std::map<std::string, uint64_t> mTopClasses;
+};
+
+void printHelpInfo()
+{
+    std::cout << "Usage: ./sample_mine_http_client --input=<directory or manifest> [--host=H] [--port=N] "
+                 "[--target=/path] [--requests=N] [--connections=N] [--pipeline=N] [--close]\n";
+    std::cout << "--input         Images to post, as for sample_mine --input\n";
+    std::cout << "--host          Server address. Default 127.0.0.1\n";
+    std::cout << "--port          Server port, as given to sample_mine --http. Default 8080\n";
+    std::cout << "--target        Path to post to. Default /predict\n";
+    std::cout << "--requests      Requests in total, cycling over the images. Default every image once\n";
+    std::cout << "--connections   Connections open at once. Default 64\n";
+    std::cout << "--pipeline      Requests each connection keeps in flight. Default 1\n";
+    std::cout << "--close         Send Connection: close, so every request opens a new connection" << std::endl;
+}
+
+bool parseClientArgs(ClientArgs& args, int argc, char** argv)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg(argv[i]);
+        const std::string value = arg.substr(arg.find('=') + 1);
+        if (arg == "-h" || arg == "--help")
+        {
+            return false;
+        }
+        else if (arg.compare(0, 8, "--input=") == 0)
+        {
+            args.input = value;
+        }
+        else if (arg.compare(0, 7, "--host=") == 0)
+        {
+            args.host = value;
+        }
+        else if (arg.compare(0, 7, "--port=") == 0)
+        {
+            args.port = std::atoi(value.c_str());
+        }
+        else if (arg.compare(0, 9, "--target=") == 0)
+        {
+            args.target = value;
+        }
+        else if (arg.compare(0, 11, "--requests=") == 0)
+        {
+            args.requests = std::max(0, std::atoi(value.c_str()));
+        }
+        else if (arg.compare(0, 14, "--connections=") == 0)
+        {
+            args.connections = std::max(1, std::atoi(value.c_str()));
+        }
+        else if (arg.compare(0, 11, "--pipeline=") == 0)
+        {
+            args.pipeline = std::max(1, std::atoi(value.c_str()));
+        }
+        else if (arg == "--close")
+        {
+            args.close = true;
+        }
+        else
+        {
+            std::cout << "Unknown argument " << arg << std::endl;
+            return false;
+        }
+    }
+    return !args.input.empty() && args.port > 0;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    ClientArgs args;
+    if (!parseClientArgs(args, argc, argv))
+    {
+        printHelpInfo();
+        return EXIT_FAILURE;
+    }
+    std::vector<Payload> payloads;
+    if (!loadPayloads(args, payloads))
+    {
+        return EXIT_FAILURE;
+    }
+    const int requests = args.requests > 0 ? args.requests : static_cast<int>(payloads.size());
+    const uint64_t fileLimit = mine::raiseOpenFileLimit();
+    if (static_cast<uint64_t>(args.connections) + 16 > fileLimit)
+    {
+        std::cout << args.connections << " connections need more than the " << fileLimit << " open files allowed"
+                  << std::endl;
+        return EXIT_FAILURE;
+    }
+    args.connections = std::min(args.connections, requests);
+
+    LoadGenerator generator(args, payloads, requests);
+    const auto start = Clock::now();
+    const bool ok = generator.run();
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    const mine::LatencySummary latency = mine::summarizeLatencies(generator.latenciesUs());
+    std::cout << generator.answered() << " of " << requests << " requests answered (" << generator.failed()
+              << " failed) over " << args.connections << " connections, " << generator.reconnects()
+              << " reconnects, in " << std::fixed << std::setprecision(2) << seconds << " s, " << std::setprecision(1)
+              << generator.answered() / std::max(seconds, 1e-9) << " images/s" << std::endl;
+    std::cout << "round trip us: mean " << latency.mean << ", p50 " << latency.p50 << ", p90 " << latency.p90
+              << ", p99 " << latency.p99 << ", max " << latency.max << std::endl;
+    for (const auto& entry : generator.statuses())
+    {
+        std::cout << "status " << entry.first << ": " << entry.second << " responses" << std::endl;
+    }
+    for (const auto& entry : generator.topClasses())
+    {
+        std::cout << "top class " << entry.first << ": " << entry.second << " images" << std::endl;
+    }
+    return ok && generator.failed() == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,242 @@
+#include "../sampleMine/bulkInput.h"
+#include "../sampleMine/imagePacking.h"
+#include "../sampleMine/imageResize.h"
+#include "../sampleMine/jpegDecode.h"
+#include "../sampleMine/tensorShard.h"
+#include "../sampleMine/threadPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Preprocesses a directory or manifest of images once, the way sample_mine
+// would, into tensor shards that sample_mine --input=a.shard,b.shard scores
+// without decoding anything.
+
+namespace
+{
+
+struct ShardArgs
+{
+    std::string input;
+    std::string output;
+    mine::ShardDataType type{mine::ShardDataType::kUINT8};
+    mine::ResizeMode resizeMode{mine::ResizeMode::kSTRETCH};
+    int height{299};
+    int width{299};
+    int shardSize{10000}; //!< Images per shard
+    int threads{0};       //!< 0 = one per hardware thread
+};
+
+//!
+//! \brief An image preprocessed into the shard's element type, or ok = false.
+//!
+struct Preprocessed
+{
+    mine::ImageEntry entry;
+    bool ok{false};
+    std::vector<uint8_t> tensor;
+};
+
+//!
+//! \brief Decodes and resizes entry like sample_mine does, then stores it as format.type:
+//!        uint8 keeps the resized pixels, fp16 the normalized values.
+//!
+void preprocess(const mine::ShardFormat& format, Preprocessed& image)
+{
+    std::vector<uint8_t> bytes;
+    cv::Mat bgr;
+    int denom = 1;
+    image.ok = mine::readFileBytes(image.entry.path, bytes)
+        && mine::decodeImageScaled(
+            bytes.data(), bytes.size(), format.width, format.height, format.resizeMode, bgr, denom);
+    if (!image.ok)
+    {
+        return;
+    }
+    image.tensor.resize(format.tensorBytes());
+    if (format.type == mine::ShardDataType::kFP16)
+    {
+        mine::resizeBGRToPlanarRGBHalf(bgr.ptr<uint8_t>(), bgr.step, bgr.cols, bgr.rows, format.width,
+            format.height, reinterpret_cast<uint16_t*>(image.tensor.data()), format.normalization, format.resizeMode);
+    }
+    else
+    {
+        mine::resizeBGRToPlanarRGB8(bgr.ptr<uint8_t>(), bgr.step, bgr.cols, bgr.rows, format.width, format.height,
+            image.tensor.data(), format.resizeMode);
+    }
+}
+
+std::string shardPath(const std::string& prefix, int index)
+{
+    char suffix[32];
+    std::snprintf(suffix, sizeof(suffix), "-%05d.shard", index);
+    return prefix + suffix;
+}
+
+void printHelpInfo()
+{
+    std::cout << "Usage: ./sample_mine_shard --input=<directory or manifest> --output=<prefix> [--type=uint8|fp16] "
+                 "[--resize=stretch|crop|letterbox] [--height=N] [--width=N] [--shardSize=N] [--threads=N]\n";
+    std::cout << "--input         Images to preprocess, as for sample_mine --input\n";
+    std::cout << "--output        Shards are written to <prefix>-00000.shard, <prefix>-00001.shard, ...\n";
+    std::cout << "--type          uint8 (default; resized pixels, 1 byte per value) or fp16 (normalized values)\n";
+    std::cout << "--resize        How images are fit to the input, as for sample_mine. Default stretch\n";
+    std::cout << "--height/width  Model input size. Default 299x299\n";
+    std::cout << "--shardSize     Images per shard. Default 10000\n";
+    std::cout << "--threads       Preprocessing threads. Default one per hardware thread" << std::endl;
+}
+
+bool parseShardArgs(ShardArgs& args, int argc, char** argv)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg(argv[i]);
+        const std::string value = arg.substr(arg.find('=') + 1);
+        if (arg == "-h" || arg == "--help")
+        {
+            return false;
+        }
+        else if (arg.compare(0, 8, "--input=") == 0)
+        {
+            args.input = value;
+        }
+        else if (arg.compare(0, 9, "--output=") == 0)
+        {
+            args.output = value;
+        }
+        else if (arg.compare(0, 7, "--type=") == 0)
+        {
+            if (!mine::parseShardDataType(value, args.type))
+            {
+                std::cout << "Unknown type " << value << std::endl;
+                return false;
+            }
+        }
+        else if (arg.compare(0, 9, "--resize=") == 0)
+        {
+            if (!mine::parseResizeMode(value, args.resizeMode))
+            {
+                std::cout << "Unknown resize mode " << value << std::endl;
+                return false;
+            }
+        }
+        else if (arg.compare(0, 9, "--height=") == 0)
+        {
+            args.height = std::max(1, std::atoi(value.c_str()));
+        }
+        else if (arg.compare(0, 8, "--width=") == 0)
+        {
+            args.width = std::max(1, std::atoi(value.c_str()));
+        }
+        else if (arg.compare(0, 12, "--shardSize=") == 0)
+        {
+            args.shardSize = std::max(1, std::atoi(value.c_str()));
+        }
+        else if (arg.compare(0, 10, "--threads=") == 0)
+        {
+            args.threads = std::max(0, std::atoi(value.c_str()));
+        }
+        else
+        {
+            std::cout << "Unknown argument " << arg << std::endl;
+            return false;
+        }
+    }
+    return !args.input.empty() && !args.output.empty();
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    ShardArgs args;
+    if (!parseShardArgs(args, argc, argv))
+    {
+        printHelpInfo();
+        return EXIT_FAILURE;
+    }
+    std::unique_ptr<mine::ImageSource> source = mine::openImageSource(args.input);
+    if (!source)
+    {
+        std::cout << "Cannot open " << args.input << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    mine::ShardFormat format;
+    format.type = args.type;
+    format.height = args.height;
+    format.width = args.width;
+    format.resizeMode = args.resizeMode;
+
+    mine::ThreadPool pool(args.threads);
+    const int chunk = 16 * pool.size();
+    std::vector<Preprocessed> images(chunk);
+    mine::ShardWriter writer;
+    int shards = 0;
+    uint64_t written = 0;
+    uint64_t failed = 0;
+    bool ok = true;
+    const auto start = std::chrono::steady_clock::now();
+
+    const auto finishShard = [&]() {
+        const uint64_t tensors = writer.size();
+        if (!writer.finish())
+        {
+            std::cout << "Cannot write " << shardPath(args.output, shards) << std::endl;
+            return false;
+        }
+        std::cout << shardPath(args.output, shards++) << ": " << tensors << " "
+                  << mine::shardDataTypeName(format.type) << " tensors" << std::endl;
+        return true;
+    };
+
+    bool more = true;
+    while (ok && more)
+    {
+        int count = 0;
+        while (count < chunk && (more = source->next(images[count].entry)))
+        {
+            ++count;
+        }
+        pool.parallelFor(count, [&](int i) { preprocess(format, images[i]); });
+
+        for (int i = 0; i < count && ok; ++i)
+        {
+            if (!images[i].ok)
+            {
+                std::cout << "Cannot open image " << images[i].entry.path << ", skipped" << std::endl;
+                ++failed;
+                continue;
+            }
+            if (writer.size() == 0 && !writer.open(shardPath(args.output, shards), format))
+            {
+                std::cout << "Cannot create " << shardPath(args.output, shards) << std::endl;
+                ok = false;
+                break;
+            }
+            ok = writer.add(images[i].entry.name, images[i].tensor.data());
+            ++written;
+            if (ok && writer.size() == static_cast<uint64_t>(args.shardSize))
+            {
+                ok = finishShard();
+            }
+        }
+    }
+    if (ok && writer.size() > 0)
+    {
+        ok = finishShard();
+    }
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << written << " images (" << failed << " failed) in " << shards << " shards, " << std::fixed
+              << std::setprecision(1) << seconds << " s, " << written / std::max(seconds, 1e-9) << " images/s"
+              << std::endl;
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
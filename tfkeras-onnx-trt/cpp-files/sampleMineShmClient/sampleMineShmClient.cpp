@@ -0,0 +1,280 @@
+#include "../sampleMine/bulkInput.h"
+#include "../sampleMine/jpegDecode.h"
+#include "../sampleMine/shmRing.h"
+#include "../sampleMine/stageStats.h"
+
+#include "opencv2/imgcodecs.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Submits images to a sample_mine --shm=NAME server through its shared memory
+// ring, from several clients at once, and reports throughput, round-trip
+// latency and the classes the server answered. Doubles as a load generator
+// for the ring and as an example of the client side of sampleMine/shmRing.h.
+
+namespace
+{
+
+struct ClientArgs
+{
+    std::string shm;
+    std::string input;
+    int requests{0}; //!< 0 = every input image once
+    int clients{4};
+    int window{16};  //!< Requests each client keeps in flight
+    bool raw{false}; //!< Send decoded BGR pixels instead of the encoded files
+};
+
+//!
+//! \brief One image as it goes into a request slot.
+//!
+struct Payload
+{
+    std::string name;
+    std::vector<uint8_t> bytes;
+    int width{0}; //!< 0 for encoded bytes
+    int height{0};
+};
+
+bool loadPayloads(const ClientArgs& args, std::vector<Payload>& payloads)
+{
+    std::unique_ptr<mine::ImageSource> source = mine::openImageSource(args.input);
+    if (!source)
+    {
+        std::cout << "Cannot open " << args.input << std::endl;
+        return false;
+    }
+    mine::ImageEntry entry;
+    while ((args.requests == 0 || static_cast<int>(payloads.size()) < args.requests) && source->next(entry))
+    {
+        Payload payload;
+        payload.name = entry.name;
+        if (!mine::readFileBytes(entry.path, payload.bytes))
+        {
+            std::cout << "Cannot read " << entry.path << std::endl;
+            return false;
+        }
+        if (args.raw)
+        {
+            const cv::Mat bgr = cv::imdecode(payload.bytes, cv::IMREAD_COLOR);
+            if (bgr.empty() || !bgr.isContinuous())
+            {
+                std::cout << "Cannot decode " << entry.path << std::endl;
+                return false;
+            }
+            payload.bytes.assign(bgr.data, bgr.data + bgr.total() * bgr.elemSize());
+            payload.width = bgr.cols;
+            payload.height = bgr.rows;
+        }
+        payloads.push_back(std::move(payload));
+    }
+    if (payloads.empty())
+    {
+        std::cout << "No images in " << args.input << std::endl;
+        return false;
+    }
+    return true;
+}
+
+//!
+//! \brief What one client thread saw.
+//!
+struct ClientResult
+{
+    bool ok{true};
+    std::string error;
+    uint64_t answered{0};
+    uint64_t failed{0};
+    std::vector<double> latenciesUs;
+    std::map<int, uint64_t> topClasses;
+};
+
+//!
+//! \brief Sends requests count requests, cycling over payloads from offset first, keeping up to
+//!        window of them in flight.
+//!
+void runClient(const ClientArgs& args, const std::vector<Payload>& payloads, int first, int count,
+    ClientResult& result)
+{
+    typedef std::chrono::steady_clock Clock;
+    mine::ShmRingClient client;
+    if (!client.attach(args.shm))
+    {
+        result.ok = false;
+        result.error = client.error();
+        return;
+    }
+    const uint32_t window = std::min<uint32_t>(std::max(1, args.window), client.capacity());
+    std::map<uint64_t, Clock::time_point> submitted;
+    int sent = 0;
+    while (result.answered < static_cast<uint64_t>(count))
+    {
+        while (sent < count && client.inFlight() < window)
+        {
+            const Payload& payload = payloads[(first + sent) % payloads.size()];
+            const mine::ShmImageKind kind = payload.width ? mine::ShmImageKind::kBGR : mine::ShmImageKind::kENCODED;
+            uint64_t id = 0;
+            if (!client.submit(kind, payload.bytes.data(), payload.bytes.size(), payload.width, payload.height, id))
+            {
+                result.ok = false;
+                result.error = client.error();
+                return;
+            }
+            submitted[id] = Clock::now();
+            ++sent;
+        }
+        mine::ShmCompletion completion;
+        if (!client.wait(completion))
+        {
+            result.ok = false;
+            result.error = client.error();
+            return;
+        }
+        const auto it = submitted.find(completion.requestId);
+        if (it != submitted.end())
+        {
+            result.latenciesUs.push_back(std::chrono::duration<double, std::micro>(Clock::now() - it->second).count());
+            submitted.erase(it);
+        }
+        ++result.answered;
+        if (!completion.ok)
+        {
+            ++result.failed;
+        }
+        else if (completion.count > 0)
+        {
+            ++result.topClasses[completion.classes[0]];
+        }
+    }
+}
+
+void printHelpInfo()
+{
+    std::cout << "Usage: ./sample_mine_shm_client --shm=<name> --input=<directory or manifest> [--requests=N] "
+                 "[--clients=N] [--window=N] [--raw]\n";
+    std::cout << "--shm           Shared memory ring of a sample_mine --shm=<name> server\n";
+    std::cout << "--input         Images to send, as for sample_mine --input\n";
+    std::cout << "--requests      Requests in total, cycling over the images. Default every image once\n";
+    std::cout << "--clients       Clients submitting at once, each on its own thread. Default 4\n";
+    std::cout << "--window        Requests each client keeps in flight, at most the ring's slots. Default 16\n";
+    std::cout << "--raw           Send decoded BGR pixels instead of the encoded files" << std::endl;
+}
+
+bool parseClientArgs(ClientArgs& args, int argc, char** argv)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg(argv[i]);
+        const std::string value = arg.substr(arg.find('=') + 1);
+        if (arg == "-h" || arg == "--help")
+        {
+            return false;
+        }
+        else if (arg.compare(0, 6, "--shm=") == 0)
+        {
+            args.shm = value;
+        }
+        else if (arg.compare(0, 8, "--input=") == 0)
+        {
+            args.input = value;
+        }
+        else if (arg.compare(0, 11, "--requests=") == 0)
+        {
+            args.requests = std::max(0, std::atoi(value.c_str()));
+        }
+        else if (arg.compare(0, 10, "--clients=") == 0)
+        {
+            args.clients = std::max(1, std::atoi(value.c_str()));
+        }
+        else if (arg.compare(0, 9, "--window=") == 0)
+        {
+            args.window = std::max(1, std::atoi(value.c_str()));
+        }
+        else if (arg == "--raw")
+        {
+            args.raw = true;
+        }
+        else
+        {
+            std::cout << "Unknown argument " << arg << std::endl;
+            return false;
+        }
+    }
+    return !args.shm.empty() && !args.input.empty();
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    ClientArgs args;
+    if (!parseClientArgs(args, argc, argv))
+    {
+        printHelpInfo();
+        return EXIT_FAILURE;
+    }
+    std::vector<Payload> payloads;
+    if (!loadPayloads(args, payloads))
+    {
+        return EXIT_FAILURE;
+    }
+    const int requests = args.requests > 0 ? args.requests : static_cast<int>(payloads.size());
+
+    std::vector<ClientResult> results(args.clients);
+    std::vector<std::thread> threads;
+    const auto start = std::chrono::steady_clock::now();
+    for (int c = 0; c < args.clients; ++c)
+    {
+        // Split requests as evenly as possible, each client starting at its own image
+        const int first = requests * c / args.clients;
+        const int count = requests * (c + 1) / args.clients - first;
+        threads.emplace_back([&, c, first, count]() { runClient(args, payloads, first, count, results[c]); });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    bool ok = true;
+    uint64_t answered = 0;
+    uint64_t failed = 0;
+    std::vector<double> latencies;
+    std::map<int, uint64_t> topClasses;
+    for (const ClientResult& result : results)
+    {
+        if (!result.ok)
+        {
+            std::cout << "Client failed: " << result.error << std::endl;
+            ok = false;
+        }
+        answered += result.answered;
+        failed += result.failed;
+        latencies.insert(latencies.end(), result.latenciesUs.begin(), result.latenciesUs.end());
+        for (const auto& entry : result.topClasses)
+        {
+            topClasses[entry.first] += entry.second;
+        }
+    }
+    const mine::LatencySummary latency = mine::summarizeLatencies(latencies);
+    std::cout << answered << " of " << requests << " requests answered (" << failed << " failed) by " << args.clients
+              << " clients in " << std::fixed << std::setprecision(2) << seconds << " s, " << std::setprecision(1)
+              << answered / std::max(seconds, 1e-9) << " images/s, " << (args.raw ? "BGR pixels" : "encoded")
+              << std::endl;
+    std::cout << "round trip us: mean " << latency.mean << ", p50 " << latency.p50 << ", p90 " << latency.p90
+              << ", p99 " << latency.p99 << ", max " << latency.max << std::endl;
+    for (const auto& entry : topClasses)
+    {
+        std::cout << "top class " << entry.first << ": " << entry.second << " images" << std::endl;
+    }
+    return ok && failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
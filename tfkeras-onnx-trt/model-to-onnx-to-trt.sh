@@ -1,2 +1,6 @@
-python -m tf2onnx.convert --saved-model ./dogs_vs_cats_saved_model --opset 13 --output dogs_vs_cats_model.onnx --inputs inception_v3_input:0[1,3,299,299]
-trtexec --onnx=./dogs_vs_cats_model.onnx --saveEngine=dogs_vs_cats_model.trt --buildOnly
+BATCH=${BATCH:-1}
+# HALF_INPUT=1 builds an engine whose input binding is fp16, for sample_mine --inputType=half
+HALF_INPUT=${HALF_INPUT:-0}
+if [ "$HALF_INPUT" = "1" ]; then TRTEXEC_INPUT="--fp16 --inputIOFormats=fp16:chw"; fi
+python -m tf2onnx.convert --saved-model ./dogs_vs_cats_saved_model --opset 13 --output dogs_vs_cats_model.onnx --inputs inception_v3_input:0[${BATCH},3,299,299]
+trtexec --onnx=./dogs_vs_cats_model.onnx --saveEngine=dogs_vs_cats_model.trt --buildOnly ${TRTEXEC_INPUT}
@@ -0,0 +1,5 @@
+# Caffe-style models, as sampleMine.copy2/sampleMine.cpp.with-opencv packed them:
+# BGR planes with the ImageNet pixel mean subtracted and no scaling.
+order = bgr
+mean  = 104, 117, 123
+std   = 1
@@ -0,0 +1,9 @@
+# The dogs-vs-cats InceptionV3 model, what sample_mine does without --preprocess:
+# RGB scaled to [0, 1].
+decode = scaled
+filter = linear
+resize = stretch
+order  = rgb
+mean   = 0, 0, 0
+std    = 255, 255, 255
+dtype  = float
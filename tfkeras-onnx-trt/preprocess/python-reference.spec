@@ -0,0 +1,7 @@
+# Closest to inference-from-trt.py: the whole image decoded, a bicubic resize and
+# RGB scaled to [0, 1]. PIL and OpenCV bicubic differ slightly, so the values are
+# near but not identical to the Python ones.
+decode = full
+filter = cubic
+mean   = 0
+std    = 255